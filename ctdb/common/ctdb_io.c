@@ -68,8 +68,12 @@ struct ctdb_queue {
 	TALLOC_CTX *data_pool;
 	const char *name;
 	uint32_t buffer_size;
+	bool *destroyed;
 };
 
+/* maximum number of queued packets sent with a single writev() */
+#define QUEUE_MAX_IOV 64
+
 
 
 int ctdb_queue_length(struct ctdb_queue *queue)
@@ -77,30 +81,19 @@ int ctdb_queue_length(struct ctdb_queue *queue)
 	return queue->out_queue_length;
 }
 
-static void queue_process(struct ctdb_queue *queue);
-
-static void queue_process_event(struct tevent_context *ev, struct tevent_immediate *im,
-				void *private_data)
-{
-	struct ctdb_queue *queue = talloc_get_type(private_data, struct ctdb_queue);
-
-	queue_process(queue);
-}
-
 /*
- * This function is used to process data in queue buffer.
+ * Pass the first complete packet in the queue buffer to the callback.
  *
- * Queue callback function can end up freeing the queue, there should not be a
- * loop processing packets from queue buffer.  Instead set up a timed event for
- * immediate run to process remaining packets from buffer.
+ * Returns true if a packet was passed on.  The callback can end up
+ * freeing the queue, see queue_process().
  */
-static void queue_process(struct ctdb_queue *queue)
+static bool queue_process_one(struct ctdb_queue *queue)
 {
 	uint32_t pkt_size;
 	uint8_t *data = NULL;
 
 	if (queue->buffer.length < sizeof(pkt_size)) {
-		return;
+		return false;
 	}
 
 	/* Did we at least read the size into the buffer */
@@ -112,7 +105,7 @@ static void queue_process(struct ctdb_queue *queue)
 
 	/* the buffer doesn't contain the full packet, return to get the rest */
 	if (queue->buffer.length < pkt_size) {
-		return;
+		return false;
 	}
 
 	/* Extract complete packet */
@@ -122,7 +115,7 @@ static void queue_process(struct ctdb_queue *queue)
 
 	if (data == NULL) {
 		D_ERR("read error alloc failed for %u\n", pkt_size);
-		return;
+		return false;
 	}
 
 	queue->buffer.offset += pkt_size;
@@ -136,11 +129,7 @@ static void queue_process(struct ctdb_queue *queue)
 		goto failed;
 	}
 
-	if (queue->buffer.length > 0) {
-		/* There is more data to be processed, schedule an event */
-		tevent_schedule_immediate(queue->im, queue->ctdb->ev,
-					  queue_process_event, queue);
-	} else {
+	if (queue->buffer.length == 0) {
 		if (queue->buffer.size > queue->buffer_size) {
 			TALLOC_FREE(queue->buffer.data);
 			queue->buffer.size = 0;
@@ -150,10 +139,49 @@ static void queue_process(struct ctdb_queue *queue)
 
 	/* It is the responsibility of the callback to free 'data' */
 	queue->callback(data, pkt_size, queue->private_data);
-	return;
+	return true;
 
 failed:
 	queue->callback(NULL, 0, queue->private_data);
+	return false;
+}
+
+/*
+ * This function is used to process data in queue buffer.
+ *
+ * All the complete packets from a read are processed in one go, instead
+ * of one packet per event loop iteration.  Queue callback function can
+ * end up freeing the queue, or processing the buffer again from a nested
+ * event loop, so the queue is not used after it is freed and all buffer
+ * state is re-read for every packet.
+ */
+static void queue_process(struct ctdb_queue *queue)
+{
+	bool *prev_destroyed = queue->destroyed;
+	bool destroyed = false;
+	bool ok;
+
+	queue->destroyed = &destroyed;
+
+	do {
+		ok = queue_process_one(queue);
+		if (destroyed) {
+			if (prev_destroyed != NULL) {
+				*prev_destroyed = true;
+			}
+			return;
+		}
+	} while (ok);
+
+	queue->destroyed = prev_destroyed;
+}
+
+static int queue_destructor(struct ctdb_queue *queue)
+{
+	if (queue->destroyed != NULL) {
+		*queue->destroyed = true;
+	}
+	return 0;
 }
 
 /*
@@ -271,16 +299,30 @@ static void queue_dead(struct tevent_context *ev, struct tevent_immediate *im,
 
 /*
   called when an incoming connection is writeable
+
+  Packets that have backed up behind a full socket are coalesced into a
+  single writev()
 */
 static void queue_io_write(struct ctdb_queue *queue)
 {
 	while (queue->out_queue) {
 		struct ctdb_queue_pkt *pkt = queue->out_queue;
+		struct iovec iov[QUEUE_MAX_IOV];
+		int niov = 0;
 		ssize_t n;
+
 		if (queue->ctdb->flags & CTDB_FLAG_TORTURE) {
 			n = write(queue->fd, pkt->data, 1);
 		} else {
-			n = write(queue->fd, pkt->data, pkt->length);
+			for (; pkt != NULL && niov < QUEUE_MAX_IOV;
+			     pkt = pkt->next) {
+				iov[niov].iov_base = pkt->data;
+				iov[niov].iov_len = pkt->length;
+				niov++;
+			}
+			pkt = queue->out_queue;
+
+			n = writev(queue->fd, iov, niov);
 		}
 
 		if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
@@ -298,16 +340,21 @@ static void queue_io_write(struct ctdb_queue *queue)
 			return;
 		}
 		if (n <= 0) return;
-		
-		if (n != pkt->length) {
-			pkt->length -= n;
-			pkt->data += n;
-			return;
-		}
 
-		DLIST_REMOVE(queue->out_queue, pkt);
-		queue->out_queue_length--;
-		talloc_free(pkt);
+		while (n > 0) {
+			pkt = queue->out_queue;
+
+			if (n < pkt->length) {
+				pkt->length -= n;
+				pkt->data += n;
+				return;
+			}
+
+			n -= pkt->length;
+			DLIST_REMOVE(queue->out_queue, pkt);
+			queue->out_queue_length--;
+			talloc_free(pkt);
+		}
 	}
 
 	TEVENT_FD_NOT_WRITEABLE(queue->fde);
@@ -476,6 +523,7 @@ struct ctdb_queue *ctdb_queue_setup(struct ctdb_context *ctdb,
 	queue->alignment = alignment;
 	queue->private_data = private_data;
 	queue->callback = callback;
+	talloc_set_destructor(queue, queue_destructor);
 	if (fd != -1) {
 		if (ctdb_queue_set_fd(queue, fd) != 0) {
 			talloc_free(queue);
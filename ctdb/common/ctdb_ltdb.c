@@ -57,6 +57,9 @@ int ctdb_db_tdb_flags(uint8_t db_flags, bool with_valgrind, bool with_mutex)
 #ifdef TDB_MUTEX_LOCKING
 		if (with_mutex && tdb_runtime_check_for_robust_mutexes()) {
 			tdb_flags |= TDB_MUTEX_LOCKING;
+#ifdef TDB_LOCKLESS_READS
+			tdb_flags |= TDB_LOCKLESS_READS;
+#endif
 		}
 #endif
 
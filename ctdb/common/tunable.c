@@ -157,6 +157,14 @@ static struct {
 		offsetof(struct ctdb_tunable_list, ip_alloc_algorithm) },
 	{ "AllowMixedVersions", 0, false,
 		offsetof(struct ctdb_tunable_list, allow_mixed_versions) },
+	{ "RecoveryMemoryLimit", 1024*1024*1024, false,
+		offsetof(struct ctdb_tunable_list, recovery_memory_limit) },
+	{ "HotKeyMigrationRate", 100, false,
+		offsetof(struct ctdb_tunable_list, hot_key_migration_rate) },
+	{ "VacuumIncremental", 0, false,
+		offsetof(struct ctdb_tunable_list, vacuum_incremental) },
+	{ "LockHelperPool", 8, false,
+		offsetof(struct ctdb_tunable_list, lock_helper_pool) },
 	{ .obsolete = true, }
 };
 
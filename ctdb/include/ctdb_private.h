@@ -338,6 +338,7 @@ struct ctdb_context {
 	/* Used for locking record/db/alldb */
 	struct lock_context *lock_current;
 	struct lock_context *lock_pending;
+	struct lock_helper *lock_helpers;
 };
 
 struct ctdb_db_context {
@@ -356,8 +357,11 @@ struct ctdb_db_context {
 	struct ctdb_vacuum_handle *vacuum_handle;
 	char *unhealthy_reason;
 	int pending_requests;
-	struct revokechild_handle *revokechild_active;
+	struct revoke_handle *revoke_active;
 	struct ctdb_persistent_state *persistent_state;
+	struct ctdb_persistent_commit *persistent_queue;
+	struct ctdb_persistent_write_state *pending_writes;
+	struct ctdb_persistent_write_batch *write_batch;
 	struct trbt_tree *delete_queue;
 	struct trbt_tree *sticky_records; 
 	int (*ctdb_ltdb_store_fn)(struct ctdb_db_context *ctdb_db,
@@ -390,6 +394,14 @@ struct ctdb_db_context {
 	bool push_started;
 	void *push_state;
 
+	/* keys modified since the last recovery, used for delta recovery */
+	struct db_hash_context *delta_keys;
+	unsigned int delta_num_keys;
+	bool delta_valid;
+	uint32_t delta_generation;
+	unsigned int delta_num_nodes;
+	bool *delta_active;
+
 	struct hash_count_context *migratedb;
 };
 
@@ -753,6 +765,8 @@ int32_t ctdb_control_modflags(struct ctdb_context *ctdb, TDB_DATA indata);
 /* from ctdb_persistent.c */
 
 void ctdb_persistent_finish_trans3_commits(struct ctdb_context *ctdb);
+void ctdb_persistent_cancel_commit(struct ctdb_db_context *ctdb_db,
+				   struct ctdb_client *client);
 
 int32_t ctdb_control_trans3_commit(struct ctdb_context *ctdb,
 				   struct ctdb_req_control_old *c,
@@ -789,11 +803,18 @@ int32_t ctdb_control_push_db(struct ctdb_context *ctdb, TDB_DATA indata);
 int32_t ctdb_control_db_pull(struct ctdb_context *ctdb,
 			     struct ctdb_req_control_old *c,
 			     TDB_DATA indata, TDB_DATA *outdata);
+int32_t ctdb_control_db_pull_delta(struct ctdb_context *ctdb,
+				   struct ctdb_req_control_old *c,
+				   TDB_DATA indata, TDB_DATA *outdata);
 int32_t ctdb_control_db_push_start(struct ctdb_context *ctdb,
 				   TDB_DATA indata);
 int32_t ctdb_control_db_push_confirm(struct ctdb_context *ctdb,
 				     TDB_DATA indata, TDB_DATA *outdata);
 
+void ctdb_db_delta_record(struct ctdb_db_context *ctdb_db, TDB_DATA key);
+void ctdb_db_delta_reset(struct ctdb_db_context *ctdb_db);
+void ctdb_db_delta_invalidate(struct ctdb_db_context *ctdb_db);
+
 int ctdb_deferred_drop_all_ips(struct ctdb_context *ctdb);
 
 int32_t ctdb_control_set_recmode(struct ctdb_context *ctdb,
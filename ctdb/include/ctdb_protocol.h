@@ -199,7 +199,16 @@ struct ctdb_db_statistics_old {
 		uint32_t count;
 		TDB_DATA key;
 	} hot_keys[MAX_HOT_KEYS];
-	char hot_keys_wire[1];
+	/*
+	 * On the wire the hot key data starts here, and damping
+	 * follows it
+	 */
+	struct {
+		uint32_t num_damped;
+		uint32_t num_backoff;
+		uint32_t num_deferred;
+		uint32_t max_pindown;
+	} damping;
 };
 
 /* 
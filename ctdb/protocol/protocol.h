@@ -373,6 +373,7 @@ enum ctdb_controls {CTDB_CONTROL_PROCESS_EXISTS          = 0,
 		    CTDB_CONTROL_CHECK_PID_SRVID         = 151,
 		    CTDB_CONTROL_TUNNEL_REGISTER         = 152,
 		    CTDB_CONTROL_TUNNEL_DEREGISTER       = 153,
+		    CTDB_CONTROL_DB_PULL_DELTA           = 154,
 };
 
 #define MAX_COUNT_BUCKETS 16
@@ -481,6 +482,16 @@ struct ctdb_pulldb_ext {
 	uint64_t srvid;
 };
 
+/*
+ * Pull only the records changed since the recovery that created
+ * generation
+ */
+struct ctdb_pulldb_delta {
+	uint32_t db_id;
+	uint32_t generation;
+	uint64_t srvid;
+};
+
 #define CTDB_RECOVERY_NORMAL		0
 #define CTDB_RECOVERY_ACTIVE		1
 
@@ -656,6 +667,10 @@ struct ctdb_tunable_list {
 	uint32_t queue_buffer_size;
 	uint32_t ip_alloc_algorithm;
 	uint32_t allow_mixed_versions;
+	uint32_t recovery_memory_limit;
+	uint32_t hot_key_migration_rate;
+	uint32_t vacuum_incremental;
+	uint32_t lock_helper_pool;
 };
 
 struct ctdb_tickle_list {
@@ -834,6 +849,13 @@ struct ctdb_db_statistics {
 		uint32_t count;
 		TDB_DATA key;
 	} hot_keys[MAX_HOT_KEYS];
+	/* Sent after the hot keys, older daemons don't send it */
+	struct {
+		uint32_t num_damped;
+		uint32_t num_backoff;
+		uint32_t num_deferred;
+		uint32_t max_pindown;
+	} damping;
 };
 
 enum ctdb_runstate {
@@ -860,6 +882,7 @@ struct ctdb_req_control_data {
 		uint32_t loglevel;
 		struct ctdb_pulldb *pulldb;
 		struct ctdb_pulldb_ext *pulldb_ext;
+		struct ctdb_pulldb_delta *pulldb_delta;
 		struct ctdb_rec_buffer *recbuf;
 		uint32_t recmode;
 		const char *db_name;
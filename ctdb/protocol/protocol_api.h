@@ -603,6 +603,11 @@ void ctdb_req_control_tunnel_deregister(struct ctdb_req_control *request,
 					uint64_t tunnel_id);
 int ctdb_reply_control_tunnel_deregister(struct ctdb_reply_control *reply);
 
+void ctdb_req_control_db_pull_delta(struct ctdb_req_control *request,
+				    struct ctdb_pulldb_delta *pulldb_delta);
+int ctdb_reply_control_db_pull_delta(struct ctdb_reply_control *reply,
+				     uint32_t *num_records);
+
 /* From protocol/protocol_debug.c */
 
 void ctdb_packet_print(uint8_t *buf, size_t buflen, FILE *fp);
@@ -2342,3 +2342,31 @@ int ctdb_reply_control_tunnel_deregister(struct ctdb_reply_control *reply)
 
 	return reply->status;
 }
+
+/* CTDB_CONTROL_DB_PULL_DELTA */
+
+void ctdb_req_control_db_pull_delta(struct ctdb_req_control *request,
+				    struct ctdb_pulldb_delta *pulldb_delta)
+{
+	request->opcode = CTDB_CONTROL_DB_PULL_DELTA;
+	request->pad = 0;
+	request->srvid = 0;
+	request->client_id = 0;
+	request->flags = 0;
+
+	request->rdata.opcode = CTDB_CONTROL_DB_PULL_DELTA;
+	request->rdata.data.pulldb_delta = pulldb_delta;
+}
+
+int ctdb_reply_control_db_pull_delta(struct ctdb_reply_control *reply,
+				     uint32_t *num_records)
+{
+	if (reply->rdata.opcode != CTDB_CONTROL_DB_PULL_DELTA) {
+		return EPROTO;
+	}
+
+	if (reply->status == 0) {
+		*num_records = reply->rdata.data.num_records;
+	}
+	return reply->status;
+}
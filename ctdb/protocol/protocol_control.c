@@ -422,6 +422,10 @@ static size_t ctdb_req_control_data_len(struct ctdb_req_control_data *cd)
 
 	case CTDB_CONTROL_TUNNEL_DEREGISTER:
 		break;
+
+	case CTDB_CONTROL_DB_PULL_DELTA:
+		len = ctdb_pulldb_delta_len(cd->data.pulldb_delta);
+		break;
 	}
 
 	return len;
@@ -703,6 +707,10 @@ static void ctdb_req_control_data_push(struct ctdb_req_control_data *cd,
 	case CTDB_CONTROL_CHECK_PID_SRVID:
 		ctdb_pid_srvid_push(cd->data.pid_srvid, buf, &np);
 		break;
+
+	case CTDB_CONTROL_DB_PULL_DELTA:
+		ctdb_pulldb_delta_push(cd->data.pulldb_delta, buf, &np);
+		break;
 	}
 
 	*npush = np;
@@ -1033,6 +1041,11 @@ static int ctdb_req_control_data_pull(uint8_t *buf, size_t buflen,
 		ret = ctdb_pid_srvid_pull(buf, buflen, mem_ctx,
 					  &cd->data.pid_srvid, &np);
 		break;
+
+	case CTDB_CONTROL_DB_PULL_DELTA:
+		ret = ctdb_pulldb_delta_pull(buf, buflen, mem_ctx,
+					     &cd->data.pulldb_delta, &np);
+		break;
 	}
 
 	if (ret != 0) {
@@ -1411,6 +1424,10 @@ static size_t ctdb_reply_control_data_len(struct ctdb_reply_control_data *cd)
 
 	case CTDB_CONTROL_TUNNEL_DEREGISTER:
 		break;
+
+	case CTDB_CONTROL_DB_PULL_DELTA:
+		len = ctdb_uint32_len(&cd->data.num_records);
+		break;
 	}
 
 	return len;
@@ -1571,6 +1588,10 @@ static void ctdb_reply_control_data_push(struct ctdb_reply_control_data *cd,
 
 	case CTDB_CONTROL_CHECK_PID_SRVID:
 		break;
+
+	case CTDB_CONTROL_DB_PULL_DELTA:
+		ctdb_uint32_push(&cd->data.num_records, buf, &np);
+		break;
 	}
 
 	*npush = np;
@@ -1761,6 +1782,11 @@ static int ctdb_reply_control_data_pull(uint8_t *buf, size_t buflen,
 
 	case CTDB_CONTROL_CHECK_PID_SRVID:
 		break;
+
+	case CTDB_CONTROL_DB_PULL_DELTA:
+		ret = ctdb_uint32_pull(buf, buflen, &cd->data.num_records,
+				       &np);
+		break;
 	}
 
 	if (ret != 0) {
@@ -242,6 +242,7 @@ static void ctdb_opcode_print(uint32_t opcode, FILE *fp)
 		{ CTDB_CONTROL_CHECK_PID_SRVID, "CHECK_PID_SRVID" },
 		{ CTDB_CONTROL_TUNNEL_REGISTER, "TUNNEL_REGISTER" },
 		{ CTDB_CONTROL_TUNNEL_DEREGISTER, "TUNNEL_DEREGISTER" },
+		{ CTDB_CONTROL_DB_PULL_DELTA, "DB_PULL_DELTA" },
 		{ MAP_END, "" },
 	};
 
@@ -1240,6 +1240,70 @@ fail:
 	return ret;
 }
 
+size_t ctdb_pulldb_delta_len(struct ctdb_pulldb_delta *in)
+{
+	return ctdb_uint32_len(&in->db_id) +
+		ctdb_uint32_len(&in->generation) +
+		ctdb_uint64_len(&in->srvid);
+}
+
+void ctdb_pulldb_delta_push(struct ctdb_pulldb_delta *in, uint8_t *buf,
+			    size_t *npush)
+{
+	size_t offset = 0, np;
+
+	ctdb_uint32_push(&in->db_id, buf+offset, &np);
+	offset += np;
+
+	ctdb_uint32_push(&in->generation, buf+offset, &np);
+	offset += np;
+
+	ctdb_uint64_push(&in->srvid, buf+offset, &np);
+	offset += np;
+
+	*npush = offset;
+}
+
+int ctdb_pulldb_delta_pull(uint8_t *buf, size_t buflen, TALLOC_CTX *mem_ctx,
+			   struct ctdb_pulldb_delta **out, size_t *npull)
+{
+	struct ctdb_pulldb_delta *val;
+	size_t offset = 0, np;
+	int ret;
+
+	val = talloc(mem_ctx, struct ctdb_pulldb_delta);
+	if (val == NULL) {
+		return ENOMEM;
+	}
+
+	ret = ctdb_uint32_pull(buf+offset, buflen-offset, &val->db_id, &np);
+	if (ret != 0) {
+		goto fail;
+	}
+	offset += np;
+
+	ret = ctdb_uint32_pull(buf+offset, buflen-offset, &val->generation,
+			       &np);
+	if (ret != 0) {
+		goto fail;
+	}
+	offset += np;
+
+	ret = ctdb_uint64_pull(buf+offset, buflen-offset, &val->srvid, &np);
+	if (ret != 0) {
+		goto fail;
+	}
+	offset += np;
+
+	*out = val;
+	*npull = offset;
+	return 0;
+
+fail:
+	talloc_free(val);
+	return ret;
+}
+
 size_t ctdb_ltdb_header_len(struct ctdb_ltdb_header *in)
 {
 	return ctdb_uint64_len(&in->rsn) +
@@ -2561,7 +2625,11 @@ size_t ctdb_tunable_list_len(struct ctdb_tunable_list *in)
 		ctdb_uint32_len(&in->rec_buffer_size_limit) +
 		ctdb_uint32_len(&in->queue_buffer_size) +
 		ctdb_uint32_len(&in->ip_alloc_algorithm) +
-		ctdb_uint32_len(&in->allow_mixed_versions);
+		ctdb_uint32_len(&in->allow_mixed_versions) +
+		ctdb_uint32_len(&in->recovery_memory_limit) +
+		ctdb_uint32_len(&in->hot_key_migration_rate) +
+		ctdb_uint32_len(&in->vacuum_incremental) +
+		ctdb_uint32_len(&in->lock_helper_pool);
 }
 
 void ctdb_tunable_list_push(struct ctdb_tunable_list *in, uint8_t *buf,
@@ -2755,6 +2823,18 @@ void ctdb_tunable_list_push(struct ctdb_tunable_list *in, uint8_t *buf,
 	ctdb_uint32_push(&in->allow_mixed_versions, buf+offset, &np);
 	offset += np;
 
+	ctdb_uint32_push(&in->recovery_memory_limit, buf+offset, &np);
+	offset += np;
+
+	ctdb_uint32_push(&in->hot_key_migration_rate, buf+offset, &np);
+	offset += np;
+
+	ctdb_uint32_push(&in->vacuum_incremental, buf+offset, &np);
+	offset += np;
+
+	ctdb_uint32_push(&in->lock_helper_pool, buf+offset, &np);
+	offset += np;
+
 	*npush = offset;
 }
 
@@ -3200,6 +3280,34 @@ static int ctdb_tunable_list_pull_elems(uint8_t *buf, size_t buflen,
 	}
 	offset += np;
 
+	ret = ctdb_uint32_pull(buf+offset, buflen-offset,
+			       &out->recovery_memory_limit, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
+	ret = ctdb_uint32_pull(buf+offset, buflen-offset,
+			       &out->hot_key_migration_rate, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
+	ret = ctdb_uint32_pull(buf+offset, buflen-offset,
+			       &out->vacuum_incremental, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
+	ret = ctdb_uint32_pull(buf+offset, buflen-offset,
+			       &out->lock_helper_pool, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
 	*npull = offset;
 	return 0;
 }
@@ -4497,7 +4605,11 @@ size_t ctdb_db_statistics_len(struct ctdb_db_statistics *in)
 		ctdb_padding_len(4) +
 		MAX_HOT_KEYS *
 			(ctdb_uint32_len(&u32) + ctdb_padding_len(4) +
-			 tdb_data_struct_len(&data));
+			 tdb_data_struct_len(&data)) +
+		ctdb_uint32_len(&in->damping.num_damped) +
+		ctdb_uint32_len(&in->damping.num_backoff) +
+		ctdb_uint32_len(&in->damping.num_deferred) +
+		ctdb_uint32_len(&in->damping.max_pindown);
 
 	for (i=0; i<MAX_HOT_KEYS; i++) {
 		len += ctdb_tdb_data_len(&in->hot_keys[i].key);
@@ -4570,6 +4682,19 @@ void ctdb_db_statistics_push(struct ctdb_db_statistics *in, uint8_t *buf,
 		offset += np;
 	}
 
+	/* Appended, so that older versions can still parse the rest */
+	ctdb_uint32_push(&in->damping.num_damped, buf+offset, &np);
+	offset += np;
+
+	ctdb_uint32_push(&in->damping.num_backoff, buf+offset, &np);
+	offset += np;
+
+	ctdb_uint32_push(&in->damping.num_deferred, buf+offset, &np);
+	offset += np;
+
+	ctdb_uint32_push(&in->damping.max_pindown, buf+offset, &np);
+	offset += np;
+
 	*npush = offset;
 }
 
@@ -4700,6 +4825,41 @@ static int ctdb_db_statistics_pull_elems(uint8_t *buf, size_t buflen,
 		offset += np;
 	}
 
+	/* Older versions don't send the damping statistics */
+	ZERO_STRUCT(out->damping);
+	if (buflen == offset) {
+		*npull = offset;
+		return 0;
+	}
+
+	ret = ctdb_uint32_pull(buf+offset, buflen-offset,
+			       &out->damping.num_damped, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
+	ret = ctdb_uint32_pull(buf+offset, buflen-offset,
+			       &out->damping.num_backoff, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
+	ret = ctdb_uint32_pull(buf+offset, buflen-offset,
+			       &out->damping.num_deferred, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
+	ret = ctdb_uint32_pull(buf+offset, buflen-offset,
+			       &out->damping.max_pindown, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
 	*npull = offset;
 	return 0;
 }
@@ -27,11 +27,10 @@
 #include <talloc.h>
 #include <tevent.h>
 
+#include "lib/tdb_wrap/tdb_wrap.h"
 #include "lib/util/dlinklist.h"
 #include "lib/util/debug.h"
 #include "lib/util/samba_util.h"
-#include "lib/util/sys_rw.h"
-#include "lib/util/util_process.h"
 
 #include "ctdb_private.h"
 #include "ctdb_client.h"
@@ -42,6 +41,9 @@
 #include "common/common.h"
 #include "common/logging.h"
 #include "common/hash_count.h"
+
+#include "server/pindown_backoff.h"
+
 #ifdef __OS2__
 #define pipe(A) os2_pipe(A)
 #endif
@@ -50,6 +52,7 @@ struct ctdb_sticky_record {
 	struct ctdb_context *ctdb;
 	struct ctdb_db_context *ctdb_db;
 	TDB_CONTEXT *pindown;
+	struct pindown_backoff damping;
 };
 
 /*
@@ -289,12 +292,33 @@ static void ctdb_sticky_pindown_timeout(struct tevent_context *ev,
 						       struct ctdb_sticky_record);
 
 	DEBUG(DEBUG_ERR,("Pindown timeout db:%s  unstick record\n", sr->ctdb_db->db_name));
+	pindown_backoff_end(&sr->damping, timeval_current());
 	if (sr->pindown != NULL) {
 		talloc_free(sr->pindown);
 		sr->pindown = NULL;
 	}
 }
 
+static struct ctdb_sticky_record *
+ctdb_find_sticky_record(struct ctdb_db_context *ctdb_db, TDB_DATA key)
+{
+	TALLOC_CTX *tmp_ctx = talloc_new(NULL);
+	uint32_t *k;
+	struct ctdb_sticky_record *sr;
+
+	k = ctdb_key_to_idkey(tmp_ctx, key);
+	if (k == NULL) {
+		DEBUG(DEBUG_ERR,("Failed to allocate key for sticky record\n"));
+		talloc_free(tmp_ctx);
+		return NULL;
+	}
+
+	sr = trbt_lookuparray32(ctdb_db->sticky_records, k[0], &k[0]);
+	talloc_free(tmp_ctx);
+
+	return sr;
+}
+
 static int
 ctdb_set_sticky_pindown(struct ctdb_context *ctdb, struct ctdb_db_context *ctdb_db, TDB_DATA key)
 {
@@ -318,15 +342,24 @@ ctdb_set_sticky_pindown(struct ctdb_context *ctdb, struct ctdb_db_context *ctdb_
 	talloc_free(tmp_ctx);
 
 	if (sr->pindown == NULL) {
-		DEBUG(DEBUG_ERR,("Pinning down record in %s for %d ms\n", ctdb_db->db_name, ctdb->tunable.sticky_pindown));
+		uint32_t pindown;
+
+		pindown = pindown_backoff_start(&sr->damping,
+						ctdb->tunable.sticky_pindown,
+						timeval_current());
+		if (pindown > ctdb_db->statistics.damping.max_pindown) {
+			ctdb_db->statistics.damping.max_pindown = pindown;
+		}
+
+		DEBUG(DEBUG_ERR,("Pinning down record in %s for %u ms\n", ctdb_db->db_name, pindown));
 		sr->pindown = talloc_new(sr);
 		if (sr->pindown == NULL) {
 			DEBUG(DEBUG_ERR,("Failed to allocate pindown context for sticky record\n"));
 			return -1;
 		}
 		tevent_add_timer(ctdb->ev, sr->pindown,
-				 timeval_current_ofs(ctdb->tunable.sticky_pindown / 1000,
-						     (ctdb->tunable.sticky_pindown * 1000) % 1000000),
+				 timeval_current_ofs(pindown / 1000,
+						     (pindown * 1000) % 1000000),
 				 ctdb_sticky_pindown_timeout, sr);
 	}
 
@@ -380,11 +413,11 @@ static void ctdb_become_dmaster(struct ctdb_db_context *ctdb_db,
 		return;
 	}
 
-	/* we just became DMASTER and this database is "sticky",
+	/* we just became DMASTER and this database has sticky records,
 	   see if the record is flagged as "hot" and set up a pin-down
 	   context to stop migrations for a little while if so
 	*/
-	if (ctdb_db_sticky(ctdb_db)) {
+	if (ctdb_db->sticky_records != NULL) {
 		ctdb_set_sticky_pindown(ctdb, ctdb_db, key);
 	}
 
@@ -728,6 +761,7 @@ ctdb_make_record_sticky(struct ctdb_context *ctdb, struct ctdb_db_context *ctdb_
 	sr->ctdb    = ctdb;
 	sr->ctdb_db = ctdb_db;
 	sr->pindown = NULL;
+	pindown_backoff_init(&sr->damping);
 
 	DEBUG(DEBUG_ERR,("Make record sticky for %d seconds in db %s key:0x%08x.\n",
 			 ctdb->tunable.sticky_duration,
@@ -932,10 +966,11 @@ void ctdb_request_call(struct ctdb_context *ctdb, struct ctdb_req_header *hdr)
 	/* If this record is pinned down we should defer the
 	   request until the pindown times out
 	*/
-	if (ctdb_db_sticky(ctdb_db)) {
+	if (ctdb_db->sticky_records != NULL) {
 		if (ctdb_defer_pinned_down_request(ctdb, ctdb_db, call->key, hdr) == 0) {
 			DEBUG(DEBUG_WARNING,
 			      ("Defer request for pinned down record in %s\n", ctdb_db->db_name));
+			CTDB_INCREMENT_DB_STAT(ctdb_db, damping.num_deferred);
 			talloc_free(call);
 			return;
 		}
@@ -1555,36 +1590,45 @@ int ctdb_daemon_call_recv(struct ctdb_call_state *state, struct ctdb_call *call)
 }
 
 
-struct revokechild_deferred_call {
-	struct revokechild_deferred_call *prev, *next;
+struct revoke_deferred_call {
+	struct revoke_deferred_call *prev, *next;
 	struct ctdb_context *ctdb;
 	struct ctdb_req_header *hdr;
 	deferred_requeue_fn fn;
 	void *ctx;
-	struct revokechild_handle *rev_hdl;
+	struct revoke_handle *rev_hdl;
 };
 
-struct revokechild_handle {
-	struct revokechild_handle *next, *prev;
+/*
+ * Revoking the read-only delegations of a record is done in the daemon.
+ * The record is sent with UPDATE_RECORD to all the nodes holding a
+ * read-only copy.  Once all of them have replied (or the controls have
+ * timed out), the local record is updated under its chainlock.  Many
+ * records can be revoked concurrently without forking.
+ */
+struct revoke_handle {
+	struct revoke_handle *next, *prev;
 	struct ctdb_context *ctdb;
 	struct ctdb_db_context *ctdb_db;
-	struct tevent_fd *fde;
-	int status;
-	int fd[2];
-	pid_t child;
 	TDB_DATA key;
-	struct revokechild_deferred_call *deferred_call_list;
+	struct ctdb_ltdb_header header;
+	TDB_DATA data;
+	int count;
+	int status;
+	struct tevent_timer *te;
+	struct lock_request *lreq;
+	struct revoke_deferred_call *deferred_call_list;
 };
 
 static void deferred_call_requeue(struct tevent_context *ev,
 				  struct tevent_timer *te,
 				  struct timeval t, void *private_data)
 {
-	struct revokechild_deferred_call *dlist = talloc_get_type_abort(
-		private_data, struct revokechild_deferred_call);
+	struct revoke_deferred_call *dlist = talloc_get_type_abort(
+		private_data, struct revoke_deferred_call);
 
 	while (dlist != NULL) {
-		struct revokechild_deferred_call *dcall = dlist;
+		struct revoke_deferred_call *dcall = dlist;
 
 		talloc_set_destructor(dcall, NULL);
 		DLIST_REMOVE(dlist, dcall);
@@ -1593,35 +1637,23 @@ static void deferred_call_requeue(struct tevent_context *ev,
 	}
 }
 
-static int deferred_call_destructor(struct revokechild_deferred_call *dcall)
+static int deferred_call_destructor(struct revoke_deferred_call *dcall)
 {
-	struct revokechild_handle *rev_hdl = dcall->rev_hdl;
+	struct revoke_handle *rev_hdl = dcall->rev_hdl;
 
 	DLIST_REMOVE(rev_hdl->deferred_call_list, dcall);
 	return 0;
 }
 
-static int revokechild_destructor(struct revokechild_handle *rev_hdl)
+static int revoke_destructor(struct revoke_handle *rev_hdl)
 {
-	struct revokechild_deferred_call *now_list = NULL;
-	struct revokechild_deferred_call *delay_list = NULL;
+	struct revoke_deferred_call *now_list = NULL;
+	struct revoke_deferred_call *delay_list = NULL;
 
-	if (rev_hdl->fde != NULL) {
-		talloc_free(rev_hdl->fde);
-	}
-
-	if (rev_hdl->fd[0] != -1) {
-		close(rev_hdl->fd[0]);
-	}
-	if (rev_hdl->fd[1] != -1) {
-		close(rev_hdl->fd[1]);
-	}
-	ctdb_kill(rev_hdl->ctdb, rev_hdl->child, SIGKILL);
-
-	DLIST_REMOVE(rev_hdl->ctdb_db->revokechild_active, rev_hdl);
+	DLIST_REMOVE(rev_hdl->ctdb_db->revoke_active, rev_hdl);
 
 	while (rev_hdl->deferred_call_list != NULL) {
-		struct revokechild_deferred_call *dcall;
+		struct revoke_deferred_call *dcall;
 
 		dcall = rev_hdl->deferred_call_list;
 		DLIST_REMOVE(rev_hdl->deferred_call_list, dcall);
@@ -1668,165 +1700,165 @@ static int revokechild_destructor(struct revokechild_handle *rev_hdl)
 	return 0;
 }
 
-static void revokechild_handler(struct tevent_context *ev,
-				struct tevent_fd *fde,
-				uint16_t flags, void *private_data)
+/*
+ * Called with the record chainlock held, once all the delegations have
+ * been revoked (or the revoke has failed on some node)
+ */
+static int revoke_update_record(struct revoke_handle *rev_hdl)
 {
-	struct revokechild_handle *rev_hdl =
-		talloc_get_type(private_data, struct revokechild_handle);
+	struct ctdb_db_context *ctdb_db = rev_hdl->ctdb_db;
+	struct ctdb_ltdb_header new_header;
+	TDB_DATA new_data;
 	int ret;
-	char c;
 
-	ret = sys_read(rev_hdl->fd[0], &c, 1);
-	if (ret != 1) {
-		DEBUG(DEBUG_ERR,("Failed to read status from revokechild. errno:%d\n", errno));
-		rev_hdl->status = -1;
-		talloc_free(rev_hdl);
-		return;
+	ret = ctdb_ltdb_fetch(ctdb_db, rev_hdl->key, &new_header, rev_hdl,
+			      &new_data);
+	if (ret != 0) {
+		DEBUG(DEBUG_ERR,("Failed for fetch tdb record in revoke\n"));
+		return -1;
 	}
-	if (c != 0) {
-		DEBUG(DEBUG_ERR,("revokechild returned failure. status:%d\n", c));
+	if (new_header.rsn > rev_hdl->header.rsn + 1) {
+		DEBUG(DEBUG_ERR,("RSN too high in tdb record in revoke\n"));
+		return -1;
+	}
+	if ( (new_header.flags & (CTDB_REC_RO_REVOKING_READONLY|CTDB_REC_RO_HAVE_DELEGATIONS)) != (CTDB_REC_RO_REVOKING_READONLY|CTDB_REC_RO_HAVE_DELEGATIONS) ) {
+		DEBUG(DEBUG_ERR,("Flags are wrong in tdb record in revoke\n"));
+		return -1;
+	}
+
+	/*
+	 * If revoke on all nodes succeed, revoke is complete.  Otherwise,
+	 * remove CTDB_REC_RO_REVOKING_READONLY flag and retry.
+	 */
+	if (rev_hdl->status == 0) {
+		new_header.rsn++;
+		new_header.flags |= CTDB_REC_RO_REVOKE_COMPLETE;
+	} else {
+		DEBUG(DEBUG_NOTICE, ("Revoke all delegations failed, retrying.\n"));
+		new_header.flags &= ~CTDB_REC_RO_REVOKING_READONLY;
+	}
+	ret = ctdb_ltdb_store(ctdb_db, rev_hdl->key, &new_header, new_data);
+	if (ret != 0) {
+		DEBUG(DEBUG_ERR,("Failed to write new record in revoke\n"));
+		return -1;
+	}
+
+	return 0;
+}
+
+static void revoke_locked(void *private_data, bool locked)
+{
+	struct revoke_handle *rev_hdl = talloc_get_type_abort(
+		private_data, struct revoke_handle);
+
+	rev_hdl->lreq = NULL;
+
+	if (!locked) {
+		DEBUG(DEBUG_ERR,("Failed to chainlock the database in revoke\n"));
+		rev_hdl->status = -1;
+	} else if (revoke_update_record(rev_hdl) != 0) {
 		rev_hdl->status = -1;
-		talloc_free(rev_hdl);
-		return;
 	}
 
 	talloc_free(rev_hdl);
 }
 
-struct ctdb_revoke_state {
-	struct ctdb_db_context *ctdb_db;
-	TDB_DATA key;
-	struct ctdb_ltdb_header *header;
-	TDB_DATA data;
-	int count;
-	int status;
-	int finished;
-};
-
-static void update_record_cb(struct ctdb_client_control_state *state)
+static void revoke_finish(struct tevent_context *ev,
+			  struct tevent_timer *te,
+			  struct timeval t, void *private_data)
 {
-	struct ctdb_revoke_state *revoke_state;
+	struct revoke_handle *rev_hdl = talloc_get_type_abort(
+		private_data, struct revoke_handle);
+	struct tdb_context *tdb = rev_hdl->ctdb_db->ltdb->tdb;
 	int ret;
-	int32_t res;
 
-	if (state == NULL) {
-		return;
-	}
-	revoke_state = state->async.private_data;
+	rev_hdl->te = NULL;
 
-	state->async.fn = NULL;
-        ret = ctdb_control_recv(state->ctdb, state, state, NULL, &res, NULL);
-        if ((ret != 0) || (res != 0)) {
-		DEBUG(DEBUG_ERR,("Recv for revoke update record failed ret:%d res:%d\n", ret, res));
-		revoke_state->status = -1;
+	ret = tdb_chainlock_nonblock(tdb, rev_hdl->key);
+	if (ret == 0) {
+		if (revoke_update_record(rev_hdl) != 0) {
+			rev_hdl->status = -1;
+		}
+		tdb_chainunlock(tdb, rev_hdl->key);
+		talloc_free(rev_hdl);
+		return;
 	}
 
-	revoke_state->count--;
-	if (revoke_state->count <= 0) {
-		revoke_state->finished = 1;
+	/* Contended, wait for the chainlock without blocking the daemon */
+	rev_hdl->lreq = ctdb_lock_record(rev_hdl, rev_hdl->ctdb_db,
+					 rev_hdl->key, true, revoke_locked,
+					 rev_hdl);
+	if (rev_hdl->lreq == NULL) {
+		DEBUG(DEBUG_ERR,("Failed to chainlock the database in revoke\n"));
+		rev_hdl->status = -1;
+		talloc_free(rev_hdl);
 	}
 }
 
-static void revoke_send_cb(struct ctdb_context *ctdb, uint32_t pnn, void *private_data)
+static void revoke_done_one(struct revoke_handle *rev_hdl)
 {
-	struct ctdb_revoke_state *revoke_state = private_data;
-	struct ctdb_client_control_state *state;
-
-	state = ctdb_ctrl_updaterecord_send(ctdb, revoke_state, timeval_current_ofs(ctdb->tunable.control_timeout,0), pnn, revoke_state->ctdb_db, revoke_state->key, revoke_state->header, revoke_state->data);
-	if (state == NULL) {
-		DEBUG(DEBUG_ERR,("Failure to send update record to revoke readonly delegation\n"));
-		revoke_state->status = -1;
+	rev_hdl->count--;
+	if (rev_hdl->count > 0) {
 		return;
 	}
-	state->async.fn           = update_record_cb;
-	state->async.private_data = revoke_state;
-
-	revoke_state->count++;
 
+	/* Never finish from within ctdb_start_revoke_ro_record() */
+	rev_hdl->te = tevent_add_timer(rev_hdl->ctdb->ev, rev_hdl,
+				       tevent_timeval_zero(),
+				       revoke_finish, rev_hdl);
+	if (rev_hdl->te == NULL) {
+		DEBUG(DEBUG_ERR,("Failed to schedule end of revoke\n"));
+		rev_hdl->status = -1;
+		talloc_free(rev_hdl);
+	}
 }
 
-static void ctdb_revoke_timeout_handler(struct tevent_context *ev,
-					struct tevent_timer *te,
-					struct timeval yt, void *private_data)
+static void revoke_update_record_done(struct ctdb_context *ctdb,
+				      int32_t status, TDB_DATA data,
+				      const char *errormsg,
+				      void *private_data)
 {
-	struct ctdb_revoke_state *state = private_data;
+	struct revoke_handle *rev_hdl = talloc_get_type_abort(
+		private_data, struct revoke_handle);
+
+	if (status != 0) {
+		DEBUG(DEBUG_ERR,("Recv for revoke update record failed status:%d %s\n",
+				 status, errormsg ? errormsg : ""));
+		rev_hdl->status = -1;
+	}
 
-	DEBUG(DEBUG_ERR,("Timed out waiting for revoke to finish\n"));
-	state->finished = 1;
-	state->status   = -1;
+	revoke_done_one(rev_hdl);
 }
 
-static int ctdb_revoke_all_delegations(struct ctdb_context *ctdb, struct ctdb_db_context *ctdb_db, TDB_DATA tdata, TDB_DATA key, struct ctdb_ltdb_header *header, TDB_DATA data)
+static void revoke_send_cb(struct ctdb_context *ctdb, uint32_t pnn, void *private_data)
 {
-	struct ctdb_revoke_state *state = talloc_zero(ctdb, struct ctdb_revoke_state);
-	struct ctdb_ltdb_header new_header;
-	TDB_DATA new_data;
-
-	state->ctdb_db = ctdb_db;
-	state->key     = key;
-	state->header  = header;
-	state->data    = data;
- 
-	ctdb_trackingdb_traverse(ctdb, tdata, revoke_send_cb, state);
-
-	tevent_add_timer(ctdb->ev, state,
-			 timeval_current_ofs(ctdb->tunable.control_timeout, 0),
-			 ctdb_revoke_timeout_handler, state);
+	struct revoke_handle *rev_hdl = talloc_get_type_abort(
+		private_data, struct revoke_handle);
+	struct ctdb_marshall_buffer *m;
+	int ret;
 
-	while (state->finished == 0) {
-		tevent_loop_once(ctdb->ev);
+	m = ctdb_marshall_add(rev_hdl, NULL, rev_hdl->ctdb_db->db_id, 0,
+			      rev_hdl->key, &rev_hdl->header, rev_hdl->data);
+	if (m == NULL) {
+		DEBUG(DEBUG_ERR,("Failed to marshall record for update record\n"));
+		rev_hdl->status = -1;
+		return;
 	}
 
-	if (ctdb_ltdb_lock(ctdb_db, key) != 0) {
-		DEBUG(DEBUG_ERR,("Failed to chainlock the database in revokechild\n"));
-		talloc_free(state);
-		return -1;
-	}
-	if (ctdb_ltdb_fetch(ctdb_db, key, &new_header, state, &new_data) != 0) {
-		ctdb_ltdb_unlock(ctdb_db, key);
-		DEBUG(DEBUG_ERR,("Failed for fetch tdb record in revokechild\n"));
-		talloc_free(state);
-		return -1;
-	}
-	header->rsn++;
-	if (new_header.rsn > header->rsn) {
-		ctdb_ltdb_unlock(ctdb_db, key);
-		DEBUG(DEBUG_ERR,("RSN too high in tdb record in revokechild\n"));
-		talloc_free(state);
-		return -1;
-	}
-	if ( (new_header.flags & (CTDB_REC_RO_REVOKING_READONLY|CTDB_REC_RO_HAVE_DELEGATIONS)) != (CTDB_REC_RO_REVOKING_READONLY|CTDB_REC_RO_HAVE_DELEGATIONS) ) {
-		ctdb_ltdb_unlock(ctdb_db, key);
-		DEBUG(DEBUG_ERR,("Flags are wrong in tdb record in revokechild\n"));
-		talloc_free(state);
-		return -1;
-	}
+	rev_hdl->count++;
 
-	/*
-	 * If revoke on all nodes succeed, revoke is complete.  Otherwise,
-	 * remove CTDB_REC_RO_REVOKING_READONLY flag and retry.
-	 */
-	if (state->status == 0) {
-		new_header.rsn++;
-		new_header.flags |= CTDB_REC_RO_REVOKE_COMPLETE;
-	} else {
-		DEBUG(DEBUG_NOTICE, ("Revoke all delegations failed, retrying.\n"));
-		new_header.flags &= ~CTDB_REC_RO_REVOKING_READONLY;
-	}
-	if (ctdb_ltdb_store(ctdb_db, key, &new_header, new_data) != 0) {
-		ctdb_ltdb_unlock(ctdb_db, key);
-		DEBUG(DEBUG_ERR,("Failed to write new record in revokechild\n"));
-		talloc_free(state);
-		return -1;
+	ret = ctdb_daemon_send_control(ctdb, pnn, 0,
+				       CTDB_CONTROL_UPDATE_RECORD,
+				       0, 0, ctdb_marshall_finish(m),
+				       revoke_update_record_done, rev_hdl);
+	talloc_free(m);
+	if (ret != 0) {
+		DEBUG(DEBUG_ERR,("Failure to send update record to revoke readonly delegation\n"));
+		rev_hdl->status = -1;
+		rev_hdl->count--;
 	}
-	ctdb_ltdb_unlock(ctdb_db, key);
-
-	talloc_free(state);
-	return 0;
 }
 
-
 int ctdb_start_revoke_ro_record(struct ctdb_context *ctdb,
 				struct ctdb_db_context *ctdb_db,
 				TDB_DATA key,
@@ -1834,9 +1866,7 @@ int ctdb_start_revoke_ro_record(struct ctdb_context *ctdb,
 				TDB_DATA data)
 {
 	TDB_DATA tdata;
-	struct revokechild_handle *rev_hdl;
-	pid_t parent = getpid();
-	int ret;
+	struct revoke_handle *rev_hdl;
 
 	header->flags &= ~(CTDB_REC_RO_REVOKING_READONLY |
 			   CTDB_REC_RO_HAVE_DELEGATIONS |
@@ -1845,92 +1875,50 @@ int ctdb_start_revoke_ro_record(struct ctdb_context *ctdb,
 	header->flags |= CTDB_REC_FLAG_MIGRATED_WITH_DATA;
 	header->rsn   -= 1;
 
-	rev_hdl = talloc_zero(ctdb_db, struct revokechild_handle);
+	rev_hdl = talloc_zero(ctdb_db, struct revoke_handle);
 	if (rev_hdl == NULL) {
-		D_ERR("Failed to allocate revokechild_handle\n");
+		D_ERR("Failed to allocate revoke_handle\n");
 		return -1;
 	}
 
-	tdata = tdb_fetch(ctdb_db->rottdb, key);
-	if (tdata.dsize > 0) {
-		uint8_t *tmp;
-
-		tmp = tdata.dptr;
-		tdata.dptr = talloc_memdup(rev_hdl, tdata.dptr, tdata.dsize);
-		free(tmp);
-	}
-
 	rev_hdl->status    = 0;
 	rev_hdl->ctdb      = ctdb;
 	rev_hdl->ctdb_db   = ctdb_db;
-	rev_hdl->fd[0]     = -1;
-	rev_hdl->fd[1]     = -1;
+	rev_hdl->header    = *header;
 
 	rev_hdl->key.dsize = key.dsize;
 	rev_hdl->key.dptr  = talloc_memdup(rev_hdl, key.dptr, key.dsize);
 	if (rev_hdl->key.dptr == NULL) {
-		D_ERR("Failed to allocate key for revokechild_handle\n");
+		D_ERR("Failed to allocate key for revoke_handle\n");
 		goto err_out;
 	}
 
-	ret = pipe(rev_hdl->fd);
-	if (ret != 0) {
-		D_ERR("Failed to allocate key for revokechild_handle\n");
-		goto err_out;
-	}
-
-
-	rev_hdl->child = ctdb_fork(ctdb);
-	if (rev_hdl->child == (pid_t)-1) {
-		D_ERR("Failed to fork child for revokechild\n");
-		goto err_out;
-	}
-
-	if (rev_hdl->child == 0) {
-		char c = 0;
-		close(rev_hdl->fd[0]);
-
-		prctl_set_comment("ctdb_revokechild");
-		if (switch_from_server_to_client(ctdb) != 0) {
-			D_ERR("Failed to switch from server to client "
-			      "for revokechild process\n");
-			c = 1;
-			goto child_finished;
+	rev_hdl->data.dsize = data.dsize;
+	if (data.dsize > 0) {
+		rev_hdl->data.dptr = talloc_memdup(rev_hdl, data.dptr,
+						   data.dsize);
+		if (rev_hdl->data.dptr == NULL) {
+			D_ERR("Failed to allocate data for revoke_handle\n");
+			goto err_out;
 		}
-
-		c = ctdb_revoke_all_delegations(ctdb,
-						ctdb_db,
-						tdata,
-						key,
-						header,
-						data);
-
-child_finished:
-		sys_write(rev_hdl->fd[1], &c, 1);
-		ctdb_wait_for_process_to_exit(parent);
-		_exit(0);
 	}
 
-	close(rev_hdl->fd[1]);
-	rev_hdl->fd[1] = -1;
-	set_close_on_exec(rev_hdl->fd[0]);
+	DLIST_ADD_END(ctdb_db->revoke_active, rev_hdl);
+	talloc_set_destructor(rev_hdl, revoke_destructor);
 
-	rev_hdl->fde = tevent_add_fd(ctdb->ev,
-				     rev_hdl,
-				     rev_hdl->fd[0],
-				     TEVENT_FD_READ,
-				     revokechild_handler,
-				     (void *)rev_hdl);
+	/*
+	 * Hold a reference while sending, replies from disconnected
+	 * nodes are delivered immediately
+	 */
+	rev_hdl->count = 1;
 
-	if (rev_hdl->fde == NULL) {
-		D_ERR("Failed to set up fd event for revokechild process\n");
-		talloc_free(rev_hdl);
+	tdata = tdb_fetch(ctdb_db->rottdb, key);
+	if (tdata.dptr != NULL) {
+		ctdb_trackingdb_traverse(ctdb, tdata, revoke_send_cb, rev_hdl);
+		free(tdata.dptr);
 	}
-	tevent_fd_set_auto_close(rev_hdl->fde);
 
-	/* This is an active revokechild child process */
-	DLIST_ADD_END(ctdb_db->revokechild_active, rev_hdl);
-	talloc_set_destructor(rev_hdl, revokechild_destructor);
+	revoke_done_one(rev_hdl);
 
 	return 0;
 err_out:
@@ -1940,10 +1928,10 @@ err_out:
 
 int ctdb_add_revoke_deferred_call(struct ctdb_context *ctdb, struct ctdb_db_context *ctdb_db, TDB_DATA key, struct ctdb_req_header *hdr, deferred_requeue_fn fn, void *call_context)
 {
-	struct revokechild_handle *rev_hdl;
-	struct revokechild_deferred_call *deferred_call;
+	struct revoke_handle *rev_hdl;
+	struct revoke_deferred_call *deferred_call;
 
-	for (rev_hdl = ctdb_db->revokechild_active;
+	for (rev_hdl = ctdb_db->revoke_active;
 	     rev_hdl;
 	     rev_hdl = rev_hdl->next) {
 		if (rev_hdl->key.dsize == 0) {
@@ -1962,7 +1950,7 @@ int ctdb_add_revoke_deferred_call(struct ctdb_context *ctdb, struct ctdb_db_cont
 		return -1;
 	}
 
-	deferred_call = talloc(call_context, struct revokechild_deferred_call);
+	deferred_call = talloc(call_context, struct revoke_deferred_call);
 	if (deferred_call == NULL) {
 		DEBUG(DEBUG_ERR,("Failed to allocate deferred call structure for revoking record\n"));
 		return -1;
@@ -1981,15 +1969,71 @@ int ctdb_add_revoke_deferred_call(struct ctdb_context *ctdb, struct ctdb_db_cont
 	return 0;
 }
 
+/*
+ * A record is migrating onto this node faster than HotKeyMigrationRate.
+ * Treat it as a sticky record, even if the database is not sticky, and
+ * double its pindown if it keeps migrating while it is already sticky.
+ * This is called just after we became the dmaster for the record.
+ */
+static void ctdb_damp_hot_key(struct ctdb_db_context *ctdb_db, TDB_DATA key)
+{
+	struct ctdb_context *ctdb = ctdb_db->ctdb;
+	struct ctdb_sticky_record *sr;
+	int ret;
+
+	if (ctdb_db->sticky_records == NULL) {
+		ctdb_db->sticky_records = trbt_create(ctdb_db, 0);
+		if (ctdb_db->sticky_records == NULL) {
+			DEBUG(DEBUG_ERR,
+			      ("Memory error in hot key damping for %s\n",
+			       ctdb_db->db_name));
+			return;
+		}
+	}
+
+	sr = ctdb_find_sticky_record(ctdb_db, key);
+	if (sr == NULL) {
+		ret = ctdb_make_record_sticky(ctdb, ctdb_db, key);
+		if (ret != 0) {
+			return;
+		}
+		CTDB_INCREMENT_DB_STAT(ctdb_db, damping.num_damped);
+		ctdb_set_sticky_pindown(ctdb, ctdb_db, key);
+		return;
+	}
+
+	if (sr->pindown == NULL) {
+		ctdb_set_sticky_pindown(ctdb, ctdb_db, key);
+		return;
+	}
+
+	if (!pindown_backoff_escalate(&sr->damping)) {
+		return;
+	}
+
+	CTDB_INCREMENT_DB_STAT(ctdb_db, damping.num_backoff);
+
+	DEBUG(DEBUG_NOTICE,
+	      ("Record still migrating in db %s key:0x%08x, "
+	       "pindown is now %u ms\n",
+	       ctdb_db->db_name, ctdb_hash(&key),
+	       ctdb->tunable.sticky_pindown << sr->damping.backoff));
+}
+
 static void ctdb_migration_count_handler(TDB_DATA key, uint64_t counter,
 					 void *private_data)
 {
 	struct ctdb_db_context *ctdb_db = talloc_get_type_abort(
 		private_data, struct ctdb_db_context);
+	uint32_t rate = ctdb_db->ctdb->tunable.hot_key_migration_rate;
 	int value;
 
 	value = (counter < INT_MAX ? counter : INT_MAX);
 	ctdb_update_db_stat_hot_keys(ctdb_db, key, value);
+
+	if (rate != 0 && counter >= rate) {
+		ctdb_damp_hot_key(ctdb_db, key);
+	}
 }
 
 static void ctdb_migration_cleandb_event(struct tevent_context *ev,
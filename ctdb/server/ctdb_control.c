@@ -729,6 +729,10 @@ static int32_t ctdb_control_dispatch(struct ctdb_context *ctdb,
 	case CTDB_CONTROL_TUNNEL_DEREGISTER:
 		return ctdb_control_tunnel_deregister(ctdb, client_id, srvid);
 
+	case CTDB_CONTROL_DB_PULL_DELTA:
+		CHECK_CONTROL_DATA_SIZE(sizeof(struct ctdb_pulldb_delta));
+		return ctdb_control_db_pull_delta(ctdb, c, indata, outdata);
+
 	default:
 		DEBUG(DEBUG_CRIT,(__location__ " Unknown CTDB control opcode %u\n", opcode));
 		return -1;
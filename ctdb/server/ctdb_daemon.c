@@ -386,9 +386,10 @@ static int ctdb_client_destructor(struct ctdb_client *client)
 		/*
 		 * trans3 transaction state:
 		 *
-		 * The destructor sets the pointer to NULL.
+		 * Only the commit of this client is dropped, the
+		 * recovery finishes the others.
 		 */
-		talloc_free(ctdb_db->persistent_state);
+		ctdb_persistent_cancel_commit(ctdb_db, client);
 	}
 
 	return 0;
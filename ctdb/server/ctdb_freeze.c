@@ -404,6 +404,7 @@ static int db_invalidate(struct ctdb_db_context *ctdb_db, void *private_data)
 {
 	if (ctdb_db_volatile(ctdb_db)) {
 		ctdb_db->invalid_records = true;
+		ctdb_db_delta_invalidate(ctdb_db);
 	}
 
 	return 0;
@@ -749,6 +750,9 @@ static int db_commit_transaction(struct ctdb_db_context *ctdb_db,
 	ctdb_db->freeze_transaction_started = false;
 	ctdb_db->freeze_transaction_id = 0;
 	ctdb_db->generation = state->transaction_id;
+
+	/* All nodes now hold the same records, start a new journal */
+	ctdb_db_delta_reset(ctdb_db);
 	return 0;
 }
 
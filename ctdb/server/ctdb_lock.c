@@ -48,6 +48,10 @@
  * 4. If the child process cannot get locks within certain time,
  *    execute an external script to debug.
  *
+ * Record locks are preferably handed to one of a pool of persistent
+ * lock helpers (see LockHelperPool), which avoids creating a process
+ * for each contended record lock.
+ *
  * ctdb_lock_record()      - get a lock on a record
  * ctdb_lock_db()          - get a lock on a DB
  *
@@ -69,6 +73,7 @@ static const char * const lock_type_str[] = {
 };
 
 struct lock_request;
+struct lock_helper;
 
 /* lock_context is the common part for a lock request */
 struct lock_context {
@@ -81,6 +86,7 @@ struct lock_context {
 	bool auto_mark;
 	struct lock_request *request;
 	pid_t child;
+	struct lock_helper *helper;
 	int fd[2];
 	struct tevent_fd *tfd;
 	struct tevent_timer *ttimer;
@@ -96,6 +102,23 @@ struct lock_request {
 	void *private_data;
 };
 
+enum lock_helper_state {
+	LOCK_HELPER_IDLE,
+	LOCK_HELPER_WAITING,
+	LOCK_HELPER_LOCKED,
+	LOCK_HELPER_DEAD,
+};
+
+/* A persistent lock helper serves one record lock at a time */
+struct lock_helper {
+	struct lock_helper *next, *prev;
+	struct ctdb_context *ctdb;
+	pid_t pid;
+	int req_fd;
+	int res_fd;
+	enum lock_helper_state state;
+};
+
 
 int ctdb_db_iterator(struct ctdb_context *ctdb, ctdb_db_handler_t handler,
 		     void *private_data)
@@ -190,13 +213,22 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb);
 /*
  * Destructor to kill the child locking process
  */
+static void lock_helper_release(struct lock_helper *helper);
+
 static int ctdb_lock_context_destructor(struct lock_context *lock_ctx)
 {
 	if (lock_ctx->request) {
 		lock_ctx->request->lctx = NULL;
 	}
-	if (lock_ctx->child > 0) {
-		ctdb_kill(lock_ctx->ctdb, lock_ctx->child, SIGTERM);
+	if (lock_ctx->helper != NULL || lock_ctx->child > 0) {
+		if (lock_ctx->helper != NULL) {
+			/* Stop watching the helper before it is reused */
+			TALLOC_FREE(lock_ctx->tfd);
+			lock_helper_release(lock_ctx->helper);
+			lock_ctx->helper = NULL;
+		} else {
+			ctdb_kill(lock_ctx->ctdb, lock_ctx->child, SIGTERM);
+		}
 		if (lock_ctx->type == LOCK_RECORD) {
 			DLIST_REMOVE(lock_ctx->ctdb_db->lock_current, lock_ctx);
 		} else {
@@ -349,8 +381,20 @@ static void ctdb_lock_handler(struct tevent_context *ev,
 	/* Read the status from the child process */
 	if (sys_read(lock_ctx->fd[0], &c, 1) != 1) {
 		locked = false;
+		if (lock_ctx->helper != NULL) {
+			lock_ctx->helper->state = LOCK_HELPER_DEAD;
+		}
 	} else {
 		locked = (c == 0 ? true : false);
+		if (lock_ctx->helper != NULL) {
+			lock_ctx->helper->state = locked ?
+				LOCK_HELPER_LOCKED : LOCK_HELPER_IDLE;
+		}
+	}
+
+	/* A persistent helper only replies once per request */
+	if (lock_ctx->helper != NULL) {
+		TALLOC_FREE(lock_ctx->tfd);
 	}
 
 	/* Update statistics */
@@ -642,6 +686,254 @@ static bool lock_helper_args(TALLOC_CTX *mem_ctx,
 	return true;
 }
 
+/*
+ * Persistent lock helpers
+ *
+ * A helper is started with "PERSISTENT <input-fd>" and then waits for
+ * requests from ctdbd.  Each request is a 32-bit length followed by
+ * the NUL separated RECORD arguments of a single-shot helper, and is
+ * answered with the usual status byte.  Once locked, the helper holds
+ * the lock until it receives UNLOCK.  A helper that is still waiting
+ * when its lock request goes away can not be interrupted, so it is
+ * sent SIGTERM.  It exits, without answering, as soon as it gets the
+ * lock and has released it again.
+ */
+
+static int lock_helper_destructor(struct lock_helper *helper)
+{
+	DLIST_REMOVE(helper->ctdb->lock_helpers, helper);
+
+	if (helper->pid > 0 && helper->state != LOCK_HELPER_DEAD) {
+		ctdb_kill(helper->ctdb, helper->pid, SIGTERM);
+	}
+	close(helper->req_fd);
+	close(helper->res_fd);
+
+	return 0;
+}
+
+static struct lock_helper *lock_helper_start(struct ctdb_context *ctdb,
+					     const char *prog)
+{
+	struct lock_helper *helper;
+	const char **args;
+	int req_fd[2], res_fd[2];
+	int ret;
+
+	ret = pipe(req_fd);
+	if (ret != 0) {
+		return NULL;
+	}
+
+	ret = pipe(res_fd);
+	if (ret != 0) {
+		close(req_fd[0]);
+		close(req_fd[1]);
+		return NULL;
+	}
+
+	set_close_on_exec(req_fd[1]);
+	set_close_on_exec(res_fd[0]);
+
+	helper = talloc_zero(ctdb, struct lock_helper);
+	if (helper == NULL) {
+		goto fail;
+	}
+
+	args = talloc_array(helper, const char *, 5);
+	if (args == NULL) {
+		goto fail;
+	}
+
+	args[0] = talloc_asprintf(args, "%d", getpid());
+	args[1] = talloc_asprintf(args, "%d", res_fd[1]);
+	args[2] = "PERSISTENT";
+	args[3] = talloc_asprintf(args, "%d", req_fd[0]);
+	args[4] = NULL;
+	if (args[0] == NULL || args[1] == NULL || args[3] == NULL) {
+		goto fail;
+	}
+
+	helper->pid = ctdb_vfork_exec(args, ctdb, prog, 5, args);
+	if (helper->pid == -1) {
+		DEBUG(DEBUG_ERR, ("Failed to start persistent lock helper\n"));
+		goto fail;
+	}
+
+	close(req_fd[0]);
+	close(res_fd[1]);
+	talloc_free(args);
+
+	helper->ctdb = ctdb;
+	helper->req_fd = req_fd[1];
+	helper->res_fd = res_fd[0];
+	helper->state = LOCK_HELPER_IDLE;
+
+	DLIST_ADD(ctdb->lock_helpers, helper);
+	talloc_set_destructor(helper, lock_helper_destructor);
+
+	DEBUG(DEBUG_INFO, ("Started persistent lock helper %d\n",
+			   (int)helper->pid));
+
+	return helper;
+
+fail:
+	talloc_free(helper);
+	close(req_fd[0]);
+	close(req_fd[1]);
+	close(res_fd[0]);
+	close(res_fd[1]);
+	return NULL;
+}
+
+/*
+ * Find an idle persistent helper, starting a new one if the pool is
+ * not yet full
+ */
+static struct lock_helper *lock_helper_get(struct ctdb_context *ctdb,
+					   const char *prog)
+{
+	struct lock_helper *helper;
+	uint32_t num = 0;
+
+	for (helper = ctdb->lock_helpers; helper != NULL;
+	     helper = helper->next) {
+		if (helper->state == LOCK_HELPER_IDLE) {
+			return helper;
+		}
+		num++;
+	}
+
+	if (num >= ctdb->tunable.lock_helper_pool) {
+		return NULL;
+	}
+
+	return lock_helper_start(ctdb, prog);
+}
+
+/*
+ * Send a request to a persistent helper.  Requests are limited to
+ * PIPE_BUF, so they are written atomically and, since a helper only
+ * has one request outstanding, never block.
+ */
+static bool lock_helper_send(struct lock_helper *helper,
+			     const char **fields, int num_fields)
+{
+	uint8_t buf[PIPE_BUF];
+	uint32_t len = 0;
+	size_t flen;
+	ssize_t n;
+	int i;
+
+	for (i = 0; i < num_fields; i++) {
+		flen = strlen(fields[i]) + 1;
+		if (sizeof(len) + len + flen > sizeof(buf)) {
+			return false;
+		}
+		memcpy(buf + sizeof(len) + len, fields[i], flen);
+		len += flen;
+	}
+	memcpy(buf, &len, sizeof(len));
+
+	n = sys_write(helper->req_fd, buf, sizeof(len) + len);
+	if (n != (ssize_t)(sizeof(len) + len)) {
+		helper->state = LOCK_HELPER_DEAD;
+		return false;
+	}
+
+	return true;
+}
+
+static bool lock_helper_request(struct lock_helper *helper,
+				struct lock_context *lock_ctx)
+{
+	const char **args;
+	int argc;
+	bool ok;
+
+	if (!lock_helper_args(helper, lock_ctx, helper->res_fd,
+			      &argc, &args)) {
+		return false;
+	}
+
+	/* Skip <ctdbd-pid> <output-fd> and the terminating NULL */
+	ok = lock_helper_send(helper, &args[2], argc - 3);
+	talloc_free(args);
+
+	return ok;
+}
+
+/*
+ * Called when the lock context using a helper goes away
+ */
+static void lock_helper_release(struct lock_helper *helper)
+{
+	struct ctdb_context *ctdb = helper->ctdb;
+	struct lock_helper *h;
+	const char *unlock = "UNLOCK";
+	uint32_t num = 0;
+
+	switch (helper->state) {
+	case LOCK_HELPER_LOCKED:
+		if (!lock_helper_send(helper, &unlock, 1)) {
+			talloc_free(helper);
+			return;
+		}
+		helper->state = LOCK_HELPER_IDLE;
+		break;
+
+	case LOCK_HELPER_IDLE:
+		/* Lock failed, the helper is ready for another request */
+		break;
+
+	case LOCK_HELPER_WAITING:
+	case LOCK_HELPER_DEAD:
+		talloc_free(helper);
+		return;
+	}
+
+	/* Shrink the pool if LockHelperPool has been reduced */
+	for (h = ctdb->lock_helpers; h != NULL; h = h->next) {
+		num++;
+	}
+	if (num > ctdb->tunable.lock_helper_pool) {
+		talloc_free(helper);
+	}
+}
+
+/*
+ * Hand a record lock to a persistent helper
+ */
+static bool ctdb_lock_helper_schedule(struct ctdb_context *ctdb,
+				      struct lock_context *lock_ctx,
+				      const char *prog)
+{
+	struct lock_helper *helper;
+
+	if (lock_ctx->type != LOCK_RECORD) {
+		return false;
+	}
+
+	helper = lock_helper_get(ctdb, prog);
+	if (helper == NULL) {
+		return false;
+	}
+
+	if (!lock_helper_request(helper, lock_ctx)) {
+		/* Keys too large for a request are not a helper failure */
+		if (helper->state == LOCK_HELPER_DEAD) {
+			talloc_free(helper);
+		}
+		return false;
+	}
+
+	helper->state = LOCK_HELPER_WAITING;
+	lock_ctx->helper = helper;
+	lock_ctx->fd[0] = helper->res_fd;
+
+	return true;
+}
+
 /*
  * Find a lock request that can be scheduled
  */
@@ -698,6 +990,22 @@ static struct lock_context *ctdb_find_lock_context(struct ctdb_context *ctdb)
 	return NULL;
 }
 
+/*
+ * Undo starting a lock child process, or handing the lock to a
+ * persistent helper, when the handlers can not be set up
+ */
+static void ctdb_lock_schedule_abort(struct lock_context *lock_ctx)
+{
+	if (lock_ctx->helper != NULL) {
+		TALLOC_FREE(lock_ctx->helper);
+		return;
+	}
+
+	ctdb_kill(lock_ctx->ctdb, lock_ctx->child, SIGTERM);
+	lock_ctx->child = -1;
+	close(lock_ctx->fd[0]);
+}
+
 /*
  * Schedule a new lock child process
  * Set up callback handler and timeout handler
@@ -725,6 +1033,19 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 	}
 
 	lock_ctx->child = -1;
+
+	if (! ctdb->do_setsched) {
+		ret = setenv("CTDB_NOSETSCHED", "1", 1);
+		if (ret != 0) {
+			DEBUG(DEBUG_WARNING,
+			      ("Failed to set CTDB_NOSETSCHED variable\n"));
+		}
+	}
+
+	if (ctdb_lock_helper_schedule(ctdb, lock_ctx, prog)) {
+		goto waiting;
+	}
+
 	ret = pipe(lock_ctx->fd);
 	if (ret != 0) {
 		DEBUG(DEBUG_ERR, ("Failed to create pipe in ctdb_lock_schedule\n"));
@@ -742,14 +1063,6 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 		return;
 	}
 
-	if (! ctdb->do_setsched) {
-		ret = setenv("CTDB_NOSETSCHED", "1", 1);
-		if (ret != 0) {
-			DEBUG(DEBUG_WARNING,
-			      ("Failed to set CTDB_NOSETSCHED variable\n"));
-		}
-	}
-
 	/* Create arguments for lock helper */
 	if (!lock_helper_args(tmp_ctx, lock_ctx, lock_ctx->fd[1],
 			      &argc, &args)) {
@@ -775,6 +1088,7 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 
 	talloc_free(tmp_ctx);
 
+waiting:
 	/* Set up timeout handler */
 	lock_ctx->ttimer = tevent_add_timer(ctdb->ev,
 					    lock_ctx,
@@ -782,9 +1096,7 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 					    ctdb_lock_timeout_handler,
 					    (void *)lock_ctx);
 	if (lock_ctx->ttimer == NULL) {
-		ctdb_kill(ctdb, lock_ctx->child, SIGTERM);
-		lock_ctx->child = -1;
-		close(lock_ctx->fd[0]);
+		ctdb_lock_schedule_abort(lock_ctx);
 		return;
 	}
 
@@ -797,12 +1109,14 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 				      (void *)lock_ctx);
 	if (lock_ctx->tfd == NULL) {
 		TALLOC_FREE(lock_ctx->ttimer);
-		ctdb_kill(ctdb, lock_ctx->child, SIGTERM);
-		lock_ctx->child = -1;
-		close(lock_ctx->fd[0]);
+		ctdb_lock_schedule_abort(lock_ctx);
 		return;
 	}
-	tevent_fd_set_auto_close(lock_ctx->tfd);
+
+	/* The pipe to a persistent helper is reused */
+	if (lock_ctx->helper == NULL) {
+		tevent_fd_set_auto_close(lock_ctx->tfd);
+	}
 
 	/* Move the context from pending to current */
 	if (lock_ctx->type == LOCK_RECORD) {
@@ -26,6 +26,7 @@
 #include <tevent.h>
 #include <tdb.h>
 
+#include "lib/util/dlinklist.h"
 #include "lib/util/sys_rw.h"
 #include "lib/util/tevent_unix.h"
 
@@ -81,6 +82,7 @@ static void usage(const char *progname)
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Usage: %s <ctdbd-pid> <output-fd> RECORD <db-path> <db-flags> <db-key>\n", progname);
 	fprintf(stderr, "       %s <ctdbd-pid> <output-fd> DB <db-path> <db-flags>\n", progname);
+	fprintf(stderr, "       %s <ctdbd-pid> <output-fd> PERSISTENT <input-fd>\n", progname);
 }
 
 static uint8_t *hex_decode_talloc(TALLOC_CTX *mem_ctx,
@@ -262,6 +264,317 @@ static void signal_handler(struct tevent_context *ev,
 	exit(0);
 }
 
+/*
+ * Persistent mode
+ *
+ * Instead of locking a single record and waiting for ctdbd to kill
+ * the helper, serve record lock requests from ctdbd one after another
+ * on <input-fd>.  Each request is a 32-bit length followed by NUL
+ * separated fields, either
+ *
+ *   RECORD <db-path> <db-flags> <db-key>
+ *   UNLOCK
+ *
+ * RECORD is answered on <output-fd> in the same way as in the
+ * single-shot mode.  UNLOCK releases the current record lock and is
+ * not answered.  Databases stay open between requests.
+ */
+
+#define LOCK_HELPER_MAX_REQUEST	(64*1024)
+
+struct lock_db {
+	struct lock_db *next, *prev;
+	const char *path;
+	struct tdb_context *tdb;
+};
+
+struct persistent_state {
+	struct tevent_context *ev;
+	int read_fd;
+	int write_fd;
+	struct lock_db *dbs;
+	struct lock_state *lock;
+	TALLOC_CTX *lock_ctx;
+};
+
+/* Reuse an open database unless the file has been replaced */
+static struct tdb_context *persistent_db_open(struct persistent_state *state,
+					      const char *dbpath,
+					      const char *dbflags)
+{
+	struct lock_db *db;
+	struct stat st1, st2;
+	int tdb_flags;
+
+	for (db = state->dbs; db != NULL; db = db->next) {
+		if (strcmp(db->path, dbpath) == 0) {
+			break;
+		}
+	}
+
+	if (db != NULL) {
+		if (stat(dbpath, &st1) == 0 &&
+		    fstat(tdb_fd(db->tdb), &st2) == 0 &&
+		    st1.st_dev == st2.st_dev &&
+		    st1.st_ino == st2.st_ino) {
+			return db->tdb;
+		}
+
+		DLIST_REMOVE(state->dbs, db);
+		tdb_close(db->tdb);
+		talloc_free(db);
+	}
+
+	db = talloc_zero(state, struct lock_db);
+	if (db == NULL) {
+		return NULL;
+	}
+
+	db->path = talloc_strdup(db, dbpath);
+	if (db->path == NULL) {
+		talloc_free(db);
+		return NULL;
+	}
+
+	/* No error checking since CTDB always passes sane values */
+	tdb_flags = strtol(dbflags, NULL, 0);
+
+	db->tdb = tdb_open(dbpath, 0, tdb_flags, O_RDWR, 0600);
+	if (db->tdb == NULL) {
+		fprintf(stderr, "locking: Error opening database %s\n", dbpath);
+		talloc_free(db);
+		return NULL;
+	}
+
+	DLIST_ADD(state->dbs, db);
+	return db->tdb;
+}
+
+static void persistent_exit(struct persistent_state *state, int status);
+
+static char persistent_lock_record(struct persistent_state *state,
+				   const char *dbpath, const char *dbflags,
+				   const char *dbkey)
+{
+	struct lock_state *lock = state->lock;
+	sigset_t set, old_set, pending;
+	int ret;
+
+	lock->tdb = persistent_db_open(state, dbpath, dbflags);
+	if (lock->tdb == NULL) {
+		return 1;
+	}
+
+	if (strcmp(dbkey, "NULL") == 0) {
+		lock->key.dptr = NULL;
+		lock->key.dsize = 0;
+	} else {
+		lock->key.dptr = hex_decode_talloc(state->lock_ctx, dbkey,
+						   &lock->key.dsize);
+	}
+
+	/*
+	 * A blocking lock can not be interrupted.  Keep SIGTERM pending
+	 * while waiting, so that a helper ctdbd has given up on drops
+	 * the lock and exits instead of answering.
+	 */
+	sigemptyset(&set);
+	sigaddset(&set, SIGTERM);
+	sigprocmask(SIG_BLOCK, &set, &old_set);
+
+	set_priority();
+
+	ret = tdb_chainlock(lock->tdb, lock->key);
+
+	reset_priority();
+
+	sigpending(&pending);
+	if (sigismember(&pending, SIGTERM)) {
+		if (ret < 0) {
+			lock->tdb = NULL;
+		}
+		persistent_exit(state, 0);
+	}
+
+	sigprocmask(SIG_SETMASK, &old_set, NULL);
+
+	if (ret < 0) {
+		fprintf(stderr, "locking: Error getting record lock (%s)\n",
+			tdb_errorstr(lock->tdb));
+		lock->tdb = NULL;
+		TALLOC_FREE(state->lock_ctx);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void persistent_unlock_record(struct persistent_state *state)
+{
+	struct lock_state *lock = state->lock;
+
+	if (lock->tdb != NULL) {
+		tdb_chainunlock(lock->tdb, lock->key);
+		lock->tdb = NULL;
+	}
+	lock->key = tdb_null;
+	TALLOC_FREE(state->lock_ctx);
+}
+
+static void persistent_exit(struct persistent_state *state, int status)
+{
+	struct lock_db *db;
+
+	persistent_unlock_record(state);
+
+	while ((db = state->dbs) != NULL) {
+		DLIST_REMOVE(state->dbs, db);
+		tdb_close(db->tdb);
+	}
+
+	exit(status);
+}
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+	size_t offset = 0;
+	ssize_t n;
+
+	while (offset < len) {
+		n = sys_read(fd, (uint8_t *)buf + offset, len - offset);
+		if (n <= 0) {
+			return false;
+		}
+		offset += n;
+	}
+
+	return true;
+}
+
+static void persistent_handler(struct tevent_context *ev,
+			       struct tevent_fd *fde,
+			       uint16_t flags,
+			       void *private_data)
+{
+	struct persistent_state *state = talloc_get_type_abort(
+		private_data, struct persistent_state);
+	const char *fields[4];
+	uint32_t len;
+	char *buf, *p;
+	char result;
+	int i;
+
+	/* EOF means ctdbd has gone away */
+	if (! read_all(state->read_fd, &len, sizeof(len))) {
+		persistent_exit(state, 0);
+	}
+
+	if (len == 0 || len > LOCK_HELPER_MAX_REQUEST) {
+		fprintf(stderr, "locking: Invalid request length %u\n", len);
+		persistent_exit(state, 1);
+	}
+
+	buf = talloc_array(state, char, len+1);
+	if (buf == NULL) {
+		fprintf(stderr, "locking: Memory allocation error\n");
+		persistent_exit(state, 1);
+	}
+
+	if (! read_all(state->read_fd, buf, len)) {
+		persistent_exit(state, 0);
+	}
+	buf[len] = '\0';
+
+	p = buf;
+	for (i = 0; i < (int)ARRAY_SIZE(fields); i++) {
+		if (p >= buf + len) {
+			break;
+		}
+		fields[i] = p;
+		p += strlen(p) + 1;
+	}
+
+	if (i == 1 && strcmp(fields[0], "UNLOCK") == 0) {
+		persistent_unlock_record(state);
+
+	} else if (i == 4 && strcmp(fields[0], "RECORD") == 0) {
+		if (state->lock->tdb != NULL) {
+			fprintf(stderr, "locking: Record already locked\n");
+			persistent_exit(state, 1);
+		}
+
+		state->lock_ctx = talloc_new(state);
+		if (state->lock_ctx == NULL) {
+			result = 1;
+		} else {
+			result = persistent_lock_record(state, fields[1],
+							fields[2], fields[3]);
+		}
+
+		if (sys_write(state->write_fd, &result, 1) != 1) {
+			persistent_exit(state, 1);
+		}
+
+	} else {
+		fprintf(stderr, "locking: Invalid request\n");
+		persistent_exit(state, 1);
+	}
+
+	talloc_free(buf);
+}
+
+static void persistent_wait_done(struct tevent_req *req);
+
+static int persistent_main(struct tevent_context *ev, pid_t ppid,
+			   int write_fd, int read_fd,
+			   struct lock_state *lock)
+{
+	struct persistent_state *state;
+	struct tevent_fd *fde;
+	struct tevent_req *req;
+
+	state = talloc_zero(ev, struct persistent_state);
+	if (state == NULL) {
+		fprintf(stderr, "locking: Memory allocation error\n");
+		return 1;
+	}
+
+	state->ev = ev;
+	state->read_fd = read_fd;
+	state->write_fd = write_fd;
+	state->lock = lock;
+
+	/* A failed write to a vanished ctdbd is handled as an error */
+	signal(SIGPIPE, SIG_IGN);
+
+	fde = tevent_add_fd(ev, state, read_fd, TEVENT_FD_READ,
+			    persistent_handler, state);
+	if (fde == NULL) {
+		fprintf(stderr, "locking: tevent_add_fd() failed\n");
+		return 1;
+	}
+
+	req = wait_for_parent_send(state, ev, ppid);
+	if (req == NULL) {
+		fprintf(stderr, "locking: wait_for_parent_send() failed\n");
+		return 1;
+	}
+	tevent_req_set_callback(req, persistent_wait_done, state);
+
+	tevent_loop_wait(ev);
+
+	persistent_exit(state, 0);
+	return 0;
+}
+
+static void persistent_wait_done(struct tevent_req *req)
+{
+	struct persistent_state *state = tevent_req_callback_data(
+		req, struct persistent_state);
+
+	persistent_exit(state, 0);
+}
+
 int main(int argc, char *argv[])
 {
 	struct tevent_context *ev;
@@ -309,6 +622,17 @@ int main(int argc, char *argv[])
 		}
 		result = lock_record(argv[4], argv[5], argv[6], &state);
 
+	} else if (strcmp(lock_type, "PERSISTENT") == 0) {
+		if (argc != 5) {
+			fprintf(stderr,
+				"locking: Invalid number of arguments (%d)\n",
+				argc);
+			usage(argv[0]);
+			exit(1);
+		}
+		return persistent_main(ev, ppid, write_fd, atoi(argv[4]),
+				       &state);
+
 	} else if (strcmp(lock_type, "DB") == 0) {
 		if (argc != 6) {
 			fprintf(stderr,
@@ -221,6 +221,8 @@ store:
 		remove_from_delete_queue = false;
 	}
 
+	ctdb_db_delta_record(ctdb_db, key);
+
 	if (schedule_for_deletion) {
 		int ret2;
 		ret2 = ctdb_local_schedule_for_deletion(ctdb_db, header, key);
@@ -1282,8 +1284,8 @@ int32_t ctdb_control_db_detach(struct ctdb_context *ctdb, TDB_DATA indata,
 	}
 
 	/* Terminate any revokes */
-	while (ctdb_db->revokechild_active) {
-		talloc_free(ctdb_db->revokechild_active);
+	while (ctdb_db->revoke_active) {
+		talloc_free(ctdb_db->revoke_active);
 	}
 
 	/* Free readonly tracking database */
@@ -1581,7 +1583,9 @@ int ctdb_set_db_sticky(struct ctdb_context *ctdb, struct ctdb_db_context *ctdb_d
 		return -1;
 	}
 
-	ctdb_db->sticky_records = trbt_create(ctdb_db, 0);
+	if (ctdb_db->sticky_records == NULL) {
+		ctdb_db->sticky_records = trbt_create(ctdb_db, 0);
+	}
 
 	ctdb_db_set_sticky(ctdb_db);
 
@@ -1620,10 +1624,11 @@ int32_t ctdb_control_get_db_statistics(struct ctdb_context *ctdb,
 		return -1;
 	}
 
-	len = offsetof(struct ctdb_db_statistics_old, hot_keys_wire);
+	len = offsetof(struct ctdb_db_statistics_old, damping);
 	for (i = 0; i < MAX_HOT_KEYS; i++) {
 		len += ctdb_db->statistics.hot_keys[i].key.dsize;
 	}
+	len += sizeof(ctdb_db->statistics.damping);
 
 	stats = talloc_size(outdata, len);
 	if (stats == NULL) {
@@ -1632,17 +1637,20 @@ int32_t ctdb_control_get_db_statistics(struct ctdb_context *ctdb,
 	}
 
 	memcpy(stats, &ctdb_db->statistics,
-	       offsetof(struct ctdb_db_statistics_old, hot_keys_wire));
+	       offsetof(struct ctdb_db_statistics_old, damping));
 
 	stats->num_hot_keys = MAX_HOT_KEYS;
 
-	ptr = &stats->hot_keys_wire[0];
+	ptr = (char *)stats + offsetof(struct ctdb_db_statistics_old, damping);
 	for (i = 0; i < MAX_HOT_KEYS; i++) {
 		memcpy(ptr, ctdb_db->statistics.hot_keys[i].key.dptr,
 		       ctdb_db->statistics.hot_keys[i].key.dsize);
 		ptr += ctdb_db->statistics.hot_keys[i].key.dsize;
 	}
 
+	memcpy(ptr, &ctdb_db->statistics.damping,
+	       sizeof(ctdb_db->statistics.damping));
+
 	outdata->dptr  = (uint8_t *)stats;
 	outdata->dsize = len;
 
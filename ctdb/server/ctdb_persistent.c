@@ -28,26 +28,62 @@
 #include <tevent.h>
 
 #include "lib/tdb_wrap/tdb_wrap.h"
+#include "lib/util/dlinklist.h"
 #include "lib/util/debug.h"
 #include "lib/util/samba_util.h"
 
 #include "ctdb_private.h"
 
 #include "common/reqid.h"
+#include "common/rb_tree.h"
 #include "common/common.h"
 #include "common/logging.h"
 
+/*
+ * A transaction commit from a client.  Commits for a database that
+ * arrive while another commit is being rolled out are queued.  The
+ * queued commits are then rolled out together with one
+ * CTDB_CONTROL_UPDATE_RECORD per node, as long as they do not touch
+ * the same keys.
+ */
+struct ctdb_persistent_commit {
+	struct ctdb_persistent_commit *prev, *next;
+	struct ctdb_db_context *ctdb_db;
+	struct ctdb_persistent_state *state; /* NULL while queued */
+	struct ctdb_client *client;
+	struct ctdb_req_control_old *c;
+	TDB_DATA recdata;
+};
+
 struct ctdb_persistent_state {
 	struct ctdb_context *ctdb;
 	struct ctdb_db_context *ctdb_db; /* used by trans3_commit */
-	struct ctdb_client *client; /* used by trans3_commit */
-	struct ctdb_req_control_old *c;
+	struct ctdb_persistent_commit *commits; /* used by trans3_commit */
 	const char *errormsg;
 	uint32_t num_pending;
 	int32_t status;
 	uint32_t num_failed, num_sent;
 };
 
+/* maximum number of commits rolled out together */
+#define PERSISTENT_BATCH_MAX	64
+
+static void ctdb_persistent_next_batch(struct ctdb_db_context *ctdb_db);
+
+/*
+  reply to all the commits rolled out by a persistent state
+ */
+static void ctdb_persistent_reply(struct ctdb_persistent_state *state,
+				  int32_t status, const char *errormsg)
+{
+	struct ctdb_persistent_commit *commit;
+
+	for (commit = state->commits; commit != NULL; commit = commit->next) {
+		ctdb_request_control_reply(state->ctdb, commit->c, NULL,
+					   status, errormsg);
+	}
+}
+
 /*
   1) all nodes fail, and all nodes reply
   2) some nodes fail, all nodes reply
@@ -65,6 +101,7 @@ static void ctdb_persistent_callback(struct ctdb_context *ctdb,
 {
 	struct ctdb_persistent_state *state = talloc_get_type(private_data, 
 							      struct ctdb_persistent_state);
+	struct ctdb_db_context *ctdb_db = state->ctdb_db;
 
 	if (ctdb->recovery_mode != CTDB_RECOVERY_NORMAL) {
 		DEBUG(DEBUG_INFO, ("ctdb_persistent_callback: ignoring reply "
@@ -96,8 +133,10 @@ static void ctdb_persistent_callback(struct ctdb_context *ctdb,
 		return;
 	}
 
-	ctdb_request_control_reply(state->ctdb, state->c, NULL, 0, state->errormsg);
+	ctdb_persistent_reply(state, 0, state->errormsg);
 	talloc_free(state);
+
+	ctdb_persistent_next_batch(ctdb_db);
 }
 
 /*
@@ -108,6 +147,7 @@ static void ctdb_persistent_store_timeout(struct tevent_context *ev,
 					  struct timeval t, void *private_data)
 {
 	struct ctdb_persistent_state *state = talloc_get_type(private_data, struct ctdb_persistent_state);
+	struct ctdb_db_context *ctdb_db = state->ctdb_db;
 
 	if (state->ctdb->recovery_mode != CTDB_RECOVERY_NORMAL) {
 		DEBUG(DEBUG_INFO, ("ctdb_persistent_store_timeout: ignoring "
@@ -115,10 +155,11 @@ static void ctdb_persistent_store_timeout(struct tevent_context *ev,
 		return;
 	}
 
-	ctdb_request_control_reply(state->ctdb, state->c, NULL, 1,
-				   "timeout in ctdb_persistent_state");
+	ctdb_persistent_reply(state, 1, "timeout in ctdb_persistent_state");
 
 	talloc_free(state);
+
+	ctdb_persistent_next_batch(ctdb_db);
 }
 
 /**
@@ -141,14 +182,28 @@ void ctdb_persistent_finish_trans3_commits(struct ctdb_context *ctdb)
 	for (ctdb_db = ctdb->db_list; ctdb_db; ctdb_db = ctdb_db->next) {
 		struct ctdb_persistent_state *state;
 
+		/*
+		 * Queued commits have not been rolled out, the clients
+		 * retry them after checking the sequence number.
+		 */
+		while (ctdb_db->persistent_queue != NULL) {
+			struct ctdb_persistent_commit *commit =
+				ctdb_db->persistent_queue;
+
+			ctdb_request_control_reply(ctdb, commit->c, NULL, 2,
+						   "trans3 commit ended by "
+						   "recovery");
+			talloc_free(commit);
+		}
+
 		if (ctdb_db->persistent_state == NULL) {
 			continue;
 		}
 
 		state = ctdb_db->persistent_state;
 
-		ctdb_request_control_reply(ctdb, state->c, NULL, 2,
-					   "trans3 commit ended by recovery");
+		ctdb_persistent_reply(state, 2,
+				      "trans3 commit ended by recovery");
 
 		/* The destructor sets ctdb_db->persistent_state to NULL. */
 		talloc_free(state);
@@ -157,10 +212,6 @@ void ctdb_persistent_finish_trans3_commits(struct ctdb_context *ctdb)
 
 static int ctdb_persistent_state_destructor(struct ctdb_persistent_state *state)
 {
-	if (state->client != NULL) {
-		state->client->db_id = 0;
-	}
-
 	if (state->ctdb_db != NULL) {
 		state->ctdb_db->persistent_state = NULL;
 	}
@@ -168,69 +219,197 @@ static int ctdb_persistent_state_destructor(struct ctdb_persistent_state *state)
 	return 0;
 }
 
+static int ctdb_persistent_commit_destructor(
+				struct ctdb_persistent_commit *commit)
+{
+	if (commit->client != NULL) {
+		commit->client->db_id = 0;
+	}
+
+	if (commit->state != NULL) {
+		DLIST_REMOVE(commit->state->commits, commit);
+	} else {
+		DLIST_REMOVE(commit->ctdb_db->persistent_queue, commit);
+	}
+
+	return 0;
+}
+
+/**
+ * Drop the commit of a client that has gone away, so that no reply is
+ * sent for it.
+ */
+void ctdb_persistent_cancel_commit(struct ctdb_db_context *ctdb_db,
+				   struct ctdb_client *client)
+{
+	struct ctdb_persistent_commit *commit;
+
+	for (commit = ctdb_db->persistent_queue;
+	     commit != NULL;
+	     commit = commit->next) {
+		if (commit->client == client) {
+			talloc_free(commit);
+			return;
+		}
+	}
+
+	if (ctdb_db->persistent_state == NULL) {
+		return;
+	}
+
+	for (commit = ctdb_db->persistent_state->commits;
+	     commit != NULL;
+	     commit = commit->next) {
+		if (commit->client == client) {
+			talloc_free(commit);
+			return;
+		}
+	}
+}
+
 /*
- * Store a set of persistent records.
- * This is used to roll out a transaction to all nodes.
+  check if a queued commit writes a key that is already in the batch
+  and add its keys to the batch
  */
-int32_t ctdb_control_trans3_commit(struct ctdb_context *ctdb,
-				   struct ctdb_req_control_old *c,
-				   TDB_DATA recdata, bool *async_reply)
+static bool ctdb_persistent_commit_conflicts(struct trbt_tree *keys,
+					     struct ctdb_persistent_commit *commit)
 {
-	struct ctdb_client *client;
-	struct ctdb_persistent_state *state;
+	struct ctdb_marshall_buffer *m =
+		(struct ctdb_marshall_buffer *)commit->recdata.dptr;
+	struct ctdb_rec_data_old *rec = NULL;
 	unsigned int i;
-	struct ctdb_marshall_buffer *m = (struct ctdb_marshall_buffer *)recdata.dptr;
-	struct ctdb_db_context *ctdb_db;
+	TDB_DATA key;
 
-	if (ctdb->recovery_mode != CTDB_RECOVERY_NORMAL) {
-		DEBUG(DEBUG_INFO,("rejecting ctdb_control_trans3_commit when recovery active\n"));
-		return -1;
-	}
+	for (i = 0; i < m->count; i++) {
+		rec = ctdb_marshall_loop_next(m, rec, NULL, NULL, &key, NULL);
+		if (rec == NULL) {
+			return true;
+		}
 
-	client = reqid_find(ctdb->idr, c->client_id, struct ctdb_client);
-	if (client == NULL) {
-		DEBUG(DEBUG_ERR,(__location__ " can not match persistent_store "
-				 "to a client. Returning error\n"));
-		return -1;
+		/* hash collisions are treated as conflicts */
+		if (trbt_lookup32(keys, ctdb_hash(&key)) != NULL) {
+			return true;
+		}
 	}
 
-	if (client->db_id != 0) {
-		DEBUG(DEBUG_ERR,(__location__ " ERROR: trans3_commit: "
-				 "client-db_id[0x%08x] != 0 "
-				 "(client_id[0x%08x]): trans3_commit active?\n",
-				 client->db_id, client->client_id));
-		return -1;
+	rec = NULL;
+	for (i = 0; i < m->count; i++) {
+		rec = ctdb_marshall_loop_next(m, rec, NULL, NULL, &key, NULL);
+		trbt_insert32(keys, ctdb_hash(&key), commit);
 	}
 
-	ctdb_db = find_ctdb_db(ctdb, m->db_id);
-	if (ctdb_db == NULL) {
-		DEBUG(DEBUG_ERR,(__location__ " ctdb_control_trans3_commit: "
-				 "Unknown database db_id[0x%08x]\n", m->db_id));
-		return -1;
+	return false;
+}
+
+/*
+  build the records to roll out for a batch of commits
+ */
+static TDB_DATA ctdb_persistent_batch_recdata(
+				struct ctdb_persistent_state *state)
+{
+	struct ctdb_persistent_commit *commit = state->commits;
+	struct ctdb_marshall_buffer *batch;
+
+	if (commit->next == NULL) {
+		return commit->recdata;
 	}
 
-	if (ctdb_db->persistent_state != NULL) {
-		DEBUG(DEBUG_ERR, (__location__ " Error: "
-				  "ctdb_control_trans3_commit "
-				  "called while a transaction commit is "
-				  "active. db_id[0x%08x]\n", m->db_id));
-		return -1;
+	batch = talloc_zero_size(state,
+				 offsetof(struct ctdb_marshall_buffer, data));
+	if (batch == NULL) {
+		return tdb_null;
 	}
+	batch->db_id = state->ctdb_db->db_id;
+
+	for (; commit != NULL; commit = commit->next) {
+		struct ctdb_marshall_buffer *m =
+			(struct ctdb_marshall_buffer *)commit->recdata.dptr;
+		struct ctdb_rec_data_old *rec = NULL;
+		struct ctdb_ltdb_header header;
+		TDB_DATA key, data;
+		unsigned int i;
+
+		for (i = 0; i < m->count; i++) {
+			rec = ctdb_marshall_loop_next(m, rec, NULL, &header,
+						      &key, &data);
+			if (rec == NULL) {
+				return tdb_null;
+			}
+
+			batch = ctdb_marshall_add(state, batch,
+						  state->ctdb_db->db_id, 0,
+						  key, &header, data);
+			if (batch == NULL) {
+				return tdb_null;
+			}
+		}
+	}
+
+	return ctdb_marshall_finish(batch);
+}
 
-	ctdb_db->persistent_state = talloc_zero(ctdb_db,
-						struct ctdb_persistent_state);
-	CTDB_NO_MEMORY(ctdb, ctdb_db->persistent_state);
+/*
+  roll out the queued commits of a database to all nodes
+ */
+static void ctdb_persistent_start_batch(struct ctdb_db_context *ctdb_db)
+{
+	struct ctdb_context *ctdb = ctdb_db->ctdb;
+	struct ctdb_persistent_state *state;
+	struct ctdb_persistent_commit *commit;
+	struct trbt_tree *keys;
+	unsigned int count = 0;
+	TDB_DATA recdata;
+	unsigned int i;
 
-	client->db_id = m->db_id;
+	state = talloc_zero(ctdb_db, struct ctdb_persistent_state);
+	if (state == NULL) {
+		DEBUG(DEBUG_ERR, (__location__ " Out of memory\n"));
+		goto failed;
+	}
 
-	state = ctdb_db->persistent_state;
 	state->ctdb = ctdb;
 	state->ctdb_db = ctdb_db;
-	state->c    = c;
-	state->client = client;
 
+	ctdb_db->persistent_state = state;
 	talloc_set_destructor(state, ctdb_persistent_state_destructor);
 
+	keys = trbt_create(state, 0);
+	if (keys == NULL) {
+		DEBUG(DEBUG_ERR, (__location__ " Out of memory\n"));
+		goto failed;
+	}
+
+	/*
+	 * Keep the commits in order: stop at the first commit that
+	 * writes a key of an earlier one in the batch.
+	 */
+	while (ctdb_db->persistent_queue != NULL &&
+	       count < PERSISTENT_BATCH_MAX) {
+		commit = ctdb_db->persistent_queue;
+
+		if (ctdb_persistent_commit_conflicts(keys, commit)) {
+			break;
+		}
+
+		DLIST_REMOVE(ctdb_db->persistent_queue, commit);
+		DLIST_ADD_END(state->commits, commit);
+		commit->state = state;
+		talloc_steal(state, commit);
+		count++;
+	}
+
+	recdata = ctdb_persistent_batch_recdata(state);
+	if (recdata.dptr == NULL) {
+		DEBUG(DEBUG_ERR, (__location__ " Failed to marshall records "
+				  "of %u commits\n", count));
+		goto failed;
+	}
+
+	if (count > 1) {
+		DEBUG(DEBUG_DEBUG, ("Rolling out %u commits for db %s "
+				    "together\n", count, ctdb_db->db_name));
+	}
+
 	for (i = 0; i < ctdb->vnn_map->size; i++) {
 		struct ctdb_node *node = ctdb->nodes[ctdb->vnn_map->map[i]];
 		int ret;
@@ -242,15 +421,14 @@ int32_t ctdb_control_trans3_commit(struct ctdb_context *ctdb,
 
 		ret = ctdb_daemon_send_control(ctdb, node->pnn, 0,
 					       CTDB_CONTROL_UPDATE_RECORD,
-					       c->client_id, 0, recdata,
+					       0, 0, recdata,
 					       ctdb_persistent_callback,
 					       state);
 		if (ret == -1) {
 			DEBUG(DEBUG_ERR,("Unable to send "
 					 "CTDB_CONTROL_UPDATE_RECORD "
 					 "to pnn %u\n", node->pnn));
-			talloc_free(state);
-			return -1;
+			goto failed;
 		}
 
 		state->num_pending++;
@@ -258,21 +436,104 @@ int32_t ctdb_control_trans3_commit(struct ctdb_context *ctdb,
 	}
 
 	if (state->num_pending == 0) {
+		ctdb_persistent_reply(state, 0, NULL);
 		talloc_free(state);
-		return 0;
+		return;
 	}
 
-	/* we need to wait for the replies */
-	*async_reply = true;
-
-	/* need to keep the control structure around */
-	talloc_steal(state, c);
-
 	/* but we won't wait forever */
 	tevent_add_timer(ctdb->ev, state,
 			 timeval_current_ofs(ctdb->tunable.control_timeout, 0),
 			 ctdb_persistent_store_timeout, state);
 
+	return;
+
+failed:
+	if (state == NULL || state->commits == NULL) {
+		/* fail the first queued commit, so the queue drains */
+		commit = ctdb_db->persistent_queue;
+		ctdb_request_control_reply(ctdb, commit->c, NULL, -1, NULL);
+		talloc_free(commit);
+	}
+
+	if (state != NULL) {
+		ctdb_persistent_reply(state, -1, NULL);
+		talloc_free(state);
+	}
+}
+
+/*
+  start the next batch of queued commits, unless one is being rolled out
+ */
+static void ctdb_persistent_next_batch(struct ctdb_db_context *ctdb_db)
+{
+	while (ctdb_db->persistent_state == NULL &&
+	       ctdb_db->persistent_queue != NULL &&
+	       ctdb_db->ctdb->recovery_mode == CTDB_RECOVERY_NORMAL) {
+		ctdb_persistent_start_batch(ctdb_db);
+	}
+}
+
+/*
+ * Store a set of persistent records.
+ * This is used to roll out a transaction to all nodes.
+ */
+int32_t ctdb_control_trans3_commit(struct ctdb_context *ctdb,
+				   struct ctdb_req_control_old *c,
+				   TDB_DATA recdata, bool *async_reply)
+{
+	struct ctdb_client *client;
+	struct ctdb_persistent_commit *commit;
+	struct ctdb_marshall_buffer *m = (struct ctdb_marshall_buffer *)recdata.dptr;
+	struct ctdb_db_context *ctdb_db;
+
+	if (ctdb->recovery_mode != CTDB_RECOVERY_NORMAL) {
+		DEBUG(DEBUG_INFO,("rejecting ctdb_control_trans3_commit when recovery active\n"));
+		return -1;
+	}
+
+	client = reqid_find(ctdb->idr, c->client_id, struct ctdb_client);
+	if (client == NULL) {
+		DEBUG(DEBUG_ERR,(__location__ " can not match persistent_store "
+				 "to a client. Returning error\n"));
+		return -1;
+	}
+
+	if (client->db_id != 0) {
+		DEBUG(DEBUG_ERR,(__location__ " ERROR: trans3_commit: "
+				 "client-db_id[0x%08x] != 0 "
+				 "(client_id[0x%08x]): trans3_commit active?\n",
+				 client->db_id, client->client_id));
+		return -1;
+	}
+
+	ctdb_db = find_ctdb_db(ctdb, m->db_id);
+	if (ctdb_db == NULL) {
+		DEBUG(DEBUG_ERR,(__location__ " ctdb_control_trans3_commit: "
+				 "Unknown database db_id[0x%08x]\n", m->db_id));
+		return -1;
+	}
+
+	commit = talloc_zero(ctdb_db, struct ctdb_persistent_commit);
+	CTDB_NO_MEMORY(ctdb, commit);
+
+	client->db_id = m->db_id;
+
+	commit->ctdb_db = ctdb_db;
+	commit->client = client;
+	commit->recdata = recdata;
+
+	/* need to keep the control structure around */
+	commit->c = talloc_steal(commit, c);
+
+	DLIST_ADD_END(ctdb_db->persistent_queue, commit);
+	talloc_set_destructor(commit, ctdb_persistent_commit_destructor);
+
+	/* we need to wait for the replies */
+	*async_reply = true;
+
+	ctdb_persistent_next_batch(ctdb_db);
+
 	return 0;
 }
 
@@ -450,6 +450,241 @@ done:
 	return 0;
 }
 
+/*
+ * Journal of the keys modified since the last recovery.
+ *
+ * After a database recovery commits, all the active nodes hold the same
+ * records.  Any key stored since then is remembered here, so that the
+ * next recovery only needs to pull (and push) those records.  The
+ * journal is in memory only and is dropped whenever it can no longer
+ * describe all the changes, in which case a full recovery is done.
+ */
+
+#define DELTA_RECOVERY_MAX_KEYS	100000
+
+void ctdb_db_delta_invalidate(struct ctdb_db_context *ctdb_db)
+{
+	TALLOC_FREE(ctdb_db->delta_keys);
+	TALLOC_FREE(ctdb_db->delta_active);
+	ctdb_db->delta_num_keys = 0;
+	ctdb_db->delta_num_nodes = 0;
+	ctdb_db->delta_valid = false;
+}
+
+void ctdb_db_delta_reset(struct ctdb_db_context *ctdb_db)
+{
+	struct ctdb_context *ctdb = ctdb_db->ctdb;
+	unsigned int i;
+	int ret;
+
+	ctdb_db_delta_invalidate(ctdb_db);
+
+	if (! ctdb_db_volatile(ctdb_db)) {
+		return;
+	}
+
+	ret = db_hash_init(ctdb_db, "delta_keys", 1024, DB_HASH_SIMPLE,
+			   &ctdb_db->delta_keys);
+	if (ret != 0) {
+		return;
+	}
+
+	ctdb_db->delta_active = talloc_array(ctdb_db, bool, ctdb->num_nodes);
+	if (ctdb_db->delta_active == NULL) {
+		TALLOC_FREE(ctdb_db->delta_keys);
+		return;
+	}
+
+	for (i=0; i<ctdb->num_nodes; i++) {
+		ctdb_db->delta_active[i] =
+			!(ctdb->nodes[i]->flags & NODE_FLAGS_INACTIVE);
+	}
+
+	ctdb_db->delta_num_nodes = ctdb->num_nodes;
+	ctdb_db->delta_generation = ctdb_db->generation;
+	ctdb_db->delta_valid = true;
+}
+
+void ctdb_db_delta_record(struct ctdb_db_context *ctdb_db, TDB_DATA key)
+{
+	int ret;
+
+	if (! ctdb_db->delta_valid) {
+		return;
+	}
+
+	ret = db_hash_insert(ctdb_db->delta_keys, key.dptr, key.dsize,
+			     NULL, 0);
+	if (ret == EEXIST) {
+		return;
+	}
+	if (ret != 0) {
+		ctdb_db_delta_invalidate(ctdb_db);
+		return;
+	}
+
+	ctdb_db->delta_num_keys += 1;
+	if (ctdb_db->delta_num_keys > DELTA_RECOVERY_MAX_KEYS) {
+		D_INFO("Too many changes in %s, delta recovery disabled\n",
+		       ctdb_db->db_name);
+		ctdb_db_delta_invalidate(ctdb_db);
+	}
+}
+
+static bool ctdb_db_delta_usable(struct ctdb_db_context *ctdb_db,
+				 uint32_t generation)
+{
+	struct ctdb_context *ctdb = ctdb_db->ctdb;
+	unsigned int i;
+
+	if (! ctdb_db->delta_valid || ctdb_db->invalid_records) {
+		return false;
+	}
+
+	if (generation == INVALID_GENERATION ||
+	    ctdb_db->delta_generation != generation) {
+		return false;
+	}
+
+	/*
+	 * Nodes that have joined or left since the journal was started
+	 * do not hold the same records as the others
+	 */
+	if (ctdb_db->delta_num_nodes != ctdb->num_nodes) {
+		return false;
+	}
+
+	for (i=0; i<ctdb->num_nodes; i++) {
+		bool active = !(ctdb->nodes[i]->flags & NODE_FLAGS_INACTIVE);
+
+		if (active != ctdb_db->delta_active[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+struct db_pull_delta_state {
+	struct db_pull_state pull;
+	bool failed;
+};
+
+static int traverse_db_pull_delta(uint8_t *keybuf, size_t keylen,
+				  uint8_t *databuf, size_t datalen,
+				  void *private_data)
+{
+	struct db_pull_delta_state *state =
+		(struct db_pull_delta_state *)private_data;
+	struct tdb_context *tdb = state->pull.ctdb_db->ltdb->tdb;
+	TDB_DATA key = { .dptr = keybuf, .dsize = keylen };
+	TDB_DATA data;
+	int ret;
+
+	data = tdb_fetch(tdb, key);
+	if (data.dptr == NULL) {
+		/* Deleted since, the other nodes have the record */
+		return 0;
+	}
+
+	ret = traverse_db_pull(tdb, key, data, &state->pull);
+	free(data.dptr);
+	if (ret != 0) {
+		state->failed = true;
+	}
+	return ret;
+}
+
+int32_t ctdb_control_db_pull_delta(struct ctdb_context *ctdb,
+				   struct ctdb_req_control_old *c,
+				   TDB_DATA indata, TDB_DATA *outdata)
+{
+	struct ctdb_pulldb_delta *pulldb_delta;
+	struct ctdb_db_context *ctdb_db;
+	struct db_pull_delta_state delta;
+	struct db_pull_state *state = &delta.pull;
+	int ret;
+
+	pulldb_delta = (struct ctdb_pulldb_delta *)indata.dptr;
+
+	ctdb_db = find_ctdb_db(ctdb, pulldb_delta->db_id);
+	if (ctdb_db == NULL) {
+		DEBUG(DEBUG_ERR,(__location__ " Unknown db 0x%08x\n",
+				 pulldb_delta->db_id));
+		return -1;
+	}
+
+	if (!ctdb_db_frozen(ctdb_db)) {
+		DEBUG(DEBUG_ERR,
+		      ("rejecting ctdb_control_db_pull_delta when not frozen\n"));
+		return -1;
+	}
+
+	if (! ctdb_db_delta_usable(ctdb_db, pulldb_delta->generation)) {
+		D_NOTICE("No delta for db(%s) since generation %u\n",
+			 ctdb_db->db_name, pulldb_delta->generation);
+		return -1;
+	}
+
+	state->ctdb = ctdb;
+	state->ctdb_db = ctdb_db;
+	state->recs = NULL;
+	state->pnn = c->hdr.srcnode;
+	state->srvid = pulldb_delta->srvid;
+	state->num_records = 0;
+	delta.failed = false;
+
+	if (ctdb_lockdb_mark(ctdb_db) != 0) {
+		DEBUG(DEBUG_ERR,
+		      (__location__ " Failed to get lock on entire db - failing\n"));
+		return -1;
+	}
+
+	ret = db_hash_traverse(ctdb_db->delta_keys, traverse_db_pull_delta,
+			       &delta, NULL);
+	if (ret != 0 || delta.failed) {
+		DEBUG(DEBUG_ERR,
+		      (__location__ " Failed to traverse delta of db '%s'\n",
+		       ctdb_db->db_name));
+		TALLOC_FREE(state->recs);
+		ctdb_lockdb_unmark(ctdb_db);
+		return -1;
+	}
+
+	/* Last few records */
+	if (state->recs != NULL) {
+		TDB_DATA buffer;
+
+		buffer = ctdb_marshall_finish(state->recs);
+		ret = ctdb_daemon_send_message(state->ctdb, state->pnn,
+					       state->srvid, buffer);
+		if (ret != 0) {
+			TALLOC_FREE(state->recs);
+			ctdb_lockdb_unmark(ctdb_db);
+			return -1;
+		}
+
+		state->num_records += state->recs->count;
+		TALLOC_FREE(state->recs);
+	}
+
+	ctdb_lockdb_unmark(ctdb_db);
+
+	D_INFO("Pulled %u of %u changed records of db(%s)\n",
+	       state->num_records, ctdb_db->delta_num_keys, ctdb_db->db_name);
+
+	outdata->dptr = talloc_size(outdata, sizeof(uint32_t));
+	if (outdata->dptr == NULL) {
+		DEBUG(DEBUG_ERR, (__location__ " Memory allocation error\n"));
+		return -1;
+	}
+
+	memcpy(outdata->dptr, (uint8_t *)&state->num_records, sizeof(uint32_t));
+	outdata->dsize = sizeof(uint32_t);
+
+	return 0;
+}
+
 /*
   push a bunch of records into a ltdb, filtering by rsn
  */
@@ -531,8 +766,8 @@ int32_t ctdb_control_push_db(struct ctdb_context *ctdb, TDB_DATA indata)
 			ctdb_db->rottdb = NULL;
 			ctdb_db_reset_readonly(ctdb_db);
 		}
-		while (ctdb_db->revokechild_active != NULL) {
-			talloc_free(ctdb_db->revokechild_active);
+		while (ctdb_db->revoke_active != NULL) {
+			talloc_free(ctdb_db->revoke_active);
 		}
 	}
 
@@ -725,8 +960,8 @@ int32_t ctdb_control_db_push_confirm(struct ctdb_context *ctdb,
 			ctdb_db_reset_readonly(ctdb_db);
 		}
 
-		while (ctdb_db->revokechild_active != NULL) {
-			talloc_free(ctdb_db->revokechild_active);
+		while (ctdb_db->revoke_active != NULL) {
+			talloc_free(ctdb_db->revoke_active);
 		}
 	}
 
@@ -1437,6 +1672,7 @@ void ctdb_node_become_inactive(struct ctdb_context *ctdb)
 	ctdb->vnn_map->generation = INVALID_GENERATION;
 	for (ctdb_db = ctdb->db_list; ctdb_db != NULL; ctdb_db = ctdb_db->next) {
 		ctdb_db->generation = INVALID_GENERATION;
+		ctdb_db_delta_invalidate(ctdb_db);
 	}
 
 	/*
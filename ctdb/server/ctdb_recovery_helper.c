@@ -27,6 +27,7 @@
 #include <libgen.h>
 
 #include "lib/tdb_wrap/tdb_wrap.h"
+#include "lib/util/dlinklist.h"
 #include "lib/util/sys_rw.h"
 #include "lib/util/time.h"
 #include "lib/util/tevent_unix.h"
@@ -80,6 +81,7 @@ struct recdb_context {
 	const char *db_path;
 	struct tdb_wrap *db;
 	bool persistent;
+	bool delta;
 };
 
 static struct recdb_context *recdb_create(TALLOC_CTX *mem_ctx, uint32_t db_id,
@@ -114,15 +116,16 @@ static struct recdb_context *recdb_create(TALLOC_CTX *mem_ctx, uint32_t db_id,
 	unlink(recdb->db_path);
 
 	tdb_flags = TDB_NOLOCK | TDB_INCOMPATIBLE_HASH | TDB_DISALLOW_NESTING;
-	recdb->db = tdb_wrap_open(mem_ctx, recdb->db_path, hash_size,
+	recdb->db = tdb_wrap_open(recdb, recdb->db_path, hash_size,
 				  tdb_flags, O_RDWR|O_CREAT|O_EXCL, 0600);
 	if (recdb->db == NULL) {
-		talloc_free(recdb);
 		D_ERR("failed to create recovery db %s\n", recdb->db_path);
+		talloc_free(recdb);
 		return NULL;
 	}
 
 	recdb->persistent = persistent;
+	recdb->delta = false;
 
 	return recdb;
 }
@@ -137,11 +140,6 @@ static const char *recdb_name(struct recdb_context *recdb)
 	return recdb->db_name;
 }
 
-static const char *recdb_path(struct recdb_context *recdb)
-{
-	return recdb->db_path;
-}
-
 static struct tdb_context *recdb_tdb(struct recdb_context *recdb)
 {
 	return recdb->db->tdb;
@@ -152,6 +150,11 @@ static bool recdb_persistent(struct recdb_context *recdb)
 	return recdb->persistent;
 }
 
+static bool recdb_delta(struct recdb_context *recdb)
+{
+	return recdb->delta;
+}
+
 struct recdb_add_traverse_state {
 	struct recdb_context *recdb;
 	uint32_t mypnn;
@@ -215,14 +218,18 @@ static bool recdb_add(struct recdb_context *recdb, int mypnn,
 
 /* This function decides which records from recdb are retained */
 static int recbuf_filter_add(struct ctdb_rec_buffer *recbuf, bool persistent,
-			     uint32_t reqid, uint32_t dmaster,
+			     bool delta, uint32_t reqid, uint32_t dmaster,
 			     TDB_DATA key, TDB_DATA data)
 {
 	struct ctdb_ltdb_header *header;
 	int ret;
 
-	/* Skip empty records */
-	if (data.dsize <= sizeof(struct ctdb_ltdb_header)) {
+	/*
+	 * Skip empty records, unless only the changed records are pushed
+	 * without wiping the database first.  Then a deleted record has
+	 * to be pushed to replace the older copies on the other nodes.
+	 */
+	if (data.dsize <= sizeof(struct ctdb_ltdb_header) && !delta) {
 		return 0;
 	}
 
@@ -246,6 +253,7 @@ struct recdb_records_traverse_state {
 	uint32_t dmaster;
 	uint32_t reqid;
 	bool persistent;
+	bool delta;
 	bool failed;
 };
 
@@ -258,7 +266,8 @@ static int recdb_records_traverse(struct tdb_context *tdb,
 	int ret;
 
 	ret = recbuf_filter_add(state->recbuf, state->persistent,
-				state->reqid, state->dmaster, key, data);
+				state->delta, state->reqid, state->dmaster,
+				key, data);
 	if (ret != 0) {
 		state->failed = true;
 		return ret;
@@ -281,6 +290,7 @@ static struct ctdb_rec_buffer *recdb_records(struct recdb_context *recdb,
 	state.dmaster = dmaster;
 	state.reqid = 0;
 	state.persistent = recdb_persistent(recdb);
+	state.delta = recdb_delta(recdb);
 	state.failed = false;
 
 	ret = tdb_traverse_read(recdb_tdb(recdb), recdb_records_traverse,
@@ -295,98 +305,55 @@ static struct ctdb_rec_buffer *recdb_records(struct recdb_context *recdb,
 	return state.recbuf;
 }
 
-struct recdb_file_traverse_state {
-	struct ctdb_rec_buffer *recbuf;
-	struct recdb_context *recdb;
-	TALLOC_CTX *mem_ctx;
-	uint32_t dmaster;
-	uint32_t reqid;
-	bool persistent;
-	bool failed;
-	int fd;
-	size_t max_size;
-	unsigned int num_buffers;
-};
-
-static int recdb_file_traverse(struct tdb_context *tdb,
-			       TDB_DATA key, TDB_DATA data,
-			       void *private_data)
+/*
+ * Marshall the records of recdb in batches of at most max_size bytes,
+ * walking the database key by key.  This allows the records to be
+ * pushed while they are read from recdb, without another copy.
+ *
+ * key is the first key of the batch and is updated to the first key
+ * of the next batch.  It is tdb_null once all the records are done.
+ */
+static int recdb_batch(struct recdb_context *recdb, TALLOC_CTX *mem_ctx,
+		       uint32_t dmaster, TDB_DATA *key, size_t max_size,
+		       struct ctdb_rec_buffer **out)
 {
-	struct recdb_file_traverse_state *state =
-		(struct recdb_file_traverse_state *)private_data;
+	struct ctdb_rec_buffer *recbuf;
+	struct tdb_context *tdb = recdb_tdb(recdb);
+	TDB_DATA data, next;
 	int ret;
 
-	ret = recbuf_filter_add(state->recbuf, state->persistent,
-				state->reqid, state->dmaster, key, data);
-	if (ret != 0) {
-		state->failed = true;
-		return ret;
-	}
-
-	if (ctdb_rec_buffer_len(state->recbuf) > state->max_size) {
-		ret = ctdb_rec_buffer_write(state->recbuf, state->fd);
-		if (ret != 0) {
-			D_ERR("Failed to collect recovery records for %s\n",
-			      recdb_name(state->recdb));
-			state->failed = true;
-			return ret;
+	recbuf = ctdb_rec_buffer_init(mem_ctx, recdb_id(recdb));
+	if (recbuf == NULL) {
+		return ENOMEM;
+	}
+
+	while (key->dptr != NULL) {
+		data = tdb_fetch(tdb, *key);
+		if (data.dptr != NULL) {
+			ret = recbuf_filter_add(recbuf,
+						recdb_persistent(recdb),
+						recdb_delta(recdb), 0,
+						dmaster, *key, data);
+			free(data.dptr);
+			if (ret != 0) {
+				talloc_free(recbuf);
+				return ret;
+			}
 		}
 
-		state->num_buffers += 1;
+		next = tdb_nextkey(tdb, *key);
+		free(key->dptr);
+		*key = next;
 
-		TALLOC_FREE(state->recbuf);
-		state->recbuf = ctdb_rec_buffer_init(state->mem_ctx,
-						     recdb_id(state->recdb));
-		if (state->recbuf == NULL) {
-			state->failed = true;
-			return ENOMEM;
+		if (ctdb_rec_buffer_len(recbuf) > max_size) {
+			break;
 		}
 	}
 
+	*out = recbuf;
 	return 0;
 }
 
-static int recdb_file(struct recdb_context *recdb, TALLOC_CTX *mem_ctx,
-		      uint32_t dmaster, int fd, int max_size)
-{
-	struct recdb_file_traverse_state state;
-	int ret;
-
-	state.recbuf = ctdb_rec_buffer_init(mem_ctx, recdb_id(recdb));
-	if (state.recbuf == NULL) {
-		return -1;
-	}
-	state.recdb = recdb;
-	state.mem_ctx = mem_ctx;
-	state.dmaster = dmaster;
-	state.reqid = 0;
-	state.persistent = recdb_persistent(recdb);
-	state.failed = false;
-	state.fd = fd;
-	state.max_size = max_size;
-	state.num_buffers = 0;
-
-	ret = tdb_traverse_read(recdb_tdb(recdb), recdb_file_traverse, &state);
-	if (ret == -1 || state.failed) {
-		TALLOC_FREE(state.recbuf);
-		return -1;
-	}
-
-	ret = ctdb_rec_buffer_write(state.recbuf, fd);
-	if (ret != 0) {
-		D_ERR("Failed to collect recovery records for %s\n",
-		      recdb_name(recdb));
-		TALLOC_FREE(state.recbuf);
-		return -1;
-	}
-	state.num_buffers += 1;
-
-	D_DEBUG("Wrote %d buffers of recovery records for %s\n",
-		state.num_buffers, recdb_name(recdb));
-
-	return state.num_buffers;
-}
-
 /*
  * Pull database from a single node
  */
@@ -397,6 +364,7 @@ struct pull_database_state {
 	struct recdb_context *recdb;
 	uint32_t pnn;
 	uint64_t srvid;
+	uint32_t delta_generation;
 	unsigned int num_records;
 	int result;
 };
@@ -413,7 +381,8 @@ static struct tevent_req *pull_database_send(
 			struct tevent_context *ev,
 			struct ctdb_client_context *client,
 			uint32_t pnn, uint32_t caps,
-			struct recdb_context *recdb)
+			struct recdb_context *recdb,
+			uint32_t delta_generation)
 {
 	struct tevent_req *req, *subreq;
 	struct pull_database_state *state;
@@ -429,6 +398,14 @@ static struct tevent_req *pull_database_send(
 	state->recdb = recdb;
 	state->pnn = pnn;
 	state->srvid = srvid_next();
+	state->delta_generation = delta_generation;
+
+	/* Only the nodes using DB_PULL can send the changed records */
+	if (delta_generation != INVALID_GENERATION &&
+	    !(caps & CTDB_CAP_FRAGMENTED_CONTROLS)) {
+		tevent_req_error(req, ENOTSUP);
+		return tevent_req_post(req, ev);
+	}
 
 	if (caps & CTDB_CAP_FRAGMENTED_CONTROLS) {
 		subreq = ctdb_client_set_message_handler_send(
@@ -524,11 +501,21 @@ static void pull_database_register_done(struct tevent_req *subreq)
 		return;
 	}
 
-	pulldb_ext.db_id = recdb_id(state->recdb);
-	pulldb_ext.lmaster = CTDB_LMASTER_ANY;
-	pulldb_ext.srvid = state->srvid;
+	if (state->delta_generation != INVALID_GENERATION) {
+		struct ctdb_pulldb_delta pulldb_delta;
 
-	ctdb_req_control_db_pull(&request, &pulldb_ext);
+		pulldb_delta.db_id = recdb_id(state->recdb);
+		pulldb_delta.generation = state->delta_generation;
+		pulldb_delta.srvid = state->srvid;
+
+		ctdb_req_control_db_pull_delta(&request, &pulldb_delta);
+	} else {
+		pulldb_ext.db_id = recdb_id(state->recdb);
+		pulldb_ext.lmaster = CTDB_LMASTER_ANY;
+		pulldb_ext.srvid = state->srvid;
+
+		ctdb_req_control_db_pull(&request, &pulldb_ext);
+	}
 	subreq = ctdb_client_control_send(state, state->ev, state->client,
 					  state->pnn, TIMEOUT(), &request);
 	if (tevent_req_nomem(subreq, req)) {
@@ -601,8 +588,19 @@ static void pull_database_new_done(struct tevent_req *subreq)
 		goto unregister;
 	}
 
-	ret = ctdb_reply_control_db_pull(reply, &num_records);
-	talloc_free(reply);
+	if (state->delta_generation != INVALID_GENERATION) {
+		ret = ctdb_reply_control_db_pull_delta(reply, &num_records);
+		talloc_free(reply);
+		if (ret != 0) {
+			D_NOTICE("No changed records for db %s from node %u\n",
+				 recdb_name(state->recdb), state->pnn);
+			state->result = EIO;
+			goto unregister;
+		}
+	} else {
+		ret = ctdb_reply_control_db_pull(reply, &num_records);
+		talloc_free(reply);
+	}
 	if (num_records != state->num_records) {
 		D_ERR("mismatch (%u != %u) in DB_PULL records for db %s\n",
 		      num_records, state->num_records,
@@ -772,12 +770,20 @@ struct push_database_new_state {
 	int count;
 	uint64_t srvid;
 	uint32_t dmaster;
-	int fd;
-	int num_buffers;
+	size_t max_size;
+	TDB_DATA key;
 	int num_buffers_sent;
 	unsigned int num_records;
 };
 
+static int push_database_new_state_destructor(
+			struct push_database_new_state *state)
+{
+	/* Key from tdb_firstkey()/tdb_nextkey() */
+	free(state->key.dptr);
+	return 0;
+}
+
 static void push_database_new_started(struct tevent_req *subreq);
 static void push_database_new_send_msg(struct tevent_req *req);
 static void push_database_new_send_done(struct tevent_req *subreq);
@@ -795,8 +801,6 @@ static struct tevent_req *push_database_new_send(
 	struct push_database_new_state *state;
 	struct ctdb_req_control request;
 	struct ctdb_pulldb_ext pulldb_ext;
-	char *filename;
-	off_t offset;
 
 	req = tevent_req_create(mem_ctx, &state,
 				struct push_database_new_state);
@@ -812,34 +816,12 @@ static struct tevent_req *push_database_new_send(
 
 	state->srvid = srvid_next();
 	state->dmaster = ctdb_client_pnn(client);
+	state->max_size = max_size;
 	state->num_buffers_sent = 0;
 	state->num_records = 0;
 
-	filename = talloc_asprintf(state, "%s.dat", recdb_path(recdb));
-	if (tevent_req_nomem(filename, req)) {
-		return tevent_req_post(req, ev);
-	}
-
-	state->fd = open(filename, O_RDWR|O_CREAT, 0644);
-	if (state->fd == -1) {
-		tevent_req_error(req, errno);
-		return tevent_req_post(req, ev);
-	}
-	unlink(filename);
-	talloc_free(filename);
-
-	state->num_buffers = recdb_file(recdb, state, state->dmaster,
-					state->fd, max_size);
-	if (state->num_buffers == -1) {
-		tevent_req_error(req, ENOMEM);
-		return tevent_req_post(req, ev);
-	}
-
-	offset = lseek(state->fd, 0, SEEK_SET);
-	if (offset != 0) {
-		tevent_req_error(req, EIO);
-		return tevent_req_post(req, ev);
-	}
+	state->key = tdb_firstkey(recdb_tdb(recdb));
+	talloc_set_destructor(state, push_database_new_state_destructor);
 
 	pulldb_ext.db_id = recdb_id(recdb);
 	pulldb_ext.srvid = state->srvid;
@@ -905,7 +887,7 @@ static void push_database_new_send_msg(struct tevent_req *req)
 	size_t np;
 	int ret;
 
-	if (state->num_buffers_sent == state->num_buffers) {
+	if (state->key.dptr == NULL) {
 		struct ctdb_req_control request;
 
 		ctdb_req_control_db_push_confirm(&request,
@@ -923,8 +905,11 @@ static void push_database_new_send_msg(struct tevent_req *req)
 		return;
 	}
 
-	ret = ctdb_rec_buffer_read(state->fd, state, &recbuf);
+	ret = recdb_batch(state->recdb, state, state->dmaster, &state->key,
+			  state->max_size, &recbuf);
 	if (ret != 0) {
+		D_ERR("Failed to collect recovery records for %s\n",
+		      recdb_name(state->recdb));
 		tevent_req_error(req, ret);
 		return;
 	}
@@ -1293,7 +1278,7 @@ static void collect_highseqnum_db_seqnum_done(struct tevent_req *subreq)
 	subreq = pull_database_send(state, state->ev, state->client,
 				    state->max_pnn,
 				    state->caps[state->max_pnn],
-				    state->recdb);
+				    state->recdb, INVALID_GENERATION);
 	if (tevent_req_nomem(subreq, req)) {
 		return;
 	}
@@ -1340,6 +1325,7 @@ struct collect_all_db_state {
 	uint32_t db_id;
 	struct recdb_context *recdb;
 	struct ctdb_pulldb pulldb;
+	uint32_t delta_generation;
 	int index;
 };
 
@@ -1351,7 +1337,8 @@ static struct tevent_req *collect_all_db_send(
 			struct ctdb_client_context *client,
 			uint32_t *pnn_list, int count, uint32_t *caps,
 			uint32_t *ban_credits, uint32_t db_id,
-			struct recdb_context *recdb)
+			struct recdb_context *recdb,
+			uint32_t delta_generation)
 {
 	struct tevent_req *req, *subreq;
 	struct collect_all_db_state *state;
@@ -1371,11 +1358,13 @@ static struct tevent_req *collect_all_db_send(
 	state->ban_credits = ban_credits;
 	state->db_id = db_id;
 	state->recdb = recdb;
+	state->delta_generation = delta_generation;
 	state->index = 0;
 
 	pnn = state->pnn_list[state->index];
 
-	subreq = pull_database_send(state, ev, client, pnn, caps[pnn], recdb);
+	subreq = pull_database_send(state, ev, client, pnn, caps[pnn], recdb,
+				    delta_generation);
 	if (tevent_req_nomem(subreq, req)) {
 		return tevent_req_post(req, ev);
 	}
@@ -1397,8 +1386,11 @@ static void collect_all_db_pulldb_done(struct tevent_req *subreq)
 	status = pull_database_recv(subreq, &ret);
 	TALLOC_FREE(subreq);
 	if (! status) {
-		pnn = state->pnn_list[state->index];
-		state->ban_credits[pnn] += 1;
+		/* Missing changes are not the node's fault */
+		if (state->delta_generation == INVALID_GENERATION) {
+			pnn = state->pnn_list[state->index];
+			state->ban_credits[pnn] += 1;
+		}
 		tevent_req_error(req, ret);
 		return;
 	}
@@ -1411,7 +1403,8 @@ static void collect_all_db_pulldb_done(struct tevent_req *subreq)
 
 	pnn = state->pnn_list[state->index];
 	subreq = pull_database_send(state, state->ev, state->client,
-				    pnn, state->caps[pnn], state->recdb);
+				    pnn, state->caps[pnn], state->recdb,
+				    state->delta_generation);
 	if (tevent_req_nomem(subreq, req)) {
 		return;
 	}
@@ -1424,10 +1417,128 @@ static bool collect_all_db_recv(struct tevent_req *req, int *perr)
 }
 
 
+/*
+ * Limit the total size of the recovery databases
+ *
+ * The size of the local copy of a database is used as the estimate for
+ * its recovery database.  A database waits until its estimate fits in
+ * the remaining budget.  Waiting databases are admitted in order, and a
+ * database is always admitted when nothing else is being recovered.
+ */
+
+struct recdb_budget {
+	uint64_t limit;
+	uint64_t used;
+	struct recdb_budget_reserve_state *waiting;
+};
+
+static void recdb_budget_init(struct recdb_budget *budget, uint64_t limit)
+{
+	budget->limit = limit;
+	budget->used = 0;
+	budget->waiting = NULL;
+}
+
+struct recdb_budget_reserve_state {
+	struct recdb_budget_reserve_state *prev, *next;
+	struct tevent_context *ev;
+	struct tevent_req *req;
+	struct recdb_budget *budget;
+	uint64_t size;
+	bool reserved;
+};
+
+static bool recdb_budget_fits(struct recdb_budget *budget, uint64_t size)
+{
+	if (budget->limit == 0 || budget->used == 0) {
+		return true;
+	}
+
+	return budget->used + size <= budget->limit;
+}
+
+static void recdb_budget_admit(struct recdb_budget *budget)
+{
+	struct recdb_budget_reserve_state *state;
+
+	while ((state = budget->waiting) != NULL) {
+		if (! recdb_budget_fits(budget, state->size)) {
+			break;
+		}
+
+		DLIST_REMOVE(budget->waiting, state);
+		budget->used += state->size;
+		state->reserved = true;
+
+		tevent_req_defer_callback(state->req, state->ev);
+		tevent_req_done(state->req);
+	}
+}
+
+static int recdb_budget_reserve_state_destructor(
+			struct recdb_budget_reserve_state *state)
+{
+	struct recdb_budget *budget = state->budget;
+
+	if (! state->reserved) {
+		DLIST_REMOVE(budget->waiting, state);
+		return 0;
+	}
+
+	budget->used -= state->size;
+	state->reserved = false;
+	recdb_budget_admit(budget);
+	return 0;
+}
+
+/*
+ * The request completes once size has been reserved.  The reservation
+ * is released when the request is freed.
+ */
+static struct tevent_req *recdb_budget_reserve_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct recdb_budget *budget,
+			uint64_t size)
+{
+	struct tevent_req *req;
+	struct recdb_budget_reserve_state *state;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct recdb_budget_reserve_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	state->ev = ev;
+	state->req = req;
+	state->budget = budget;
+	state->size = size;
+	state->reserved = false;
+
+	talloc_set_destructor(state, recdb_budget_reserve_state_destructor);
+
+	if (budget->waiting == NULL && recdb_budget_fits(budget, size)) {
+		budget->used += size;
+		state->reserved = true;
+		tevent_req_done(req);
+		return tevent_req_post(req, ev);
+	}
+
+	DLIST_ADD_END(budget->waiting, state);
+	return req;
+}
+
+static bool recdb_budget_reserve_recv(struct tevent_req *req, int *perr)
+{
+	return generic_recv(req, perr);
+}
+
 /**
  * For each database do the following:
  *  - Get DB name
  *  - Get DB path
+ *  - Wait for the recovery database to fit in the memory budget
  *  - Freeze database on all nodes
  *  - Start transaction on all nodes
  *  - Collect database from all nodes
@@ -1435,6 +1546,11 @@ static bool collect_all_db_recv(struct tevent_req *req, int *perr)
  *  - Push database to all nodes
  *  - Commit transaction on all nodes
  *  - Thaw database on all nodes
+ *
+ * For volatile databases, first try to collect only the records changed
+ * since the previous recovery.  If all nodes can supply them, the
+ * database is not wiped and only those records are pushed.  Otherwise
+ * the whole database is collected as above.
  */
 
 struct recover_db_state {
@@ -1450,6 +1566,9 @@ struct recover_db_state {
 
 	uint32_t destnode;
 	struct ctdb_transdb transdb;
+	uint32_t prev_generation;
+	struct recdb_budget *budget;
+	struct tevent_req *reservation;
 
 	const char *db_name, *db_path;
 	struct recdb_context *recdb;
@@ -1457,9 +1576,11 @@ struct recover_db_state {
 
 static void recover_db_name_done(struct tevent_req *subreq);
 static void recover_db_path_done(struct tevent_req *subreq);
+static void recover_db_reserved(struct tevent_req *subreq);
 static void recover_db_freeze_done(struct tevent_req *subreq);
 static void recover_db_transaction_started(struct tevent_req *subreq);
 static void recover_db_collect_done(struct tevent_req *subreq);
+static void recover_db_collect_delta_done(struct tevent_req *subreq);
 static void recover_db_wipedb_done(struct tevent_req *subreq);
 static void recover_db_pushdb_done(struct tevent_req *subreq);
 static void recover_db_transaction_committed(struct tevent_req *subreq);
@@ -1473,6 +1594,8 @@ static struct tevent_req *recover_db_send(TALLOC_CTX *mem_ctx,
 					  uint32_t *caps,
 					  uint32_t *ban_credits,
 					  uint32_t generation,
+					  uint32_t prev_generation,
+					  struct recdb_budget *budget,
 					  uint32_t db_id, uint8_t db_flags)
 {
 	struct tevent_req *req, *subreq;
@@ -1497,6 +1620,9 @@ static struct tevent_req *recover_db_send(TALLOC_CTX *mem_ctx,
 	state->destnode = ctdb_client_pnn(client);
 	state->transdb.db_id = db_id;
 	state->transdb.tid = generation;
+	state->prev_generation = prev_generation;
+	state->budget = budget;
+	state->reservation = NULL;
 
 	ctdb_req_control_get_dbname(&request, db_id);
 	subreq = ctdb_client_control_send(state, ev, client, state->destnode,
@@ -1556,7 +1682,7 @@ static void recover_db_path_done(struct tevent_req *subreq)
 	struct recover_db_state *state = tevent_req_data(
 		req, struct recover_db_state);
 	struct ctdb_reply_control *reply;
-	struct ctdb_req_control request;
+	struct stat st;
 	int ret;
 	bool status;
 
@@ -1579,6 +1705,38 @@ static void recover_db_path_done(struct tevent_req *subreq)
 
 	talloc_free(reply);
 
+	ret = stat(state->db_path, &st);
+	if (ret != 0) {
+		st.st_size = 0;
+	}
+
+	subreq = recdb_budget_reserve_send(state, state->ev, state->budget,
+					   st.st_size);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, recover_db_reserved, req);
+}
+
+static void recover_db_reserved(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct recover_db_state *state = tevent_req_data(
+		req, struct recover_db_state);
+	struct ctdb_req_control request;
+	int ret;
+	bool status;
+
+	/* Keep the reservation until the recovery database is gone */
+	status = recdb_budget_reserve_recv(subreq, &ret);
+	if (! status) {
+		TALLOC_FREE(subreq);
+		tevent_req_error(req, ret);
+		return;
+	}
+	state->reservation = subreq;
+
 	ctdb_req_control_db_freeze(&request, state->db_id);
 	subreq = ctdb_client_control_multi_send(state, state->ev,
 						state->client,
@@ -1682,13 +1840,74 @@ static void recover_db_transaction_started(struct tevent_req *subreq)
 				state->pnn_list, state->count, state->caps,
 				state->ban_credits, state->db_id,
 				state->recdb);
+	} else if (state->prev_generation != INVALID_GENERATION) {
+		state->recdb->delta = true;
+		subreq = collect_all_db_send(
+				state, state->ev, state->client,
+				state->pnn_list, state->count, state->caps,
+				state->ban_credits, state->db_id,
+				state->recdb, state->prev_generation);
+		if (tevent_req_nomem(subreq, req)) {
+			return;
+		}
+		tevent_req_set_callback(subreq, recover_db_collect_delta_done,
+					req);
+		return;
 	} else {
 		subreq = collect_all_db_send(
 				state, state->ev, state->client,
 				state->pnn_list, state->count, state->caps,
 				state->ban_credits, state->db_id,
-				state->recdb);
+				state->recdb, INVALID_GENERATION);
+	}
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, recover_db_collect_done, req);
+}
+
+static void recover_db_collect_delta_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct recover_db_state *state = tevent_req_data(
+		req, struct recover_db_state);
+	int ret;
+	bool status;
+
+	status = collect_all_db_recv(subreq, &ret);
+	TALLOC_FREE(subreq);
+	if (status) {
+		/* Nothing to wipe, only the changed records are pushed */
+		subreq = push_database_send(state, state->ev, state->client,
+					    state->pnn_list, state->count,
+					    state->caps, state->tun_list,
+					    state->recdb);
+		if (tevent_req_nomem(subreq, req)) {
+			return;
+		}
+		tevent_req_set_callback(subreq, recover_db_pushdb_done, req);
+		return;
+	}
+
+	D_NOTICE("Delta recovery not possible for db %s, ret=%d,"
+		 " collecting all records\n", state->db_name, ret);
+
+	/* Start again with an empty recovery database */
+	TALLOC_FREE(state->recdb);
+	state->recdb = recdb_create(state, state->db_id, state->db_name,
+				    state->db_path,
+				    state->tun_list->database_hash_size,
+				    false);
+	if (tevent_req_nomem(state->recdb, req)) {
+		return;
 	}
+
+	subreq = collect_all_db_send(state, state->ev, state->client,
+				     state->pnn_list, state->count,
+				     state->caps, state->ban_credits,
+				     state->db_id, state->recdb,
+				     INVALID_GENERATION);
 	if (tevent_req_nomem(subreq, req)) {
 		return;
 	}
@@ -1787,6 +2006,7 @@ static void recover_db_pushdb_done(struct tevent_req *subreq)
 	}
 
 	TALLOC_FREE(state->recdb);
+	TALLOC_FREE(state->reservation);
 
 	ctdb_req_control_db_transaction_commit(&request, &state->transdb);
 	subreq = ctdb_client_control_multi_send(state, state->ev,
@@ -1892,6 +2112,7 @@ static bool recover_db_recv(struct tevent_req *req)
 struct db_recovery_state {
 	struct tevent_context *ev;
 	struct ctdb_dbid_map *dbmap;
+	struct recdb_budget budget;
 	unsigned int num_replies;
 	unsigned int num_failed;
 };
@@ -1906,6 +2127,7 @@ struct db_recovery_one_state {
 	uint32_t *caps;
 	uint32_t *ban_credits;
 	uint32_t generation;
+	uint32_t prev_generation;
 	uint32_t db_id;
 	uint8_t db_flags;
 	int num_fails;
@@ -1921,7 +2143,8 @@ static struct tevent_req *db_recovery_send(TALLOC_CTX *mem_ctx,
 					   uint32_t *pnn_list, int count,
 					   uint32_t *caps,
 					   uint32_t *ban_credits,
-					   uint32_t generation)
+					   uint32_t generation,
+					   uint32_t prev_generation)
 {
 	struct tevent_req *req, *subreq;
 	struct db_recovery_state *state;
@@ -1936,6 +2159,7 @@ static struct tevent_req *db_recovery_send(TALLOC_CTX *mem_ctx,
 	state->dbmap = dbmap;
 	state->num_replies = 0;
 	state->num_failed = 0;
+	recdb_budget_init(&state->budget, tun_list->recovery_memory_limit);
 
 	if (dbmap->num == 0) {
 		tevent_req_done(req);
@@ -1959,13 +2183,15 @@ static struct tevent_req *db_recovery_send(TALLOC_CTX *mem_ctx,
 		substate->caps = caps;
 		substate->ban_credits = ban_credits;
 		substate->generation = generation;
+		substate->prev_generation = prev_generation;
 		substate->db_id = dbmap->dbs[i].db_id;
 		substate->db_flags = dbmap->dbs[i].flags;
 
 		subreq = recover_db_send(state, ev, client, tun_list,
 					 pnn_list, count, caps, ban_credits,
-					 generation, substate->db_id,
-					 substate->db_flags);
+					 generation, prev_generation,
+					 &state->budget,
+					 substate->db_id, substate->db_flags);
 		if (tevent_req_nomem(subreq, req)) {
 			return tevent_req_post(req, ev);
 		}
@@ -1996,11 +2222,18 @@ static void db_recovery_one_done(struct tevent_req *subreq)
 
 	substate->num_fails += 1;
 	if (substate->num_fails < NUM_RETRIES) {
+		/*
+		 * A failed attempt may have left the nodes with different
+		 * records, so always do a full recovery on retry
+		 */
 		subreq = recover_db_send(state, state->ev, substate->client,
 					 substate->tun_list,
 					 substate->pnn_list, substate->count,
 					 substate->caps, substate->ban_credits,
-					 substate->generation, substate->db_id,
+					 substate->generation,
+					 INVALID_GENERATION,
+					 &state->budget,
+					 substate->db_id,
 					 substate->db_flags);
 		if (tevent_req_nomem(subreq, req)) {
 			goto failed;
@@ -2063,6 +2296,7 @@ struct recovery_state {
 	struct tevent_context *ev;
 	struct ctdb_client_context *client;
 	uint32_t generation;
+	uint32_t prev_generation;
 	uint32_t *pnn_list;
 	unsigned int count;
 	uint32_t destnode;
@@ -2236,6 +2470,9 @@ static void recovery_vnnmap_done(struct tevent_req *subreq)
 		return;
 	}
 
+	/* Generation of the last recovery, for delta recovery */
+	state->prev_generation = state->vnnmap->generation;
+
 	ctdb_req_control_get_capabilities(&request);
 	subreq = ctdb_client_control_multi_send(state, state->ev,
 						state->client,
@@ -2530,7 +2767,8 @@ static void recovery_vnnmap_update_done(struct tevent_req *subreq)
 				  state->dbmap, state->tun_list,
 				  state->pnn_list, state->count,
 				  state->caps, state->ban_credits,
-				  state->vnnmap->generation);
+				  state->vnnmap->generation,
+				  state->prev_generation);
 	if (tevent_req_nomem(subreq, req)) {
 		return;
 	}
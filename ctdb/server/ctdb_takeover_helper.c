@@ -81,6 +81,8 @@ determine_algorithm(const struct ctdb_tunable_list *tunables)
 		return IPALLOC_NONDETERMINISTIC;
 	case 2:
 		return IPALLOC_LCP2;
+	case 3:
+		return IPALLOC_LOAD;
 	default:
 		return IPALLOC_LCP2;
 	};
@@ -227,6 +229,169 @@ static bool get_public_ips_recv(struct tevent_req *req, int *perr,
 
 /**********************************************************************/
 
+/*
+ * Fetch the load on each hosted public IP, for load-aware IP
+ * allocation.  The load on an IP is the number of client connections
+ * its hosting node has registered for it, taken from the tickle list.
+ * This is best effort: if the hosting node can not be asked then the
+ * IP is treated as idle.
+ */
+
+struct get_ip_loads_state {
+	struct ipalloc_ip_load *loads;
+	unsigned int num_loads;
+	unsigned int num_sent;
+	unsigned int num_replies;
+};
+
+struct get_ip_loads_one_state {
+	struct tevent_req *req;
+	struct ipalloc_ip_load *load;
+	uint32_t pnn;
+};
+
+static void get_ip_loads_done(struct tevent_req *subreq);
+
+static struct tevent_req *get_ip_loads_send(
+				TALLOC_CTX *mem_ctx,
+				struct tevent_context *ev,
+				struct ctdb_client_context *client,
+				struct timeval timeout,
+				struct ctdb_public_ip_list *known_ips,
+				unsigned int num_nodes)
+{
+	struct tevent_req *req, *subreq;
+	struct get_ip_loads_state *state;
+	struct ctdb_req_control request;
+	unsigned int i, j, num;
+
+	req = tevent_req_create(mem_ctx, &state, struct get_ip_loads_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	/* Only the node hosting an IP knows its connections */
+	num = 0;
+	for (i = 0; i < num_nodes; i++) {
+		for (j = 0; j < known_ips[i].num; j++) {
+			if (known_ips[i].ip[j].pnn == i) {
+				num++;
+			}
+		}
+	}
+
+	state->loads = talloc_zero_array(state, struct ipalloc_ip_load, num);
+	if (tevent_req_nomem(state->loads, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	for (i = 0; i < num_nodes; i++) {
+		for (j = 0; j < known_ips[i].num; j++) {
+			struct get_ip_loads_one_state *substate;
+			struct ctdb_public_ip *ip = &known_ips[i].ip[j];
+
+			if (ip->pnn != i) {
+				continue;
+			}
+
+			substate = talloc_zero(state,
+					       struct get_ip_loads_one_state);
+			if (tevent_req_nomem(substate, req)) {
+				return tevent_req_post(req, ev);
+			}
+
+			substate->req = req;
+			substate->pnn = i;
+			substate->load = &state->loads[state->num_loads];
+			substate->load->addr = ip->addr;
+			state->num_loads++;
+
+			ctdb_req_control_get_tcp_tickle_list(&request,
+							     &ip->addr);
+			subreq = ctdb_client_control_send(state, ev, client,
+							  i, timeout,
+							  &request);
+			if (tevent_req_nomem(subreq, req)) {
+				return tevent_req_post(req, ev);
+			}
+			tevent_req_set_callback(subreq, get_ip_loads_done,
+						substate);
+
+			state->num_sent++;
+		}
+	}
+
+	if (state->num_sent == 0) {
+		tevent_req_done(req);
+		return tevent_req_post(req, ev);
+	}
+
+	return req;
+}
+
+static void get_ip_loads_done(struct tevent_req *subreq)
+{
+	struct get_ip_loads_one_state *substate = tevent_req_callback_data(
+		subreq, struct get_ip_loads_one_state);
+	struct tevent_req *req = substate->req;
+	struct get_ip_loads_state *state = tevent_req_data(
+		req, struct get_ip_loads_state);
+	struct ctdb_reply_control *reply;
+	struct ctdb_tickle_list *tickles;
+	int ret;
+	bool status;
+
+	status = ctdb_client_control_recv(subreq, &ret, substate, &reply);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		D_WARNING("control GET_TCP_TICKLE_LIST failed on node %u, "
+			  "ret=%d\n", substate->pnn, ret);
+		goto done;
+	}
+
+	ret = ctdb_reply_control_get_tcp_tickle_list(reply, substate,
+						     &tickles);
+	if (ret != 0) {
+		D_WARNING("control GET_TCP_TICKLE_LIST failed on node %u, "
+			  "ret=%d\n", substate->pnn, ret);
+		goto done;
+	}
+
+	substate->load->load = tickles->num;
+
+done:
+	talloc_free(substate);
+
+	state->num_replies++;
+	if (state->num_replies == state->num_sent) {
+		tevent_req_done(req);
+	}
+}
+
+static bool get_ip_loads_recv(struct tevent_req *req, int *perr,
+			      TALLOC_CTX *mem_ctx,
+			      struct ipalloc_ip_load **loads,
+			      unsigned int *num_loads)
+{
+	struct get_ip_loads_state *state = tevent_req_data(
+		req, struct get_ip_loads_state);
+	int err;
+
+	if (tevent_req_is_unix_error(req, &err)) {
+		if (perr != NULL) {
+			*perr = err;
+		}
+		return false;
+	}
+
+	*loads = talloc_steal(mem_ctx, state->loads);
+	*num_loads = state->num_loads;
+
+	return true;
+}
+
+/**********************************************************************/
+
 struct release_ip_state {
 	int num_sent;
 	int num_replies;
@@ -680,6 +845,7 @@ static bool ipreallocated_recv(struct tevent_req *req, int *perr)
  * - Use ipalloc_set_public_ips() to set known and available IP
  *   addresses for allocation
  * - If cluster can't host IP addresses then jump to IPREALLOCATED
+ * - For load-aware allocation, fetch the load on each hosted IP
  * - Run IP allocation algorithm
  * - Send RELEASE_IP to all nodes for IPs they should not host
  * - Send TAKE_IP to all nodes for IPs they should host
@@ -708,6 +874,8 @@ static void takeover_tunables_done(struct tevent_req *subreq);
 static void takeover_nodemap_done(struct tevent_req *subreq);
 static void takeover_known_ips_done(struct tevent_req *subreq);
 static void takeover_avail_ips_done(struct tevent_req *subreq);
+static void takeover_ip_loads_done(struct tevent_req *subreq);
+static void takeover_ipalloc(struct tevent_req *req);
 static void takeover_release_ip_done(struct tevent_req *subreq);
 static void takeover_take_ip_done(struct tevent_req *subreq);
 static void takeover_ipreallocated(struct tevent_req *req);
@@ -952,6 +1120,51 @@ static void takeover_avail_ips_done(struct tevent_req *subreq)
 		return;
 	}
 
+	if (determine_algorithm(state->tun_list) == IPALLOC_LOAD) {
+		subreq = get_ip_loads_send(state, state->ev, state->client,
+					   TIMEOUT(), state->known_ips,
+					   state->num_nodes);
+		if (tevent_req_nomem(subreq, req)) {
+			return;
+		}
+		tevent_req_set_callback(subreq, takeover_ip_loads_done, req);
+		return;
+	}
+
+	takeover_ipalloc(req);
+}
+
+static void takeover_ip_loads_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct takeover_state *state = tevent_req_data(
+		req, struct takeover_state);
+	struct ipalloc_ip_load *loads;
+	unsigned int num_loads;
+	bool status;
+	int ret;
+
+	status = get_ip_loads_recv(subreq, &ret, state, &loads, &num_loads);
+	TALLOC_FREE(subreq);
+
+	if (! status) {
+		D_ERR("Failed to fetch public IP loads\n");
+		takeover_failed(req, ret);
+		return;
+	}
+
+	ipalloc_set_ip_loads(state->ipalloc_state, loads, num_loads);
+
+	takeover_ipalloc(req);
+}
+
+static void takeover_ipalloc(struct tevent_req *req)
+{
+	struct takeover_state *state = tevent_req_data(
+		req, struct takeover_state);
+	struct tevent_req *subreq;
+
 	/* Do the IP reassignment calculations */
 	state->all_ips = ipalloc(state->ipalloc_state);
 	if (tevent_req_nomem(state->all_ips, req)) {
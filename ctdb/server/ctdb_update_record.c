@@ -26,6 +26,7 @@
 #include <tevent.h>
 
 #include "lib/tdb_wrap/tdb_wrap.h"
+#include "lib/util/dlinklist.h"
 #include "lib/util/debug.h"
 #include "lib/util/samba_util.h"
 #include "lib/util/sys_rw.h"
@@ -42,18 +43,39 @@
 #define pipe(A) os2_pipe(A)
 #endif
 
+struct ctdb_persistent_write_batch;
+
 struct ctdb_persistent_write_state {
+	struct ctdb_persistent_write_state *prev, *next;
 	struct ctdb_db_context *ctdb_db;
 	struct ctdb_marshall_buffer *m;
 	struct ctdb_req_control_old *c;
 	uint32_t flags;
+	/* batch being written, NULL while queued */
+	struct ctdb_persistent_write_batch *batch;
+	unsigned int index;
+};
+
+/*
+ * Group commit: the update record controls that arrive for a database
+ * while a child is writing are queued, and the next child writes all of
+ * them in a single tdb transaction.
+ */
+struct ctdb_persistent_write_batch {
+	struct ctdb_db_context *ctdb_db;
+	struct ctdb_persistent_write_state **states;
+	unsigned int count;
 };
 
+/* maximum number of update record controls written by one child */
+#define UPDATE_RECORD_BATCH_MAX	64
+
 /* don't create/update records that does not exist locally */
 #define UPDATE_FLAGS_REPLACE_ONLY	1
 
 /*
-  called from a child process to write the data
+  called from a child process to write the data of one control, inside
+  the transaction for the batch
  */
 static int ctdb_persistent_store(struct ctdb_persistent_write_state *state)
 {
@@ -62,13 +84,6 @@ static int ctdb_persistent_store(struct ctdb_persistent_write_state *state)
 	struct ctdb_rec_data_old *rec = NULL;
 	struct ctdb_marshall_buffer *m = state->m;
 
-	ret = tdb_transaction_start(state->ctdb_db->ltdb->tdb);
-	if (ret == -1) {
-		DEBUG(DEBUG_ERR,("Failed to start transaction for db_id 0x%08x in ctdb_persistent_store\n",
-				 state->ctdb_db->db_id));
-		return -1;
-	}
-
 	for (i=0;i<m->count;i++) {
 		struct ctdb_ltdb_header oldheader;
 		struct ctdb_ltdb_header header;
@@ -83,7 +98,7 @@ static int ctdb_persistent_store(struct ctdb_persistent_write_state *state)
 			      i,
 			      state->ctdb_db->db_id);
 			talloc_free(tmp_ctx);
-			goto failed;
+			return -1;
 		}
 
 		/* we must check if the record exists or not because
@@ -105,7 +120,7 @@ static int ctdb_persistent_store(struct ctdb_persistent_write_state *state)
 			DEBUG(DEBUG_ERR,("Failed to fetch old record for db_id 0x%08x in ctdb_persistent_store\n",
 					 state->ctdb_db->db_id));
 			talloc_free(tmp_ctx);
-			goto failed;
+			return -1;
 		}
 
 		if (oldheader.rsn >= header.rsn &&
@@ -115,7 +130,7 @@ static int ctdb_persistent_store(struct ctdb_persistent_write_state *state)
 					  state->ctdb_db->db_id,
 					  (unsigned long long)oldheader.rsn, (unsigned long long)header.rsn));
 			talloc_free(tmp_ctx);
-			goto failed;
+			return -1;
 		}
 
 		talloc_free(tmp_ctx);
@@ -124,38 +139,149 @@ static int ctdb_persistent_store(struct ctdb_persistent_write_state *state)
 		if (ret != 0) {
 			DEBUG(DEBUG_CRIT,("Failed to store record for db_id 0x%08x in ctdb_persistent_store\n",
 					  state->ctdb_db->db_id));
-			goto failed;
+			return -1;
 		}
 	}
 
-	ret = tdb_transaction_commit(state->ctdb_db->ltdb->tdb);
+	return 0;
+}
+
+/*
+  called from a child process to write the data of all the controls in
+  a batch in one transaction.
+
+  A control that fails is left out and the transaction is redone
+  without it, so the other controls in the batch see the same result
+  as if they had been written one at a time.
+ */
+static void ctdb_persistent_store_batch(struct ctdb_persistent_write_batch *batch,
+					uint8_t *status)
+{
+	struct tdb_context *tdb = batch->ctdb_db->ltdb->tdb;
+	unsigned int i;
+	int ret;
+
+again:
+	ret = tdb_transaction_start(tdb);
+	if (ret == -1) {
+		DEBUG(DEBUG_ERR,("Failed to start transaction for db_id 0x%08x in ctdb_persistent_store\n",
+				 batch->ctdb_db->db_id));
+		goto failed;
+	}
+
+	for (i=0; i<batch->count; i++) {
+		if (status[i] != 0) {
+			continue;
+		}
+
+		ret = ctdb_persistent_store(batch->states[i]);
+		if (ret != 0) {
+			status[i] = 1;
+			tdb_transaction_cancel(tdb);
+			goto again;
+		}
+	}
+
+	ret = tdb_transaction_commit(tdb);
 	if (ret == -1) {
 		DEBUG(DEBUG_ERR,("Failed to commit transaction for db_id 0x%08x in ctdb_persistent_store\n",
-				 state->ctdb_db->db_id));
-		return -1;
+				 batch->ctdb_db->db_id));
+		goto failed;
 	}
 
-	return 0;
+	return;
 
 failed:
-	tdb_transaction_cancel(state->ctdb_db->ltdb->tdb);
-	return -1;
+	for (i=0; i<batch->count; i++) {
+		status[i] = 1;
+	}
 }
 
+static int ctdb_persistent_write_start(struct ctdb_db_context *ctdb_db);
+
+/*
+  start a child for the update record controls queued while the last
+  one was busy
+ */
+static void ctdb_persistent_write_next(struct ctdb_db_context *ctdb_db)
+{
+	int ret;
+
+	if (ctdb_db->pending_writes == NULL) {
+		return;
+	}
+
+	ret = ctdb_persistent_write_start(ctdb_db);
+	if (ret != 0) {
+		DEBUG(DEBUG_ERR, ("Failed to setup childwrite handler for "
+				  "queued update record controls\n"));
+		while (ctdb_db->pending_writes != NULL) {
+			struct ctdb_persistent_write_state *state =
+				ctdb_db->pending_writes;
+
+			ctdb_request_control_reply(ctdb_db->ctdb, state->c,
+						   NULL, -1, NULL);
+			talloc_free(state);
+		}
+	}
+}
+
+/*
+  kill the child writing a batch and put the controls of the batch back
+  at the head of the queue, in their original order
+ */
+static void ctdb_persistent_write_abort(
+				struct ctdb_persistent_write_batch *batch)
+{
+	struct ctdb_db_context *ctdb_db = batch->ctdb_db;
+	unsigned int i;
+
+	for (i = batch->count; i > 0; i--) {
+		struct ctdb_persistent_write_state *state =
+			batch->states[i-1];
+
+		if (state == NULL) {
+			continue;
+		}
+
+		state->batch = NULL;
+		DLIST_ADD(ctdb_db->pending_writes, state);
+	}
+
+	ctdb_db->write_batch = NULL;
+
+	/* freeing the childwrite handle kills the child */
+	talloc_free(batch);
+}
 
 /*
   called when we the child has completed the persistent write
   on our behalf
  */
-static void ctdb_persistent_write_callback(int status, void *private_data)
+static void ctdb_persistent_write_callback(const uint8_t *status,
+					   void *private_data)
 {
-	struct ctdb_persistent_write_state *state = talloc_get_type(private_data,
-								   struct ctdb_persistent_write_state);
+	struct ctdb_persistent_write_batch *batch = talloc_get_type_abort(
+		private_data, struct ctdb_persistent_write_batch);
+	struct ctdb_db_context *ctdb_db = batch->ctdb_db;
+	unsigned int i;
 
+	for (i=0; i<batch->count; i++) {
+		struct ctdb_persistent_write_state *state = batch->states[i];
 
-	ctdb_request_control_reply(state->ctdb_db->ctdb, state->c, NULL, status, NULL);
+		if (state == NULL) {
+			continue;
+		}
 
-	talloc_free(state);
+		ctdb_request_control_reply(ctdb_db->ctdb, state->c, NULL,
+					   status[i], NULL);
+		talloc_free(state);
+	}
+
+	ctdb_db->write_batch = NULL;
+	talloc_free(batch);
+
+	ctdb_persistent_write_next(ctdb_db);
 }
 
 /*
@@ -167,8 +293,34 @@ static void ctdb_persistent_lock_timeout(struct tevent_context *ev,
 {
 	struct ctdb_persistent_write_state *state = talloc_get_type(private_data,
 								   struct ctdb_persistent_write_state);
-	ctdb_request_control_reply(state->ctdb_db->ctdb, state->c, NULL, -1, "timeout in ctdb_persistent_lock");
+	struct ctdb_db_context *ctdb_db = state->ctdb_db;
+
+	/* The control must not be written once it has been failed.  If
+	   it is being written, kill the child before replying and let a
+	   new child write the rest of the batch.
+	*/
+	if (state->batch != NULL) {
+		ctdb_persistent_write_abort(state->batch);
+	}
+
+	ctdb_request_control_reply(ctdb_db->ctdb, state->c, NULL, -1, "timeout in ctdb_persistent_lock");
 	talloc_free(state);
+
+	if (ctdb_db->write_batch == NULL) {
+		ctdb_persistent_write_next(ctdb_db);
+	}
+}
+
+static int ctdb_persistent_write_state_destructor(
+				struct ctdb_persistent_write_state *state)
+{
+	if (state->batch != NULL) {
+		state->batch->states[state->index] = NULL;
+	} else {
+		DLIST_REMOVE(state->ctdb_db->pending_writes, state);
+	}
+
+	return 0;
 }
 
 struct childwrite_handle {
@@ -178,7 +330,8 @@ struct childwrite_handle {
 	int fd[2];
 	pid_t child;
 	void *private_data;
-	void (*callback)(int, void *);
+	void (*callback)(const uint8_t *, void *);
+	unsigned int num_status;
 	struct timeval start_time;
 };
 
@@ -199,11 +352,11 @@ static void childwrite_handler(struct tevent_context *ev,
 	struct childwrite_handle *h = talloc_get_type(private_data,
 						     struct childwrite_handle);
 	void *p = h->private_data;
-	void (*callback)(int, void *) = h->callback;
+	void (*callback)(const uint8_t *, void *) = h->callback;
 	pid_t child = h->child;
 	TALLOC_CTX *tmp_ctx = talloc_new(ev);
-	int ret;
-	char c;
+	uint8_t status[UPDATE_RECORD_BATCH_MAX];
+	ssize_t ret;
 
 	CTDB_UPDATE_LATENCY(h->ctdb, h->ctdb_db, "persistent", childwrite_latency, h->start_time);
 	CTDB_DECREMENT_STAT(h->ctdb, pending_childwrite_calls);
@@ -215,25 +368,26 @@ static void childwrite_handler(struct tevent_context *ev,
 
 	talloc_set_destructor(h, NULL);
 
-	ret = sys_read(h->fd[0], &c, 1);
-	if (ret < 1) {
-		DEBUG(DEBUG_ERR, (__location__ " Read returned %d. Childwrite failed\n", ret));
-		c = 1;
+	ret = sys_read(h->fd[0], status, h->num_status);
+	if (ret != (ssize_t)h->num_status) {
+		DEBUG(DEBUG_ERR, (__location__ " Read returned %zd. Childwrite failed\n", ret));
+		memset(status, 1, sizeof(status));
 	}
 
-	callback(c, p);
+	callback(status, p);
 
 	ctdb_kill(h->ctdb, child, SIGKILL);
 	talloc_free(tmp_ctx);
 }
 
 /* this creates a child process which will take out a tdb transaction
-   and write the record to the database.
+   and write the records of a batch to the database.
 */
 static struct childwrite_handle *ctdb_childwrite(
 				struct ctdb_db_context *ctdb_db,
-				void (*callback)(int, void *private_data),
-				struct ctdb_persistent_write_state *state)
+				void (*callback)(const uint8_t *status,
+						 void *private_data),
+				struct ctdb_persistent_write_batch *batch)
 {
 	struct childwrite_handle *result;
 	int ret;
@@ -242,7 +396,7 @@ static struct childwrite_handle *ctdb_childwrite(
 	CTDB_INCREMENT_STAT(ctdb_db->ctdb, childwrite_calls);
 	CTDB_INCREMENT_STAT(ctdb_db->ctdb, pending_childwrite_calls);
 
-	if (!(result = talloc_zero(state, struct childwrite_handle))) {
+	if (!(result = talloc_zero(batch, struct childwrite_handle))) {
 		CTDB_DECREMENT_STAT(ctdb_db->ctdb, pending_childwrite_calls);
 		return NULL;
 	}
@@ -266,22 +420,22 @@ static struct childwrite_handle *ctdb_childwrite(
 	}
 
 	result->callback = callback;
-	result->private_data = state;
+	result->private_data = batch;
+	result->num_status = batch->count;
 	result->ctdb = ctdb_db->ctdb;
 	result->ctdb_db = ctdb_db;
 
 	if (result->child == 0) {
-		char c = 0;
+		uint8_t status[UPDATE_RECORD_BATCH_MAX] = { 0 };
 
 		close(result->fd[0]);
 		prctl_set_comment("ctdb_write_persistent");
-		ret = ctdb_persistent_store(state);
-		if (ret != 0) {
+		ctdb_persistent_store_batch(batch, status);
+		if (memchr(status, 1, batch->count) != NULL) {
 			DEBUG(DEBUG_ERR, (__location__ " Failed to write persistent data\n"));
-			c = 1;
 		}
 
-		sys_write(result->fd[1], &c, 1);
+		sys_write(result->fd[1], status, batch->count);
 
 		ctdb_wait_for_process_to_exit(parent);
 		_exit(0);
@@ -309,6 +463,55 @@ static struct childwrite_handle *ctdb_childwrite(
 	return result;
 }
 
+/*
+  start a child to write the queued update record controls of a database
+ */
+static int ctdb_persistent_write_start(struct ctdb_db_context *ctdb_db)
+{
+	struct ctdb_persistent_write_batch *batch;
+	struct ctdb_persistent_write_state *state;
+	struct childwrite_handle *handle;
+	unsigned int i;
+
+	batch = talloc_zero(ctdb_db->ctdb, struct ctdb_persistent_write_batch);
+	if (batch == NULL) {
+		return -1;
+	}
+	batch->ctdb_db = ctdb_db;
+
+	batch->states = talloc_array(batch,
+				     struct ctdb_persistent_write_state *,
+				     UPDATE_RECORD_BATCH_MAX);
+	if (batch->states == NULL) {
+		talloc_free(batch);
+		return -1;
+	}
+
+	for (state = ctdb_db->pending_writes;
+	     state != NULL && batch->count < UPDATE_RECORD_BATCH_MAX;
+	     state = state->next) {
+		batch->states[batch->count++] = state;
+	}
+
+	handle = ctdb_childwrite(ctdb_db, ctdb_persistent_write_callback,
+				 batch);
+	if (handle == NULL) {
+		talloc_free(batch);
+		return -1;
+	}
+
+	for (i=0; i<batch->count; i++) {
+		state = batch->states[i];
+		DLIST_REMOVE(ctdb_db->pending_writes, state);
+		state->batch = batch;
+		state->index = i;
+	}
+
+	ctdb_db->write_batch = batch;
+
+	return 0;
+}
+
 /*
    update a record on this node if the new record has a higher rsn than the
    current record
@@ -319,8 +522,8 @@ int32_t ctdb_control_update_record(struct ctdb_context *ctdb,
 {
 	struct ctdb_db_context *ctdb_db;
 	struct ctdb_persistent_write_state *state;
-	struct childwrite_handle *handle;
 	struct ctdb_marshall_buffer *m = (struct ctdb_marshall_buffer *)recdata.dptr;
+	int ret;
 
 	if (ctdb->recovery_mode != CTDB_RECOVERY_NORMAL) {
 		DEBUG(DEBUG_INFO,("rejecting ctdb_control_update_record when recovery active\n"));
@@ -339,7 +542,7 @@ int32_t ctdb_control_update_record(struct ctdb_context *ctdb,
 		return -1;
 	}
 
-	state = talloc(ctdb, struct ctdb_persistent_write_state);
+	state = talloc_zero(ctdb, struct ctdb_persistent_write_state);
 	CTDB_NO_MEMORY(ctdb, state);
 
 	state->ctdb_db = ctdb_db;
@@ -350,14 +553,20 @@ int32_t ctdb_control_update_record(struct ctdb_context *ctdb,
 		state->flags   = UPDATE_FLAGS_REPLACE_ONLY;
 	}
 
+	DLIST_ADD_END(ctdb_db->pending_writes, state);
+	talloc_set_destructor(state, ctdb_persistent_write_state_destructor);
+
 	/* create a child process to take out a transaction and
-	   write the data.
+	   write the data, unless a child is already busy.  The
+	   control is then written by the next child.
 	*/
-	handle = ctdb_childwrite(ctdb_db, ctdb_persistent_write_callback, state);
-	if (handle == NULL) {
-		DEBUG(DEBUG_ERR,("Failed to setup childwrite handler in ctdb_control_update_record\n"));
-		talloc_free(state);
-		return -1;
+	if (ctdb_db->write_batch == NULL) {
+		ret = ctdb_persistent_write_start(ctdb_db);
+		if (ret != 0) {
+			DEBUG(DEBUG_ERR,("Failed to setup childwrite handler in ctdb_control_update_record\n"));
+			talloc_free(state);
+			return -1;
+		}
 	}
 
 	/* we need to wait for the replies */
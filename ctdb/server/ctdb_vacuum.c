@@ -28,6 +28,7 @@
 #include <tevent.h>
 
 #include "lib/tdb_wrap/tdb_wrap.h"
+#include "lib/util/bitmap.h"
 #include "lib/util/dlinklist.h"
 #include "lib/util/debug.h"
 #include "lib/util/samba_util.h"
@@ -57,12 +58,21 @@ struct ctdb_vacuum_child_context {
 	pid_t child_pid;
 	enum vacuum_child_status status;
 	struct timeval start_time;
+	/* hash chains handed over to the child */
+	struct bitmap *chains;
 };
 
 struct ctdb_vacuum_handle {
 	struct ctdb_db_context *ctdb_db;
 	struct ctdb_vacuum_child_context *child_ctx;
 	uint32_t fast_path_count;
+	/*
+	 * Hash chains that may contain empty records which are not in
+	 * the delete queue.  NULL if the chain of a record can not be
+	 * determined for this database.
+	 */
+	struct bitmap *dirty_chains;
+	unsigned int num_chains;
 };
 
 
@@ -76,6 +86,7 @@ struct vacuum_data {
 	struct timeval start;
 	bool traverse_error;
 	bool vacuum;
+	bool incremental;
 	struct {
 		struct {
 			uint32_t added_to_vacuum_fetch_list;
@@ -90,6 +101,7 @@ struct vacuum_data {
 			uint32_t skipped;
 			uint32_t error;
 			uint32_t total;
+			uint32_t chains;
 		} db_traverse;
 		struct {
 			uint32_t total;
@@ -125,6 +137,45 @@ static int insert_record_into_delete_queue(struct ctdb_db_context *ctdb_db,
 					   const struct ctdb_ltdb_header *hdr,
 					   TDB_DATA key);
 
+/*
+ * Return the tdb hash chain of a record, or -1 if it is not known.
+ *
+ * ctdb opens volatile databases with TDB_INCOMPATIBLE_HASH, so the
+ * chain can be calculated without looking into the database.
+ */
+static int vacuum_key_chain(struct ctdb_db_context *ctdb_db, TDB_DATA key)
+{
+	struct tdb_context *tdb = ctdb_db->ltdb->tdb;
+
+	if ((tdb_get_flags(tdb) & TDB_INCOMPATIBLE_HASH) == 0) {
+		return -1;
+	}
+
+	return tdb_jenkins_hash(&key) % tdb_hash_size(tdb);
+}
+
+/*
+ * Remember that the chain of a record has to be scanned, because the
+ * record could not be added to the delete queue
+ */
+static void vacuum_mark_chain_dirty(struct ctdb_db_context *ctdb_db,
+				    TDB_DATA key)
+{
+	struct ctdb_vacuum_handle *vh = ctdb_db->vacuum_handle;
+	int chain;
+
+	if (vh == NULL || vh->dirty_chains == NULL) {
+		return;
+	}
+
+	chain = vacuum_key_chain(ctdb_db, key);
+	if (chain == -1) {
+		return;
+	}
+
+	bitmap_set(vh->dirty_chains, chain);
+}
+
 /**
  * Store key and header in a tree, indexed by the key hash.
  */
@@ -314,6 +365,28 @@ static int delete_marshall_traverse(void *param, void *data)
 	return 0;
 }
 
+/*
+ * In incremental mode there is no full traverse to find the records
+ * that could not be deleted in this run, so hand them back to the
+ * main daemon for the next run.
+ */
+static void vacuum_requeue_record(struct vacuum_data *vdata,
+				  struct delete_record_data *dd)
+{
+	int ret;
+
+	if (!vdata->incremental) {
+		return;
+	}
+
+	ret = ctdb_local_schedule_for_deletion(dd->ctdb_db, &dd->hdr, dd->key);
+	if (ret != 0) {
+		DEBUG(DEBUG_ERR, (__location__ " Failed to requeue record "
+				  "with key hash [0x%08x] for deletion\n",
+				  ctdb_hash(&dd->key)));
+	}
+}
+
 /**
  * traverse function for the traversal of the delete_queue,
  * the fast-path vacuuming list.
@@ -351,6 +424,7 @@ static int delete_queue_traverse(void *param, void *data)
 	res = tdb_chainlock_nonblock(ctdb_db->ltdb->tdb, dd->key);
 	if (res != 0) {
 		vdata->count.delete_queue.error++;
+		vacuum_requeue_record(vdata, dd);
 		return 0;
 	}
 
@@ -392,6 +466,7 @@ static int delete_queue_traverse(void *param, void *data)
 			      (__location__ " Error adding record to list "
 			       "of records to send to lmaster.\n"));
 			vdata->count.delete_queue.error++;
+			vacuum_requeue_record(vdata, dd);
 		} else {
 			vdata->count.delete_queue.added_to_vacuum_fetch_list++;
 		}
@@ -407,6 +482,7 @@ static int delete_queue_traverse(void *param, void *data)
 			      (__location__ " Error adding record to list "
 			       "of records for deletion on lmaster.\n"));
 			vdata->count.delete_queue.error++;
+			vacuum_requeue_record(vdata, dd);
 		} else {
 			vdata->count.delete_queue.added_to_delete_list++;
 		}
@@ -419,6 +495,7 @@ static int delete_queue_traverse(void *param, void *data)
 			       "hash [0x%08x] from local data base db[%s].\n",
 			       hash, ctdb_db->db_name));
 			vdata->count.delete_queue.error++;
+			vacuum_requeue_record(vdata, dd);
 			goto done;
 		}
 
@@ -460,6 +537,7 @@ static int delete_record_traverse(void *param, void *data)
 	if (dd->remote_fail_count > 0) {
 		vdata->count.delete_list.remote_error++;
 		vdata->count.delete_list.left--;
+		vacuum_requeue_record(vdata, dd);
 		talloc_free(dd);
 		return 0;
 	}
@@ -472,6 +550,7 @@ static int delete_record_traverse(void *param, void *data)
 		       hash, ctdb_db->db_name));
 		vdata->count.delete_list.local_error++;
 		vdata->count.delete_list.left--;
+		vacuum_requeue_record(vdata, dd);
 		talloc_free(dd);
 		return 0;
 	}
@@ -534,6 +613,7 @@ static int delete_record_traverse(void *param, void *data)
 		       "[0x%08x] from local data base db[%s].\n",
 		       hash, ctdb_db->db_name));
 		vdata->count.delete_list.local_error++;
+		vacuum_requeue_record(vdata, dd);
 		goto done;
 	}
 
@@ -651,6 +731,55 @@ static void ctdb_vacuum_traverse_db(struct ctdb_db_context *ctdb_db,
 	return;
 }
 
+/**
+ * read-only traverse of the hash chains that have been marked dirty,
+ * looking for records that might be able to be vacuumed.
+ *
+ * This replaces the full database traverse in incremental mode.
+ */
+static void ctdb_vacuum_traverse_dirty_chains(struct ctdb_db_context *ctdb_db,
+					      struct vacuum_data *vdata)
+{
+	struct ctdb_vacuum_handle *vh = ctdb_db->vacuum_handle;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < vh->num_chains; i++) {
+		if (!bitmap_query(vh->dirty_chains, i)) {
+			continue;
+		}
+
+		vdata->count.db_traverse.chains++;
+
+		ret = tdb_traverse_chain(ctdb_db->ltdb->tdb, i,
+					 vacuum_traverse, vdata);
+		if (ret == -1) {
+			DEBUG(DEBUG_ERR, (__location__ " Traverse error in "
+					  "vacuuming chain %u of '%s'\n",
+					  i, ctdb_db->db_name));
+			return;
+		}
+	}
+
+	if (vdata->count.db_traverse.chains > 0) {
+		DEBUG(DEBUG_INFO,
+		      (__location__
+		       " incremental vacuuming chain traverse statistics: "
+		       "db[%s] "
+		       "chains[%u] "
+		       "total[%u] "
+		       "skp[%u] "
+		       "err[%u] "
+		       "sched[%u]\n",
+		       ctdb_db->db_name,
+		       (unsigned)vdata->count.db_traverse.chains,
+		       (unsigned)vdata->count.db_traverse.total,
+		       (unsigned)vdata->count.db_traverse.skipped,
+		       (unsigned)vdata->count.db_traverse.error,
+		       (unsigned)vdata->count.db_traverse.scheduled));
+	}
+}
+
 /**
  * Process the vacuum fetch lists:
  * For records for which we are not the lmaster, tell the lmaster to
@@ -958,6 +1087,7 @@ static struct vacuum_data *ctdb_vacuum_init_vacuum_data(
 	vdata->count.db_traverse.skipped = 0;
 	vdata->count.db_traverse.error = 0;
 	vdata->count.db_traverse.total = 0;
+	vdata->count.db_traverse.chains = 0;
 	vdata->count.delete_list.total = 0;
 	vdata->count.delete_list.left = 0;
 	vdata->count.delete_list.remote_error = 0;
@@ -1025,7 +1155,8 @@ fail:
  * This executes in the child context.
  */
 static int ctdb_vacuum_db(struct ctdb_db_context *ctdb_db,
-			  bool full_vacuum_run)
+			  bool full_vacuum_run,
+			  bool incremental)
 {
 	struct ctdb_context *ctdb = ctdb_db->ctdb;
 	int ret, pnn;
@@ -1034,7 +1165,8 @@ static int ctdb_vacuum_db(struct ctdb_db_context *ctdb_db,
 
 	DEBUG(DEBUG_INFO, (__location__ " Entering %s vacuum run for db "
 			   "%s db_id[0x%08x]\n",
-			   full_vacuum_run ? "full" : "fast",
+			   full_vacuum_run ? "full" :
+			   (incremental ? "incremental" : "fast"),
 			   ctdb_db->db_name, ctdb_db->db_id));
 
 	ret = ctdb_ctrl_getvnnmap(ctdb, TIMELIMIT(), CTDB_CURRENT_NODE, ctdb, &ctdb->vnn_map);
@@ -1063,8 +1195,12 @@ static int ctdb_vacuum_db(struct ctdb_db_context *ctdb_db,
 		return -1;
 	}
 
+	vdata->incremental = incremental;
+
 	if (full_vacuum_run) {
 		ctdb_vacuum_traverse_db(ctdb_db, vdata);
+	} else if (incremental) {
+		ctdb_vacuum_traverse_dirty_chains(ctdb_db, vdata);
 	}
 
 	ctdb_process_delete_queue(ctdb_db, vdata);
@@ -1086,14 +1222,15 @@ static int ctdb_vacuum_db(struct ctdb_db_context *ctdb_db,
  * called from the child context
  */
 static int ctdb_vacuum_and_repack_db(struct ctdb_db_context *ctdb_db,
-				     bool full_vacuum_run)
+				     bool full_vacuum_run,
+				     bool incremental)
 {
 	uint32_t repack_limit = ctdb_db->ctdb->tunable.repack_limit;
 	const char *name = ctdb_db->db_name;
 	int freelist_size = 0;
 	int ret;
 
-	if (ctdb_vacuum_db(ctdb_db, full_vacuum_run) != 0) {
+	if (ctdb_vacuum_db(ctdb_db, full_vacuum_run, incremental) != 0) {
 		DEBUG(DEBUG_ERR,(__location__ " Failed to vacuum '%s'\n", name));
 	}
 
@@ -1146,6 +1283,21 @@ static int vacuum_child_destructor(struct ctdb_vacuum_child_context *child_ctx)
 		child_ctx->vacuum_handle->fast_path_count++;
 	}
 
+	if (child_ctx->status != VACUUM_OK && child_ctx->chains != NULL) {
+		/*
+		 * The records handed over to the child may not have
+		 * been processed, so scan their chains in the next run.
+		 */
+		struct ctdb_vacuum_handle *vh = child_ctx->vacuum_handle;
+		unsigned int i;
+
+		for (i = 0; i < vh->num_chains; i++) {
+			if (bitmap_query(child_ctx->chains, i)) {
+				bitmap_set(vh->dirty_chains, i);
+			}
+		}
+	}
+
 	DLIST_REMOVE(ctdb->vacuumers, child_ctx);
 
 	tevent_add_timer(ctdb->ev, child_ctx->vacuum_handle,
@@ -1197,6 +1349,25 @@ static void vacuum_child_handler(struct tevent_context *ev,
 	talloc_free(child_ctx);
 }
 
+/*
+ * remember the chain of a record handed over to the vacuum child
+ */
+static int vacuum_mark_child_chain(void *param, void *data)
+{
+	struct ctdb_vacuum_child_context *child_ctx = talloc_get_type_abort(
+		param, struct ctdb_vacuum_child_context);
+	struct delete_record_data *dd = talloc_get_type_abort(
+		data, struct delete_record_data);
+	int chain;
+
+	chain = vacuum_key_chain(dd->ctdb_db, dd->key);
+	if (chain != -1) {
+		bitmap_set(child_ctx->chains, chain);
+	}
+
+	return 0;
+}
+
 /*
  * this event is called every time we need to start a new vacuum process
  */
@@ -1210,6 +1381,7 @@ static void ctdb_vacuum_event(struct tevent_context *ev,
 	struct ctdb_vacuum_child_context *child_ctx;
 	struct tevent_fd *fde;
 	bool full_vacuum_run = false;
+	bool incremental = false;
 	int ret;
 
 	/* we don't vacuum if we are in recovery mode, or db frozen */
@@ -1252,14 +1424,24 @@ static void ctdb_vacuum_event(struct tevent_context *ev,
 		return;
 	}
 
-	if (vacuum_handle->fast_path_count >=
-	    ctdb->tunable.vacuum_fast_path_count) {
+	if (ctdb->tunable.vacuum_incremental != 0 &&
+	    vacuum_handle->dirty_chains != NULL) {
+		/*
+		 * Only the dirty hash chains are scanned, there is no
+		 * need for a full database traverse.
+		 */
+		incremental = true;
+		vacuum_handle->fast_path_count = 0;
+	} else if (vacuum_handle->fast_path_count >=
+		   ctdb->tunable.vacuum_fast_path_count) {
 		if (ctdb->tunable.vacuum_fast_path_count > 0) {
 			full_vacuum_run = true;
 		}
 		vacuum_handle->fast_path_count = 0;
 	}
 
+	child_ctx->chains = NULL;
+
 	child_ctx->child_pid = ctdb_fork(ctdb);
 	if (child_ctx->child_pid == (pid_t)-1) {
 		close(child_ctx->fd[0]);
@@ -1284,7 +1466,8 @@ static void ctdb_vacuum_event(struct tevent_context *ev,
 			_exit(1);
 		}
 
-		cc = ctdb_vacuum_and_repack_db(ctdb_db, full_vacuum_run);
+		cc = ctdb_vacuum_and_repack_db(ctdb_db, full_vacuum_run,
+					       incremental);
 
 		sys_write(child_ctx->fd[1], &cc, 1);
 		_exit(0);
@@ -1299,6 +1482,26 @@ static void ctdb_vacuum_event(struct tevent_context *ev,
 	DLIST_ADD(ctdb->vacuumers, child_ctx);
 	talloc_set_destructor(child_ctx, vacuum_child_destructor);
 
+	if (vacuum_handle->dirty_chains != NULL) {
+		/*
+		 * The child now owns the dirty chains and the records
+		 * in the delete queue.  Remember their chains, so
+		 * they can be scanned again if the child fails.
+		 */
+		child_ctx->chains = talloc_steal(child_ctx,
+						 vacuum_handle->dirty_chains);
+		trbt_traversearray32(ctdb_db->delete_queue, 1,
+				     vacuum_mark_child_chain, child_ctx);
+
+		vacuum_handle->dirty_chains =
+			bitmap_talloc(vacuum_handle, vacuum_handle->num_chains);
+		if (vacuum_handle->dirty_chains == NULL) {
+			ctdb_fatal(ctdb, "Out of memory when re-creating "
+					 "dirty chains in parent context. "
+					 "Shutting down\n");
+		}
+	}
+
 	/*
 	 * Clear the fastpath vacuuming list in the parent.
 	 */
@@ -1353,6 +1556,16 @@ int ctdb_vacuum_init(struct ctdb_db_context *ctdb_db)
 
 	ctdb_db->vacuum_handle->ctdb_db         = ctdb_db;
 	ctdb_db->vacuum_handle->fast_path_count = 0;
+	ctdb_db->vacuum_handle->dirty_chains    = NULL;
+	ctdb_db->vacuum_handle->num_chains      = 0;
+
+	if (tdb_get_flags(ctdb_db->ltdb->tdb) & TDB_INCOMPATIBLE_HASH) {
+		struct ctdb_vacuum_handle *vh = ctdb_db->vacuum_handle;
+
+		vh->num_chains = tdb_hash_size(ctdb_db->ltdb->tdb);
+		vh->dirty_chains = bitmap_talloc(vh, vh->num_chains);
+		CTDB_NO_MEMORY(ctdb_db->ctdb, vh->dirty_chains);
+	}
 
 	tevent_add_timer(ctdb_db->ctdb->ev, ctdb_db->vacuum_handle,
 			 timeval_current_ofs(get_vacuum_interval(ctdb_db), 0),
@@ -1445,6 +1658,7 @@ static int insert_record_into_delete_queue(struct ctdb_db_context *ctdb_db,
 			      (__location__ " schedule for deletion: "
 			       "hash collision for key hash [0x%08x]. "
 			       "Skipping the record.\n", hash));
+			vacuum_mark_chain_dirty(ctdb_db, key);
 			return 0;
 		} else {
 			DEBUG(DEBUG_DEBUG,
@@ -1462,6 +1676,7 @@ static int insert_record_into_delete_queue(struct ctdb_db_context *ctdb_db,
 		      (__location__ " schedule for deletion: error "
 		       "inserting key with hash [0x%08x] into delete queue\n",
 		       hash));
+		vacuum_mark_chain_dirty(ctdb_db, key);
 		return -1;
 	}
 
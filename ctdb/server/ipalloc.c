@@ -196,6 +196,23 @@ static bool populate_bitmap(struct ipalloc_state *ipalloc_state)
 	return true;
 }
 
+static void populate_load(struct ipalloc_state *ipalloc_state)
+{
+	struct public_ip_list *ip = NULL;
+	unsigned int i;
+
+	for (ip = ipalloc_state->all_ips; ip != NULL; ip = ip->next) {
+		for (i = 0; i < ipalloc_state->num_ip_loads; i++) {
+			struct ipalloc_ip_load *l = &ipalloc_state->ip_loads[i];
+
+			if (ctdb_sock_addr_same_ip(&ip->addr, &l->addr)) {
+				ip->load = l->load;
+				break;
+			}
+		}
+	}
+}
+
 void ipalloc_set_public_ips(struct ipalloc_state *ipalloc_state,
 			    struct ctdb_public_ip_list *known_ips,
 			    struct ctdb_public_ip_list *available_ips)
@@ -204,6 +221,14 @@ void ipalloc_set_public_ips(struct ipalloc_state *ipalloc_state,
 	ipalloc_state->known_public_ips = known_ips;
 }
 
+void ipalloc_set_ip_loads(struct ipalloc_state *ipalloc_state,
+			  struct ipalloc_ip_load *loads,
+			  unsigned int num_loads)
+{
+	ipalloc_state->ip_loads = loads;
+	ipalloc_state->num_ip_loads = num_loads;
+}
+
 /* This can only return false if there are no available IPs *and*
  * there are no IP addresses currently allocated.  If the latter is
  * true then the cluster can clearly host IPs... just not necessarily
@@ -259,6 +284,8 @@ struct public_ip_list *ipalloc(struct ipalloc_state *ipalloc_state)
 		return NULL;
 	}
 
+	populate_load(ipalloc_state);
+
 	switch (ipalloc_state->algorithm) {
 	case IPALLOC_LCP2:
 		ret = ipalloc_lcp2(ipalloc_state);
@@ -269,6 +296,9 @@ struct public_ip_list *ipalloc(struct ipalloc_state *ipalloc_state)
 	case IPALLOC_NONDETERMINISTIC:
 		ret = ipalloc_nondeterministic(ipalloc_state);
                break;
+	case IPALLOC_LOAD:
+		ret = ipalloc_load(ipalloc_state);
+		break;
 	}
 
 	/* at this point ->pnn is the node which will own each IP
@@ -35,6 +35,7 @@ struct public_ip_list {
 	ctdb_sock_addr addr;
 	struct bitmap *known_on;
 	struct bitmap *available_on;
+	uint32_t load;
 };
 
 #define IP_KEYLEN	4
@@ -45,6 +46,13 @@ enum ipalloc_algorithm {
 	IPALLOC_DETERMINISTIC,
 	IPALLOC_NONDETERMINISTIC,
 	IPALLOC_LCP2,
+	IPALLOC_LOAD,
+};
+
+/* Per-IP load (e.g. number of client connections) for IPALLOC_LOAD */
+struct ipalloc_ip_load {
+	ctdb_sock_addr addr;
+	uint32_t load;
 };
 
 struct ipalloc_state;
@@ -60,6 +68,10 @@ void ipalloc_set_public_ips(struct ipalloc_state *ipalloc_state,
 			    struct ctdb_public_ip_list *known_ips,
 			    struct ctdb_public_ip_list *available_ips);
 
+void ipalloc_set_ip_loads(struct ipalloc_state *ipalloc_state,
+			  struct ipalloc_ip_load *loads,
+			  unsigned int num_loads);
+
 bool ipalloc_can_host_ips(struct ipalloc_state *ipalloc_state);
 
 struct public_ip_list *ipalloc(struct ipalloc_state *ipalloc_state);
@@ -0,0 +1,294 @@
+/*
+   ctdb ip takeover code
+
+   Load-aware IP allocation
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "system/network.h"
+
+#include "lib/util/debug.h"
+#include "common/logging.h"
+
+#include "protocol/protocol_util.h"
+
+#include "server/ipalloc_private.h"
+
+/*
+ * The weight of an IP is its reported load (e.g. the number of
+ * client connections) plus one.  The extra unit means that, with no
+ * load information at all, this degrades to balancing the number of
+ * IPs on each node.
+ */
+static uint64_t load_ip_weight(struct public_ip_list *ip)
+{
+	return (uint64_t)ip->load + 1;
+}
+
+struct load_ip_order {
+	struct public_ip_list *ip;
+	unsigned int idx;
+};
+
+/* Heaviest first, keeping list order for equal weights */
+static int load_ip_order_cmp(const void *a, const void *b)
+{
+	const struct load_ip_order *o1 = a;
+	const struct load_ip_order *o2 = b;
+	uint64_t w1 = load_ip_weight(o1->ip);
+	uint64_t w2 = load_ip_weight(o2->ip);
+
+	if (w1 != w2) {
+		return (w1 > w2) ? -1 : 1;
+	}
+
+	return (o1->idx < o2->idx) ? -1 : 1;
+}
+
+static bool load_init(struct ipalloc_state *ipalloc_state,
+		      uint64_t **node_loads)
+{
+	struct public_ip_list *t;
+	uint64_t *loads;
+
+	loads = talloc_zero_array(ipalloc_state, uint64_t,
+				  ipalloc_state->num);
+	if (loads == NULL) {
+		DEBUG(DEBUG_ERR, (__location__ " out of memory\n"));
+		return false;
+	}
+
+	for (t = ipalloc_state->all_ips; t != NULL; t = t->next) {
+		if (t->pnn != CTDB_UNKNOWN_PNN) {
+			loads[t->pnn] += load_ip_weight(t);
+		}
+	}
+
+	*node_loads = loads;
+	return true;
+}
+
+/* Allocate unassigned IPs, heaviest first, each to the eligible node
+ * that is currently carrying the least load.
+ */
+static bool load_allocate_unassigned(struct ipalloc_state *ipalloc_state,
+				     uint64_t *node_loads)
+{
+	struct public_ip_list *t;
+	struct load_ip_order *order;
+	unsigned int i, num_ips, dstnode, minnode;
+
+	num_ips = 0;
+	for (t = ipalloc_state->all_ips; t != NULL; t = t->next) {
+		if (t->pnn == CTDB_UNKNOWN_PNN) {
+			num_ips++;
+		}
+	}
+	if (num_ips == 0) {
+		return true;
+	}
+
+	order = talloc_array(ipalloc_state, struct load_ip_order, num_ips);
+	if (order == NULL) {
+		DEBUG(DEBUG_ERR, (__location__ " out of memory\n"));
+		return false;
+	}
+
+	i = 0;
+	for (t = ipalloc_state->all_ips; t != NULL; t = t->next) {
+		if (t->pnn == CTDB_UNKNOWN_PNN) {
+			order[i].ip = t;
+			order[i].idx = i;
+			i++;
+		}
+	}
+
+	qsort(order, num_ips, sizeof(struct load_ip_order),
+	      load_ip_order_cmp);
+
+	for (i = 0; i < num_ips; i++) {
+		t = order[i].ip;
+
+		minnode = CTDB_UNKNOWN_PNN;
+		for (dstnode = 0; dstnode < ipalloc_state->num; dstnode++) {
+			if (!can_node_takeover_ip(ipalloc_state,
+						  dstnode, t)) {
+				continue;
+			}
+
+			if (minnode == CTDB_UNKNOWN_PNN ||
+			    node_loads[dstnode] < node_loads[minnode]) {
+				minnode = dstnode;
+			}
+		}
+
+		if (minnode == CTDB_UNKNOWN_PNN) {
+			DEBUG(DEBUG_WARNING,
+			      ("Failed to find node to cover ip %s\n",
+			       ctdb_sock_addr_to_string(ipalloc_state,
+							&t->addr,
+							false)));
+			continue;
+		}
+
+		t->pnn = minnode;
+		node_loads[minnode] += load_ip_weight(t);
+
+		DEBUG(DEBUG_INFO,
+		      (" %s -> %d [+%"PRIu64"]\n",
+		       ctdb_sock_addr_to_string(ipalloc_state,
+						&t->addr,
+						false),
+		       minnode,
+		       load_ip_weight(t)));
+	}
+
+	talloc_free(order);
+	return true;
+}
+
+/* Find a single move of an IP off the most loaded node.  A move is
+ * only considered if it strictly reduces the larger of the source
+ * and destination loads, which guarantees that rebalancing
+ * terminates and that IPs never ping-pong between nodes.  Among the
+ * candidates, prefer the lowest resulting maximum, then the IP with
+ * the least load, since moving an IP disrupts its clients, and then
+ * the least loaded destination.
+ */
+static bool load_rebalance_one(struct ipalloc_state *ipalloc_state,
+			       uint64_t *node_loads)
+{
+	struct public_ip_list *t, *best_ip;
+	unsigned int srcnode, dstnode, best_node, i;
+	uint64_t w, newmax, best_max;
+
+	srcnode = CTDB_UNKNOWN_PNN;
+	for (i = 0; i < ipalloc_state->num; i++) {
+		if (node_ip_coverage(i, ipalloc_state->all_ips) == 0) {
+			continue;
+		}
+		if (srcnode == CTDB_UNKNOWN_PNN ||
+		    node_loads[i] > node_loads[srcnode]) {
+			srcnode = i;
+		}
+	}
+	if (srcnode == CTDB_UNKNOWN_PNN) {
+		return false;
+	}
+
+	best_ip = NULL;
+	best_node = CTDB_UNKNOWN_PNN;
+	best_max = node_loads[srcnode];
+
+	for (t = ipalloc_state->all_ips; t != NULL; t = t->next) {
+		if (t->pnn != srcnode) {
+			continue;
+		}
+
+		w = load_ip_weight(t);
+
+		for (dstnode = 0; dstnode < ipalloc_state->num; dstnode++) {
+			if (dstnode == srcnode) {
+				continue;
+			}
+			if (!can_node_takeover_ip(ipalloc_state,
+						  dstnode, t)) {
+				continue;
+			}
+
+			newmax = MAX(node_loads[srcnode] - w,
+				     node_loads[dstnode] + w);
+			if (newmax > best_max) {
+				continue;
+			}
+			if (newmax == best_max) {
+				if (best_ip == NULL ||
+				    t->load > best_ip->load) {
+					continue;
+				}
+				if (t->load == best_ip->load &&
+				    node_loads[dstnode] >=
+				    node_loads[best_node]) {
+					continue;
+				}
+			}
+
+			best_ip = t;
+			best_node = dstnode;
+			best_max = newmax;
+		}
+	}
+
+	if (best_ip == NULL) {
+		return false;
+	}
+
+	DEBUG(DEBUG_INFO,
+	      ("Moving %s from %u to %u (load %u, max %"PRIu64" -> %"PRIu64")\n",
+	       ctdb_sock_addr_to_string(ipalloc_state, &best_ip->addr, false),
+	       srcnode, best_node, best_ip->load,
+	       node_loads[srcnode], best_max));
+
+	w = load_ip_weight(best_ip);
+	node_loads[srcnode] -= w;
+	node_loads[best_node] += w;
+	best_ip->pnn = best_node;
+
+	return true;
+}
+
+bool ipalloc_load(struct ipalloc_state *ipalloc_state)
+{
+	uint64_t *node_loads;
+	unsigned int moves, max_moves;
+	struct public_ip_list *t;
+
+	unassign_unsuitable_ips(ipalloc_state);
+
+	if (!load_init(ipalloc_state, &node_loads)) {
+		return false;
+	}
+
+	if (!load_allocate_unassigned(ipalloc_state, node_loads)) {
+		talloc_free(node_loads);
+		return false;
+	}
+
+	/* If we don't want IPs to fail back then don't rebalance IPs. */
+	if (ipalloc_state->no_ip_failback) {
+		talloc_free(node_loads);
+		return true;
+	}
+
+	/* Each move strictly lowers the load on the busiest node it
+	 * touches, so this terminates anyway.  Bound it by the number
+	 * of IPs so that a single run can never move an IP more than
+	 * once on average.
+	 */
+	max_moves = 0;
+	for (t = ipalloc_state->all_ips; t != NULL; t = t->next) {
+		max_moves++;
+	}
+
+	for (moves = 0; moves < max_moves; moves++) {
+		if (!load_rebalance_one(ipalloc_state, node_loads)) {
+			break;
+		}
+	}
+
+	talloc_free(node_loads);
+	return true;
+}
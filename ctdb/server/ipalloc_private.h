@@ -38,6 +38,10 @@ struct ipalloc_state {
 	bool no_ip_failback;
 	bool no_ip_takeover;
 	uint32_t *force_rebalance_nodes;
+
+	/* Only used by IPALLOC_LOAD */
+	struct ipalloc_ip_load *ip_loads;
+	unsigned int num_ip_loads;
 };
 
 bool can_node_takeover_ip(struct ipalloc_state *ipalloc_state,
@@ -53,5 +57,6 @@ void basic_allocate_unassigned(struct ipalloc_state *ipalloc_state);
 bool ipalloc_nondeterministic(struct ipalloc_state *ipalloc_state);
 bool ipalloc_deterministic(struct ipalloc_state *ipalloc_state);
 bool ipalloc_lcp2(struct ipalloc_state *ipalloc_state);
+bool ipalloc_load(struct ipalloc_state *ipalloc_state);
 
 #endif /* __CTDB_IPALLOC_PRIVATE_H__ */
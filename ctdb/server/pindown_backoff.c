@@ -0,0 +1,65 @@
+/*
+   Pindown backoff for records that keep migrating
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "system/time.h"
+
+#include "lib/util/time.h"
+
+#include "server/pindown_backoff.h"
+
+void pindown_backoff_init(struct pindown_backoff *pb)
+{
+	pb->backoff = 0;
+	pb->escalated = false;
+	pb->pindown_end = timeval_zero();
+}
+
+uint32_t pindown_backoff_start(struct pindown_backoff *pb,
+			       uint32_t sticky_pindown,
+			       struct timeval now)
+{
+	/* The record stayed away for a while after the last pindown,
+	 * so it is no longer ping-ponging as badly
+	 */
+	if (pb->backoff > 0 &&
+	    !timeval_is_zero(&pb->pindown_end) &&
+	    timeval_elapsed2(&pb->pindown_end, &now) > 1.0) {
+		pb->backoff--;
+	}
+	pb->escalated = false;
+
+	return sticky_pindown << pb->backoff;
+}
+
+void pindown_backoff_end(struct pindown_backoff *pb, struct timeval now)
+{
+	pb->pindown_end = now;
+}
+
+bool pindown_backoff_escalate(struct pindown_backoff *pb)
+{
+	if (pb->escalated || pb->backoff >= PINDOWN_BACKOFF_MAX) {
+		return false;
+	}
+
+	/* Takes effect from the next pindown */
+	pb->backoff++;
+	pb->escalated = true;
+
+	return true;
+}
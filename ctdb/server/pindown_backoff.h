@@ -0,0 +1,71 @@
+/*
+   Pindown backoff for records that keep migrating
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __CTDB_PINDOWN_BACKOFF_H__
+#define __CTDB_PINDOWN_BACKOFF_H__
+
+#include "replace.h"
+#include "system/time.h"
+
+/*
+ * A record that keeps migrating onto this node gets a pindown that is
+ * doubled up to this many times
+ */
+#define PINDOWN_BACKOFF_MAX	5
+
+struct pindown_backoff {
+	unsigned int backoff;
+	bool escalated;
+	struct timeval pindown_end;
+};
+
+/**
+ * @brief Reset the backoff of a newly sticky record
+ */
+void pindown_backoff_init(struct pindown_backoff *pb);
+
+/**
+ * @brief Start a new pindown
+ *
+ * If the record stayed away for more than a second after the last
+ * pindown, the backoff is halved first.
+ *
+ * @param[in] pb The backoff state of the record
+ * @param[in] sticky_pindown The base pindown in milliseconds
+ * @param[in] now The current time
+ * @return The pindown in milliseconds
+ */
+uint32_t pindown_backoff_start(struct pindown_backoff *pb,
+			       uint32_t sticky_pindown,
+			       struct timeval now);
+
+/**
+ * @brief Note that a pindown has timed out
+ */
+void pindown_backoff_end(struct pindown_backoff *pb, struct timeval now);
+
+/**
+ * @brief The record is still migrating too often while pinned down
+ *
+ * Double the next pindown, at most once per pindown and up to
+ * PINDOWN_BACKOFF_MAX times.
+ *
+ * @return true if the backoff was increased
+ */
+bool pindown_backoff_escalate(struct pindown_backoff *pb);
+
+#endif /* __CTDB_PINDOWN_BACKOFF_H__ */
@@ -0,0 +1,13 @@
+#!/bin/sh
+
+. "${TEST_SCRIPTS_DIR}/unit.sh"
+
+dbdir=$(TMPDIR="$TEST_VAR_DIR" mktemp -d)
+
+ok <<EOF
+locking: Record already locked
+EOF
+unit_test lock_helper_test "${CTDB_SCRIPTS_HELPER_BINDIR}/ctdb_lock_helper" \
+	"$dbdir"
+
+rm -rf "$dbdir"
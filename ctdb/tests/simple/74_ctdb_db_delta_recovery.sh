@@ -0,0 +1,154 @@
+#!/bin/bash
+
+test_info()
+{
+    cat <<EOF
+Recovery of a volatile database from the changed records only
+
+* A recovery with an unchanged set of active nodes only pulls the
+  records changed since the previous recovery
+* After a node has been stopped and continued the recovery falls back
+  to pulling all the records
+
+In both cases changed and deleted records must be recovered correctly.
+The kind of recovery done is checked in the logs of the local daemons.
+EOF
+}
+
+. "${TEST_SCRIPTS_DIR}/integration.bash"
+
+ctdb_test_init
+
+set -e
+
+cluster_is_healthy
+
+if [ -z "$TEST_LOCAL_DAEMONS" ] ; then
+	echo "SKIPPING this test - only runs against local daemons"
+	exit 0
+fi
+
+testdb="delta_test.tdb"
+
+echo "Getting list of nodes..."
+try_command_on_node -v any "onnode -pq all ctdb pnn | grep '^[0-9][0-9]*$'"
+
+first=$(sed -n -e '1p' "$outfile")
+second=$(sed -n -e '2p' "$outfile")
+all=$(cat "$outfile")
+
+if [ -z "$second" ] ; then
+	echo "SKIPPING: test needs at least 2 nodes"
+	exit 0
+fi
+
+echo "Create/wipe test database ${testdb}"
+try_command_on_node $first $CTDB attach "$testdb"
+try_command_on_node $first $CTDB wipedb "$testdb"
+
+echo "store key(stale) data(value1), key(gone) data(value1)"
+try_command_on_node $first $CTDB writekey "$testdb" stale value1
+try_command_on_node $first $CTDB writekey "$testdb" gone value1
+
+echo "Migrate the records to all nodes"
+try_command_on_node all $CTDB readkey "$testdb" stale
+try_command_on_node all $CTDB readkey "$testdb" gone
+
+# Starts the journal of changed records on all nodes
+echo "Force recovery"
+try_command_on_node $first $CTDB recover
+wait_until_node_has_status $first recovered
+
+# Number of full recoveries of the test database done by any node
+num_fallbacks ()
+{
+	try_command_on_node all \
+		"grep -c 'Delta recovery not possible for db ${testdb},'" \
+		"\${CTDB_BASE}/log.ctdb || true"
+	awk '{ n += $1 } END { print n }' "$outfile"
+}
+
+# Returns the value of key $2 in the local copy on node $1, or "none"
+local_value ()
+{
+	local _pnn="$1"
+	local _key="$2"
+
+	try_command_on_node $_pnn $CTDB cattdb "$testdb"
+	awk -v key="key(${#_key}) = \"${_key}\"" '
+		$0 == key { found = 1; next }
+		found && /^data\(/ {
+			sub(/^data\([0-9]*\) = "/, "");
+			sub(/"$/, "");
+			print (length($0) > 0 ? $0 : "none");
+			exit
+		}
+		END { if (! found) print "none" }' "$outfile"
+}
+
+check_value ()
+{
+	local _key="$1"
+	local _expected="$2"
+	local _n _value
+
+	for _n in $all ; do
+		_value=$(local_value $_n "$_key")
+		if [ "$_value" != "$_expected" ] ; then
+			echo "BAD: key(${_key}) on node ${_n} is \"${_value}\"," \
+			     "expected \"${_expected}\""
+			exit 1
+		fi
+	done
+
+	echo "GOOD: key(${_key}) is \"${_expected}\" on all nodes"
+}
+
+echo "Change key(stale), delete key(gone)"
+try_command_on_node $first $CTDB writekey "$testdb" stale value2
+try_command_on_node $first $CTDB deletekey "$testdb" gone
+
+fallbacks=$(num_fallbacks)
+
+echo "Force recovery"
+try_command_on_node $first $CTDB recover
+wait_until_node_has_status $first recovered
+
+echo "Checking that the changed records were recovered"
+check_value stale value2
+check_value gone none
+
+echo "Checking that only the changed records were pulled"
+if [ "$(num_fallbacks)" -ne "$fallbacks" ] ; then
+	echo "BAD: all records were pulled, expected a delta recovery"
+	exit 1
+fi
+echo "GOOD: only the changed records were pulled"
+
+fallbacks=$(num_fallbacks)
+
+echo "Stop node ${second}"
+try_command_on_node $second $CTDB stop
+wait_until_node_has_status $second stopped
+
+echo "Continue node ${second}"
+try_command_on_node $second $CTDB continue
+wait_until_node_has_status $second notstopped
+
+echo "Change key(stale)"
+try_command_on_node $first $CTDB writekey "$testdb" stale value3
+
+echo "Force recovery"
+try_command_on_node $first $CTDB recover
+wait_until_node_has_status $first recovered
+
+echo "Checking that all the records were recovered"
+check_value stale value3
+check_value gone none
+
+echo "Checking that all the records were pulled"
+if [ "$(num_fallbacks)" -le "$fallbacks" ] ; then
+	echo "BAD: expected a full recovery after the node set changed"
+	exit 1
+fi
+echo "GOOD: all the records were pulled"
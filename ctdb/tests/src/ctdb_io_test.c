@@ -168,11 +168,17 @@ static void test2(void)
 	ret = write(fd, req, test2_req_len[2]);
 	assert(ret != -1 && (size_t)ret == test2_req_len[2]);
 
-	tevent_loop_once(ctdb->ev);
 	tevent_loop_once(ctdb->ev);
 
 	assert(test2_cb_num == 2);
 
+	/*
+	 * Request 2 did not fit in the buffer, read the rest of it
+	 */
+	tevent_loop_once(ctdb->ev);
+
+	assert(test2_cb_num == 3);
+
 	TALLOC_FREE(ctdb);
 }
 
@@ -236,11 +242,6 @@ static void test3(void)
 	 * to fetch the new 199 bytes -> offset must be 0 now.
 	 */
 	tevent_loop_once(ctdb->ev);
-	/*
-	 * needs to be called twice as an incomplete packet
-	 * does not trigger a schedule_immediate
-	 */
-	tevent_loop_once(ctdb->ev);
 
 	assert(queue->buffer.offset == 0);
 
@@ -320,6 +321,169 @@ static void test4(void)
 	TALLOC_FREE(ctdb);
 }
 
+static const size_t test5_req_len[] = { 12, 100, 40, 8, 300 };
+
+static int test5_cb_num = 0;
+
+static void test5_callback(uint8_t *data, size_t length, void *private_data)
+{
+	uint32_t len;
+
+	len = *(uint32_t *)data;
+	assert(len == sizeof(uint32_t) + test5_req_len[test5_cb_num]);
+	assert(length == sizeof(uint32_t) + test5_req_len[test5_cb_num]);
+
+	test5_cb_num++;
+	TALLOC_FREE(data);
+}
+
+static void test5(void)
+{
+	struct ctdb_context *ctdb;
+	struct ctdb_queue *queue;
+	uint8_t buf[1024] = { 0 };
+	size_t i, offset = 0;
+	uint32_t pkt_size;
+	int fd;
+	ssize_t ret;
+
+	test_setup(test5_callback, &fd, &ctdb, &queue);
+
+	/* All packets fit in a single read */
+	for (i = 0; i < ARRAY_SIZE(test5_req_len); i++) {
+		pkt_size = sizeof(uint32_t) + test5_req_len[i];
+		memcpy(&buf[offset], &pkt_size, sizeof(pkt_size));
+		offset += pkt_size;
+	}
+	assert(offset <= queue->buffer_size);
+
+	ret = write(fd, buf, offset);
+	assert(ret != -1 && (size_t)ret == offset);
+
+	/* ...and are all processed in one event loop iteration */
+	tevent_loop_once(ctdb->ev);
+
+	assert(test5_cb_num == ARRAY_SIZE(test5_req_len));
+	assert(queue->buffer.length == 0);
+	assert(queue->buffer.offset == 0);
+
+	TALLOC_FREE(ctdb);
+}
+
+static int test6_cb_num = 0;
+
+static void test6_callback(uint8_t *data, size_t length, void *private_data)
+{
+	struct ctdb_queue **queue = (struct ctdb_queue **)private_data;
+
+	test6_cb_num++;
+	TALLOC_FREE(data);
+
+	/* Free the queue from the first callback */
+	TALLOC_FREE(*queue);
+}
+
+static void test6(void)
+{
+	struct ctdb_context *ctdb;
+	struct ctdb_queue *queue;
+	uint8_t buf[64] = { 0 };
+	uint32_t pkt_size = 16;
+	int pipefd[2];
+	ssize_t ret;
+
+	ret = pipe(pipefd);
+	assert(ret == 0);
+
+	ctdb = talloc_zero(NULL, struct ctdb_context);
+	assert(ctdb != NULL);
+
+	ctdb->ev = tevent_context_init(ctdb);
+	assert(ctdb->ev != NULL);
+
+	queue = ctdb_queue_setup(ctdb, ctdb, pipefd[0], 0, test6_callback,
+				 &queue, "test queue");
+	assert(queue != NULL);
+
+	memcpy(&buf[0], &pkt_size, sizeof(pkt_size));
+	memcpy(&buf[16], &pkt_size, sizeof(pkt_size));
+	memcpy(&buf[32], &pkt_size, sizeof(pkt_size));
+
+	ret = write(pipefd[1], buf, 48);
+	assert(ret == 48);
+
+	/* Processing stops once the queue is freed */
+	tevent_loop_once(ctdb->ev);
+
+	assert(test6_cb_num == 1);
+	assert(queue == NULL);
+
+	close(pipefd[1]);
+	TALLOC_FREE(ctdb);
+}
+
+static void test7(void)
+{
+	struct ctdb_context *ctdb;
+	struct ctdb_queue *queue;
+	uint8_t pkt[256];
+	uint8_t buf[4096];
+	int pipefd[2], flags, i;
+	ssize_t ret;
+
+	ret = pipe(pipefd);
+	assert(ret == 0);
+
+	for (i = 0; i < 2; i++) {
+		flags = fcntl(pipefd[i], F_GETFL);
+		ret = fcntl(pipefd[i], F_SETFL, flags | O_NONBLOCK);
+		assert(ret == 0);
+	}
+
+	ctdb = talloc_zero(NULL, struct ctdb_context);
+	assert(ctdb != NULL);
+
+	ctdb->ev = tevent_context_init(ctdb);
+	assert(ctdb->ev != NULL);
+
+	queue = ctdb_queue_setup(ctdb, ctdb, pipefd[1], 0, test_cb,
+				 NULL, "test queue");
+	assert(queue != NULL);
+
+	/* Fill the pipe, so that packets have to be queued */
+	memset(buf, 0, sizeof(buf));
+	do {
+		ret = write(pipefd[1], buf, sizeof(buf));
+	} while (ret > 0);
+	assert(errno == EAGAIN || errno == EWOULDBLOCK);
+
+	memset(pkt, 0, sizeof(pkt));
+	for (i = 0; i < 10; i++) {
+		struct ctdb_req_header *hdr = (struct ctdb_req_header *)pkt;
+
+		hdr->length = sizeof(pkt);
+		ret = ctdb_queue_send(queue, pkt, sizeof(pkt));
+		assert(ret == 0);
+	}
+	assert(ctdb_queue_length(queue) == 10);
+
+	/* Drain the pipe, all the queued packets go out together */
+	do {
+		ret = read(pipefd[0], buf, sizeof(buf));
+	} while (ret > 0);
+	assert(errno == EAGAIN || errno == EWOULDBLOCK);
+
+	tevent_loop_once(ctdb->ev);
+
+	assert(ctdb_queue_length(queue) == 0);
+
+	ret = read(pipefd[0], buf, sizeof(buf));
+	assert(ret == 10 * sizeof(pkt));
+
+	close(pipefd[0]);
+	TALLOC_FREE(ctdb);
+}
+
 int main(int argc, const char **argv)
 {
 	int num;
@@ -348,6 +512,18 @@ int main(int argc, const char **argv)
 		test4();
 		break;
 
+	case 5:
+		test5();
+		break;
+
+	case 6:
+		test6();
+		break;
+
+	case 7:
+		test7();
+		break;
+
 	default:
 		fprintf(stderr, "Unknown test number %s\n", argv[1]);
 	}
@@ -132,6 +132,58 @@ static enum ctdb_runstate *get_runstate(TALLOC_CTX *tmp_ctx,
 	return runstate;
 }
 
+/* Per-IP loads for load-aware allocation are read from
+ * CTDB_TEST_IP_LOAD as a comma-separated list of IP=LOAD.  IPs that
+ * are not listed have no load.
+ */
+static void set_ip_loads(TALLOC_CTX *mem_ctx,
+			 struct ipalloc_state *ipalloc_state)
+{
+	struct ipalloc_ip_load *loads = NULL;
+	unsigned int num = 0;
+	char *t, *tok, *val;
+	int ret;
+
+	t = getenv("CTDB_TEST_IP_LOAD");
+	if (t == NULL) {
+		return;
+	}
+
+	t = talloc_strdup(mem_ctx, t);
+	assert(t != NULL);
+
+	tok = strtok(t, ",");
+	while (tok != NULL) {
+		val = strchr(tok, '=');
+		if (val == NULL) {
+			fprintf(stderr,
+				"ERROR: Bad value \"%s\" in CTDB_TEST_IP_LOAD\n",
+				tok);
+			exit(1);
+		}
+		*val = '\0';
+		val++;
+
+		loads = talloc_realloc(mem_ctx, loads,
+				       struct ipalloc_ip_load, num+1);
+		assert(loads != NULL);
+
+		ret = ctdb_sock_addr_from_string(tok, &loads[num].addr, false);
+		if (ret != 0) {
+			fprintf(stderr,
+				"ERROR: Bad IP \"%s\" in CTDB_TEST_IP_LOAD\n",
+				tok);
+			exit(1);
+		}
+		loads[num].load = (uint32_t) strtoul(val, NULL, 0);
+		num++;
+
+		tok = strtok(NULL, ",");
+	}
+
+	ipalloc_set_ip_loads(ipalloc_state, loads, num);
+}
+
 /* Fake up enough CTDB state to be able to run the IP allocation
  * algorithm.  Usually this sets up some standard state, sets the node
  * states from the command-line and reads the current IP layout from
@@ -188,6 +240,8 @@ static void ctdb_test_init(TALLOC_CTX *mem_ctx,
 			algorithm = IPALLOC_NONDETERMINISTIC;
 		} else if (strcmp(t, "det") == 0) {
 			algorithm = IPALLOC_DETERMINISTIC;
+		} else if (strcmp(t, "load") == 0) {
+			algorithm = IPALLOC_LOAD;
 		} else {
 			DEBUG(DEBUG_ERR,
 			      ("ERROR: unknown IP algorithm %s\n", t));
@@ -222,6 +276,8 @@ static void ctdb_test_init(TALLOC_CTX *mem_ctx,
 	}
 
 	ipalloc_set_public_ips(*ipalloc_state, known, avail);
+
+	set_ip_loads(mem_ctx, *ipalloc_state);
 }
 
 /* IP layout is read from stdin.  See comment for ctdb_test_init() for
@@ -2652,6 +2652,58 @@ done:
 	client_send_control(req, header, &reply);
 }
 
+static void control_get_tcp_tickle_list(TALLOC_CTX *mem_ctx,
+				       struct tevent_req *req,
+				       struct ctdb_req_header *header,
+				       struct ctdb_req_control *request)
+{
+	struct client_state *state = tevent_req_data(
+		req, struct client_state);
+	struct ctdbd_context *ctdb = state->ctdb;
+	struct ctdb_reply_control reply;
+	struct ctdb_public_ip_list *ips;
+	struct ctdb_tickle_list *tickles;
+	ctdb_sock_addr *addr = request->rdata.data.addr;
+	unsigned int i;
+
+	reply.rdata.opcode = request->opcode;
+
+	if (ctdb->known_ips == NULL) {
+		goto fail;
+	}
+
+	ips = &ctdb->known_ips[header->destnode];
+	for (i = 0; i < ips->num; i++) {
+		if (ctdb_sock_addr_same_ip(addr, &ips->ip[i].addr)) {
+			break;
+		}
+	}
+	if (i == ips->num) {
+		goto fail;
+	}
+
+	/* Connections are not faked, so the list is always empty */
+	tickles = talloc_zero(mem_ctx, struct ctdb_tickle_list);
+	if (tickles == NULL) {
+		reply.status = ENOMEM;
+		reply.errmsg = "Memory error";
+		goto done;
+	}
+	tickles->addr = *addr;
+
+	reply.rdata.data.tickles = tickles;
+	reply.status = 0;
+	reply.errmsg = NULL;
+	goto done;
+
+fail:
+	reply.status = -1;
+	reply.errmsg = "Not a public address";
+
+done:
+	client_send_control(req, header, &reply);
+}
+
 static void control_get_nodemap(TALLOC_CTX *mem_ctx,
 				struct tevent_req *req,
 				struct ctdb_req_header *header,
@@ -4123,6 +4175,10 @@ static void client_process_control(struct tevent_req *req,
 		control_get_public_ips(mem_ctx, req, &header, &request);
 		break;
 
+	case CTDB_CONTROL_GET_TCP_TICKLE_LIST:
+		control_get_tcp_tickle_list(mem_ctx, req, &header, &request);
+		break;
+
 	case CTDB_CONTROL_GET_NODEMAP:
 		control_get_nodemap(mem_ctx, req, &header, &request);
 		break;
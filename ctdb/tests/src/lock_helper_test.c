@@ -0,0 +1,353 @@
+/*
+   Persistent lock helper tests
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "system/filesys.h"
+#include "system/wait.h"
+
+#include <assert.h>
+#include <poll.h>
+#include <talloc.h>
+#include <tdb.h>
+
+#include "lib/util/sys_rw.h"
+
+/*
+ * Drive ctdb_lock_helper in PERSISTENT mode the way ctdbd does, and
+ * check the locks it takes from a separate tdb handle
+ */
+
+#define KEY	"testkey"
+#define HEXKEY	"746573746B6579"
+
+struct helper {
+	pid_t pid;
+	int req_fd;
+	int res_fd;
+};
+
+static TDB_DATA key = {
+	.dptr = (uint8_t *)discard_const(KEY),
+	.dsize = sizeof(KEY) - 1,
+};
+
+static void helper_start(const char *prog, struct helper *h)
+{
+	int req_fd[2], res_fd[2];
+	char ppid[32], out_fd[32], in_fd[32];
+	int ret;
+
+	ret = pipe(req_fd);
+	assert(ret == 0);
+	ret = pipe(res_fd);
+	assert(ret == 0);
+
+	snprintf(ppid, sizeof(ppid), "%d", getpid());
+	snprintf(out_fd, sizeof(out_fd), "%d", res_fd[1]);
+	snprintf(in_fd, sizeof(in_fd), "%d", req_fd[0]);
+
+	h->pid = fork();
+	assert(h->pid != -1);
+
+	if (h->pid == 0) {
+		close(req_fd[1]);
+		close(res_fd[0]);
+		execl(prog, prog, ppid, out_fd, "PERSISTENT", in_fd, NULL);
+		_exit(1);
+	}
+
+	close(req_fd[0]);
+	close(res_fd[1]);
+	h->req_fd = req_fd[1];
+	h->res_fd = res_fd[0];
+}
+
+static void helper_send(struct helper *h, const char **fields, int num)
+{
+	uint8_t buf[1024];
+	uint32_t len = 0;
+	ssize_t n;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		size_t flen = strlen(fields[i]) + 1;
+
+		assert(sizeof(len) + len + flen <= sizeof(buf));
+		memcpy(buf + sizeof(len) + len, fields[i], flen);
+		len += flen;
+	}
+	memcpy(buf, &len, sizeof(len));
+
+	n = sys_write(h->req_fd, buf, sizeof(len) + len);
+	assert(n == (ssize_t)(sizeof(len) + len));
+}
+
+static void helper_lock(struct helper *h, const char *path)
+{
+	const char *fields[] = { "RECORD", path, "0", HEXKEY };
+
+	helper_send(h, fields, 4);
+}
+
+static void helper_unlock(struct helper *h)
+{
+	const char *fields[] = { "UNLOCK" };
+
+	helper_send(h, fields, 1);
+}
+
+/* Returns the status byte, -1 on EOF and -2 on timeout */
+static int helper_status(struct helper *h, int timeout_ms)
+{
+	struct pollfd pfd = {
+		.fd = h->res_fd,
+		.events = POLLIN,
+	};
+	ssize_t n;
+	char c;
+	int ret;
+
+	ret = poll(&pfd, 1, timeout_ms);
+	assert(ret != -1);
+	if (ret == 0) {
+		return -2;
+	}
+
+	n = sys_read(h->res_fd, &c, 1);
+	if (n != 1) {
+		return -1;
+	}
+
+	return c;
+}
+
+static int helper_wait(struct helper *h)
+{
+	pid_t pid;
+	int status;
+
+	close(h->req_fd);
+	close(h->res_fd);
+
+	pid = waitpid(h->pid, &status, 0);
+	assert(pid == h->pid);
+
+	return status;
+}
+
+static bool record_locked(struct tdb_context *tdb)
+{
+	int ret;
+
+	ret = tdb_chainlock_nonblock(tdb, key);
+	if (ret == 0) {
+		tdb_chainunlock(tdb, key);
+		return false;
+	}
+
+	return true;
+}
+
+/* UNLOCK is not answered, so wait for the lock to go away */
+static void wait_unlocked(struct tdb_context *tdb)
+{
+	int i;
+
+	for (i = 0; i < 500; i++) {
+		if (! record_locked(tdb)) {
+			return;
+		}
+		usleep(10000);
+	}
+
+	assert(! record_locked(tdb));
+}
+
+static struct tdb_context *db_create(const char *path)
+{
+	struct tdb_context *tdb;
+
+	tdb = tdb_open(path, 0, TDB_DEFAULT, O_RDWR|O_CREAT, 0600);
+	assert(tdb != NULL);
+
+	return tdb;
+}
+
+/* The same helper serves several lock requests in turn */
+static void test_record_unlock(const char *prog, const char *dir)
+{
+	struct helper h;
+	struct tdb_context *tdb;
+	char *path;
+	int i, status;
+
+	path = talloc_asprintf(NULL, "%s/test1.tdb", dir);
+	assert(path != NULL);
+	tdb = db_create(path);
+
+	helper_start(prog, &h);
+
+	for (i = 0; i < 3; i++) {
+		helper_lock(&h, path);
+		assert(helper_status(&h, 5000) == 0);
+		assert(record_locked(tdb));
+
+		helper_unlock(&h);
+		wait_unlocked(tdb);
+	}
+
+	/* A second request without UNLOCK is a protocol error */
+	helper_lock(&h, path);
+	assert(helper_status(&h, 5000) == 0);
+	helper_lock(&h, path);
+	assert(helper_status(&h, 5000) == -1);
+	wait_unlocked(tdb);
+
+	status = helper_wait(&h);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 1);
+
+	/* Closing the request pipe makes the helper exit */
+	helper_start(prog, &h);
+	helper_lock(&h, path);
+	assert(helper_status(&h, 5000) == 0);
+	status = helper_wait(&h);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	wait_unlocked(tdb);
+
+	tdb_close(tdb);
+	unlink(path);
+	talloc_free(path);
+}
+
+/* A database replaced between requests is reopened */
+static void test_replaced_db(const char *prog, const char *dir)
+{
+	struct helper h;
+	struct tdb_context *old_tdb, *new_tdb;
+	char *path, *tmp_path;
+	int ret, status;
+
+	path = talloc_asprintf(NULL, "%s/test2.tdb", dir);
+	assert(path != NULL);
+	tmp_path = talloc_asprintf(path, "%s.new", path);
+	assert(tmp_path != NULL);
+
+	old_tdb = db_create(path);
+
+	helper_start(prog, &h);
+
+	helper_lock(&h, path);
+	assert(helper_status(&h, 5000) == 0);
+	assert(record_locked(old_tdb));
+	helper_unlock(&h);
+	wait_unlocked(old_tdb);
+
+	new_tdb = db_create(tmp_path);
+	ret = rename(tmp_path, path);
+	assert(ret == 0);
+
+	helper_lock(&h, path);
+	assert(helper_status(&h, 5000) == 0);
+	assert(record_locked(new_tdb));
+	assert(! record_locked(old_tdb));
+	helper_unlock(&h);
+	wait_unlocked(new_tdb);
+
+	status = helper_wait(&h);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	tdb_close(old_tdb);
+	tdb_close(new_tdb);
+	unlink(path);
+	talloc_free(path);
+}
+
+/* A helper that dies while waiting for a lock never holds it */
+static void test_death_while_waiting(const char *prog, const char *dir)
+{
+	struct helper h;
+	struct tdb_context *tdb;
+	char *path;
+	int ret, status;
+
+	path = talloc_asprintf(NULL, "%s/test3.tdb", dir);
+	assert(path != NULL);
+	tdb = db_create(path);
+
+	/* Killed, as ctdbd does when a waiting lock request goes away */
+	ret = tdb_chainlock(tdb, key);
+	assert(ret == 0);
+
+	helper_start(prog, &h);
+	helper_lock(&h, path);
+	assert(helper_status(&h, 500) == -2);
+
+	kill(h.pid, SIGKILL);
+	assert(helper_status(&h, 5000) == -1);
+	status = helper_wait(&h);
+	assert(WIFSIGNALED(status));
+
+	tdb_chainunlock(tdb, key);
+	assert(! record_locked(tdb));
+
+	/*
+	 * SIGTERM can not interrupt a blocking lock, the helper exits
+	 * without answering once it gets the lock and has released it
+	 */
+	ret = tdb_chainlock(tdb, key);
+	assert(ret == 0);
+
+	helper_start(prog, &h);
+	helper_lock(&h, path);
+	assert(helper_status(&h, 500) == -2);
+
+	kill(h.pid, SIGTERM);
+	assert(helper_status(&h, 500) == -2);
+	tdb_chainunlock(tdb, key);
+
+	assert(helper_status(&h, 5000) == -1);
+	status = helper_wait(&h);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	assert(! record_locked(tdb));
+
+	/* A new helper can take the lock */
+	helper_start(prog, &h);
+	helper_lock(&h, path);
+	assert(helper_status(&h, 5000) == 0);
+	assert(record_locked(tdb));
+	status = helper_wait(&h);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	wait_unlocked(tdb);
+
+	tdb_close(tdb);
+	unlink(path);
+	talloc_free(path);
+}
+
+int main(int argc, const char *argv[])
+{
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <lock-helper> <dir>\n", argv[0]);
+		exit(1);
+	}
+
+	test_record_unlock(argv[1], argv[2]);
+	test_replaced_db(argv[1], argv[2]);
+	test_death_while_waiting(argv[1], argv[2]);
+
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*
+   pindown_backoff tests
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+
+#include <assert.h>
+
+#include "server/pindown_backoff.c"
+
+#define PINDOWN	200
+
+static struct timeval at(int sec, int msec)
+{
+	return timeval_set(1000 + sec, msec * 1000);
+}
+
+/* A new sticky record is pinned down for StickyPindown */
+static void test_enter(void)
+{
+	struct pindown_backoff pb;
+	uint32_t pindown;
+
+	pindown_backoff_init(&pb);
+	assert(pb.backoff == 0);
+	assert(! pb.escalated);
+
+	pindown = pindown_backoff_start(&pb, PINDOWN, at(0, 0));
+	assert(pindown == PINDOWN);
+
+	pindown_backoff_end(&pb, at(0, 200));
+
+	/* No backoff, nothing to decay */
+	pindown = pindown_backoff_start(&pb, PINDOWN, at(5, 0));
+	assert(pindown == PINDOWN);
+}
+
+/* Migrating while pinned doubles the next pindown, once per pindown */
+static void test_backoff(void)
+{
+	struct pindown_backoff pb;
+	uint32_t pindown;
+
+	pindown_backoff_init(&pb);
+	pindown = pindown_backoff_start(&pb, PINDOWN, at(0, 0));
+	assert(pindown == PINDOWN);
+
+	assert(pindown_backoff_escalate(&pb));
+	assert(! pindown_backoff_escalate(&pb));
+	assert(pb.backoff == 1);
+
+	pindown_backoff_end(&pb, at(0, 200));
+
+	/* Escalation only takes effect from the next pindown */
+	pindown = pindown_backoff_start(&pb, PINDOWN, at(0, 300));
+	assert(pindown == 2 * PINDOWN);
+
+	assert(pindown_backoff_escalate(&pb));
+	pindown_backoff_end(&pb, at(0, 700));
+
+	pindown = pindown_backoff_start(&pb, PINDOWN, at(0, 800));
+	assert(pindown == 4 * PINDOWN);
+}
+
+/* The pindown never exceeds 32 times StickyPindown */
+static void test_cap(void)
+{
+	struct pindown_backoff pb;
+	uint32_t pindown = 0;
+	int i, msec = 0;
+
+	pindown_backoff_init(&pb);
+
+	for (i = 0; i < 10; i++) {
+		pindown = pindown_backoff_start(&pb, PINDOWN, at(0, msec));
+		assert(pindown <= 32 * PINDOWN);
+		if (i < PINDOWN_BACKOFF_MAX) {
+			assert(pindown_backoff_escalate(&pb));
+		} else {
+			assert(! pindown_backoff_escalate(&pb));
+		}
+		msec += 10;
+		pindown_backoff_end(&pb, at(0, msec));
+	}
+
+	assert(pb.backoff == PINDOWN_BACKOFF_MAX);
+	assert(pindown == 32 * PINDOWN);
+}
+
+/* Staying away for more than a second halves the pindown */
+static void test_decay(void)
+{
+	struct pindown_backoff pb;
+	uint32_t pindown;
+	int i;
+
+	pindown_backoff_init(&pb);
+	for (i = 0; i < 3; i++) {
+		pindown_backoff_start(&pb, PINDOWN, at(0, i * 10));
+		assert(pindown_backoff_escalate(&pb));
+		pindown_backoff_end(&pb, at(0, i * 10 + 5));
+	}
+	assert(pb.backoff == 3);
+
+	/* Back within a second, no decay */
+	pindown = pindown_backoff_start(&pb, PINDOWN, at(0, 900));
+	assert(pindown == 8 * PINDOWN);
+	pindown_backoff_end(&pb, at(2, 500));
+
+	/* Away for more than a second, one step down */
+	pindown = pindown_backoff_start(&pb, PINDOWN, at(4, 0));
+	assert(pindown == 4 * PINDOWN);
+	pindown_backoff_end(&pb, at(4, 800));
+
+	pindown = pindown_backoff_start(&pb, PINDOWN, at(6, 0));
+	assert(pindown == 2 * PINDOWN);
+	pindown_backoff_end(&pb, at(6, 400));
+
+	pindown = pindown_backoff_start(&pb, PINDOWN, at(8, 0));
+	assert(pindown == PINDOWN);
+	pindown_backoff_end(&pb, at(8, 200));
+
+	/* Never below StickyPindown */
+	pindown = pindown_backoff_start(&pb, PINDOWN, at(10, 0));
+	assert(pindown == PINDOWN);
+	assert(pb.backoff == 0);
+}
+
+int main(void)
+{
+	test_enter();
+	test_backoff();
+	test_cap();
+	test_decay();
+
+	return 0;
+}
@@ -310,6 +310,21 @@ void verify_ctdb_pulldb_ext(struct ctdb_pulldb_ext *p1,
 	assert(p1->srvid == p2->srvid);
 }
 
+void fill_ctdb_pulldb_delta(TALLOC_CTX *mem_ctx, struct ctdb_pulldb_delta *p)
+{
+	p->db_id = rand32();
+	p->generation = rand32();
+	p->srvid = rand64();
+}
+
+void verify_ctdb_pulldb_delta(struct ctdb_pulldb_delta *p1,
+			      struct ctdb_pulldb_delta *p2)
+{
+	assert(p1->db_id == p2->db_id);
+	assert(p1->generation == p2->generation);
+	assert(p1->srvid == p2->srvid);
+}
+
 void fill_ctdb_ltdb_header(struct ctdb_ltdb_header *p)
 {
 	p->rsn = rand64();
@@ -643,6 +658,10 @@ void fill_ctdb_tunable_list(TALLOC_CTX *mem_ctx, struct ctdb_tunable_list *p)
 	p->queue_buffer_size = rand32();
 	p->ip_alloc_algorithm = rand32();
 	p->allow_mixed_versions = rand32();
+	p->recovery_memory_limit = rand32();
+	p->hot_key_migration_rate = rand32();
+	p->vacuum_incremental = rand32();
+	p->lock_helper_pool = rand32();
 }
 
 void verify_ctdb_tunable_list(struct ctdb_tunable_list *p1,
@@ -710,6 +729,10 @@ void verify_ctdb_tunable_list(struct ctdb_tunable_list *p1,
 	assert(p1->queue_buffer_size == p2->queue_buffer_size);
 	assert(p1->ip_alloc_algorithm == p2->ip_alloc_algorithm);
 	assert(p1->allow_mixed_versions == p2->allow_mixed_versions);
+	assert(p1->recovery_memory_limit == p2->recovery_memory_limit);
+	assert(p1->hot_key_migration_rate == p2->hot_key_migration_rate);
+	assert(p1->vacuum_incremental == p2->vacuum_incremental);
+	assert(p1->lock_helper_pool == p2->lock_helper_pool);
 }
 
 void fill_ctdb_tickle_list(TALLOC_CTX *mem_ctx, struct ctdb_tickle_list *p)
@@ -1071,6 +1094,11 @@ void fill_ctdb_db_statistics(TALLOC_CTX *mem_ctx,
 		p->hop_count_bucket[i] = rand32();
 	}
 
+	p->damping.num_damped = rand32();
+	p->damping.num_backoff = rand32();
+	p->damping.num_deferred = rand32();
+	p->damping.max_pindown = rand32();
+
 	p->num_hot_keys = MAX_HOT_KEYS;
 	for (i=0; i<p->num_hot_keys; i++) {
 		p->hot_keys[i].count = rand32();
@@ -1100,6 +1128,11 @@ void verify_ctdb_db_statistics(struct ctdb_db_statistics *p1,
 		assert(p1->hop_count_bucket[i] == p2->hop_count_bucket[i]);
 	}
 
+	assert(p1->damping.num_damped == p2->damping.num_damped);
+	assert(p1->damping.num_backoff == p2->damping.num_backoff);
+	assert(p1->damping.num_deferred == p2->damping.num_deferred);
+	assert(p1->damping.max_pindown == p2->damping.max_pindown);
+
 	assert(p1->num_hot_keys == p2->num_hot_keys);
 	for (i=0; i<p1->num_hot_keys; i++) {
 		assert(p1->hot_keys[i].count == p2->hot_keys[i].count);
@@ -64,6 +64,10 @@ void fill_ctdb_pulldb_ext(TALLOC_CTX *mem_ctx, struct ctdb_pulldb_ext *p);
 void verify_ctdb_pulldb_ext(struct ctdb_pulldb_ext *p1,
 			    struct ctdb_pulldb_ext *p2);
 
+void fill_ctdb_pulldb_delta(TALLOC_CTX *mem_ctx, struct ctdb_pulldb_delta *p);
+void verify_ctdb_pulldb_delta(struct ctdb_pulldb_delta *p1,
+			      struct ctdb_pulldb_delta *p2);
+
 void fill_ctdb_ltdb_header(struct ctdb_ltdb_header *p);
 void verify_ctdb_ltdb_header(struct ctdb_ltdb_header *p1,
 			     struct ctdb_ltdb_header *p2);
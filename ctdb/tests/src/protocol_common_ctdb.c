@@ -609,6 +609,13 @@ void fill_ctdb_req_control_data(TALLOC_CTX *mem_ctx,
 
 	case CTDB_CONTROL_TUNNEL_DEREGISTER:
 		break;
+
+	case CTDB_CONTROL_DB_PULL_DELTA:
+		cd->data.pulldb_delta = talloc(mem_ctx,
+					       struct ctdb_pulldb_delta);
+		assert(cd->data.pulldb_delta != NULL);
+		fill_ctdb_pulldb_delta(mem_ctx, cd->data.pulldb_delta);
+		break;
 	}
 }
 
@@ -1016,6 +1023,11 @@ void verify_ctdb_req_control_data(struct ctdb_req_control_data *cd,
 
 	case CTDB_CONTROL_TUNNEL_DEREGISTER:
 		break;
+
+	case CTDB_CONTROL_DB_PULL_DELTA:
+		verify_ctdb_pulldb_delta(cd->data.pulldb_delta,
+					 cd2->data.pulldb_delta);
+		break;
 	}
 }
 
@@ -1431,6 +1443,10 @@ void fill_ctdb_reply_control_data(TALLOC_CTX *mem_ctx,
 	case CTDB_CONTROL_TUNNEL_DEREGISTER:
 		break;
 
+	case CTDB_CONTROL_DB_PULL_DELTA:
+		cd->data.num_records = rand32();
+		break;
+
 	}
 }
 
@@ -1781,6 +1797,10 @@ void verify_ctdb_reply_control_data(struct ctdb_reply_control_data *cd,
 	case CTDB_CONTROL_TUNNEL_DEREGISTER:
 		break;
 
+	case CTDB_CONTROL_DB_PULL_DELTA:
+		assert(cd->data.num_records == cd2->data.num_records);
+		break;
+
 	}
 }
 
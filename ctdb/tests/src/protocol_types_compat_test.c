@@ -1981,17 +1981,18 @@ static int ctdb_key_data_pull_old(uint8_t *buf, size_t buflen,
 	return 0;
 }
 
-struct ctdb_db_statistics_wire {
-	struct ctdb_db_statistics dbstats;
-	char hot_keys_wire[1];
-};
+/*
+ * The hot key data follows the hot_keys array, the damping statistics
+ * are appended after it
+ */
+#define DB_STATISTICS_FIXED_LEN offsetof(struct ctdb_db_statistics, damping)
 
 static size_t ctdb_db_statistics_len_old(struct ctdb_db_statistics *in)
 {
 	size_t len;
 	int i;
 
-	len = sizeof(struct ctdb_db_statistics);
+	len = DB_STATISTICS_FIXED_LEN + sizeof(in->damping);
 	for (i=0; i<MAX_HOT_KEYS; i++) {
 		len += in->hot_keys[i].key.dsize;
 	}
@@ -2001,21 +2002,22 @@ static size_t ctdb_db_statistics_len_old(struct ctdb_db_statistics *in)
 static void ctdb_db_statistics_push_old(struct ctdb_db_statistics *in,
 					void *buf)
 {
-	struct ctdb_db_statistics_wire *wire =
-		(struct ctdb_db_statistics_wire *)buf;
+	uint8_t *ptr = (uint8_t *)buf;
 	size_t offset;
 	int i;
 
 	in->num_hot_keys = MAX_HOT_KEYS;
-	memcpy(wire, in, sizeof(struct ctdb_db_statistics));
+	memcpy(ptr, in, DB_STATISTICS_FIXED_LEN);
 
-	offset = 0;
+	offset = DB_STATISTICS_FIXED_LEN;
 	for (i=0; i<MAX_HOT_KEYS; i++) {
-		memcpy(&wire->hot_keys_wire[offset],
+		memcpy(&ptr[offset],
 		       in->hot_keys[i].key.dptr,
 		       in->hot_keys[i].key.dsize);
 		offset += in->hot_keys[i].key.dsize;
 	}
+
+	memcpy(&ptr[offset], &in->damping, sizeof(in->damping));
 }
 
 static int ctdb_db_statistics_pull_old(uint8_t *buf, size_t buflen,
@@ -2023,51 +2025,49 @@ static int ctdb_db_statistics_pull_old(uint8_t *buf, size_t buflen,
 				       struct ctdb_db_statistics **out)
 {
 	struct ctdb_db_statistics *val;
-	struct ctdb_db_statistics_wire *wire =
-		(struct ctdb_db_statistics_wire *)buf;
+	struct ctdb_db_statistics *wire = (struct ctdb_db_statistics *)buf;
 	size_t offset;
 	unsigned int i;
 
-	if (buflen < sizeof(struct ctdb_db_statistics)) {
+	if (buflen < DB_STATISTICS_FIXED_LEN) {
 		return EMSGSIZE;
 	}
 
 	offset = 0;
-	for (i=0; i<wire->dbstats.num_hot_keys; i++) {
-		if (wire->dbstats.hot_keys[i].key.dsize > buflen) {
+	for (i=0; i<wire->num_hot_keys; i++) {
+		if (wire->hot_keys[i].key.dsize > buflen) {
 			return EMSGSIZE;
 		}
-		if (offset + wire->dbstats.hot_keys[i].key.dsize < offset) {
+		if (offset + wire->hot_keys[i].key.dsize < offset) {
 			return EMSGSIZE;
 		}
-		offset += wire->dbstats.hot_keys[i].key.dsize;
+		offset += wire->hot_keys[i].key.dsize;
 		if (offset > buflen) {
 			return EMSGSIZE;
 		}
 	}
-	if (sizeof(struct ctdb_db_statistics) + offset <
-	    sizeof(struct ctdb_db_statistics)) {
+	if (DB_STATISTICS_FIXED_LEN + offset < DB_STATISTICS_FIXED_LEN) {
 		return EMSGSIZE;
 	}
-	if (buflen < sizeof(struct ctdb_db_statistics) + offset) {
+	if (buflen < DB_STATISTICS_FIXED_LEN + offset +
+		     sizeof(wire->damping)) {
 		return EMSGSIZE;
 	}
 
-	val = talloc(mem_ctx, struct ctdb_db_statistics);
+	val = talloc_zero(mem_ctx, struct ctdb_db_statistics);
 	if (val == NULL) {
 		return ENOMEM;
 	}
 
-	memcpy(val, wire, sizeof(struct ctdb_db_statistics));
+	memcpy(val, wire, DB_STATISTICS_FIXED_LEN);
 
-	offset = 0;
-	for (i=0; i<wire->dbstats.num_hot_keys; i++) {
+	offset = DB_STATISTICS_FIXED_LEN;
+	for (i=0; i<wire->num_hot_keys; i++) {
 		uint8_t *ptr;
 		size_t key_size;
 
 		key_size = val->hot_keys[i].key.dsize;
-		ptr = talloc_memdup(mem_ctx, &wire->hot_keys_wire[offset],
-				    key_size);
+		ptr = talloc_memdup(mem_ctx, &buf[offset], key_size);
 		if (ptr == NULL) {
 			talloc_free(val);
 			return ENOMEM;
@@ -2076,6 +2076,8 @@ static int ctdb_db_statistics_pull_old(uint8_t *buf, size_t buflen,
 		offset += key_size;
 	}
 
+	memcpy(&val->damping, &buf[offset], sizeof(val->damping));
+
 	*out = val;
 	return 0;
 }
@@ -38,6 +38,7 @@ PROTOCOL_TYPE3_TEST(struct ctdb_dbid, ctdb_dbid);
 PROTOCOL_TYPE3_TEST(struct ctdb_dbid_map, ctdb_dbid_map);
 PROTOCOL_TYPE3_TEST(struct ctdb_pulldb, ctdb_pulldb);
 PROTOCOL_TYPE3_TEST(struct ctdb_pulldb_ext, ctdb_pulldb_ext);
+PROTOCOL_TYPE3_TEST(struct ctdb_pulldb_delta, ctdb_pulldb_delta);
 PROTOCOL_TYPE1_TEST(struct ctdb_ltdb_header, ctdb_ltdb_header);
 PROTOCOL_TYPE3_TEST(struct ctdb_rec_data, ctdb_rec_data);
 PROTOCOL_TYPE3_TEST(struct ctdb_rec_buffer, ctdb_rec_buffer);
@@ -126,6 +127,37 @@ static void test_ctdb_rec_buffer_read_write(void)
 	talloc_free(mem_ctx);
 }
 
+/* Replies from older daemons end with the hot keys */
+static void test_ctdb_db_statistics_without_damping(void)
+{
+	TALLOC_CTX *mem_ctx = talloc_new(NULL);
+	struct ctdb_db_statistics p1, *p2;
+	uint8_t *buf;
+	size_t buflen, np;
+	int ret;
+
+	fill_ctdb_db_statistics(mem_ctx, &p1);
+	buflen = ctdb_db_statistics_len(&p1);
+	buf = talloc_size(mem_ctx, buflen);
+	assert(buf != NULL);
+	ctdb_db_statistics_push(&p1, buf, &np);
+	assert(np == buflen);
+
+	buflen -= sizeof(p1.damping);
+	ret = ctdb_db_statistics_pull(buf, buflen, mem_ctx, &p2, &np);
+	assert(ret == 0);
+	assert(np == buflen);
+
+	ZERO_STRUCT(p1.damping);
+	verify_ctdb_db_statistics(&p1, p2);
+
+	/* A partial damping section is an error */
+	ret = ctdb_db_statistics_pull(buf, buflen + 1, mem_ctx, &p2, &np);
+	assert(ret == EMSGSIZE);
+
+	talloc_free(mem_ctx);
+}
+
 int main(int argc, char *argv[])
 {
 	if (argc == 2) {
@@ -143,6 +175,7 @@ int main(int argc, char *argv[])
 	TEST_FUNC(ctdb_dbid_map)();
 	TEST_FUNC(ctdb_pulldb)();
 	TEST_FUNC(ctdb_pulldb_ext)();
+	TEST_FUNC(ctdb_pulldb_delta)();
 	TEST_FUNC(ctdb_ltdb_header)();
 	TEST_FUNC(ctdb_rec_data)();
 	TEST_FUNC(ctdb_rec_buffer)();
@@ -186,6 +219,7 @@ int main(int argc, char *argv[])
 	TEST_FUNC(sock_packet_header)();
 
 	test_ctdb_rec_buffer_read_write();
+	test_ctdb_db_statistics_without_damping();
 
 	return 0;
 }
@@ -0,0 +1,373 @@
+/*
+   ctdb benchmark for transactions per second on persistent databases
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "system/network.h"
+#include "system/time.h"
+
+#include "lib/util/debug.h"
+#include "lib/util/time.h"
+#include "lib/util/tevent_unix.h"
+
+#include "client/client.h"
+#include "tests/src/test_options.h"
+#include "tests/src/cluster_wait.h"
+
+struct transaction_bench_state {
+	struct tevent_context *ev;
+	struct ctdb_client_context *client;
+	struct ctdb_db_context *ctdb_db;
+	int num_nodes;
+	int timelimit;
+	int interactive;
+	TDB_DATA key;
+	struct ctdb_transaction_handle *h;
+	struct timeval start_time;
+	uint32_t count, last_count;
+	bool done;
+};
+
+static void transaction_bench_start(struct tevent_req *subreq);
+static void transaction_bench_next(struct tevent_req *req);
+static void transaction_bench_started(struct tevent_req *subreq);
+static void transaction_bench_committed(struct tevent_req *subreq);
+static void transaction_bench_each_second(struct tevent_req *subreq);
+static void transaction_bench_finish(struct tevent_req *subreq);
+
+static struct tevent_req *transaction_bench_send(
+				TALLOC_CTX *mem_ctx,
+				struct tevent_context *ev,
+				struct ctdb_client_context *client,
+				struct ctdb_db_context *ctdb_db,
+				int num_nodes, int timelimit, int interactive,
+				const char *keystr)
+{
+	struct tevent_req *req, *subreq;
+	struct transaction_bench_state *state;
+	char *key;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct transaction_bench_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	state->ev = ev;
+	state->client = client;
+	state->ctdb_db = ctdb_db;
+	state->num_nodes = num_nodes;
+	state->timelimit = timelimit;
+	state->interactive = interactive;
+
+	/* Each node updates its own key, so only the commits contend */
+	key = talloc_asprintf(state, "%s-%u", keystr,
+			      ctdb_client_pnn(client));
+	if (tevent_req_nomem(key, req)) {
+		return tevent_req_post(req, ev);
+	}
+	state->key.dptr = (uint8_t *)key;
+	state->key.dsize = strlen(key);
+
+	subreq = cluster_wait_send(state, state->ev, state->client,
+				   state->num_nodes);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, transaction_bench_start, req);
+
+	return req;
+}
+
+static void transaction_bench_start(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct transaction_bench_state *state = tevent_req_data(
+		req, struct transaction_bench_state);
+	bool status;
+	int ret;
+
+	status = cluster_wait_recv(subreq, &ret);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		tevent_req_error(req, ret);
+		return;
+	}
+
+	state->start_time = tevent_timeval_current();
+
+	if (state->interactive == 1) {
+		subreq = tevent_wakeup_send(state, state->ev,
+					    tevent_timeval_current_ofs(1, 0));
+		if (tevent_req_nomem(subreq, req)) {
+			return;
+		}
+		tevent_req_set_callback(subreq, transaction_bench_each_second,
+					req);
+	}
+
+	subreq = tevent_wakeup_send(state, state->ev,
+				    tevent_timeval_current_ofs(
+					    state->timelimit, 0));
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, transaction_bench_finish, req);
+
+	transaction_bench_next(req);
+}
+
+static void transaction_bench_next(struct tevent_req *req)
+{
+	struct transaction_bench_state *state = tevent_req_data(
+		req, struct transaction_bench_state);
+	struct tevent_req *subreq;
+
+	subreq = ctdb_transaction_start_send(state, state->ev, state->client,
+					     tevent_timeval_current_ofs(
+						     state->timelimit, 0),
+					     state->ctdb_db, false);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, transaction_bench_started, req);
+}
+
+static void transaction_bench_started(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct transaction_bench_state *state = tevent_req_data(
+		req, struct transaction_bench_state);
+	TDB_DATA data;
+	uint32_t counter = 0;
+	int ret;
+
+	state->h = ctdb_transaction_start_recv(subreq, &ret);
+	TALLOC_FREE(subreq);
+	if (state->h == NULL) {
+		fprintf(stderr, "transaction start failed\n");
+		tevent_req_error(req, ret);
+		return;
+	}
+
+	ret = ctdb_transaction_fetch_record(state->h, state->key,
+					    state, &data);
+	if (ret != 0) {
+		fprintf(stderr, "transaction fetch record failed\n");
+		tevent_req_error(req, ret);
+		return;
+	}
+
+	if (data.dsize == sizeof(uint32_t)) {
+		memcpy(&counter, data.dptr, sizeof(uint32_t));
+	}
+	TALLOC_FREE(data.dptr);
+
+	counter += 1;
+	data.dptr = (uint8_t *)&counter;
+	data.dsize = sizeof(uint32_t);
+
+	ret = ctdb_transaction_store_record(state->h, state->key, data);
+	if (ret != 0) {
+		fprintf(stderr, "transaction store failed\n");
+		tevent_req_error(req, ret);
+		return;
+	}
+
+	subreq = ctdb_transaction_commit_send(state, state->ev,
+					      tevent_timeval_current_ofs(
+						      state->timelimit, 0),
+					      state->h);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, transaction_bench_committed, req);
+}
+
+static void transaction_bench_committed(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct transaction_bench_state *state = tevent_req_data(
+		req, struct transaction_bench_state);
+	int ret;
+	bool status;
+
+	status = ctdb_transaction_commit_recv(subreq, &ret);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		fprintf(stderr, "transaction commit failed - %s\n",
+			strerror(ret));
+		tevent_req_error(req, ret);
+		return;
+	}
+
+	state->count += 1;
+
+	if (state->done) {
+		double t = timeval_elapsed(&state->start_time);
+
+		printf("Transaction[%u]: %.2f transactions/sec\n",
+		       ctdb_client_pnn(state->client), state->count / t);
+
+		tevent_req_done(req);
+		return;
+	}
+
+	transaction_bench_next(req);
+}
+
+static void transaction_bench_each_second(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct transaction_bench_state *state = tevent_req_data(
+		req, struct transaction_bench_state);
+	bool status;
+
+	status = tevent_wakeup_recv(subreq);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		fprintf(stderr, "tevent wakeup failed\n");
+		tevent_req_error(req, EIO);
+		return;
+	}
+
+	printf("Transaction[%u]: %u transactions/sec\n",
+	       ctdb_client_pnn(state->client),
+	       state->count - state->last_count);
+	fflush(stdout);
+	state->last_count = state->count;
+
+	subreq = tevent_wakeup_send(state, state->ev,
+				    tevent_timeval_current_ofs(1, 0));
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, transaction_bench_each_second, req);
+}
+
+static void transaction_bench_finish(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct transaction_bench_state *state = tevent_req_data(
+		req, struct transaction_bench_state);
+	bool status;
+
+	status = tevent_wakeup_recv(subreq);
+	TALLOC_FREE(subreq);
+
+	state->done = true;
+
+	if (! status) {
+		tevent_req_error(req, EIO);
+		return;
+	}
+}
+
+static bool transaction_bench_recv(struct tevent_req *req, int *perr)
+{
+	int err;
+
+	if (tevent_req_is_unix_error(req, &err)) {
+		if (perr != NULL) {
+			*perr = err;
+		}
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, const char *argv[])
+{
+	const struct test_options *opts;
+	TALLOC_CTX *mem_ctx;
+	struct tevent_context *ev;
+	struct ctdb_client_context *client;
+	struct ctdb_db_context *ctdb_db;
+	struct tevent_req *req;
+	uint8_t db_flags;
+	int ret;
+	bool status;
+
+	setup_logging("transaction_bench", DEBUG_STDERR);
+
+	status = process_options_database(argc, argv, &opts);
+	if (! status) {
+		exit(1);
+	}
+
+	mem_ctx = talloc_new(NULL);
+	if (mem_ctx == NULL) {
+		fprintf(stderr, "Memory allocation error\n");
+		exit(1);
+	}
+
+	ev = tevent_context_init(mem_ctx);
+	if (ev == NULL) {
+		fprintf(stderr, "Memory allocation error\n");
+		exit(1);
+	}
+
+	ret = ctdb_client_init(mem_ctx, ev, opts->socket, &client);
+	if (ret != 0) {
+		fprintf(stderr, "Failed to initialize client, ret=%d\n", ret);
+		exit(1);
+	}
+
+	if (! ctdb_recovery_wait(ev, client)) {
+		fprintf(stderr, "Memory allocation error\n");
+		exit(1);
+	}
+
+	if (strcmp(opts->dbtype, "persistent") == 0) {
+		db_flags = CTDB_DB_FLAGS_PERSISTENT;
+	} else if (strcmp(opts->dbtype, "replicated") == 0) {
+		db_flags = CTDB_DB_FLAGS_REPLICATED;
+	} else {
+		fprintf(stderr, "Database must be persistent or replicated\n");
+		exit(1);
+	}
+
+	ret = ctdb_attach(ev, client, tevent_timeval_zero(), opts->dbname,
+			  db_flags, &ctdb_db);
+	if (ret != 0) {
+		fprintf(stderr, "Failed to attach to DB %s\n", opts->dbname);
+		exit(1);
+	}
+
+	req = transaction_bench_send(mem_ctx, ev, client, ctdb_db,
+				     opts->num_nodes, opts->timelimit,
+				     opts->interactive, opts->keystr);
+	if (req == NULL) {
+		fprintf(stderr, "Memory allocation error\n");
+		exit(1);
+	}
+
+	tevent_req_poll(req, ev);
+
+	status = transaction_bench_recv(req, &ret);
+	if (! status) {
+		fprintf(stderr, "transaction bench failed, ret=%d\n", ret);
+		exit(1);
+	}
+
+	talloc_free(mem_ctx);
+	return 0;
+}
@@ -0,0 +1,31 @@
+#!/bin/sh
+
+. "${TEST_SCRIPTS_DIR}/unit.sh"
+
+define_test "3 nodes, no load, 1 -> all healthy"
+
+export CTDB_TEST_LOGLEVEL=ERR
+
+required_result <<EOF
+192.168.21.254 1
+192.168.21.253 2
+192.168.21.252 1
+192.168.20.254 2
+192.168.20.253 1
+192.168.20.252 2
+192.168.20.251 0
+192.168.20.250 0
+192.168.20.249 0
+EOF
+
+simple_test 0,0,0 <<EOF
+192.168.20.249 0
+192.168.20.250 0
+192.168.20.251 0
+192.168.20.252 0
+192.168.20.253 0
+192.168.20.254 0
+192.168.21.252 0
+192.168.21.253 0
+192.168.21.254 0
+EOF
@@ -0,0 +1,32 @@
+#!/bin/sh
+
+. "${TEST_SCRIPTS_DIR}/unit.sh"
+
+define_test "3 nodes, all healthy, 1 busy IP per node, rebalance around hottest"
+
+export CTDB_TEST_LOGLEVEL=ERR
+export CTDB_TEST_IP_LOAD="192.168.20.249=100,192.168.20.250=40,192.168.20.251=30"
+
+required_result <<EOF
+192.168.21.254 2
+192.168.21.253 1
+192.168.21.252 2
+192.168.20.254 2
+192.168.20.253 1
+192.168.20.252 2
+192.168.20.251 2
+192.168.20.250 1
+192.168.20.249 0
+EOF
+
+simple_test 0,0,0 <<EOF
+192.168.20.249 0
+192.168.20.250 1
+192.168.20.251 2
+192.168.20.252 0
+192.168.20.253 1
+192.168.20.254 2
+192.168.21.252 0
+192.168.21.253 1
+192.168.21.254 2
+EOF
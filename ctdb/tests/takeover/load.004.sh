@@ -0,0 +1,32 @@
+#!/bin/sh
+
+. "${TEST_SCRIPTS_DIR}/unit.sh"
+
+define_test "3 nodes, busy IPs, all -> 2 healthy"
+
+export CTDB_TEST_LOGLEVEL=ERR
+export CTDB_TEST_IP_LOAD="192.168.20.249=50,192.168.20.251=30,192.168.20.254=20,192.168.21.254=5"
+
+required_result <<EOF
+192.168.21.254 0
+192.168.21.253 1
+192.168.21.252 1
+192.168.20.254 1
+192.168.20.253 1
+192.168.20.252 1
+192.168.20.251 1
+192.168.20.250 1
+192.168.20.249 0
+EOF
+
+simple_test 0,0,2 <<EOF
+192.168.20.249 0
+192.168.20.250 1
+192.168.20.251 2
+192.168.20.252 0
+192.168.20.253 1
+192.168.20.254 2
+192.168.21.252 0
+192.168.21.253 1
+192.168.21.254 2
+EOF
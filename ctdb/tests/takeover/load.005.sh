@@ -0,0 +1,32 @@
+#!/bin/sh
+
+. "${TEST_SCRIPTS_DIR}/unit.sh"
+
+define_test "3 nodes, busy IPs, 2 -> all healthy"
+
+export CTDB_TEST_LOGLEVEL=ERR
+export CTDB_TEST_IP_LOAD="192.168.20.249=50,192.168.20.251=30,192.168.20.254=20,192.168.21.254=5"
+
+required_result <<EOF
+192.168.21.254 1
+192.168.21.253 1
+192.168.21.252 0
+192.168.20.254 0
+192.168.20.253 1
+192.168.20.252 0
+192.168.20.251 1
+192.168.20.250 1
+192.168.20.249 2
+EOF
+
+simple_test 0,0,0 <<EOF
+192.168.20.249 0
+192.168.20.250 1
+192.168.20.251 1
+192.168.20.252 0
+192.168.20.253 1
+192.168.20.254 0
+192.168.21.252 0
+192.168.21.253 1
+192.168.21.254 1
+EOF
@@ -8,7 +8,7 @@ define_test ()
 
     export CTDB_IP_ALGORITHM="${_f%%.*}"
     case "$CTDB_IP_ALGORITHM" in
-	lcp2|nondet|det) : ;;
+	lcp2|nondet|det|load) : ;;
 	*) die "Unknown algorithm for testcase \"$_f\"" ;;
     esac
 
@@ -62,6 +62,10 @@ RecBufferSizeLimit         = 1000000
 QueueBufferSize            = 1024
 IPAllocAlgorithm           = 2
 AllowMixedVersions         = 0
+RecoveryMemoryLimit        = 1073741824
+HotKeyMigrationRate        = 100
+VacuumIncremental          = 0
+LockHelperPool             = 8
 EOF
 
 simple_test
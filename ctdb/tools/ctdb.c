@@ -5634,6 +5634,10 @@ const struct {
 	DBSTATISTICS_FIELD(locks.num_current),
 	DBSTATISTICS_FIELD(locks.num_pending),
 	DBSTATISTICS_FIELD(locks.num_failed),
+	DBSTATISTICS_FIELD(damping.num_damped),
+	DBSTATISTICS_FIELD(damping.num_backoff),
+	DBSTATISTICS_FIELD(damping.num_deferred),
+	DBSTATISTICS_FIELD(damping.max_pindown),
 };
 
 static void print_dbstatistics(const char *db_name,
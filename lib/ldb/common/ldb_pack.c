@@ -240,18 +240,87 @@ static int ldb_pack_data_v1(struct ldb_context *ldb,
  * # For each element:
  * 	# For each value:
  *	 	Value data (#bytes given by corresponding length above)
+ *
+ * Version 3 is version 2 with an attribute directory, so a single
+ * attribute can be found and decoded without walking all the others:
+ *
+ * Version (4 bytes)
+ * ... as version 2 up to and including the value data section offset
+ * # For each element, sorted by ldb_pack_attr_cmp() of the name:
+ * 	Offset of the element from the value data section offset field
+ * 	(4 bytes)
+ * # For each element:
+ * 	Element name length (4 bytes)
+ * 	Element name with null terminator (Element name length + 1 bytes)
+ * 	Number of values (4 bytes)
+ * 	Offset of the first value in the value data section (4 bytes)
+ * 	Width of value lengths
+ * 	# For each value:
+ * 		Value data length (#bytes given by width field above)
+ * # For each element:
+ * 	# For each value:
+ *	 	Value data (#bytes given by corresponding length above)
  */
+
+/*
+ * Attribute names are ASCII, so the directory is sorted with a
+ * locale independent case insensitive compare, which gives the
+ * same answers as ldb_attr_cmp() for them.
+ */
+static int ldb_pack_ascii_tolower(unsigned char c)
+{
+	if (c >= 'A' && c <= 'Z') {
+		return c - 'A' + 'a';
+	}
+	return c;
+}
+
+static int ldb_pack_attr_cmp(const char *a, const char *b)
+{
+	int ca, cb;
+
+	do {
+		ca = ldb_pack_ascii_tolower(*a++);
+		cb = ldb_pack_ascii_tolower(*b++);
+	} while (ca == cb && ca != '\0');
+
+	return ca - cb;
+}
+
+struct ldb_pack_dir_entry {
+	const char *name;
+	uint32_t offset;
+};
+
+static int ldb_pack_dir_entry_cmp(const struct ldb_pack_dir_entry *a,
+				  const struct ldb_pack_dir_entry *b)
+{
+	int cmp = ldb_pack_attr_cmp(a->name, b->name);
+	if (cmp != 0) {
+		return cmp;
+	}
+	/* Keep duplicate names in message order */
+	if (a->offset < b->offset) {
+		return -1;
+	}
+	return a->offset > b->offset;
+}
+
 static int ldb_pack_data_v2(struct ldb_context *ldb,
 			    const struct ldb_message *message,
-			    struct ldb_val *data)
+			    struct ldb_val *data,
+			    uint32_t pack_format_version)
 {
-	unsigned int i, j, real_elements=0;
+	unsigned int i, j, real_elements=0, num_dir=0;
 	size_t size, dn_len, dn_canon_len, attr_len, value_len;
 	const char *dn, *dn_canon;
-	uint8_t *p, *q;
+	uint8_t *p, *q, *dir_p = NULL;
 	size_t len;
 	size_t max_val_len;
+	size_t value_offset = 0;
 	uint8_t val_len_width;
+	struct ldb_pack_dir_entry *dir = NULL;
+	bool v3 = (pack_format_version == LDB_PACKING_FORMAT_V3);
 
 	/*
 	 * First half of this function will calculate required size for
@@ -316,6 +385,15 @@ static int ldb_pack_data_v2(struct ldb_context *ldb,
 		}
 		size += attr_len + U32_LEN * 2 + NULL_PAD_BYTE_LEN;
 
+		/* Directory entry and value offset */
+		if (v3) {
+			if (size + U32_LEN * 2 < size) {
+				errno = ENOMEM;
+				return -1;
+			}
+			size += U32_LEN * 2;
+		}
+
 		/*
 		 * Find the max value length, so we can calculate the width
 		 * required for the value length fields.
@@ -365,9 +443,19 @@ static int ldb_pack_data_v2(struct ldb_context *ldb,
 	}
 	data->length = size;
 
+	if (v3 && real_elements > 0) {
+		dir = talloc_array(data->data, struct ldb_pack_dir_entry,
+				   real_elements);
+		if (dir == NULL) {
+			TALLOC_FREE(data->data);
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+
 	/* Packing format version and number of element */
 	p = data->data;
-	PUSH_LE_U32(p, 0, LDB_PACKING_FORMAT_V2);
+	PUSH_LE_U32(p, 0, pack_format_version);
 	p += U32_LEN;
 	PUSH_LE_U32(p, 0, real_elements);
 	p += U32_LEN;
@@ -391,11 +479,23 @@ static int ldb_pack_data_v2(struct ldb_context *ldb,
 	q = p;
 	p += U32_LEN;
 
+	/* Leave room for the directory, filled in below */
+	if (v3) {
+		dir_p = p;
+		p += U32_LEN * real_elements;
+	}
+
 	for (i=0;i<message->num_elements;i++) {
 		if (attribute_storable_values(&message->elements[i]) == 0) {
 			continue;
 		}
 
+		if (dir != NULL) {
+			dir[num_dir].name = message->elements[i].name;
+			dir[num_dir].offset = p - q;
+			num_dir++;
+		}
+
 		/* Length of el name */
 		len = strlen(message->elements[i].name);
 		PUSH_LE_U32(p, 0, len);
@@ -426,6 +526,22 @@ static int ldb_pack_data_v2(struct ldb_context *ldb,
 			}
 		}
 
+		/* Where the values start in the value section */
+		if (v3) {
+			if (value_offset > UINT32_MAX) {
+				TALLOC_FREE(data->data);
+				errno = EMSGSIZE;
+				return -1;
+			}
+			PUSH_LE_U32(p, 0, value_offset);
+			p += U32_LEN;
+			for (j=0;j<message->elements[i].num_values;j++) {
+				value_offset +=
+					message->elements[i].values[j].length +
+					NULL_PAD_BYTE_LEN;
+			}
+		}
+
 		if (max_val_len <= UCHAR_MAX) {
 			val_len_width = U8_LEN;
 		} else if (max_val_len <= USHRT_MAX) {
@@ -474,6 +590,15 @@ static int ldb_pack_data_v2(struct ldb_context *ldb,
 	 */
 	PUSH_LE_U32(q, 0, p-q);
 
+	if (dir != NULL) {
+		TYPESAFE_QSORT(dir, num_dir, ldb_pack_dir_entry_cmp);
+		for (i=0;i<num_dir;i++) {
+			PUSH_LE_U32(dir_p, 0, dir[i].offset);
+			dir_p += U32_LEN;
+		}
+		TALLOC_FREE(dir);
+	}
+
 	/* Now pack the values */
 	for (i=0;i<message->num_elements;i++) {
 		if (attribute_storable_values(&message->elements[i]) == 0) {
@@ -522,20 +647,44 @@ int ldb_pack_data(struct ldb_context *ldb,
 
 	if (pack_format_version == LDB_PACKING_FORMAT) {
 		return ldb_pack_data_v1(ldb, message, data);
-	} else if (pack_format_version == LDB_PACKING_FORMAT_V2) {
-		return ldb_pack_data_v2(ldb, message, data);
+	} else if (pack_format_version == LDB_PACKING_FORMAT_V2 ||
+		   pack_format_version == LDB_PACKING_FORMAT_V3) {
+		return ldb_pack_data_v2(ldb, message, data,
+					pack_format_version);
 	} else {
 		errno = EINVAL;
 		return -1;
 	}
 }
 
+/*
+ * Is attr in the NULL terminated list of attributes to unpack?  A
+ * NULL list means all of them.
+ */
+static bool ldb_unpack_attr_wanted(const char *attr,
+				   const char * const *attrs)
+{
+	unsigned int i;
+
+	if (attrs == NULL) {
+		return true;
+	}
+
+	for (i = 0; attrs[i] != NULL; i++) {
+		if (ldb_attr_cmp(attr, attrs[i]) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
  * Unpack a ldb message from a linear buffer in ldb_val
  */
 static int ldb_unpack_data_flags_v1(struct ldb_context *ldb,
 				    const struct ldb_val *data,
 				    struct ldb_message *message,
+				    const char * const *attrs,
 				    unsigned int flags,
 				    unsigned format)
 {
@@ -650,6 +799,7 @@ static int ldb_unpack_data_flags_v1(struct ldb_context *ldb,
 	for (i=0;i<message->num_elements;i++) {
 		const char *attr = NULL;
 		size_t attr_len;
+		uint32_t num_values;
 		struct ldb_message_element *element = NULL;
 
 		/*
@@ -676,24 +826,34 @@ static int ldb_unpack_data_flags_v1(struct ldb_context *ldb,
 		}
 		attr = (char *)p;
 
-		element = &message->elements[nelem];
-		element->name = attr;
-		element->flags = 0;
-
 		if (remaining < (attr_len + NULL_PAD_BYTE_LEN)) {
 			errno = EIO;
 			goto failed;
 		}
 		remaining -= attr_len + NULL_PAD_BYTE_LEN;
 		p += attr_len + NULL_PAD_BYTE_LEN;
-		element->num_values = PULL_LE_U32(p, 0);
-		element->values = NULL;
-		if ((flags & LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC) && element->num_values == 1) {
+		num_values = PULL_LE_U32(p, 0);
+
+		/*
+		 * Attributes we were not asked for are stepped over
+		 * without allocating anything for their values
+		 */
+		if (ldb_unpack_attr_wanted(attr, attrs)) {
+			element = &message->elements[nelem];
+			element->name = attr;
+			element->flags = 0;
+			element->num_values = num_values;
+			element->values = NULL;
+		}
+		if (element == NULL || num_values == 0) {
+			/* nothing to allocate */
+		} else if ((flags & LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC) &&
+			   num_values == 1) {
 			element->values = &ldb_val_single_array[nelem];
-		} else if (element->num_values != 0) {
+		} else {
 			element->values = talloc_array(message->elements,
 						       struct ldb_val,
-						       element->num_values);
+						       num_values);
 			if (!element->values) {
 				errno = ENOMEM;
 				goto failed;
@@ -705,7 +865,7 @@ static int ldb_unpack_data_flags_v1(struct ldb_context *ldb,
 			goto failed;
 		}
 		remaining -= U32_LEN;
-		for (j = 0; j < element->num_values; j++) {
+		for (j = 0; j < num_values; j++) {
 			/*
 			 * Sanity check: Value must be at least the size of
 			 * empty val and NULL terminator.
@@ -726,12 +886,16 @@ static int ldb_unpack_data_flags_v1(struct ldb_context *ldb,
 				goto failed;
 			}
 
-			element->values[j].length = len;
-			element->values[j].data = p + U32_LEN;
+			if (element != NULL) {
+				element->values[j].length = len;
+				element->values[j].data = p + U32_LEN;
+			}
 			remaining -= len;
 			p += len + U32_LEN + NULL_PAD_BYTE_LEN;
 		}
-		nelem++;
+		if (element != NULL) {
+			nelem++;
+		}
 	}
 	/*
 	 * Adapt the number of elements to the real number of unpacked elements,
@@ -760,15 +924,280 @@ failed:
 	return -1;
 }
 
+/*
+ * Step over the values of an attribute in a v2 packed message
+ * without unpacking them: p points at the value lengths, q at the
+ * values themselves.
+ */
+static int ldb_unpack_skip_values_v2(uint8_t **_p, uint8_t **_q,
+				     const uint8_t *end_p,
+				     uint32_t num_values,
+				     uint8_t val_len_width)
+{
+	uint8_t *p = *_p;
+	uint8_t *q = *_q;
+	uint32_t j;
+
+	if (val_len_width != U8_LEN &&
+	    val_len_width != U16_LEN &&
+	    val_len_width != U32_LEN) {
+		errno = ERANGE;
+		return -1;
+	}
+
+	for (j = 0; j < num_values; j++) {
+		size_t len;
+
+		if (val_len_width == U8_LEN) {
+			len = PULL_LE_U8(p, 0);
+		} else if (val_len_width == U16_LEN) {
+			len = PULL_LE_U16(p, 0);
+		} else {
+			len = PULL_LE_U32(p, 0);
+		}
+		p += val_len_width;
+
+		if (len + NULL_PAD_BYTE_LEN < len) {
+			errno = EIO;
+			return -1;
+		}
+		if (len + NULL_PAD_BYTE_LEN > end_p - q) {
+			errno = EIO;
+			return -1;
+		}
+		q += len + NULL_PAD_BYTE_LEN;
+	}
+
+	*_p = p;
+	*_q = q;
+	return 0;
+}
+
+/*
+ * Find the name of the n-th entry of the attribute directory of a
+ * version 3 record, checking that the entry is within the attribute
+ * section.
+ */
+static const char *ldb_unpack_dir_name_v3(const uint8_t *attr_section_p,
+					  const uint8_t *elements_p,
+					  const uint8_t *value_section_p,
+					  const uint8_t *dir_p,
+					  uint32_t n)
+{
+	const uint8_t *e = attr_section_p + PULL_LE_U32(dir_p, n * U32_LEN);
+	size_t attr_len;
+
+	if (e < elements_p || e + U32_LEN > value_section_p) {
+		return NULL;
+	}
+	attr_len = PULL_LE_U32(e, 0);
+	if (attr_len == 0 ||
+	    attr_len + NULL_PAD_BYTE_LEN > value_section_p - (e + U32_LEN)) {
+		return NULL;
+	}
+	if (e[U32_LEN + attr_len] != '\0') {
+		return NULL;
+	}
+	return (const char *)e + U32_LEN;
+}
+
+static int ldb_unpack_offset_cmp(const uint32_t *a, const uint32_t *b)
+{
+	if (*a < *b) {
+		return -1;
+	}
+	return *a > *b;
+}
+
+/*
+ * Unpack only the attributes in attrs from a version 3 record, by
+ * looking each of them up in the attribute directory.  The elements
+ * are returned in the order they were packed, as with a full unpack.
+ */
+static int ldb_unpack_attrs_v3(struct ldb_message *message,
+			       const char * const *attrs,
+			       unsigned int flags,
+			       struct ldb_val *ldb_val_single_array,
+			       uint8_t *attr_section_p,
+			       const uint8_t *dir_p,
+			       uint8_t *value_section_p,
+			       const uint8_t *end_p)
+{
+	const uint8_t *elements_p = dir_p + U32_LEN * message->num_elements;
+	uint32_t num_dir = message->num_elements;
+	uint32_t *found = NULL;
+	unsigned int num_found = 0;
+	unsigned int i, j, k, nelem = 0;
+
+	found = talloc_array(message->elements, uint32_t, num_dir);
+	if (found == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (i = 0; attrs[i] != NULL; i++) {
+		uint32_t lo = 0, hi = num_dir;
+		bool dup = false;
+
+		for (k = 0; k < i; k++) {
+			if (ldb_attr_cmp(attrs[k], attrs[i]) == 0) {
+				dup = true;
+				break;
+			}
+		}
+		if (dup) {
+			continue;
+		}
+
+		/* Find the first directory entry not below attrs[i] */
+		while (lo < hi) {
+			uint32_t mid = lo + (hi - lo) / 2;
+			const char *name = ldb_unpack_dir_name_v3(
+				attr_section_p, elements_p, value_section_p,
+				dir_p, mid);
+			if (name == NULL) {
+				errno = EIO;
+				return -1;
+			}
+			if (ldb_pack_attr_cmp(name, attrs[i]) < 0) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+
+		for (; lo < num_dir; lo++) {
+			const char *name = ldb_unpack_dir_name_v3(
+				attr_section_p, elements_p, value_section_p,
+				dir_p, lo);
+			if (name == NULL) {
+				errno = EIO;
+				return -1;
+			}
+			if (ldb_pack_attr_cmp(name, attrs[i]) != 0) {
+				break;
+			}
+			if (num_found == num_dir) {
+				errno = EIO;
+				return -1;
+			}
+			found[num_found++] = PULL_LE_U32(dir_p, lo * U32_LEN);
+		}
+	}
+
+	TYPESAFE_QSORT(found, num_found, ldb_unpack_offset_cmp);
+
+	for (i = 0; i < num_found; i++) {
+		struct ldb_message_element *element = NULL;
+		uint8_t *p = attr_section_p + found[i];
+		uint8_t *q = NULL;
+		size_t attr_len, len;
+		uint8_t val_len_width;
+
+		if (i > 0 && found[i] == found[i-1]) {
+			errno = EIO;
+			return -1;
+		}
+
+		/* The name was checked by ldb_unpack_dir_name_v3() */
+		attr_len = PULL_LE_U32(p, 0);
+		element = &message->elements[nelem];
+		element->name = (const char *)p + U32_LEN;
+		element->flags = 0;
+		p += U32_LEN + attr_len + NULL_PAD_BYTE_LEN;
+
+		/* num_values, value offset, val_len_width */
+		if (p + U32_LEN * 2 + U8_LEN > value_section_p) {
+			errno = EIO;
+			return -1;
+		}
+		element->num_values = PULL_LE_U32(p, 0);
+		p += U32_LEN;
+		if (PULL_LE_U32(p, 0) > end_p - value_section_p) {
+			errno = EIO;
+			return -1;
+		}
+		q = value_section_p + PULL_LE_U32(p, 0);
+		p += U32_LEN;
+		val_len_width = *p;
+		p += U8_LEN;
+
+		if (val_len_width != U8_LEN &&
+		    val_len_width != U16_LEN &&
+		    val_len_width != U32_LEN) {
+			errno = ERANGE;
+			return -1;
+		}
+		if ((size_t)val_len_width * element->num_values >
+		    value_section_p - p) {
+			errno = EIO;
+			return -1;
+		}
+
+		element->values = NULL;
+		if ((flags & LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC) &&
+		    element->num_values == 1) {
+			element->values = &ldb_val_single_array[nelem];
+		} else if (element->num_values != 0) {
+			element->values = talloc_array(message->elements,
+						       struct ldb_val,
+						       element->num_values);
+			if (!element->values) {
+				errno = ENOMEM;
+				return -1;
+			}
+		}
+
+		for (j = 0; j < element->num_values; j++) {
+			if (val_len_width == U8_LEN) {
+				len = PULL_LE_U8(p, 0);
+			} else if (val_len_width == U16_LEN) {
+				len = PULL_LE_U16(p, 0);
+			} else {
+				len = PULL_LE_U32(p, 0);
+			}
+			p += val_len_width;
+
+			if (len + NULL_PAD_BYTE_LEN < len) {
+				errno = EIO;
+				return -1;
+			}
+			if (len + NULL_PAD_BYTE_LEN > end_p - q) {
+				errno = EIO;
+				return -1;
+			}
+			element->values[j].length = len;
+			element->values[j].data = q;
+			q += len + NULL_PAD_BYTE_LEN;
+		}
+		nelem++;
+	}
+
+	TALLOC_FREE(found);
+
+	message->num_elements = nelem;
+	if (nelem == 0) {
+		TALLOC_FREE(message->elements);
+		return 0;
+	}
+	message->elements = talloc_realloc(message, message->elements,
+					   struct ldb_message_element,
+					   message->num_elements);
+	return 0;
+}
+
 /*
  * Unpack a ldb message from a linear buffer in ldb_val
  */
 static int ldb_unpack_data_flags_v2(struct ldb_context *ldb,
 				    const struct ldb_val *data,
 				    struct ldb_message *message,
-				    unsigned int flags)
+				    const char * const *attrs,
+				    unsigned int flags,
+				    unsigned format)
 {
 	uint8_t *p, *q, *end_p, *value_section_p;
+	size_t value_offset_len = 0;
 	unsigned int i, j;
 	unsigned int nelem = 0;
 	size_t len;
@@ -879,14 +1308,53 @@ static int ldb_unpack_data_flags_v2(struct ldb_context *ldb,
 		}
 	}
 
+	if (PULL_LE_U32(p, 0) > end_p - p) {
+		errno = EIO;
+		goto failed;
+	}
 	q = p + PULL_LE_U32(p, 0);
 	value_section_p = q;
+
+	if (format == LDB_PACKING_FORMAT_V3) {
+		uint8_t *attr_section_p = p;
+		const uint8_t *dir_p = p + U32_LEN;
+
+		if (message->num_elements >
+		    (value_section_p - dir_p) / U32_LEN) {
+			errno = EIO;
+			goto failed;
+		}
+
+		if (attrs != NULL) {
+			int ret = ldb_unpack_attrs_v3(message,
+						      attrs,
+						      flags,
+						      ldb_val_single_array,
+						      attr_section_p,
+						      dir_p,
+						      value_section_p,
+						      end_p);
+			if (ret != 0) {
+				goto failed;
+			}
+			return 0;
+		}
+
+		/*
+		 * A full unpack walks the elements in order, as for
+		 * version 2, and only checks the value offsets
+		 */
+		p += U32_LEN * message->num_elements;
+		value_offset_len = U32_LEN;
+	}
 	p += U32_LEN;
 
 	for (i=0;i<message->num_elements;i++) {
 		const char *attr = NULL;
 		size_t attr_len;
+		uint32_t num_values;
 		struct ldb_message_element *element = NULL;
+		int ret;
 
 		/* Sanity check: minimum element size */
 		if (p + (U32_LEN * 2) + /* attr name len, num values */
@@ -913,7 +1381,8 @@ static int ldb_unpack_data_flags_v2(struct ldb_context *ldb,
 		 * val_len_width is the width specifier
 		 * for the variable length encoding
 		 */
-		if (p + U32_LEN + U8_LEN > value_section_p) {
+		if (p + U32_LEN + value_offset_len + U8_LEN >
+		    value_section_p) {
 			errno = EIO;
 			goto failed;
 		}
@@ -923,27 +1392,17 @@ static int ldb_unpack_data_flags_v2(struct ldb_context *ldb,
 			goto failed;
 		}
 
-		element = &message->elements[nelem];
-		element->name = attr;
-		element->flags = 0;
+		num_values = PULL_LE_U32(p, 0);
+		p += U32_LEN;
 
-		element->num_values = PULL_LE_U32(p, 0);
-		element->values = NULL;
-		if ((flags & LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC) &&
-		    element->num_values == 1) {
-			element->values = &ldb_val_single_array[nelem];
-		} else if (element->num_values != 0) {
-			element->values = talloc_array(message->elements,
-						       struct ldb_val,
-						       element->num_values);
-			if (!element->values) {
-				errno = ENOMEM;
+		if (value_offset_len != 0) {
+			if (value_section_p + PULL_LE_U32(p, 0) != q) {
+				errno = EIO;
 				goto failed;
 			}
+			p += value_offset_len;
 		}
 
-		p += U32_LEN;
-
 		/*
 		 * Here we read how wide the remaining lengths are
 		 * which avoids storing and parsing a lot of leading
@@ -952,12 +1411,49 @@ static int ldb_unpack_data_flags_v2(struct ldb_context *ldb,
 		val_len_width = *p;
 		p += U8_LEN;
 
-		if (p + val_len_width * element->num_values >
+		if (p + (size_t)val_len_width * num_values >
 		    value_section_p) {
 			errno = EIO;
 			goto failed;
 		}
 
+		/*
+		 * Attributes we were not asked for only have their
+		 * value lengths summed, so that we know where the
+		 * values of the next attribute start.  Nothing is
+		 * allocated for them, which makes a search that only
+		 * looks at a few small attributes of an object with a
+		 * huge linked attribute cheap.
+		 */
+		if (!ldb_unpack_attr_wanted(attr, attrs)) {
+			ret = ldb_unpack_skip_values_v2(&p, &q, end_p,
+							num_values,
+							val_len_width);
+			if (ret != 0) {
+				goto failed;
+			}
+			continue;
+		}
+
+		element = &message->elements[nelem];
+		element->name = attr;
+		element->flags = 0;
+
+		element->num_values = num_values;
+		element->values = NULL;
+		if ((flags & LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC) &&
+		    element->num_values == 1) {
+			element->values = &ldb_val_single_array[nelem];
+		} else if (element->num_values != 0) {
+			element->values = talloc_array(message->elements,
+						       struct ldb_val,
+						       element->num_values);
+			if (!element->values) {
+				errno = ENOMEM;
+				goto failed;
+			}
+		}
+
 		/*
 		 * This is structured weird for compiler optimization
 		 * purposes, but we need to pull the array of widths
@@ -1052,12 +1548,16 @@ int ldb_unpack_get_format(const struct ldb_val *data,
 }
 
 /*
- * Unpack a ldb message from a linear buffer in ldb_val
+ * Unpack a ldb message from a linear buffer in ldb_val, but only the
+ * attributes named in the NULL terminated attrs list (all of them if
+ * attrs is NULL).  The other attributes are skipped over in the
+ * packed data and never decoded.
  */
-int ldb_unpack_data_flags(struct ldb_context *ldb,
-			  const struct ldb_val *data,
-			  struct ldb_message *message,
-			  unsigned int flags)
+int ldb_unpack_data_attrs_flags(struct ldb_context *ldb,
+				const struct ldb_val *data,
+				struct ldb_message *message,
+				const char * const *attrs,
+				unsigned int flags)
 {
 	unsigned format;
 
@@ -1067,8 +1567,10 @@ int ldb_unpack_data_flags(struct ldb_context *ldb,
 	}
 
 	format = PULL_LE_U32(data->data, 0);
-	if (format == LDB_PACKING_FORMAT_V2) {
-		return ldb_unpack_data_flags_v2(ldb, data, message, flags);
+	if (format == LDB_PACKING_FORMAT_V2 ||
+	    format == LDB_PACKING_FORMAT_V3) {
+		return ldb_unpack_data_flags_v2(ldb, data, message,
+						attrs, flags, format);
 	}
 
 	/*
@@ -1077,7 +1579,19 @@ int ldb_unpack_data_flags(struct ldb_context *ldb,
 	 * if given some other version, so we don't need to do any further
 	 * checks on 'format'.
 	 */
-	return ldb_unpack_data_flags_v1(ldb, data, message, flags, format);
+	return ldb_unpack_data_flags_v1(ldb, data, message,
+					attrs, flags, format);
+}
+
+/*
+ * Unpack a ldb message from a linear buffer in ldb_val
+ */
+int ldb_unpack_data_flags(struct ldb_context *ldb,
+			  const struct ldb_val *data,
+			  struct ldb_message *message,
+			  unsigned int flags)
+{
+	return ldb_unpack_data_attrs_flags(ldb, data, message, NULL, flags);
 }
 
 
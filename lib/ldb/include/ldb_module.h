@@ -550,6 +550,17 @@ int ldb_unpack_data_flags(struct ldb_context *ldb,
 			  struct ldb_message *message,
 			  unsigned int flags);
 
+/*
+ * As ldb_unpack_data_flags(), but only the attributes named in the
+ * NULL terminated attrs list are unpacked (all of them if attrs is
+ * NULL).  The values of the other attributes are never decoded.
+ */
+int ldb_unpack_data_attrs_flags(struct ldb_context *ldb,
+				const struct ldb_val *data,
+				struct ldb_message *message,
+				const char * const *attrs,
+				unsigned int flags);
+
 int ldb_unpack_get_format(const struct ldb_val *data,
 			  uint32_t *pack_format_version);
 
@@ -566,7 +577,10 @@ enum ldb_pack_format {
 
 	/* In-use packing formats */
 	LDB_PACKING_FORMAT,
-	LDB_PACKING_FORMAT_V2
+	LDB_PACKING_FORMAT_V2,
+
+	/* Version 2 with a sorted attribute directory */
+	LDB_PACKING_FORMAT_V3
 };
 
 /**
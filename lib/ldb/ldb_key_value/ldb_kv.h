@@ -78,6 +78,7 @@ struct ldb_kv_private {
 		struct ldb_message *indexlist;
 		bool one_level_indexes;
 		bool attribute_indexes;
+		bool substring_indexes;
 		const char *GUID_index_attribute;
 		const char *GUID_index_dn_component;
 	} *cache;
@@ -85,6 +86,7 @@ struct ldb_kv_private {
 
 	bool check_base;
 	bool disallow_dn_filter;
+	bool attribute_directory;
 	/*
 	 * To improve the performance of batch operations we maintain a cache
 	 * of index records, these entries get written to disk in the
@@ -160,6 +162,8 @@ struct ldb_kv_context {
 	struct ldb_dn *base;
 	enum ldb_scope scope;
 	const char * const *attrs;
+	/* attributes the filter and attrs need, NULL for all */
+	const char **unpack_attrs;
 	struct tevent_timer *timeout_event;
 
 	/* error handling */
@@ -185,6 +189,7 @@ struct ldb_kv_repack_context {
 #define LDB_KV_IDX        "@IDX"
 #define LDB_KV_IDXVERSION "@IDXVERSION"
 #define LDB_KV_IDXATTR    "@IDXATTR"
+#define LDB_KV_IDXSUBSTR  "@IDXSUBSTR"
 #define LDB_KV_IDXONE     "@IDXONE"
 #define LDB_KV_IDXDN     "@IDXDN"
 #define LDB_KV_IDXGUID    "@IDXGUID"
@@ -206,6 +211,7 @@ struct ldb_kv_repack_context {
 #define LDB_KV_SEQUENCE_NUMBER "sequenceNumber"
 #define LDB_KV_CHECK_BASE "checkBaseOnSearch"
 #define LDB_KV_DISALLOW_DN_FILTER "disallowDNFilter"
+#define LDB_KV_ATTRIBUTE_DIRECTORY "attributeDirectory"
 #define LDB_KV_MOD_TIMESTAMP "whenChanged"
 #define LDB_KV_OBJECTCLASS "objectClass"
 
@@ -291,6 +297,12 @@ int ldb_kv_search_key(struct ldb_module *module,
 		      const struct ldb_val ldb_key,
 		      struct ldb_message *msg,
 		      unsigned int unpack_flags);
+int ldb_kv_search_key_attrs(struct ldb_module *module,
+			    struct ldb_kv_private *ldb_kv,
+			    const struct ldb_val ldb_key,
+			    struct ldb_message *msg,
+			    const char * const *attrs,
+			    unsigned int unpack_flags);
 int ldb_kv_filter_attrs(struct ldb_context *ldb,
 			const struct ldb_message *msg,
 			const char *const *attrs,
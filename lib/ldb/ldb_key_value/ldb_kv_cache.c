@@ -251,6 +251,7 @@ static int ldb_kv_index_load(struct ldb_module *module,
 		 * supplying its own attribute handling
 		 */
 		ldb_kv->cache->attribute_indexes = true;
+		ldb_kv->cache->substring_indexes = false;
 		ldb_kv->cache->one_level_indexes =
 		    ldb->schema.one_level_indexes;
 		ldb_kv->cache->GUID_index_attribute =
@@ -268,6 +269,7 @@ static int ldb_kv_index_load(struct ldb_module *module,
 	}
 	ldb_kv->cache->one_level_indexes = false;
 	ldb_kv->cache->attribute_indexes = false;
+	ldb_kv->cache->substring_indexes = false;
 
 	indexlist_dn = ldb_dn_new(ldb_kv, ldb, LDB_KV_INDEXLIST);
 	if (indexlist_dn == NULL) {
@@ -293,6 +295,10 @@ static int ldb_kv_index_load(struct ldb_module *module,
 	    NULL) {
 		ldb_kv->cache->attribute_indexes = true;
 	}
+	if (ldb_msg_find_element(ldb_kv->cache->indexlist, LDB_KV_IDXSUBSTR) !=
+	    NULL) {
+		ldb_kv->cache->substring_indexes = true;
+	}
 	ldb_kv->cache->GUID_index_attribute = ldb_msg_find_attr_as_string(
 	    ldb_kv->cache->indexlist, LDB_KV_IDXGUID, NULL);
 	ldb_kv->cache->GUID_index_dn_component = ldb_msg_find_attr_as_string(
@@ -521,9 +527,12 @@ int ldb_kv_cache_load(struct ldb_module *module)
 		    ldb_msg_find_attr_as_bool(options, LDB_KV_CHECK_BASE, false);
 		ldb_kv->disallow_dn_filter = ldb_msg_find_attr_as_bool(
 		    options, LDB_KV_DISALLOW_DN_FILTER, false);
+		ldb_kv->attribute_directory = ldb_msg_find_attr_as_bool(
+		    options, LDB_KV_ATTRIBUTE_DIRECTORY, false);
 	} else {
 		ldb_kv->check_base = false;
 		ldb_kv->disallow_dn_filter = false;
+		ldb_kv->attribute_directory = false;
 	}
 
 	/*
@@ -553,10 +562,20 @@ int ldb_kv_cache_load(struct ldb_module *module)
 	 * Initialise packing version and GUID index syntax, and force the
 	 * two to travel together, ie a GUID indexed database must use V2
 	 * packing format and a DN indexed database must use V1.
+	 *
+	 * A GUID indexed database can opt into V3 (V2 plus a sorted
+	 * attribute directory) with attributeDirectory: TRUE in
+	 * @OPTIONS.  Changing that repacks the database.
 	 */
 	ldb_kv->GUID_index_syntax = NULL;
 	if (ldb_kv->cache->GUID_index_attribute != NULL) {
-		ldb_kv->target_pack_format_version = LDB_PACKING_FORMAT_V2;
+		if (ldb_kv->attribute_directory) {
+			ldb_kv->target_pack_format_version =
+				LDB_PACKING_FORMAT_V3;
+		} else {
+			ldb_kv->target_pack_format_version =
+				LDB_PACKING_FORMAT_V2;
+		}
 
 		/*
 		 * Now the attributes are loaded, set the guid_index_syntax.
@@ -121,6 +121,23 @@ dn: @INDEXLIST
 @IDXATTR: samAccountName
 @IDXATTR: nETBIOSName
 
+@IDXSUBSTR controls if an attribute has a substring index, used for
+wildcard searches like (displayName=*smith*)
+
+dn: @INDEXLIST
+@IDXSUBSTR: displayName
+
+Every 3 byte run (trigram) of each canonicalised value is indexed
+under the special attribute name @IDXSUBSTR:<attr>, for example
+
+dn: @INDEX:@IDXSUBSTR:DISPLAYNAME:SMI
+
+A substring search intersects the lists of all trigrams of its
+chunks, starting from the shortest.  Chunks shorter than a trigram,
+or trigrams matching too many objects, fall back to a full search.
+Substring indexes are not available with the C override functions
+below.
+
 
 C Override functions
 --------------------
@@ -170,6 +187,20 @@ struct ldb_kv_idxptr {
 	 */
 	struct tdb_context *itdb;
 	int error;
+	/*
+	 * Set while a re-index is adding records.  GUID lists are then
+	 * appended to rather than kept sorted, and are sorted once by
+	 * ldb_kv_index_bulk_sort() when the traverse is complete.
+	 */
+	bool bulk;
+	/* A GUID list has been appended to while in bulk mode */
+	bool unsorted;
+	/*
+	 * Duplicate values within one record, reported while in bulk
+	 * mode, and the duplicate entries found by sorting the lists
+	 */
+	unsigned int bulk_duplicates;
+	unsigned int sorted_duplicates;
 };
 
 enum key_truncation {
@@ -196,6 +227,29 @@ static void ldb_kv_dn_list_sort(struct ldb_kv_private *ldb_kv,
 
 #define LDB_KV_GUID_INDEXING_VERSION 3
 
+/*
+ * @IDXSUBSTR attributes are indexed on every LDB_KV_SUBSTR_INDEX_LEN
+ * byte run of the canonical value.  A substring search whose rarest
+ * run still matches more than LDB_KV_SUBSTR_INDEX_MAX_CANDIDATES
+ * objects is not selective enough to be worth the index lookups.
+ */
+#define LDB_KV_SUBSTR_INDEX_LEN 3
+#define LDB_KV_SUBSTR_INDEX_MAX_CANDIDATES 10000
+
+/*
+ * The AND planner stops intersecting once fewer than
+ * LDB_KV_INDEX_SMALL_CANDIDATES objects are left, and does not load an
+ * index list more than LDB_KV_INDEX_INTERSECT_RATIO times longer than
+ * the current candidate set, filtering the candidates is cheaper.
+ *
+ * An index list holding more than half of the database is loaded after
+ * the parts of unknown size, but only on databases holding more than
+ * twice LDB_KV_INDEX_LARGE_LIST_MIN records.
+ */
+#define LDB_KV_INDEX_SMALL_CANDIDATES 10
+#define LDB_KV_INDEX_INTERSECT_RATIO 100
+#define LDB_KV_INDEX_LARGE_LIST_MIN 1000
+
 static unsigned ldb_kv_max_key_length(struct ldb_kv_private *ldb_kv)
 {
 	if (ldb_kv->max_key_length == 0) {
@@ -284,6 +338,19 @@ static int ldb_kv_dn_list_find_val(struct ldb_kv_private *ldb_kv,
 		return -1;
 	}
 
+	/*
+	 * During a re-index the GUID lists are unsorted, but records
+	 * are added one at a time, so an entry for the record being
+	 * indexed can only be the last one.
+	 */
+	if (ldb_kv->idxptr != NULL && ldb_kv->idxptr->bulk) {
+		if (list->count > 0 &&
+		    ldb_val_equal_exact(&list->dn[list->count - 1], v) == 1) {
+			return list->count - 1;
+		}
+		return -1;
+	}
+
 	BINARY_ARRAY_SEARCH_GTE(list->dn, list->count,
 				*v, ldb_val_equal_exact_ordered,
 				exact, next);
@@ -578,6 +645,129 @@ normal_index:
 	return LDB_SUCCESS;
 }
 
+struct ldb_kv_dn_list_count_ctx {
+	struct ldb_module *module;
+	struct ldb_kv_private *ldb_kv;
+	unsigned int count;
+};
+
+static int ldb_kv_dn_list_count_parser(_UNUSED_ struct ldb_val key,
+				       struct ldb_val data,
+				       void *private_data)
+{
+	struct ldb_kv_dn_list_count_ctx *ctx = private_data;
+	struct ldb_context *ldb = ldb_module_get_ctx(ctx->module);
+	struct ldb_message_element *el = NULL;
+	struct ldb_message *msg = NULL;
+	int ret;
+
+	msg = ldb_msg_new(NULL);
+	if (msg == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	/*
+	 * Only the lengths are looked at, so the values can point
+	 * into the database for the duration of the callback
+	 */
+	ret = ldb_unpack_data_flags(ldb, &data, msg,
+				    LDB_UNPACK_DATA_FLAG_NO_DN |
+				    LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC);
+	if (ret != 0) {
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	el = ldb_msg_find_element(msg, LDB_KV_IDX);
+	if (el == NULL) {
+		ctx->count = 0;
+	} else if (ctx->ldb_kv->cache->GUID_index_attribute == NULL) {
+		ctx->count = el->num_values;
+	} else if (el->num_values == 0) {
+		ctx->count = 0;
+	} else {
+		ctx->count = el->values[0].length / LDB_KV_GUID_SIZE;
+	}
+
+	talloc_free(msg);
+	return LDB_SUCCESS;
+}
+
+/*
+  return the number of entries in an index record without loading the
+  list itself.  This is the cardinality the query planner works from.
+ */
+static int ldb_kv_dn_list_count(struct ldb_module *module,
+				struct ldb_kv_private *ldb_kv,
+				struct ldb_dn *dn,
+				unsigned int *count)
+{
+	struct ldb_kv_dn_list_count_ctx ctx = {
+		.module = module,
+		.ldb_kv = ldb_kv,
+		.count = 0,
+	};
+	struct ldb_val key;
+	int ret;
+
+	*count = 0;
+
+	/*
+	 * Records changed in this transaction are only in the in
+	 * memory index cache
+	 */
+	if (ldb_kv->idxptr != NULL) {
+		TDB_DATA rec = {0};
+		TDB_DATA tkey;
+		struct dn_list *list = NULL;
+
+		tkey.dptr = discard_const_p(unsigned char,
+					    ldb_dn_get_linearized(dn));
+		tkey.dsize = strlen((char *)tkey.dptr);
+
+		if (ldb_kv->nested_idx_ptr != NULL) {
+			rec = tdb_fetch(ldb_kv->nested_idx_ptr->itdb, tkey);
+		}
+		if (rec.dptr == NULL) {
+			rec = tdb_fetch(ldb_kv->idxptr->itdb, tkey);
+		}
+		if (rec.dptr != NULL) {
+			list = ldb_kv_index_idxptr(module, rec);
+			free(rec.dptr);
+			if (list == NULL) {
+				return LDB_ERR_OPERATIONS_ERROR;
+			}
+			*count = list->count;
+			return LDB_SUCCESS;
+		}
+	}
+
+	key = ldb_kv_key_dn(module, dn);
+	if (key.data == NULL) {
+		return ldb_module_oom(module);
+	}
+
+	ret = ldb_kv->kv_ops->fetch_and_parse(
+	    ldb_kv, key, ldb_kv_dn_list_count_parser, &ctx);
+	talloc_free(key.data);
+	if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+		return LDB_SUCCESS;
+	}
+	if (ret == -1) {
+		ret = ldb_kv->kv_ops->error(ldb_kv);
+		if (ret == LDB_SUCCESS) {
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		return ret;
+	}
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	*count = ctx.count;
+	return LDB_SUCCESS;
+}
+
 int ldb_kv_key_dn_from_idx(struct ldb_module *module,
 			   struct ldb_kv_private *ldb_kv,
 			   TALLOC_CTX *mem_ctx,
@@ -1232,6 +1422,172 @@ static bool ldb_kv_is_indexed(struct ldb_module *module,
 	return false;
 }
 
+/*
+  see if a attribute value is in the list of substring indexed attributes
+*/
+static bool ldb_kv_is_substr_indexed(struct ldb_module *module,
+				     struct ldb_kv_private *ldb_kv,
+				     const char *attr)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	unsigned int i;
+	struct ldb_message_element *el;
+
+	if (!ldb_kv->cache->substring_indexes) {
+		return false;
+	}
+	if (ldb->schema.index_handler_override) {
+		return false;
+	}
+	if (attr[0] == '@') {
+		return false;
+	}
+	if ((ldb_kv->cache->GUID_index_attribute != NULL) &&
+	    (ldb_attr_cmp(attr, ldb_kv->cache->GUID_index_attribute) == 0)) {
+		return false;
+	}
+
+	el = ldb_msg_find_element(ldb_kv->cache->indexlist, LDB_KV_IDXSUBSTR);
+	if (el == NULL) {
+		return false;
+	}
+
+	for (i=0; i<el->num_values; i++) {
+		if (ldb_attr_cmp((char *)el->values[i].data, attr) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+  the name of the index attribute holding the trigrams of attr, the
+  leading @ means ldb_kv_index_key() uses the trigram as-is.
+*/
+static char *ldb_kv_substr_index_attr(TALLOC_CTX *mem_ctx,
+				      struct ldb_context *ldb,
+				      const char *attr)
+{
+	char *attr_folded = NULL;
+	char *ret = NULL;
+
+	attr_folded = ldb_attr_casefold(mem_ctx, attr);
+	if (attr_folded == NULL) {
+		return NULL;
+	}
+	ret = talloc_asprintf(mem_ctx, "%s:%s", LDB_KV_IDXSUBSTR, attr_folded);
+	talloc_free(attr_folded);
+	return ret;
+}
+
+/*
+  append the trigrams of the canonical form of value to *trigrams.
+
+  The trigrams point into the canonical value, which is allocated on
+  mem_ctx.
+*/
+static int ldb_kv_substr_trigrams_add(TALLOC_CTX *mem_ctx,
+				      struct ldb_context *ldb,
+				      const struct ldb_schema_attribute *a,
+				      const struct ldb_val *value,
+				      struct ldb_val **trigrams,
+				      unsigned int *count)
+{
+	struct ldb_val v;
+	struct ldb_val *t = NULL;
+	size_t i, num;
+	int ret;
+
+	ret = a->syntax->canonicalise_fn(ldb, mem_ctx, value, &v);
+	if (ret != LDB_SUCCESS) {
+		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
+	}
+
+	if (v.length < LDB_KV_SUBSTR_INDEX_LEN) {
+		return LDB_SUCCESS;
+	}
+	num = v.length - LDB_KV_SUBSTR_INDEX_LEN + 1;
+
+	t = talloc_realloc(mem_ctx, *trigrams, struct ldb_val, *count + num);
+	if (t == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	for (i = 0; i < num; i++) {
+		t[*count + i].data = v.data + i;
+		t[*count + i].length = LDB_KV_SUBSTR_INDEX_LEN;
+	}
+	*trigrams = t;
+	*count += num;
+
+	return LDB_SUCCESS;
+}
+
+/*
+  sort the trigrams and remove any duplicates
+*/
+static void ldb_kv_substr_trigrams_uniq(struct ldb_val *trigrams,
+					unsigned int *count)
+{
+	unsigned int i, j;
+
+	if (*count < 2) {
+		return;
+	}
+
+	TYPESAFE_QSORT(trigrams, *count, ldb_val_equal_exact_for_qsort);
+
+	for (i = 1, j = 1; i < *count; i++) {
+		if (ldb_val_equal_exact_for_qsort(&trigrams[j-1],
+						  &trigrams[i]) != 0) {
+			trigrams[j++] = trigrams[i];
+		}
+	}
+	*count = j;
+}
+
+/*
+  the sorted, unique trigrams of an array of values, optionally
+  skipping the value at skip_idx.  Values that can not be canonicalised
+  are skipped, they can never match a substring search either.
+*/
+static int ldb_kv_substr_trigrams(TALLOC_CTX *mem_ctx,
+				  struct ldb_context *ldb,
+				  const char *attr,
+				  const struct ldb_val *values,
+				  unsigned int num_values,
+				  int skip_idx,
+				  struct ldb_val **trigrams,
+				  unsigned int *count)
+{
+	const struct ldb_schema_attribute *a = NULL;
+	unsigned int i;
+
+	*trigrams = NULL;
+	*count = 0;
+
+	a = ldb_schema_attribute_by_name(ldb, attr);
+
+	for (i = 0; i < num_values; i++) {
+		int ret;
+
+		if ((int)i == skip_idx) {
+			continue;
+		}
+		ret = ldb_kv_substr_trigrams_add(mem_ctx, ldb, a, &values[i],
+						 trigrams, count);
+		if (ret == LDB_ERR_INVALID_ATTRIBUTE_SYNTAX) {
+			continue;
+		}
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	}
+
+	ldb_kv_substr_trigrams_uniq(*trigrams, count);
+
+	return LDB_SUCCESS;
+}
+
 /*
   in the following logic functions, the return value is treated as
   follows:
@@ -1244,6 +1600,29 @@ static bool ldb_kv_is_indexed(struct ldb_module *module,
                                we'll need a full search
  */
 
+/*
+  the length of an index list above which the list is unlikely to
+  narrow down an AND search.
+
+  The size reported by the backend is a rough guess (tdb derives it
+  from the file size, lmdb also counts the index records), so this is
+  only used to order the parts of an AND, never to give up on an index.
+ */
+static size_t ldb_kv_index_large_list_threshold(struct ldb_kv_private *ldb_kv)
+{
+	size_t db_size;
+
+	if (ldb_kv->disable_full_db_scan) {
+		return SIZE_MAX;
+	}
+
+	db_size = ldb_kv->kv_ops->get_size(ldb_kv);
+	if (db_size / 2 < LDB_KV_INDEX_LARGE_LIST_MIN) {
+		return SIZE_MAX;
+	}
+	return db_size / 2;
+}
+
 /*
   return a list of dn's that might match a simple indexed search (an
   equality search only)
@@ -1654,70 +2033,325 @@ static bool ldb_kv_index_unique(struct ldb_context *ldb,
 	return false;
 }
 
+#define LDB_KV_INDEX_ESTIMATE_UNKNOWN UINT_MAX
+
 /*
-  process an AND expression (intersection)
+  estimate how many objects an indexed search of tree returns, from
+  the length of the index records and without loading any list.  The
+  return value is treated as for the logic functions above, a
+  successful estimate may be LDB_KV_INDEX_ESTIMATE_UNKNOWN.
  */
-static int ldb_kv_index_dn_and(struct ldb_module *module,
-			       struct ldb_kv_private *ldb_kv,
-			       const struct ldb_parse_tree *tree,
-			       struct dn_list *list)
+static int ldb_kv_index_dn_estimate(struct ldb_module *module,
+				    struct ldb_kv_private *ldb_kv,
+				    const struct ldb_parse_tree *tree,
+				    unsigned int *estimate)
 {
-	struct ldb_context *ldb;
-	unsigned int i;
-	bool found;
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	enum key_truncation truncation = KEY_NOT_TRUNCATED;
+	const char *attr = NULL;
+	struct ldb_dn *dn = NULL;
+	unsigned int i, count = 0;
+	bool known = false;
+	int ret;
 
-	ldb = ldb_module_get_ctx(module);
+	*estimate = LDB_KV_INDEX_ESTIMATE_UNKNOWN;
 
-	list->dn = NULL;
-	list->count = 0;
+	switch (tree->operation) {
+	case LDB_OP_EQUALITY:
+		break;
 
-	/* in the first pass we only look for unique simple
-	   equality tests, in the hope of avoiding having to look
-	   at any others */
-	for (i=0; i<tree->u.list.num_elements; i++) {
-		const struct ldb_parse_tree *subtree = tree->u.list.elements[i];
-		int ret;
+	case LDB_OP_OR:
+		/* the sum of the estimates, any unindexed part is fatal */
+		*estimate = 0;
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			unsigned int e;
 
-		if (subtree->operation != LDB_OP_EQUALITY ||
-		    !ldb_kv_index_unique(
-			ldb, ldb_kv, subtree->u.equality.attr)) {
-			continue;
+			ret = ldb_kv_index_dn_estimate(
+			    module, ldb_kv, tree->u.list.elements[i], &e);
+			if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+				continue;
+			}
+			if (ret != LDB_SUCCESS) {
+				return ret;
+			}
+			if (e == LDB_KV_INDEX_ESTIMATE_UNKNOWN ||
+			    *estimate + e < *estimate) {
+				*estimate = LDB_KV_INDEX_ESTIMATE_UNKNOWN;
+			} else if (*estimate != LDB_KV_INDEX_ESTIMATE_UNKNOWN) {
+				*estimate += e;
+			}
+			known = true;
 		}
-
-		ret = ldb_kv_index_dn(module, ldb_kv, subtree, list);
-		if (ret == LDB_ERR_NO_SUCH_OBJECT) {
-			/* 0 && X == 0 */
+		if (!known) {
 			return LDB_ERR_NO_SUCH_OBJECT;
 		}
-		if (ret == LDB_SUCCESS) {
-			/* a unique index match means we can
-			 * stop. Note that we don't care if we return
-			 * a few too many objects, due to later
-			 * filtering */
-			return LDB_SUCCESS;
-		}
-	}
+		return LDB_SUCCESS;
 
-	/* now do a full intersection */
-	found = false;
+	case LDB_OP_AND:
+		/* the smallest estimate, unindexed parts are ignored */
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			unsigned int e;
 
-	for (i=0; i<tree->u.list.num_elements; i++) {
-		const struct ldb_parse_tree *subtree = tree->u.list.elements[i];
-		struct dn_list *list2;
-		int ret;
+			ret = ldb_kv_index_dn_estimate(
+			    module, ldb_kv, tree->u.list.elements[i], &e);
+			if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+				return ret;
+			}
+			if (ret != LDB_SUCCESS) {
+				continue;
+			}
+			*estimate = MIN(*estimate, e);
+			known = true;
+		}
+		if (!known) {
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		return LDB_SUCCESS;
 
-		list2 = talloc_zero(list, struct dn_list);
-		if (list2 == NULL) {
-			return ldb_module_oom(module);
+	case LDB_OP_NOT:
+		return LDB_ERR_OPERATIONS_ERROR;
+
+	default:
+		/* indexed as far as we know, but at an unknown cost */
+		return LDB_SUCCESS;
+	}
+
+	attr = tree->u.equality.attr;
+	if (ldb_kv->disallow_dn_filter &&
+	    (ldb_attr_cmp(attr, "dn") == 0)) {
+		return LDB_ERR_NO_SUCH_OBJECT;
+	}
+	if (attr[0] == '@') {
+		return LDB_ERR_NO_SUCH_OBJECT;
+	}
+	if (ldb_attr_dn(attr) == 0) {
+		*estimate = 1;
+		return LDB_SUCCESS;
+	}
+	if ((ldb_kv->cache->GUID_index_attribute != NULL) &&
+	    (ldb_attr_cmp(attr, ldb_kv->cache->GUID_index_attribute) == 0)) {
+		*estimate = 1;
+		return LDB_SUCCESS;
+	}
+	if (!ldb_kv_is_indexed(module, ldb_kv, attr)) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	dn = ldb_kv_index_key(ldb, ldb_kv, attr, &tree->u.equality.value,
+			      NULL, &truncation);
+	if (dn == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ldb_kv_dn_list_count(module, ldb_kv, dn, &count);
+	talloc_free(dn);
+	if (ret != LDB_SUCCESS) {
+		/* let loading the list decide */
+		return LDB_SUCCESS;
+	}
+	if (count == 0) {
+		return LDB_ERR_NO_SUCH_OBJECT;
+	}
+
+	*estimate = count;
+	return LDB_SUCCESS;
+}
+
+struct ldb_kv_index_plan {
+	const struct ldb_parse_tree *tree;
+	struct dn_list *list;
+	unsigned int estimate;
+	bool large;
+	unsigned int idx;
+};
+
+/*
+  free a plan, including the lists loaded for it and not used
+ */
+static void ldb_kv_index_plan_free(struct ldb_kv_index_plan *plan,
+				   unsigned int num_plan)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_plan; i++) {
+		TALLOC_FREE(plan[i].list);
+	}
+	talloc_free(plan);
+}
+
+static int ldb_kv_index_plan_cmp(const struct ldb_kv_index_plan *p1,
+				 const struct ldb_kv_index_plan *p2)
+{
+	if (p1->large != p2->large) {
+		return p1->large ? 1 : -1;
+	}
+	if (p1->estimate != p2->estimate) {
+		return p1->estimate < p2->estimate ? -1 : 1;
+	}
+	if (p1->idx != p2->idx) {
+		return p1->idx < p2->idx ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+  process an AND expression (intersection)
+ */
+static int ldb_kv_index_dn_and(struct ldb_module *module,
+			       struct ldb_kv_private *ldb_kv,
+			       const struct ldb_parse_tree *tree,
+			       struct dn_list *list)
+{
+	struct ldb_context *ldb;
+	struct ldb_kv_index_plan *plan = NULL;
+	unsigned int i, num_plan = 0;
+	size_t threshold;
+	bool found;
+
+	ldb = ldb_module_get_ctx(module);
+
+	list->dn = NULL;
+	list->count = 0;
+
+	/* in the first pass we only look for unique simple
+	   equality tests, in the hope of avoiding having to look
+	   at any others */
+	for (i=0; i<tree->u.list.num_elements; i++) {
+		const struct ldb_parse_tree *subtree = tree->u.list.elements[i];
+		int ret;
+
+		if (subtree->operation != LDB_OP_EQUALITY ||
+		    !ldb_kv_index_unique(
+			ldb, ldb_kv, subtree->u.equality.attr)) {
+			continue;
 		}
 
-		ret = ldb_kv_index_dn(module, ldb_kv, subtree, list2);
+		ret = ldb_kv_index_dn(module, ldb_kv, subtree, list);
+		if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+			/* 0 && X == 0 */
+			return LDB_ERR_NO_SUCH_OBJECT;
+		}
+		if (ret == LDB_SUCCESS) {
+			/* a unique index match means we can
+			 * stop. Note that we don't care if we return
+			 * a few too many objects, due to later
+			 * filtering */
+			return LDB_SUCCESS;
+		}
+	}
+
+	/*
+	 * Plan the full intersection: estimate the size of each part
+	 * from the index records, so the most selective lists are
+	 * loaded first and the large ones possibly not at all.  Lists
+	 * holding most of the database go after the parts of unknown
+	 * size, but are still used if nothing else narrows the search.
+	 *
+	 * The list of an equality part has to be fetched to be sized,
+	 * so it is kept in the plan rather than fetched again below.
+	 */
+	plan = talloc_array(list, struct ldb_kv_index_plan,
+			    tree->u.list.num_elements);
+	if (plan == NULL) {
+		return ldb_module_oom(module);
+	}
+	threshold = ldb_kv_index_large_list_threshold(ldb_kv);
+
+	for (i=0; i<tree->u.list.num_elements; i++) {
+		const struct ldb_parse_tree *subtree = tree->u.list.elements[i];
+		struct dn_list *list2 = NULL;
+		unsigned int estimate;
+		int ret;
+
+		if (subtree->operation == LDB_OP_EQUALITY) {
+			/*
+			 * Allocated on list, as list_intersect() keeps
+			 * pointers to its values
+			 */
+			list2 = talloc_zero(list, struct dn_list);
+			if (list2 == NULL) {
+				ldb_kv_index_plan_free(plan, num_plan);
+				return ldb_module_oom(module);
+			}
+			ret = ldb_kv_index_dn(module, ldb_kv, subtree, list2);
+			if (ret == LDB_SUCCESS && list2->count == 0) {
+				ret = LDB_ERR_NO_SUCH_OBJECT;
+			}
+			if (ret != LDB_SUCCESS) {
+				TALLOC_FREE(list2);
+			} else {
+				estimate = list2->count;
+			}
+		} else {
+			ret = ldb_kv_index_dn_estimate(module, ldb_kv, subtree,
+						       &estimate);
+		}
+		if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+			/* X && 0 == 0 */
+			ldb_kv_index_plan_free(plan, num_plan);
+			return LDB_ERR_NO_SUCH_OBJECT;
+		}
+		if (ret != LDB_SUCCESS) {
+			/* not indexed, left to the filter */
+			continue;
+		}
+		plan[num_plan].tree = subtree;
+		plan[num_plan].list = list2;
+		plan[num_plan].estimate = estimate;
+		plan[num_plan].large =
+			(estimate != LDB_KV_INDEX_ESTIMATE_UNKNOWN &&
+			 estimate > threshold);
+		plan[num_plan].idx = i;
+		num_plan++;
+	}
+
+	TYPESAFE_QSORT(plan, num_plan, ldb_kv_index_plan_cmp);
+
+	/* now do the intersection */
+	found = false;
+
+	for (i=0; i<num_plan; i++) {
+		const struct ldb_parse_tree *subtree = plan[i].tree;
+		struct dn_list *list2;
+		int ret;
+
+		if (found) {
+			if (list->count < LDB_KV_INDEX_SMALL_CANDIDATES) {
+				/*
+				 * it isn't worth loading the next part
+				 * of the tree
+				 */
+				break;
+			}
+			if (plan[i].estimate != LDB_KV_INDEX_ESTIMATE_UNKNOWN &&
+			    plan[i].estimate / LDB_KV_INDEX_INTERSECT_RATIO >
+			    list->count) {
+				/* filtering the candidates is cheaper */
+				continue;
+			}
+		}
+
+		if (plan[i].list != NULL) {
+			/* already loaded while planning */
+			list2 = plan[i].list;
+			plan[i].list = NULL;
+			ret = LDB_SUCCESS;
+		} else {
+			list2 = talloc_zero(list, struct dn_list);
+			if (list2 == NULL) {
+				ldb_kv_index_plan_free(plan, num_plan);
+				return ldb_module_oom(module);
+			}
+
+			ret = ldb_kv_index_dn(module, ldb_kv, subtree, list2);
+		}
 
 		if (ret == LDB_ERR_NO_SUCH_OBJECT) {
 			/* X && 0 == 0 */
 			list->dn = NULL;
 			list->count = 0;
 			talloc_free(list2);
+			ldb_kv_index_plan_free(plan, num_plan);
 			return LDB_ERR_NO_SUCH_OBJECT;
 		}
 
@@ -1734,20 +2368,19 @@ static int ldb_kv_index_dn_and(struct ldb_module *module,
 			found = true;
 		} else if (!list_intersect(ldb_kv, list, list2)) {
 			talloc_free(list2);
+			ldb_kv_index_plan_free(plan, num_plan);
 			return LDB_ERR_OPERATIONS_ERROR;
 		}
 
 		if (list->count == 0) {
 			list->dn = NULL;
+			ldb_kv_index_plan_free(plan, num_plan);
 			return LDB_ERR_NO_SUCH_OBJECT;
 		}
-
-		if (list->count < 2) {
-			/* it isn't worth loading the next part of the tree */
-			return LDB_SUCCESS;
-		}
 	}
 
+	ldb_kv_index_plan_free(plan, num_plan);
+
 	if (!found) {
 		/* none of the attributes were indexed */
 		return LDB_ERR_OPERATIONS_ERROR;
@@ -2173,6 +2806,187 @@ static int ldb_kv_index_dn_base_dn(struct ldb_module *module,
 	    module, ldb_kv, LDB_KV_IDXDN, base_dn, dn_list, truncation);
 }
 
+static int ldb_kv_dn_list_count_cmp(struct dn_list * const *l1,
+				    struct dn_list * const *l2)
+{
+	if ((*l1)->count < (*l2)->count) {
+		return -1;
+	}
+	if ((*l1)->count > (*l2)->count) {
+		return 1;
+	}
+	return 0;
+}
+
+/*
+  return a list of dn's that might match a substring search, using the
+  trigram index of an @IDXSUBSTR attribute
+ */
+static int ldb_kv_index_dn_substring(struct ldb_module *module,
+				     struct ldb_kv_private *ldb_kv,
+				     const struct ldb_parse_tree *tree,
+				     struct dn_list *list)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	const char *attr = tree->u.substring.attr;
+	const struct ldb_schema_attribute *a = NULL;
+	struct ldb_val *trigrams = NULL;
+	struct dn_list **lists = NULL;
+	struct dn_list *result = NULL;
+	unsigned int i, count = 0;
+	char *substr_attr = NULL;
+	TALLOC_CTX *tmp_ctx = NULL;
+	int ret;
+
+	list->dn = NULL;
+	list->count = 0;
+
+	if (ldb_kv->disallow_dn_filter &&
+	    (ldb_attr_cmp(attr, "dn") == 0)) {
+		/* in AD mode we do not support "(dn=...)" search filters */
+		return LDB_SUCCESS;
+	}
+	if (attr[0] == '@') {
+		/* Do not allow a indexed search against an @ */
+		return LDB_SUCCESS;
+	}
+
+	if (!ldb_kv_is_substr_indexed(module, ldb_kv, attr)) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	if (tree->u.substring.chunks == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	tmp_ctx = talloc_new(NULL);
+	if (tmp_ctx == NULL) {
+		return ldb_module_oom(module);
+	}
+
+	/*
+	 * Every trigram of every chunk must be present in a matching
+	 * value, as ldb_wildcard_compare() looks for the canonicalised
+	 * chunks in the canonicalised value.
+	 */
+	a = ldb_schema_attribute_by_name(ldb, attr);
+	for (i = 0; tree->u.substring.chunks[i] != NULL; i++) {
+		ret = ldb_kv_substr_trigrams_add(tmp_ctx, ldb, a,
+						 tree->u.substring.chunks[i],
+						 &trigrams, &count);
+		if (ret != LDB_SUCCESS) {
+			talloc_free(tmp_ctx);
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+	}
+	ldb_kv_substr_trigrams_uniq(trigrams, &count);
+
+	if (count == 0) {
+		/* all chunks are too short to use the index */
+		talloc_free(tmp_ctx);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	substr_attr = ldb_kv_substr_index_attr(tmp_ctx, ldb, attr);
+	if (substr_attr == NULL) {
+		talloc_free(tmp_ctx);
+		return ldb_module_oom(module);
+	}
+
+	lists = talloc_array(tmp_ctx, struct dn_list *, count);
+	if (lists == NULL) {
+		talloc_free(tmp_ctx);
+		return ldb_module_oom(module);
+	}
+
+	for (i = 0; i < count; i++) {
+		enum key_truncation truncation = KEY_NOT_TRUNCATED;
+		struct ldb_dn *key = NULL;
+
+		lists[i] = talloc_zero(lists, struct dn_list);
+		if (lists[i] == NULL) {
+			talloc_free(tmp_ctx);
+			return ldb_module_oom(module);
+		}
+
+		key = ldb_kv_index_key(ldb, ldb_kv, substr_attr, &trigrams[i],
+				       NULL, &truncation);
+		if (key == NULL) {
+			talloc_free(tmp_ctx);
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+
+		ret = ldb_kv_dn_list_load(module, ldb_kv, key, lists[i],
+					  DN_LIST_WILL_BE_READ_ONLY);
+		talloc_free(key);
+		if (ret == LDB_ERR_NO_SUCH_OBJECT || lists[i]->count == 0) {
+			/* one missing trigram rules out every object */
+			talloc_free(tmp_ctx);
+			return LDB_ERR_NO_SUCH_OBJECT;
+		}
+		if (ret != LDB_SUCCESS) {
+			talloc_free(tmp_ctx);
+			return ret;
+		}
+	}
+
+	/* intersect starting from the rarest trigram */
+	TYPESAFE_QSORT(lists, count, ldb_kv_dn_list_count_cmp);
+
+	if (lists[0]->count > LDB_KV_SUBSTR_INDEX_MAX_CANDIDATES) {
+		/*
+		 * Not selective enough, let the rest of the search
+		 * expression or a full scan decide
+		 */
+		talloc_free(tmp_ctx);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	result = talloc_zero(tmp_ctx, struct dn_list);
+	if (result == NULL) {
+		talloc_free(tmp_ctx);
+		return ldb_module_oom(module);
+	}
+	result->dn = lists[0]->dn;
+	result->count = lists[0]->count;
+
+	for (i = 1; i < count && result->count >= 2; i++) {
+		if (!list_intersect(ldb_kv, result, lists[i])) {
+			talloc_free(tmp_ctx);
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+	}
+
+	if (result->count == 0) {
+		talloc_free(tmp_ctx);
+		return LDB_ERR_NO_SUCH_OBJECT;
+	}
+
+	/*
+	 * The values still point into the loaded index records, which
+	 * go away with tmp_ctx, so copy the (bounded) result onto list
+	 */
+	list->dn = talloc_array(list, struct ldb_val, result->count);
+	if (list->dn == NULL) {
+		talloc_free(tmp_ctx);
+		return ldb_module_oom(module);
+	}
+	for (i = 0; i < result->count; i++) {
+		list->dn[i].length = result->dn[i].length;
+		list->dn[i].data = talloc_memdup(list->dn,
+						 result->dn[i].data,
+						 result->dn[i].length);
+		if (list->dn[i].data == NULL) {
+			TALLOC_FREE(list->dn);
+			talloc_free(tmp_ctx);
+			return ldb_module_oom(module);
+		}
+	}
+	list->count = result->count;
+
+	talloc_free(tmp_ctx);
+	return LDB_SUCCESS;
+}
+
 /*
   return a list of dn's that might match a indexed search or
   an error. return LDB_ERR_NO_SUCH_OBJECT for no matches, or LDB_SUCCESS for matches
@@ -2210,6 +3024,9 @@ static int ldb_kv_index_dn(struct ldb_module *module,
 		break;
 
 	case LDB_OP_SUBSTRING:
+		ret = ldb_kv_index_dn_substring(module, ldb_kv, tree, list);
+		break;
+
 	case LDB_OP_PRESENT:
 	case LDB_OP_APPROX:
 	case LDB_OP_EXTENDED:
@@ -2328,17 +3145,19 @@ static int ldb_kv_index_filter(struct ldb_kv_private *ldb_kv,
 		}
 
 		ret =
-		    ldb_kv_search_key(ac->module,
-				      ldb_kv,
-				      keys[i],
-				      msg,
-				      LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC |
-				      /*
-				       * The entry point ldb_kv_search_indexed is
-				       * only called from the read-locked
-				       * ldb_kv_search.
-				       */
-				      LDB_UNPACK_DATA_FLAG_READ_LOCKED);
+		    ldb_kv_search_key_attrs(ac->module,
+					    ldb_kv,
+					    keys[i],
+					    msg,
+					    ac->unpack_attrs,
+					    LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC |
+					    /*
+					     * The entry point
+					     * ldb_kv_search_indexed is only
+					     * called from the read-locked
+					     * ldb_kv_search.
+					     */
+					    LDB_UNPACK_DATA_FLAG_READ_LOCKED);
 		if (ret == LDB_ERR_NO_SUCH_OBJECT) {
 			/*
 			 * the record has disappeared? yes, this can
@@ -2644,6 +3463,7 @@ static int ldb_kv_index_add1(struct ldb_module *module,
 	struct dn_list *list;
 	unsigned alloc_len;
 	enum key_truncation truncation = KEY_TRUNCATED;
+	bool bulk = ldb_kv->idxptr != NULL && ldb_kv->idxptr->bulk;
 
 
 	ldb = ldb_module_get_ctx(module);
@@ -2822,9 +3642,20 @@ static int ldb_kv_index_add1(struct ldb_module *module,
 		return LDB_ERR_CONSTRAINT_VIOLATION;
 	}
 
-	/* overallocate the list a bit, to reduce the number of
-	 * realloc trigered copies */
-	alloc_len = ((list->count+1)+7) & ~7;
+	if (bulk) {
+		/*
+		 * A re-index only ever appends, so grow the list
+		 * geometrically rather than copying it every 8 entries
+		 */
+		alloc_len = talloc_array_length(list->dn);
+		if (list->count + 1 > alloc_len) {
+			alloc_len = MAX(8, alloc_len * 2);
+		}
+	} else {
+		/* overallocate the list a bit, to reduce the number of
+		 * realloc trigered copies */
+		alloc_len = ((list->count+1)+7) & ~7;
+	}
 	list->dn = talloc_realloc(list, list->dn, struct ldb_val, alloc_len);
 	if (list->dn == NULL) {
 		talloc_free(list);
@@ -2855,9 +3686,26 @@ static int ldb_kv_index_add1(struct ldb_module *module,
 			return ldb_module_operr(module);
 		}
 
-		BINARY_ARRAY_SEARCH_GTE(list->dn, list->count,
-					*key_val, ldb_val_equal_exact_ordered,
-					exact, next);
+		/*
+		 * A re-index appends, the list is sorted once the
+		 * traverse is complete.  Records are added one at a
+		 * time, so a duplicate value of this record can only
+		 * be the last entry.
+		 */
+		if (bulk) {
+			ldb_kv->idxptr->unsorted = true;
+			if (list->count > 0 &&
+			    ldb_val_equal_exact(&list->dn[list->count - 1],
+						key_val) == 1) {
+				exact = &list->dn[list->count - 1];
+				ldb_kv->idxptr->bulk_duplicates++;
+			}
+		} else {
+			BINARY_ARRAY_SEARCH_GTE(list->dn, list->count,
+						*key_val,
+						ldb_val_equal_exact_ordered,
+						exact, next);
+		}
 
 		/*
 		 * Give a warning rather than fail, this could be a
@@ -2911,6 +3759,86 @@ static int ldb_kv_index_add1(struct ldb_module *module,
 	return ret;
 }
 
+/*
+  add the trigram index entries for the values of an @IDXSUBSTR
+  element.  Trigrams already indexed for this message, from another
+  value, are left alone.
+ */
+static int ldb_kv_index_substr_add(struct ldb_module *module,
+				   struct ldb_kv_private *ldb_kv,
+				   const struct ldb_message *msg,
+				   struct ldb_message_element *el)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct ldb_message_element idx_el = { 0 };
+	struct ldb_val *trigrams = NULL;
+	unsigned int i, count = 0;
+	TALLOC_CTX *tmp_ctx = NULL;
+	int ret;
+
+	tmp_ctx = talloc_new(NULL);
+	if (tmp_ctx == NULL) {
+		return ldb_module_oom(module);
+	}
+
+	ret = ldb_kv_substr_trigrams(tmp_ctx, ldb, el->name, el->values,
+				     el->num_values, -1, &trigrams, &count);
+	if (ret != LDB_SUCCESS) {
+		talloc_free(tmp_ctx);
+		return ret;
+	}
+
+	idx_el.name = ldb_kv_substr_index_attr(tmp_ctx, ldb, el->name);
+	if (idx_el.name == NULL) {
+		talloc_free(tmp_ctx);
+		return ldb_module_oom(module);
+	}
+	idx_el.num_values = 1;
+
+	for (i = 0; i < count; i++) {
+		enum key_truncation truncation = KEY_NOT_TRUNCATED;
+		struct dn_list *list = NULL;
+		struct ldb_dn *dn_key = NULL;
+
+		dn_key = ldb_kv_index_key(ldb, ldb_kv, idx_el.name,
+					  &trigrams[i], NULL, &truncation);
+		if (dn_key == NULL) {
+			talloc_free(tmp_ctx);
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		talloc_steal(tmp_ctx, dn_key);
+
+		list = talloc_zero(dn_key, struct dn_list);
+		if (list == NULL) {
+			talloc_free(tmp_ctx);
+			return ldb_module_oom(module);
+		}
+
+		ret = ldb_kv_dn_list_load(module, ldb_kv, dn_key, list,
+					  DN_LIST_WILL_BE_READ_ONLY);
+		if (ret != LDB_SUCCESS && ret != LDB_ERR_NO_SUCH_OBJECT) {
+			talloc_free(tmp_ctx);
+			return ret;
+		}
+		if (ret == LDB_SUCCESS &&
+		    ldb_kv_dn_list_find_msg(ldb_kv, list, msg) != -1) {
+			talloc_free(dn_key);
+			continue;
+		}
+		talloc_free(dn_key);
+
+		idx_el.values = &trigrams[i];
+		ret = ldb_kv_index_add1(module, ldb_kv, msg, &idx_el, 0);
+		if (ret != LDB_SUCCESS) {
+			talloc_free(tmp_ctx);
+			return ret;
+		}
+	}
+
+	talloc_free(tmp_ctx);
+	return LDB_SUCCESS;
+}
+
 /*
   add index entries for one elements in a message
  */
@@ -2920,13 +3848,20 @@ static int ldb_kv_index_add_el(struct ldb_module *module,
 			       struct ldb_message_element *el)
 {
 	unsigned int i;
-	for (i = 0; i < el->num_values; i++) {
-		int ret = ldb_kv_index_add1(module, ldb_kv, msg, el, i);
-		if (ret != LDB_SUCCESS) {
-			return ret;
+
+	if (ldb_kv_is_indexed(module, ldb_kv, el->name)) {
+		for (i = 0; i < el->num_values; i++) {
+			int ret = ldb_kv_index_add1(module, ldb_kv, msg, el, i);
+			if (ret != LDB_SUCCESS) {
+				return ret;
+			}
 		}
 	}
 
+	if (ldb_kv_is_substr_indexed(module, ldb_kv, el->name)) {
+		return ldb_kv_index_substr_add(module, ldb_kv, msg, el);
+	}
+
 	return LDB_SUCCESS;
 }
 
@@ -2962,9 +3897,6 @@ static int ldb_kv_index_add_all(struct ldb_module *module,
 	}
 
 	for (i = 0; i < msg->num_elements; i++) {
-		if (!ldb_kv_is_indexed(module, ldb_kv, elements[i].name)) {
-			continue;
-		}
 		ret = ldb_kv_index_add_el(module, ldb_kv, msg, &elements[i]);
 		if (ret != LDB_SUCCESS) {
 			struct ldb_context *ldb = ldb_module_get_ctx(module);
@@ -3102,9 +4034,6 @@ int ldb_kv_index_add_element(struct ldb_module *module,
 	if (ldb_dn_is_special(msg->dn)) {
 		return LDB_SUCCESS;
 	}
-	if (!ldb_kv_is_indexed(module, ldb_kv, el->name)) {
-		return LDB_SUCCESS;
-	}
 	return ldb_kv_index_add_el(module, ldb_kv, msg, el);
 }
 
@@ -3152,11 +4081,11 @@ int ldb_kv_index_add_new(struct ldb_module *module,
 /*
   delete an index entry for one message element
 */
-int ldb_kv_index_del_value(struct ldb_module *module,
-			   struct ldb_kv_private *ldb_kv,
-			   const struct ldb_message *msg,
-			   struct ldb_message_element *el,
-			   unsigned int v_idx)
+static int ldb_kv_index_del_value1(struct ldb_module *module,
+				   struct ldb_kv_private *ldb_kv,
+				   const struct ldb_message *msg,
+				   struct ldb_message_element *el,
+				   unsigned int v_idx)
 {
 	struct ldb_context *ldb;
 	struct ldb_dn *dn_key;
@@ -3239,6 +4168,103 @@ int ldb_kv_index_del_value(struct ldb_module *module,
 	return ret;
 }
 
+/*
+  delete the trigram index entries for an @IDXSUBSTR element.
+
+  With v_idx == -1 the entries of all values are removed, otherwise
+  only those of the value at v_idx that are not shared with any other
+  value of the element.
+*/
+static int ldb_kv_index_substr_del(struct ldb_module *module,
+				   struct ldb_kv_private *ldb_kv,
+				   const struct ldb_message *msg,
+				   struct ldb_message_element *el,
+				   int v_idx)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct ldb_message_element idx_el = { 0 };
+	struct ldb_val *trigrams = NULL, *others = NULL;
+	unsigned int i, j, count = 0, num_others = 0;
+	TALLOC_CTX *tmp_ctx = NULL;
+	int ret;
+
+	tmp_ctx = talloc_new(NULL);
+	if (tmp_ctx == NULL) {
+		return ldb_module_oom(module);
+	}
+
+	if (v_idx == -1) {
+		ret = ldb_kv_substr_trigrams(tmp_ctx, ldb, el->name,
+					     el->values, el->num_values, -1,
+					     &trigrams, &count);
+	} else {
+		ret = ldb_kv_substr_trigrams(tmp_ctx, ldb, el->name,
+					     &el->values[v_idx], 1, -1,
+					     &trigrams, &count);
+		if (ret == LDB_SUCCESS) {
+			ret = ldb_kv_substr_trigrams(tmp_ctx, ldb, el->name,
+						     el->values,
+						     el->num_values, v_idx,
+						     &others, &num_others);
+		}
+	}
+	if (ret != LDB_SUCCESS) {
+		talloc_free(tmp_ctx);
+		return ret;
+	}
+
+	idx_el.name = ldb_kv_substr_index_attr(tmp_ctx, ldb, el->name);
+	if (idx_el.name == NULL) {
+		talloc_free(tmp_ctx);
+		return ldb_module_oom(module);
+	}
+	idx_el.num_values = 1;
+
+	/* both arrays are sorted, so skip the shared trigrams in one pass */
+	for (i = 0, j = 0; i < count; i++) {
+		while (j < num_others &&
+		       ldb_val_equal_exact_for_qsort(&others[j],
+						     &trigrams[i]) < 0) {
+			j++;
+		}
+		if (j < num_others &&
+		    ldb_val_equal_exact_for_qsort(&others[j],
+						  &trigrams[i]) == 0) {
+			continue;
+		}
+
+		idx_el.values = &trigrams[i];
+		ret = ldb_kv_index_del_value1(module, ldb_kv, msg, &idx_el, 0);
+		if (ret != LDB_SUCCESS) {
+			talloc_free(tmp_ctx);
+			return ret;
+		}
+	}
+
+	talloc_free(tmp_ctx);
+	return LDB_SUCCESS;
+}
+
+/*
+  delete the index entries for one value of a message element
+*/
+int ldb_kv_index_del_value(struct ldb_module *module,
+			   struct ldb_kv_private *ldb_kv,
+			   const struct ldb_message *msg,
+			   struct ldb_message_element *el,
+			   unsigned int v_idx)
+{
+	if (ldb_kv_is_substr_indexed(module, ldb_kv, el->name)) {
+		int ret = ldb_kv_index_substr_del(module, ldb_kv, msg, el,
+						  v_idx);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	}
+
+	return ldb_kv_index_del_value1(module, ldb_kv, msg, el, v_idx);
+}
+
 /*
   delete the index entries for a element
   return -1 on failure
@@ -3266,11 +4292,18 @@ int ldb_kv_index_del_element(struct ldb_module *module,
 		return LDB_SUCCESS;
 	}
 
+	if (ldb_kv_is_substr_indexed(module, ldb_kv, el->name)) {
+		ret = ldb_kv_index_substr_del(module, ldb_kv, msg, el, -1);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	}
+
 	if (!ldb_kv_is_indexed(module, ldb_kv, el->name)) {
 		return LDB_SUCCESS;
 	}
 	for (i = 0; i < el->num_values; i++) {
-		ret = ldb_kv_index_del_value(module, ldb_kv, msg, el, i);
+		ret = ldb_kv_index_del_value1(module, ldb_kv, msg, el, i);
 		if (ret != LDB_SUCCESS) {
 			return ret;
 		}
@@ -3635,6 +4668,89 @@ int ldb_kv_repack(struct ldb_module *module)
 	return LDB_SUCCESS;
 }
 
+/*
+  traverse function sorting the GUID lists appended to by re_index
+*/
+static int ldb_kv_index_bulk_sort_traverse(_UNUSED_ struct tdb_context *tdb,
+					   _UNUSED_ TDB_DATA key,
+					   TDB_DATA data,
+					   void *state)
+{
+	struct ldb_module *module = state;
+	struct ldb_kv_private *ldb_kv = talloc_get_type(
+	    ldb_module_get_private(module), struct ldb_kv_private);
+	struct dn_list *list;
+	unsigned int i;
+
+	list = ldb_kv_index_idxptr(module, data);
+	if (list == NULL) {
+		ldb_kv->idxptr->error = LDB_ERR_OPERATIONS_ERROR;
+		return -1;
+	}
+
+	if (list->count > 1) {
+		TYPESAFE_QSORT(list->dn, list->count,
+			       ldb_val_equal_exact_for_qsort);
+	}
+	for (i = 1; i < list->count; i++) {
+		if (ldb_val_equal_exact(&list->dn[i - 1],
+					&list->dn[i]) == 1) {
+			ldb_kv->idxptr->sorted_duplicates++;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Leave bulk mode, sorting every list in the index cache once rather
+ * than keeping each one sorted while it is built.
+ */
+static int ldb_kv_index_bulk_sort(struct ldb_module *module,
+				  struct ldb_kv_private *ldb_kv)
+{
+	unsigned int bulk_duplicates = ldb_kv->idxptr->bulk_duplicates;
+	int ret;
+
+	ldb_kv->idxptr->bulk = false;
+	ldb_kv->idxptr->bulk_duplicates = 0;
+	ldb_kv->idxptr->sorted_duplicates = 0;
+
+	if (!ldb_kv->idxptr->unsorted) {
+		return LDB_SUCCESS;
+	}
+	ldb_kv->idxptr->unsorted = false;
+
+	ret = tdb_traverse(ldb_kv->idxptr->itdb,
+			   ldb_kv_index_bulk_sort_traverse,
+			   module);
+	if (ret < 0) {
+		if (ldb_kv->idxptr->error != LDB_SUCCESS) {
+			return ldb_kv->idxptr->error;
+		}
+		return ltdb_err_map(tdb_error(ldb_kv->idxptr->itdb));
+	}
+	if (ldb_kv->idxptr->error != LDB_SUCCESS) {
+		return ldb_kv->idxptr->error;
+	}
+
+	/*
+	 * Adding a record one at a time finds any existing entry for
+	 * it.  Appending only finds the duplicate values of the record
+	 * being added, any other duplicate means two records were
+	 * indexed as the same object.
+	 */
+	if (ldb_kv->idxptr->sorted_duplicates > bulk_duplicates) {
+		ldb_asprintf_errstring(ldb_module_get_ctx(module),
+				       __location__ ": index inconsistency, "
+				       "%u index entries are shared by "
+				       "more than one record",
+				       ldb_kv->idxptr->sorted_duplicates -
+				       bulk_duplicates);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	return LDB_SUCCESS;
+}
+
 /*
   force a complete reindex of the database
 */
@@ -3645,6 +4761,7 @@ int ldb_kv_reindex(struct ldb_module *module)
 	int ret;
 	struct ldb_kv_reindex_context ctx;
 	size_t index_cache_size = 0;
+	int sort_ret;
 
 	/*
 	 * Only triggered after a modification, but make clear we do
@@ -3670,17 +4787,18 @@ int ldb_kv_reindex(struct ldb_module *module)
 
 	/*
 	 * Calculate the size of the index cache needed for
-	 * the re-index. If specified always use the
-	 * ldb_kv->index_transaction_cache_size otherwise use the maximum
-	 * of the size estimate or the DEFAULT_INDEX_CACHE_SIZE
+	 * the re-index.  Every record will have at least one index
+	 * entry in the cache, so use the larger of the size estimate
+	 * and ldb_kv->index_transaction_cache_size (which is always
+	 * set, to DEFAULT_INDEX_CACHE_SIZE if not specified), rather
+	 * than walking long hash chains in the in-memory tdb.
 	 */
-	if (ldb_kv->index_transaction_cache_size > 0) {
+	index_cache_size = ldb_kv->kv_ops->get_size(ldb_kv);
+	if (index_cache_size < ldb_kv->index_transaction_cache_size) {
 		index_cache_size = ldb_kv->index_transaction_cache_size;
-	} else {
-		index_cache_size = ldb_kv->kv_ops->get_size(ldb_kv);
-		if (index_cache_size < DEFAULT_INDEX_CACHE_SIZE) {
-			index_cache_size = DEFAULT_INDEX_CACHE_SIZE;
-		}
+	}
+	if (index_cache_size < DEFAULT_INDEX_CACHE_SIZE) {
+		index_cache_size = DEFAULT_INDEX_CACHE_SIZE;
 	}
 
 	/*
@@ -3722,8 +4840,16 @@ int ldb_kv_reindex(struct ldb_module *module)
 	ctx.error = 0;
 	ctx.count = 0;
 
-	/* now traverse adding any indexes for normal LDB records */
+	/*
+	 * now traverse adding any indexes for normal LDB records.
+	 *
+	 * The index lists are built in the in-memory cache by
+	 * appending, and sorted once at the end, avoiding an
+	 * insertion sort into every (possibly very long) list.
+	 */
+	ldb_kv->idxptr->bulk = true;
 	ret = ldb_kv->kv_ops->iterate(ldb_kv, re_index, &ctx);
+	sort_ret = ldb_kv_index_bulk_sort(module, ldb_kv);
 	if (ret < 0) {
 		struct ldb_context *ldb = ldb_module_get_ctx(module);
 		ldb_asprintf_errstring(ldb, "reindexing traverse failed: %s",
@@ -3737,6 +4863,13 @@ int ldb_kv_reindex(struct ldb_module *module)
 		return ctx.error;
 	}
 
+	if (sort_ret != LDB_SUCCESS) {
+		struct ldb_context *ldb = ldb_module_get_ctx(module);
+		ldb_asprintf_errstring(ldb, "sorting the rebuilt index failed: %s",
+				       ldb_errstring(ldb));
+		return sort_ret;
+	}
+
 	if (ctx.count > 10000) {
 		ldb_debug(ldb_module_get_ctx(module),
 			  LDB_DEBUG_WARNING,
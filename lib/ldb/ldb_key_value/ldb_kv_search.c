@@ -101,6 +101,7 @@ struct ldb_kv_parse_data_unpack_ctx {
 	struct ldb_message *msg;
 	struct ldb_module *module;
 	struct ldb_kv_private *ldb_kv;
+	const char * const *attrs;
 	unsigned int unpack_flags;
 };
 
@@ -151,8 +152,8 @@ static int ldb_kv_parse_data_unpack(struct ldb_val key,
 		}
 	}
 
-	ret = ldb_unpack_data_flags(ldb, &data_parse,
-				    ctx->msg, ctx->unpack_flags);
+	ret = ldb_unpack_data_attrs_flags(ldb, &data_parse, ctx->msg,
+					  ctx->attrs, ctx->unpack_flags);
 	if (ret == -1) {
 		if (data_parse.data != data.data) {
 			talloc_free(data_parse.data);
@@ -166,22 +167,25 @@ static int ldb_kv_parse_data_unpack(struct ldb_val key,
 }
 
 /*
-  search the database for a single simple dn, returning all attributes
-  in a single message
+  search the database for a single simple dn, returning only the
+  attributes in the NULL terminated attrs list (all attributes if
+  attrs is NULL) in a single message
 
   return LDB_ERR_NO_SUCH_OBJECT on record-not-found
   and LDB_SUCCESS on success
 */
-int ldb_kv_search_key(struct ldb_module *module,
-		      struct ldb_kv_private *ldb_kv,
-		      const struct ldb_val ldb_key,
-		      struct ldb_message *msg,
-		      unsigned int unpack_flags)
+int ldb_kv_search_key_attrs(struct ldb_module *module,
+			    struct ldb_kv_private *ldb_kv,
+			    const struct ldb_val ldb_key,
+			    struct ldb_message *msg,
+			    const char * const *attrs,
+			    unsigned int unpack_flags)
 {
 	int ret;
 	struct ldb_kv_parse_data_unpack_ctx ctx = {
 		.msg = msg,
 		.module = module,
+		.attrs = attrs,
 		.unpack_flags = unpack_flags,
 		.ldb_kv = ldb_kv
 	};
@@ -218,10 +222,29 @@ int ldb_kv_search_key(struct ldb_module *module,
   return LDB_ERR_NO_SUCH_OBJECT on record-not-found
   and LDB_SUCCESS on success
 */
-int ldb_kv_search_dn1(struct ldb_module *module,
-		      struct ldb_dn *dn,
+int ldb_kv_search_key(struct ldb_module *module,
+		      struct ldb_kv_private *ldb_kv,
+		      const struct ldb_val ldb_key,
 		      struct ldb_message *msg,
 		      unsigned int unpack_flags)
+{
+	return ldb_kv_search_key_attrs(module, ldb_kv, ldb_key, msg,
+				       NULL, unpack_flags);
+}
+
+/*
+  search the database for a single simple dn, returning only the
+  attributes in the attrs list (all attributes if attrs is NULL) in a
+  single message
+
+  return LDB_ERR_NO_SUCH_OBJECT on record-not-found
+  and LDB_SUCCESS on success
+*/
+static int ldb_kv_search_dn1_attrs(struct ldb_module *module,
+				   struct ldb_dn *dn,
+				   struct ldb_message *msg,
+				   const char * const *attrs,
+				   unsigned int unpack_flags)
 {
 	void *data = ldb_module_get_private(module);
 	struct ldb_kv_private *ldb_kv =
@@ -270,7 +293,8 @@ int ldb_kv_search_dn1(struct ldb_module *module,
 		}
 	}
 
-	ret = ldb_kv_search_key(module, ldb_kv, key, msg, unpack_flags);
+	ret = ldb_kv_search_key_attrs(module, ldb_kv, key, msg,
+				      attrs, unpack_flags);
 
 	TALLOC_FREE(tdb_key_ctx);
 
@@ -290,6 +314,21 @@ int ldb_kv_search_dn1(struct ldb_module *module,
 	return LDB_SUCCESS;
 }
 
+/*
+  search the database for a single simple dn, returning all attributes
+  in a single message
+
+  return LDB_ERR_NO_SUCH_OBJECT on record-not-found
+  and LDB_SUCCESS on success
+*/
+int ldb_kv_search_dn1(struct ldb_module *module,
+		      struct ldb_dn *dn,
+		      struct ldb_message *msg,
+		      unsigned int unpack_flags)
+{
+	return ldb_kv_search_dn1_attrs(module, dn, msg, NULL, unpack_flags);
+}
+
 /*
  * filter the specified list of attributes from msg,
  * adding requested attributes, and perhaps all for *,
@@ -347,9 +386,13 @@ static int search_func(_UNUSED_ struct ldb_kv_private *ldb_kv,
 		return -1;
 	}
 
-	/* unpack the record */
-	ret = ldb_unpack_data_flags(ldb, &val, msg,
-				    LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC);
+	/*
+	 * unpack the record, but only the attributes we need to
+	 * match the filter and to return
+	 */
+	ret = ldb_unpack_data_attrs_flags(ldb, &val, msg,
+					  ac->unpack_attrs,
+					  LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC);
 	if (ret == -1) {
 		talloc_free(msg);
 		ac->error = LDB_ERR_OPERATIONS_ERROR;
@@ -444,11 +487,12 @@ static int ldb_kv_search_and_return_base(struct ldb_kv_private *ldb_kv,
 	if (!msg) {
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
-	ret = ldb_kv_search_dn1(ctx->module,
-				ctx->base,
-				msg,
-				LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC |
-				LDB_UNPACK_DATA_FLAG_READ_LOCKED);
+	ret = ldb_kv_search_dn1_attrs(ctx->module,
+				      ctx->base,
+				      msg,
+				      ctx->unpack_attrs,
+				      LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC |
+				      LDB_UNPACK_DATA_FLAG_READ_LOCKED);
 
 	if (ret == LDB_ERR_NO_SUCH_OBJECT) {
 		if (ldb_kv->check_base == false) {
@@ -545,6 +589,96 @@ static int ldb_kv_search_and_return_base(struct ldb_kv_private *ldb_kv,
 	return LDB_SUCCESS;
 }
 
+static int ldb_kv_unpack_attrs_add(struct ldb_parse_tree *tree,
+				   void *private_data)
+{
+	struct ldb_kv_context *ctx =
+	    talloc_get_type(private_data, struct ldb_kv_context);
+	const char *attr = NULL;
+	const char **attrs = NULL;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+	case LDB_OP_NOT:
+		return LDB_SUCCESS;
+	case LDB_OP_EQUALITY:
+		attr = tree->u.equality.attr;
+		break;
+	case LDB_OP_GREATER:
+	case LDB_OP_LESS:
+	case LDB_OP_APPROX:
+		attr = tree->u.comparison.attr;
+		break;
+	case LDB_OP_SUBSTRING:
+		attr = tree->u.substring.attr;
+		break;
+	case LDB_OP_PRESENT:
+		attr = tree->u.present.attr;
+		break;
+	case LDB_OP_EXTENDED:
+		if (tree->u.extended.dnAttributes == 0) {
+			attr = tree->u.extended.attr;
+		}
+		break;
+	}
+
+	if (attr == NULL) {
+		/*
+		 * We can't tell what this node looks at, so unpack
+		 * everything
+		 */
+		TALLOC_FREE(ctx->unpack_attrs);
+		return LDB_ERR_UNWILLING_TO_PERFORM;
+	}
+
+	if (ldb_attr_in_list(ctx->unpack_attrs, attr)) {
+		return LDB_SUCCESS;
+	}
+
+	attrs = ldb_attr_list_copy_add(ctx, ctx->unpack_attrs, attr);
+	if (attrs == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	talloc_free(ctx->unpack_attrs);
+	ctx->unpack_attrs = attrs;
+	return LDB_SUCCESS;
+}
+
+/*
+ * Work out which attributes have to be unpacked from each candidate
+ * record: the ones the filter looks at and the ones that were asked
+ * for.  Everything else is skipped over in the packed record, which
+ * is a big saving on objects with large multi-valued attributes.
+ *
+ * ctx->unpack_attrs is left NULL (unpack everything) if all
+ * attributes were asked for.
+ */
+static int ldb_kv_search_unpack_attrs(struct ldb_kv_context *ctx)
+{
+	int ret;
+
+	ctx->unpack_attrs = NULL;
+
+	if (ctx->attrs == NULL || ldb_attr_in_list(ctx->attrs, "*")) {
+		return LDB_SUCCESS;
+	}
+
+	ctx->unpack_attrs = ldb_attr_list_copy(ctx, ctx->attrs);
+	if (ctx->unpack_attrs == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ldb_parse_tree_walk(discard_const_p(struct ldb_parse_tree,
+						  ctx->tree),
+				  ldb_kv_unpack_attrs_add,
+				  ctx);
+	if (ret == LDB_ERR_UNWILLING_TO_PERFORM) {
+		return LDB_SUCCESS;
+	}
+	return ret;
+}
+
 /*
   search the database with a LDAP-like expression.
   choses a search method
@@ -582,6 +716,12 @@ int ldb_kv_search(struct ldb_kv_context *ctx)
 	ctx->base = req->op.search.base;
 	ctx->attrs = req->op.search.attrs;
 
+	ret = ldb_kv_search_unpack_attrs(ctx);
+	if (ret != LDB_SUCCESS) {
+		ldb_kv->kv_ops->unlock_read(module);
+		return ret;
+	}
+
 	if ((req->op.search.base == NULL) || (ldb_dn_is_null(req->op.search.base) == true)) {
 
 		/* Check what we should do with a NULL dn */
@@ -137,6 +137,91 @@ static int sort_compare(struct ldb_message **msg1, struct ldb_message **msg2, vo
 	return ac->a->syntax->comparison_fn(ldb, ac, &el1->values[0], &el2->values[0]);
 }
 
+struct sort_key {
+	struct ldb_message *msg;
+	struct ldb_val key;
+	bool has_key;
+};
+
+static int sort_key_compare(struct sort_key *k1, struct sort_key *k2,
+			    void *opaque)
+{
+	struct sort_context *ac = talloc_get_type(opaque, struct sort_context);
+	size_t len;
+	int ret;
+
+	if (!k1->has_key && k2->has_key) {
+		return 1;
+	}
+	if (k1->has_key && !k2->has_key) {
+		return -1;
+	}
+	if (!k1->has_key && !k2->has_key) {
+		return 0;
+	}
+
+	len = MIN(k1->key.length, k2->key.length);
+	ret = memcmp(k1->key.data, k2->key.data, len);
+	if (ret == 0 && k1->key.length != k2->key.length) {
+		ret = k1->key.length < k2->key.length ? -1 : 1;
+	}
+
+	if (ac->reverse) {
+		return -ret;
+	}
+	return ret;
+}
+
+/*
+  Sort on the ordered index format of the first value, the same
+  memcmp()-able key the ordered indexes are built from.  This formats
+  each value once rather than calling comparison_fn O(n log n) times.
+
+  Returns false if a value could not be formatted, in which case the
+  caller falls back to comparison_fn.
+*/
+static bool server_sort_by_index_format(struct sort_context *ac)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(ac->module);
+	struct sort_key *keys;
+	unsigned int i;
+
+	keys = talloc_zero_array(ac, struct sort_key, ac->num_msgs);
+	if (keys == NULL) {
+		return false;
+	}
+
+	for (i = 0; i < ac->num_msgs; i++) {
+		struct ldb_message_element *el;
+		int ret;
+
+		keys[i].msg = ac->msgs[i];
+
+		el = ldb_msg_find_element(ac->msgs[i], ac->attributeName);
+		if (el == NULL || el->num_values == 0) {
+			continue;
+		}
+
+		ret = ac->a->syntax->index_format_fn(ldb, keys,
+						     &el->values[0],
+						     &keys[i].key);
+		if (ret != LDB_SUCCESS) {
+			TALLOC_FREE(keys);
+			return false;
+		}
+		keys[i].has_key = true;
+	}
+
+	LDB_TYPESAFE_QSORT(keys, ac->num_msgs, ac, sort_key_compare);
+
+	for (i = 0; i < ac->num_msgs; i++) {
+		ac->msgs[i] = keys[i].msg;
+	}
+
+	TALLOC_FREE(keys);
+	return true;
+}
+
 static int server_sort_results(struct sort_context *ac)
 {
 	struct ldb_context *ldb;
@@ -149,7 +234,10 @@ static int server_sort_results(struct sort_context *ac)
 	ac->a = ldb_schema_attribute_by_name(ldb, ac->attributeName);
 	ac->sort_result = 0;
 
-	LDB_TYPESAFE_QSORT(ac->msgs, ac->num_msgs, ac, sort_compare);
+	if (ac->a->syntax->index_format_fn == NULL ||
+	    !server_sort_by_index_format(ac)) {
+		LDB_TYPESAFE_QSORT(ac->msgs, ac->num_msgs, ac, sort_compare);
+	}
 
 	if (ac->sort_result != LDB_SUCCESS) {
 		return ac->sort_result;
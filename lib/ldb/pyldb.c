@@ -4412,6 +4412,7 @@ static PyObject* module_init(void)
 
 	ADD_LDB_INT(PACKING_FORMAT);
 	ADD_LDB_INT(PACKING_FORMAT_V2);
+	ADD_LDB_INT(PACKING_FORMAT_V3);
 
 	/* Historical misspelling */
 	PyModule_AddIntConstant(m, "ERR_ALIAS_DEREFERINCING_PROBLEM", LDB_ERR_ALIAS_DEREFERENCING_PROBLEM);
@@ -1,5 +1,6 @@
 /*
- * Tests exercising the ldb_filter_attrs().
+ * Tests exercising the ldb_filter_attrs() and
+ * ldb_unpack_data_attrs_flags(), including the V3 attribute directory.
  *
  *
  * Copyright (C) Catalyst.NET Ltd 2017
@@ -923,6 +924,218 @@ static void test_filter_attrs_one_attr_empty_list(void **state)
 	assert_null(filtered_msg->elements);
 }
 
+/*
+ * Pack a record with a small attribute either side of a large
+ * multi-valued one, and check that only the requested attributes are
+ * unpacked, in both pack formats.
+ */
+static void test_unpack_attrs_skip_large(void **state)
+{
+	struct ldbtest_ctx *ctx = *state;
+	unsigned int formats[] = {
+		LDB_PACKING_FORMAT,
+		LDB_PACKING_FORMAT_V2,
+		LDB_PACKING_FORMAT_V3
+	};
+	unsigned int f, i;
+	int ret;
+
+	const char *attrs[] = {"FOO", "baz", "missing", NULL};
+
+	uint8_t value[] = "The value.......end";
+	uint8_t value2[] = "The second value";
+	struct ldb_val value_1 = {
+		.data   = value,
+		.length = (sizeof(value))
+	};
+	struct ldb_val value_2 = {
+		.data   = value2,
+		.length = (sizeof(value2))
+	};
+	struct ldb_message_element elements[3] = {
+		{
+			.name = "foo",
+			.num_values = 1,
+			.values = &value_1
+		},
+		{
+			.name = "member",
+			.num_values = 1000,
+		},
+		{
+			.name = "baz",
+			.num_values = 1,
+			.values = &value_2
+		},
+	};
+	struct ldb_message in = {
+		.dn = ldb_dn_new(ctx, ctx->ldb, "dc=samba,dc=org"),
+		.num_elements = 3,
+		.elements = elements,
+	};
+
+	assert_non_null(in.dn);
+
+	elements[1].values = talloc_array(ctx, struct ldb_val,
+					  elements[1].num_values);
+	assert_non_null(elements[1].values);
+	for (i = 0; i < elements[1].num_values; i++) {
+		/* make some of the values need wide lengths */
+		size_t len = (i % 100 == 0) ? 300 : 10;
+		elements[1].values[i].data = talloc_zero_size(ctx, len);
+		assert_non_null(elements[1].values[i].data);
+		elements[1].values[i].length = len;
+	}
+
+	for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+		struct ldb_message *msg = ldb_msg_new(ctx);
+		struct ldb_message *all = ldb_msg_new(ctx);
+		struct ldb_val packed;
+
+		ret = ldb_pack_data(ctx->ldb, &in, &packed, formats[f]);
+		assert_int_equal(ret, 0);
+
+		ret = ldb_unpack_data_attrs_flags(
+			ctx->ldb, &packed, msg, attrs,
+			LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC);
+		assert_int_equal(ret, 0);
+
+		assert_string_equal(ldb_dn_get_linearized(msg->dn),
+				    "dc=samba,dc=org");
+		assert_int_equal(msg->num_elements, 2);
+		assert_string_equal(msg->elements[0].name, "foo");
+		assert_int_equal(msg->elements[0].num_values, 1);
+		assert_int_equal(msg->elements[0].values[0].length,
+				 sizeof(value));
+		assert_memory_equal(msg->elements[0].values[0].data,
+				    value, sizeof(value));
+		assert_string_equal(msg->elements[1].name, "baz");
+		assert_int_equal(msg->elements[1].num_values, 1);
+		assert_int_equal(msg->elements[1].values[0].length,
+				 sizeof(value2));
+		assert_memory_equal(msg->elements[1].values[0].data,
+				    value2, sizeof(value2));
+
+		/* A NULL list unpacks everything */
+		ret = ldb_unpack_data_attrs_flags(ctx->ldb, &packed, all,
+						  NULL, 0);
+		assert_int_equal(ret, 0);
+		assert_int_equal(all->num_elements, 3);
+		assert_string_equal(all->elements[1].name, "member");
+		assert_int_equal(all->elements[1].num_values,
+				 elements[1].num_values);
+		assert_int_equal(all->elements[1].values[100].length, 300);
+		assert_memory_equal(all->elements[2].values[0].data,
+				    value2, sizeof(value2));
+
+		/* A truncated record is still rejected */
+		packed.length -= 1;
+		talloc_free(msg);
+		msg = ldb_msg_new(ctx);
+		ret = ldb_unpack_data_attrs_flags(ctx->ldb, &packed, msg,
+						  attrs, 0);
+		assert_int_equal(ret, -1);
+
+		talloc_free(msg);
+		talloc_free(all);
+		talloc_free(packed.data);
+	}
+}
+
+/*
+ * Find each attribute of a record with many attributes through the
+ * attribute directory of the V3 pack format, whatever the case of the
+ * name asked for.
+ */
+static void test_unpack_attrs_v3_directory(void **state)
+{
+	struct ldbtest_ctx *ctx = *state;
+	struct ldb_message *in = ldb_msg_new(ctx);
+	struct ldb_message *full_v2 = ldb_msg_new(ctx);
+	struct ldb_message *full_v3 = ldb_msg_new(ctx);
+	struct ldb_val packed_v2, packed_v3;
+	unsigned int i, j;
+	int ret;
+
+	in->dn = ldb_dn_new(in, ctx->ldb, "dc=samba,dc=org");
+	assert_non_null(in->dn);
+
+	/* Names deliberately not added in sorted order */
+	for (i = 0; i < 50; i++) {
+		char *name = talloc_asprintf(in, "attr%02u", (i * 7) % 50);
+		assert_non_null(name);
+		for (j = 0; j <= i % 3; j++) {
+			char *v = talloc_asprintf(in, "%s-value-%u", name, j);
+			ret = ldb_msg_add_string(in, name, v);
+			assert_int_equal(ret, LDB_SUCCESS);
+		}
+	}
+
+	ret = ldb_pack_data(ctx->ldb, in, &packed_v2, LDB_PACKING_FORMAT_V2);
+	assert_int_equal(ret, 0);
+	ret = ldb_pack_data(ctx->ldb, in, &packed_v3, LDB_PACKING_FORMAT_V3);
+	assert_int_equal(ret, 0);
+
+	/* A full unpack gives the same message for both formats */
+	ret = ldb_unpack_data(ctx->ldb, &packed_v2, full_v2);
+	assert_int_equal(ret, 0);
+	ret = ldb_unpack_data(ctx->ldb, &packed_v3, full_v3);
+	assert_int_equal(ret, 0);
+	assert_int_equal(full_v3->num_elements, in->num_elements);
+	for (i = 0; i < in->num_elements; i++) {
+		struct ldb_message_element *a = &full_v2->elements[i];
+		struct ldb_message_element *b = &full_v3->elements[i];
+		assert_string_equal(a->name, b->name);
+		assert_int_equal(a->num_values, b->num_values);
+		for (j = 0; j < a->num_values; j++) {
+			assert_int_equal(a->values[j].length,
+					 b->values[j].length);
+			assert_memory_equal(a->values[j].data,
+					    b->values[j].data,
+					    a->values[j].length);
+		}
+	}
+
+	for (i = 0; i < in->num_elements; i++) {
+		struct ldb_message *msg = ldb_msg_new(ctx);
+		char *upper = ldb_attr_casefold(msg, in->elements[i].name);
+		const char *attrs[] = {upper, "nosuchattr", upper, NULL};
+
+		ret = ldb_unpack_data_attrs_flags(
+			ctx->ldb, &packed_v3, msg, attrs,
+			LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC);
+		assert_int_equal(ret, 0);
+		assert_int_equal(msg->num_elements, 1);
+		assert_string_equal(msg->elements[0].name,
+				    in->elements[i].name);
+		assert_int_equal(msg->elements[0].num_values,
+				 in->elements[i].num_values);
+		for (j = 0; j < in->elements[i].num_values; j++) {
+			assert_int_equal(msg->elements[0].values[j].length,
+					 in->elements[i].values[j].length);
+			assert_memory_equal(msg->elements[0].values[j].data,
+					    in->elements[i].values[j].data,
+					    in->elements[i].values[j].length);
+		}
+		talloc_free(msg);
+	}
+
+	/* Several attributes come back in the order they were packed */
+	{
+		struct ldb_message *msg = ldb_msg_new(ctx);
+		const char *attrs[] = {"attr49", "ATTR00", "attr07", NULL};
+
+		ret = ldb_unpack_data_attrs_flags(ctx->ldb, &packed_v3, msg,
+						  attrs, 0);
+		assert_int_equal(ret, 0);
+		assert_int_equal(msg->num_elements, 3);
+		assert_string_equal(msg->elements[0].name, "attr00");
+		assert_string_equal(msg->elements[1].name, "attr07");
+		assert_string_equal(msg->elements[2].name, "attr49");
+		talloc_free(msg);
+	}
+}
+
 int main(int argc, const char **argv)
 {
 	const struct CMUnitTest tests[] = {
@@ -982,6 +1195,14 @@ int main(int argc, const char **argv)
 			test_filter_attrs_one_attr_empty_list,
 			setup,
 			teardown),
+		cmocka_unit_test_setup_teardown(
+			test_unpack_attrs_skip_large,
+			setup,
+			teardown),
+		cmocka_unit_test_setup_teardown(
+			test_unpack_attrs_v3_directory,
+			setup,
+			teardown),
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
@@ -225,6 +225,29 @@ static void test_reindex_cache_size(void **state)
 
 	assert_int_equal(db_size, tdb_hash_size(ldb_kv->idxptr->itdb));
 
+	/*
+	 * Use a value greater than the configured cache size
+	 * Should get the size estimate.
+	 */
+	ldb_kv->index_transaction_cache_size = DEFAULT_INDEX_CACHE_SIZE;
+	db_size = DEFAULT_INDEX_CACHE_SIZE * 4;
+	ret = ldb_kv_reindex(module);
+	assert_int_equal(LDB_SUCCESS, ret);
+
+	assert_int_equal(db_size, tdb_hash_size(ldb_kv->idxptr->itdb));
+
+	/*
+	 * Use a value less than the configured cache size
+	 * Should get the configured size.
+	 */
+	ldb_kv->index_transaction_cache_size = DEFAULT_INDEX_CACHE_SIZE * 8;
+	ret = ldb_kv_reindex(module);
+	assert_int_equal(LDB_SUCCESS, ret);
+
+	assert_int_equal(
+		DEFAULT_INDEX_CACHE_SIZE * 8,
+		tdb_hash_size(ldb_kv->idxptr->itdb));
+
 	TALLOC_FREE(ldb_kv);
 	TALLOC_FREE(module);
 }
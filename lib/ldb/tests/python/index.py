@@ -1417,6 +1417,192 @@ class OrderedIntegerRangeTestsLmdb(OrderedIntegerRangeTests):
         super(OrderedIntegerRangeTestsLmdb, self).tearDown()
 
 
+class SubstringIndexTests(LdbBaseTest):
+
+    def tearDown(self):
+        shutil.rmtree(self.testdir)
+        super(SubstringIndexTests, self).tearDown()
+
+        # Ensure the LDB is closed now, so we close the FD
+        del(self.l)
+
+    def setUp(self):
+        super(SubstringIndexTests, self).setUp()
+        self.testdir = tempdir()
+        self.filename = os.path.join(self.testdir, "substring_test.ldb")
+
+        # Any search the substring index can not answer will fail
+        self.l = ldb.Ldb(self.url(),
+                         options=['modules:rdn_name',
+                                  'disable_full_db_scan_for_self_test:1'])
+        self.l.add({"dn": "@ATTRIBUTES",
+                    "displayName": "CASE_INSENSITIVE"})
+        self.l.add({"dn": "@INDEXLIST",
+                    "@IDXATTR": [b"cn"],
+                    "@IDXSUBSTR": [b"displayName"],
+                    "@IDXGUID": [b"objectUUID"],
+                    "@IDX_DN_GUID": [b"GUID"]})
+
+        self.l.add({"dn": "CN=A,DC=SAMBA,DC=ORG",
+                    "objectUUID": b"0123456789abcde0",
+                    "displayName": b"John Smith"})
+        self.l.add({"dn": "CN=B,DC=SAMBA,DC=ORG",
+                    "objectUUID": b"0123456789abcde1",
+                    "displayName": [b"Jane Smithers", b"Other Name"]})
+        self.l.add({"dn": "CN=C,DC=SAMBA,DC=ORG",
+                    "objectUUID": b"0123456789abcde2",
+                    "displayName": b"Bob Jones"})
+
+    def search(self, expression):
+        res = self.l.search(base="DC=SAMBA,DC=ORG",
+                            scope=ldb.SCOPE_SUBTREE,
+                            expression=expression)
+        return sorted([str(r.dn) for r in res])
+
+    def test_substring(self):
+        self.assertEqual(self.search("(displayName=*smith*)"),
+                         ["CN=A,DC=SAMBA,DC=ORG", "CN=B,DC=SAMBA,DC=ORG"])
+        self.assertEqual(self.search("(displayName=*SMITHERS)"),
+                         ["CN=B,DC=SAMBA,DC=ORG"])
+        self.assertEqual(self.search("(displayName=*oth*nam*)"),
+                         ["CN=B,DC=SAMBA,DC=ORG"])
+        self.assertEqual(self.search("(displayName=*jon*)"),
+                         ["CN=C,DC=SAMBA,DC=ORG"])
+        self.assertEqual(self.search("(displayName=*xyz*)"), [])
+
+    def test_substring_too_short(self):
+        try:
+            self.search("(displayName=*o*)")
+            self.fail("Expected a full scan")
+        except ldb.LdbError as err:
+            enum = err.args[0]
+            self.assertEqual(enum, ldb.ERR_INAPPROPRIATE_MATCHING)
+
+    def test_substring_modify(self):
+        m = ldb.Message()
+        m.dn = ldb.Dn(self.l, "CN=B,DC=SAMBA,DC=ORG")
+        m["displayName"] = ldb.MessageElement([b"Jane Smithers"],
+                                              ldb.FLAG_MOD_DELETE,
+                                              "displayName")
+        self.l.modify(m)
+        self.assertEqual(self.search("(displayName=*smith*)"),
+                         ["CN=A,DC=SAMBA,DC=ORG"])
+        self.assertEqual(self.search("(displayName=*name*)"),
+                         ["CN=B,DC=SAMBA,DC=ORG"])
+
+        m = ldb.Message()
+        m.dn = ldb.Dn(self.l, "CN=C,DC=SAMBA,DC=ORG")
+        m["displayName"] = ldb.MessageElement([b"Bob Smithson"],
+                                              ldb.FLAG_MOD_REPLACE,
+                                              "displayName")
+        self.l.modify(m)
+        self.assertEqual(self.search("(displayName=*smith*)"),
+                         ["CN=A,DC=SAMBA,DC=ORG", "CN=C,DC=SAMBA,DC=ORG"])
+        self.assertEqual(self.search("(displayName=*jon*)"), [])
+
+    def test_substring_delete(self):
+        self.l.delete("CN=A,DC=SAMBA,DC=ORG")
+        self.assertEqual(self.search("(displayName=*smith*)"),
+                         ["CN=B,DC=SAMBA,DC=ORG"])
+
+    def test_substring_reindex(self):
+        # Dropping the substring index must not leave stale entries
+        self.l.modify_ldif("""dn: @INDEXLIST
+changetype: modify
+delete: @IDXSUBSTR
+""")
+        self.l.delete("CN=A,DC=SAMBA,DC=ORG")
+        self.l.modify_ldif("""dn: @INDEXLIST
+changetype: modify
+add: @IDXSUBSTR
+@IDXSUBSTR: displayName
+""")
+        self.assertEqual(self.search("(displayName=*smith*)"),
+                         ["CN=B,DC=SAMBA,DC=ORG"])
+
+
+class SubstringIndexTestsLmdb(SubstringIndexTests):
+
+    def setUp(self):
+        if os.environ.get('HAVE_LMDB', '1') == '0':
+            self.skipTest("No lmdb backend")
+        self.prefix = MDB_PREFIX
+        super(SubstringIndexTestsLmdb, self).setUp()
+
+    def tearDown(self):
+        super(SubstringIndexTestsLmdb, self).tearDown()
+
+
+class IndexPlannerTests(LdbBaseTest):
+
+    def tearDown(self):
+        shutil.rmtree(self.testdir)
+        super(IndexPlannerTests, self).tearDown()
+
+        # Ensure the LDB is closed now, so we close the FD
+        del(self.l)
+
+    def setUp(self):
+        super(IndexPlannerTests, self).setUp()
+        self.testdir = tempdir()
+        self.filename = os.path.join(self.testdir, "planner_test.ldb")
+
+        self.l = ldb.Ldb(self.url(),
+                         options=['modules:rdn_name',
+                                  'disable_full_db_scan_for_self_test:1'])
+        self.l.add({"dn": "@INDEXLIST",
+                    "@IDXATTR": [b"x", b"y", b"z"],
+                    "@IDXGUID": [b"objectUUID"],
+                    "@IDX_DN_GUID": [b"GUID"]})
+
+        # x is shared by all, y by 1 in 100 and z by 1 in 10 objects
+        self.l.transaction_start()
+        for i in range(1100):
+            self.l.add({"dn": "OU=PLAN{},DC=SAMBA,DC=ORG".format(i),
+                        "objectUUID": b"%016d" % i,
+                        "x": b"x",
+                        "y": b"%d" % (i % 100),
+                        "z": b"%d" % (i % 10),
+                        "w": b"%d" % (i % 2)})
+        self.l.transaction_commit()
+
+    def search(self, expression):
+        res = self.l.search(base="DC=SAMBA,DC=ORG",
+                            scope=ldb.SCOPE_SUBTREE,
+                            expression=expression)
+        return len(res)
+
+    def test_and(self):
+        self.assertEqual(self.search("(&(x=x)(y=5))"), 11)
+        self.assertEqual(self.search("(&(x=x)(z=5)(y=5))"), 11)
+        self.assertEqual(self.search("(&(x=x)(z=5)(y=6))"), 0)
+        self.assertEqual(self.search("(&(x=x)(z=5))"), 110)
+        self.assertEqual(self.search("(&(x=x)(z=5)(w=1))"), 110)
+        self.assertEqual(self.search("(&(x=x)(z=5)(w=0))"), 0)
+        self.assertEqual(self.search("(&(x=x)(y=5)(!(w=1)))"), 0)
+
+    def test_and_or(self):
+        self.assertEqual(self.search("(&(x=x)(|(y=5)(y=6)))"), 22)
+        self.assertEqual(self.search("(&(z=5)(|(y=5)(y=6)))"), 11)
+        self.assertEqual(self.search("(&(x=x)(|(y=5)(z=6)))"), 121)
+
+    def test_and_no_match(self):
+        self.assertEqual(self.search("(&(x=x)(y=nosuch))"), 0)
+        self.assertEqual(self.search("(&(x=nosuch)(z=1))"), 0)
+
+
+class IndexPlannerTestsLmdb(IndexPlannerTests):
+
+    def setUp(self):
+        if os.environ.get('HAVE_LMDB', '1') == '0':
+            self.skipTest("No lmdb backend")
+        self.prefix = MDB_PREFIX
+        super(IndexPlannerTestsLmdb, self).setUp()
+
+    def tearDown(self):
+        super(IndexPlannerTestsLmdb, self).tearDown()
+
+
 # Run the index truncation tests against an lmdb backend
 class RejectSubDBIndex(LdbBaseTest):
 
@@ -196,6 +196,57 @@ class GUIDIndexAndPackFormatTests(TestCase):
 
         self.toggle_guidindex_check_pack()
 
+    def set_attribute_directory(self, enable=True):
+        modmsg = ldb.Message()
+        modmsg.dn = ldb.Dn(self.l, '@OPTIONS')
+        el = [b"TRUE"] if enable else []
+        modmsg["attributeDirectory"] = \
+            ldb.MessageElement(elements=el,
+                               flags=ldb.FLAG_MOD_REPLACE,
+                               name="attributeDirectory")
+        self.l.modify(modmsg)
+
+    # Check a GUID indexed database is repacked at V3 when the attribute
+    # directory is enabled in @OPTIONS, and back at V2 when it is
+    # disabled again, and that searches see the same records either way.
+    def test_repack_attribute_directory(self):
+        self.setup_newdb()
+
+        self.l.add({"dn": "@OPTIONS"})
+        self.l.add({"dn": "@INDEXLIST",
+                    "@IDXONE": [b"1"],
+                    "@IDXGUID": [b"objectUUID"],
+                    "@IDX_DN_GUID": [b"GUID"]})
+
+        expect_db = {}
+        for i in range(5):
+            rec = self.add_one_rec()
+            expect_db[rec['dn']] = rec
+
+        for enable in [True, True, False, True, False]:
+            pf = ldb.PACKING_FORMAT_V3 if enable else ldb.PACKING_FORMAT_V2
+
+            self.set_attribute_directory(enable=enable)
+
+            guid_keys, pack_formats = self.ldbdump_guid_keys_pack_formats()
+            self.assertEqual(len(guid_keys), self.num_recs_added)
+            self.assertEqual(pack_formats, [pf])
+            self.assertEqual(self.get_database(), expect_db)
+
+            rec = self.add_one_rec()
+            expect_db[rec['dn']] = rec
+
+            guid_keys, pack_formats = self.ldbdump_guid_keys_pack_formats()
+            self.assertEqual(len(guid_keys), self.num_recs_added)
+            self.assertEqual(pack_formats, [pf])
+            self.assertEqual(self.get_database(), expect_db)
+
+            res = self.l.search(base=rec['dn'], scope=ldb.SCOPE_BASE,
+                                attrs=["OBJECTUUID"])
+            self.assertEqual(len(res), 1)
+            self.assertEqual(list(res[0].keys()), ["dn", "objectUUID"])
+            self.assertEqual(str(res[0]["objectUUID"]), rec["objectUUID"])
+
 
 if __name__ == '__main__':
     import unittest
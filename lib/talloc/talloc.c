@@ -315,6 +315,15 @@ struct talloc_chunk {
 	 * from.
 	 */
 	struct talloc_pool_hdr *pool;
+
+	/*
+	 * For chunks allocated by talloc_cached_object() or
+	 * talloc_cached_pooled_object() "cache" points to the per-thread
+	 * object cache the memory came from. On free the memory is
+	 * handed back to that cache instead of free(3), as long as we
+	 * are still in the same thread and the cache has room for it.
+	 */
+	struct talloc_object_cache *cache;
 };
 
 union talloc_chunk_cast_u {
@@ -732,14 +741,171 @@ static inline struct talloc_chunk *tc_alloc_pool(struct talloc_chunk *parent,
 	return result;
 }
 
+/*
+  The object cache keeps freed blocks of malloc'ed memory on per-thread
+  free lists, one list per 16 byte size class, so that hot fixed-size
+  objects (requests, their state and the like) do not go through
+  malloc(3)/free(3) for every allocation. Only memory allocated with
+  talloc_cached_object() or talloc_cached_pooled_object() is put on
+  the free lists.
+
+  Without thread local storage we can't tell threads apart, so caching
+  is disabled and the cached allocators behave like their uncached
+  counterparts.
+*/
+
+#define TALLOC_OBJECT_CACHE_MAX_BLOCK 4096
+#define TALLOC_OBJECT_CACHE_CLASSES (TALLOC_OBJECT_CACHE_MAX_BLOCK / 16)
+#define TALLOC_OBJECT_CACHE_DEFAULT_LIMIT (1024 * 1024)
+
+struct talloc_cached_block {
+	struct talloc_cached_block *next;
+};
+
+struct talloc_object_cache {
+	struct talloc_cached_block *free_list[TALLOC_OBJECT_CACHE_CLASSES];
+	size_t cached_bytes;
+	size_t max_bytes;
+};
+
+#ifdef HAVE___THREAD
+static __thread struct talloc_object_cache talloc_thread_cache = {
+	.max_bytes = TALLOC_OBJECT_CACHE_DEFAULT_LIMIT,
+};
+#define TALLOC_OBJECT_CACHE (&talloc_thread_cache)
+#else
+#define TALLOC_OBJECT_CACHE NULL
+#endif
+
+/*
+  Get a block of at least len bytes, from this thread's object cache
+  if possible. *pcache is set to the cache the block has to be returned
+  to, or NULL if it has to be given back with free(3).
+*/
+static inline void *tc_cache_malloc(size_t len,
+				    struct talloc_object_cache **pcache)
+{
+	struct talloc_object_cache *cache = TALLOC_OBJECT_CACHE;
+	struct talloc_cached_block *b;
+	size_t block_size = TC_ALIGN16(len);
+	size_t idx;
+
+	if ((cache == NULL) || (block_size > TALLOC_OBJECT_CACHE_MAX_BLOCK)) {
+		*pcache = NULL;
+		return malloc(len);
+	}
+
+	*pcache = cache;
+
+	idx = (block_size / 16) - 1;
+	b = cache->free_list[idx];
+	if (b == NULL) {
+		return malloc(block_size);
+	}
+
+	cache->free_list[idx] = b->next;
+	cache->cached_bytes -= block_size;
+
+#if defined(DEVELOPER) && defined(VALGRIND_MAKE_MEM_UNDEFINED)
+	VALGRIND_MAKE_MEM_UNDEFINED(b, block_size);
+#endif
+
+	return b;
+}
+
+/*
+  Give back a block of len bytes obtained from tc_cache_malloc()
+*/
+static inline void tc_cache_free(struct talloc_object_cache *cache,
+				 void *ptr, size_t len)
+{
+	struct talloc_cached_block *b = (struct talloc_cached_block *)ptr;
+	size_t block_size = TC_ALIGN16(len);
+	size_t idx;
+
+	/*
+	 * Blocks freed by another thread than the one that allocated
+	 * them go back to the system, we must not touch the free lists
+	 * of other threads.
+	 */
+	if ((cache == NULL) || (cache != TALLOC_OBJECT_CACHE)) {
+		free(ptr);
+		return;
+	}
+
+	if (cache->cached_bytes + block_size > cache->max_bytes) {
+		free(ptr);
+		return;
+	}
+
+#if defined(DEVELOPER) && defined(VALGRIND_MAKE_MEM_UNDEFINED)
+	VALGRIND_MAKE_MEM_UNDEFINED(b, sizeof(*b));
+#endif
+
+	idx = (block_size / 16) - 1;
+	b->next = cache->free_list[idx];
+	cache->free_list[idx] = b;
+	cache->cached_bytes += block_size;
+}
+
+static void tc_cache_trim(struct talloc_object_cache *cache, size_t max_bytes)
+{
+	size_t i;
+
+	for (i = 0; i < TALLOC_OBJECT_CACHE_CLASSES; i++) {
+		size_t block_size = (i + 1) * 16;
+
+		if (cache->cached_bytes <= max_bytes) {
+			break;
+		}
+
+		while (cache->free_list[i] != NULL) {
+			struct talloc_cached_block *b = cache->free_list[i];
+
+			cache->free_list[i] = b->next;
+			cache->cached_bytes -= block_size;
+			free(b);
+
+			if (cache->cached_bytes <= max_bytes) {
+				break;
+			}
+		}
+	}
+}
+
+_PUBLIC_ void talloc_object_cache_set_limit(size_t max_bytes)
+{
+	struct talloc_object_cache *cache = TALLOC_OBJECT_CACHE;
+
+	if (cache == NULL) {
+		return;
+	}
+
+	cache->max_bytes = max_bytes;
+	tc_cache_trim(cache, max_bytes);
+}
+
+_PUBLIC_ void talloc_object_cache_flush(void)
+{
+	struct talloc_object_cache *cache = TALLOC_OBJECT_CACHE;
+
+	if (cache == NULL) {
+		return;
+	}
+
+	tc_cache_trim(cache, 0);
+}
+
 /*
    Allocate a bit of memory as a child of an existing pointer
 */
 static inline void *__talloc_with_prefix(const void *context,
 					size_t size,
 					size_t prefix_len,
+					bool cached,
 					struct talloc_chunk **tc_ret)
 {
+	struct talloc_object_cache *cache = NULL;
 	struct talloc_chunk *tc = NULL;
 	struct talloc_memlimit *limit = NULL;
 	size_t total_len = TC_HDR_SIZE + size + prefix_len;
@@ -779,7 +945,11 @@ static inline void *__talloc_with_prefix(const void *context,
 			return NULL;
 		}
 
-		ptr = malloc(total_len);
+		if (cached) {
+			ptr = tc_cache_malloc(total_len, &cache);
+		} else {
+			ptr = malloc(total_len);
+		}
 		if (unlikely(ptr == NULL)) {
 			return NULL;
 		}
@@ -792,6 +962,7 @@ static inline void *__talloc_with_prefix(const void *context,
 	}
 
 	tc->limit = limit;
+	tc->cache = cache;
 	tc->size = size;
 	tc->destructor = NULL;
 	tc->child = NULL;
@@ -821,20 +992,21 @@ static inline void *__talloc(const void *context,
 			size_t size,
 			struct talloc_chunk **tc)
 {
-	return __talloc_with_prefix(context, size, 0, tc);
+	return __talloc_with_prefix(context, size, 0, false, tc);
 }
 
 /*
  * Create a talloc pool
  */
 
-static inline void *_talloc_pool(const void *context, size_t size)
+static inline void *_talloc_pool(const void *context, size_t size,
+				 bool cached)
 {
 	struct talloc_chunk *tc;
 	struct talloc_pool_hdr *pool_hdr;
 	void *result;
 
-	result = __talloc_with_prefix(context, size, TP_HDR_SIZE, &tc);
+	result = __talloc_with_prefix(context, size, TP_HDR_SIZE, cached, &tc);
 
 	if (unlikely(result == NULL)) {
 		return NULL;
@@ -856,7 +1028,7 @@ static inline void *_talloc_pool(const void *context, size_t size)
 
 _PUBLIC_ void *talloc_pool(const void *context, size_t size)
 {
-	return _talloc_pool(context, size);
+	return _talloc_pool(context, size, false);
 }
 
 /*
@@ -865,11 +1037,12 @@ _PUBLIC_ void *talloc_pool(const void *context, size_t size)
  * a custom allocator for talloc to reduce fragmentation.
  */
 
-_PUBLIC_ void *_talloc_pooled_object(const void *ctx,
-				     size_t type_size,
-				     const char *type_name,
-				     unsigned num_subobjects,
-				     size_t total_subobjects_size)
+static inline void *__talloc_pooled_object(const void *ctx,
+					   size_t type_size,
+					   const char *type_name,
+					   unsigned num_subobjects,
+					   size_t total_subobjects_size,
+					   bool cached)
 {
 	size_t poolsize, subobjects_slack, tmp;
 	struct talloc_chunk *tc;
@@ -902,7 +1075,7 @@ _PUBLIC_ void *_talloc_pooled_object(const void *ctx,
 	}
 	poolsize = tmp;
 
-	ret = _talloc_pool(ctx, poolsize);
+	ret = _talloc_pool(ctx, poolsize, cached);
 	if (ret == NULL) {
 		return NULL;
 	}
@@ -925,6 +1098,45 @@ overflow:
 	return NULL;
 }
 
+_PUBLIC_ void *_talloc_pooled_object(const void *ctx,
+				     size_t type_size,
+				     const char *type_name,
+				     unsigned num_subobjects,
+				     size_t total_subobjects_size)
+{
+	return __talloc_pooled_object(ctx, type_size, type_name,
+				      num_subobjects, total_subobjects_size,
+				      false);
+}
+
+_PUBLIC_ void *_talloc_cached_pooled_object(const void *ctx,
+					    size_t type_size,
+					    const char *type_name,
+					    unsigned num_subobjects,
+					    size_t total_subobjects_size)
+{
+	return __talloc_pooled_object(ctx, type_size, type_name,
+				      num_subobjects, total_subobjects_size,
+				      true);
+}
+
+_PUBLIC_ void *_talloc_cached_object(const void *ctx,
+				     size_t type_size,
+				     const char *type_name)
+{
+	struct talloc_chunk *tc;
+	void *ptr;
+
+	ptr = __talloc_with_prefix(ctx, type_size, 0, true, &tc);
+	if (unlikely(ptr == NULL)) {
+		return NULL;
+	}
+
+	_tc_set_name_const(tc, type_name);
+
+	return ptr;
+}
+
 /*
   setup a destructor to be called on free of a pointer
   the destructor should return 0 on success, or -1 on failure.
@@ -1068,6 +1280,9 @@ static inline void _tc_free_poolmem(struct talloc_chunk *tc,
 		if (pool_tc->flags & TALLOC_FLAG_POOLMEM) {
 			_tc_free_poolmem(pool_tc, location);
 		} else {
+			struct talloc_object_cache *cache = pool_tc->cache;
+			size_t len = TP_HDR_SIZE + TC_HDR_SIZE + pool->poolsize;
+
 			/*
 			 * The tc_memlimit_update_on_free()
 			 * call takes into account the
@@ -1076,7 +1291,7 @@ static inline void _tc_free_poolmem(struct talloc_chunk *tc,
 			 */
 			tc_memlimit_update_on_free(pool_tc);
 			TC_INVALIDATE_FULL_CHUNK(pool_tc);
-			free(pool);
+			tc_cache_free(cache, pool, len);
 		}
 		return;
 	}
@@ -1110,6 +1325,8 @@ static inline int _tc_free_internal(struct talloc_chunk *tc,
 				const char *location)
 {
 	void *ptr_to_free;
+	size_t len_to_free;
+	struct talloc_object_cache *cache;
 	void *ptr = TC_PTR_FROM_CHUNK(tc);
 
 	if (unlikely(tc->refs)) {
@@ -1206,8 +1423,10 @@ static inline int _tc_free_internal(struct talloc_chunk *tc,
 		 * to be freed as poolmem, else it needs to be just freed.
 		*/
 		ptr_to_free = pool;
+		len_to_free = TP_HDR_SIZE + TC_HDR_SIZE + pool->poolsize;
 	} else {
 		ptr_to_free = tc;
+		len_to_free = TC_HDR_SIZE + tc->size;
 	}
 
 	if (tc->flags & TALLOC_FLAG_POOLMEM) {
@@ -1217,8 +1436,9 @@ static inline int _tc_free_internal(struct talloc_chunk *tc,
 
 	tc_memlimit_update_on_free(tc);
 
+	cache = tc->cache;
 	TC_INVALIDATE_FULL_CHUNK(tc);
-	free(ptr_to_free);
+	tc_cache_free(cache, ptr_to_free, len_to_free);
 	return 0;
 }
 
@@ -1831,6 +2051,12 @@ _PUBLIC_ void *_talloc_realloc(const void *context, void *ptr, size_t size, cons
 		return NULL;
 	}
 
+	/*
+	 * Once resized the memory no longer matches its size class in
+	 * the object cache, just hand it back to free(3) later.
+	 */
+	tc->cache = NULL;
+
 	if (tc->limit && (size > tc->size)) {
 		if (!talloc_memlimit_check(tc->limit, (size - tc->size))) {
 			errno = ENOMEM;
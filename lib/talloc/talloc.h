@@ -43,7 +43,7 @@ extern "C" {
  */
 
 #define TALLOC_VERSION_MAJOR 2
-#define TALLOC_VERSION_MINOR 2
+#define TALLOC_VERSION_MINOR 3
 
 int talloc_version_major(void);
 int talloc_version_minor(void);
@@ -899,6 +899,92 @@ void *_talloc_pooled_object(const void *ctx,
 			    size_t total_subobjects_size);
 #endif
 
+#ifdef DOXYGEN
+/**
+ * @brief Allocate a talloc object using the per-thread object cache.
+ *
+ * This is like talloc(), but the memory is taken from and given back to a
+ * per-thread cache of freed chunks of the same size class instead of going
+ * through malloc(3) and free(3) every time. Use this for small objects that
+ * are allocated and freed at a high rate.
+ *
+ * The object has to be freed in the thread that allocated it to be reused,
+ * otherwise it's just given back to free(3). Allocations hanging off a talloc
+ * pool are still served from the pool.
+ *
+ * @param[in] ctx       The talloc context to hang the result off.
+ *
+ * @param[in] type      The type that we want to allocate.
+ *
+ * @return              The allocated talloc object, NULL on error.
+ *
+ * @see talloc_cached_pooled_object()
+ * @see talloc_object_cache_flush()
+ */
+void *talloc_cached_object(const void *ctx, #type);
+#else
+#define talloc_cached_object(_ctx, _type) \
+	(_type *)_talloc_cached_object((_ctx), sizeof(_type), #_type)
+void *_talloc_cached_object(const void *ctx,
+			    size_t type_size,
+			    const char *type_name);
+#endif
+
+#ifdef DOXYGEN
+/**
+ * @brief Allocate a pooled talloc object using the per-thread object cache.
+ *
+ * This is like talloc_pooled_object(), but the memory for the whole pool is
+ * taken from the per-thread object cache, see talloc_cached_object().
+ *
+ * @param[in] ctx                   The talloc context to hang the result off.
+ *
+ * @param[in] type                  The type that we want to allocate.
+ *
+ * @param[in] num_subobjects        The expected number of subobjects, which will
+ *                                  be allocated within the pool. This allocates
+ *                                  space for talloc_chunk headers.
+ *
+ * @param[in] total_subobjects_size The size that all subobjects can use in total.
+ *
+ * @return              The allocated talloc object, NULL on error.
+ */
+void *talloc_cached_pooled_object(const void *ctx, #type,
+				  unsigned num_subobjects,
+				  size_t total_subobjects_size);
+#else
+#define talloc_cached_pooled_object(_ctx, _type, \
+				    _num_subobjects, \
+				    _total_subobjects_size) \
+	(_type *)_talloc_cached_pooled_object((_ctx), sizeof(_type), #_type, \
+					       (_num_subobjects), \
+					       (_total_subobjects_size))
+void *_talloc_cached_pooled_object(const void *ctx,
+				   size_t type_size,
+				   const char *type_name,
+				   unsigned num_subobjects,
+				   size_t total_subobjects_size);
+#endif
+
+/**
+ * @brief Limit the memory held by the object cache of the calling thread.
+ *
+ * Freed cached objects are only kept if the cache holds less than max_bytes,
+ * the default is 1MB. Setting a lower limit releases the excess memory
+ * immediately, a limit of 0 disables caching for the calling thread.
+ *
+ * @param[in]  max_bytes  The maximum number of bytes to keep cached.
+ */
+void talloc_object_cache_set_limit(size_t max_bytes);
+
+/**
+ * @brief Release all memory held by the object cache of the calling thread.
+ *
+ * Threads using talloc_cached_object() should call this before they exit,
+ * the cached memory is not released automatically.
+ */
+void talloc_object_cache_flush(void);
+
 /**
  * @brief Free a talloc chunk and NULL out the pointer.
  *
@@ -851,6 +851,12 @@ static bool test_unref_reparent(void)
 	return true;
 }
 
+struct pooled {
+	char *s1;
+	char *s2;
+	char *s3;
+};
+
 /*
   measure the speed of talloc versus malloc
 */
@@ -904,6 +910,30 @@ static bool test_speed(void)
 
 	fprintf(stderr, "talloc_pool: %.0f ops/sec\n", count/private_timeval_elapsed(&tv));
 
+	ctx = talloc_new(NULL);
+
+	tv = private_timeval_current();
+	count = 0;
+	do {
+		struct pooled *p1;
+		void *p2, *p3;
+		for (i=0;i<loop;i++) {
+			p1 = talloc_cached_pooled_object(ctx, struct pooled,
+							 2, 400);
+			p2 = talloc_strdup(p1, "foo bar");
+			p3 = talloc_size(p1, 300);
+			(void)p2;
+			(void)p3;
+			talloc_free(p1);
+		}
+		count += 3 * loop;
+	} while (private_timeval_elapsed(&tv) < 5.0);
+
+	talloc_free(ctx);
+	talloc_object_cache_flush();
+
+	fprintf(stderr, "talloc_cached_pooled_object: %.0f ops/sec\n", count/private_timeval_elapsed(&tv));
+
 	tv = private_timeval_current();
 	count = 0;
 	do {
@@ -1467,12 +1497,6 @@ static bool test_pool_nest(void)
 	return true;
 }
 
-struct pooled {
-	char *s1;
-	char *s2;
-	char *s3;
-};
-
 static bool test_pooled_object(void)
 {
 	struct pooled *p;
@@ -1501,6 +1525,93 @@ static bool test_pooled_object(void)
 	return true;
 }
 
+static bool test_object_cache(void)
+{
+	void *root;
+	struct pooled *p, *p2;
+	void *old;
+	char *s;
+
+	printf("test: object_cache\n# OBJECT CACHE\n");
+
+	talloc_object_cache_flush();
+
+	root = talloc_new(NULL);
+
+	p = talloc_cached_object(root, struct pooled);
+	torture_assert("object_cache", p != NULL, "allocation failed\n");
+	torture_assert("object_cache", talloc_get_type(p, struct pooled) == p,
+		       "wrong type name\n");
+	CHECK_SIZE("object_cache", p, sizeof(struct pooled));
+	CHECK_PARENT("object_cache", p, root);
+
+	old = p;
+	talloc_free(p);
+
+#ifdef HAVE___THREAD
+	p = talloc_cached_object(root, struct pooled);
+	torture_assert("object_cache", p == old,
+		       "freed chunk was not reused\n");
+	talloc_free(p);
+#endif
+
+	/* Same for a pooled object, the whole pool gets cached */
+	p = talloc_cached_pooled_object(root, struct pooled, 1, 100);
+	torture_assert("object_cache", p != NULL, "allocation failed\n");
+	CHECK_SIZE("object_cache", p, sizeof(struct pooled));
+	p->s1 = talloc_strdup(p, "hello");
+	torture_assert("object_cache", p->s1 != NULL, "allocation failed\n");
+
+	/* A child outliving its pool keeps the pool memory alive */
+	s = talloc_steal(root, p->s1);
+	old = p;
+	talloc_free(p);
+	torture_assert_str_equal("object_cache", s, "hello",
+				 "stolen child damaged\n");
+
+	p2 = talloc_cached_object(root, struct pooled);
+	torture_assert("object_cache", p2 != old,
+		       "pool reused while still in use\n");
+	talloc_free(s);
+
+#ifdef HAVE___THREAD
+	p = talloc_cached_pooled_object(root, struct pooled, 1, 100);
+	torture_assert("object_cache", p == old,
+		       "freed pool was not reused\n");
+	talloc_free(p);
+#endif
+
+	/* A resized chunk must not be put back into its old size class */
+	p2 = talloc_realloc_size(root, p2, 10 * sizeof(struct pooled));
+	torture_assert("object_cache", p2 != NULL, "realloc failed\n");
+	talloc_free(p2);
+
+	/* With a limit of 0 nothing is cached */
+	talloc_object_cache_set_limit(0);
+	p = talloc_cached_object(root, struct pooled);
+	torture_assert("object_cache", p != NULL, "allocation failed\n");
+	talloc_free(p);
+	talloc_object_cache_set_limit(1024 * 1024);
+
+	/* Allocations off a pool still come from the pool */
+	old = talloc_pool(root, 1024);
+	p = talloc_cached_object(old, struct pooled);
+	torture_assert("object_cache", p != NULL, "allocation failed\n");
+	torture_assert("object_cache",
+		       (char *)p > (char *)old &&
+		       (char *)p < (char *)old + 1024,
+		       "not allocated from the pool\n");
+	talloc_free(old);
+
+	CHECK_BLOCKS("object_cache", root, 1);
+
+	talloc_free(root);
+	talloc_object_cache_flush();
+
+	printf("success: object_cache\n");
+	return true;
+}
+
 static bool test_free_ref_null_context(void)
 {
 	void *p1, *p2, *p3;
@@ -2093,6 +2204,8 @@ bool torture_local_talloc(struct torture_context *tctx)
 	test_reset();
 	ret &= test_pool_nest();
 	test_reset();
+	ret &= test_object_cache();
+	test_reset();
 	ret &= test_ref1();
 	test_reset();
 	ret &= test_ref2();
@@ -58,16 +58,10 @@ static tdb_off_t tdb_dump_record(struct tdb_context *tdb, int hash,
 	return rec.next;
 }
 
-static int tdb_dump_chain(struct tdb_context *tdb, int i)
+static int tdb_dump_chain(struct tdb_context *tdb, int i, tdb_off_t top)
 {
 	struct tdb_chainwalk_ctx chainwalk;
-	tdb_off_t rec_ptr, top;
-
-	if (i == -1) {
-		top = FREELIST_TOP;
-	} else {
-		top = TDB_HASH_TOP(i);
-	}
+	tdb_off_t rec_ptr;
 
 	if (tdb_lock(tdb, i, F_WRLCK) != 0)
 		return -1;
@@ -97,10 +91,12 @@ _PUBLIC_ void tdb_dump_all(struct tdb_context *tdb)
 {
 	uint32_t i;
 	for (i=0;i<tdb->hash_size;i++) {
-		tdb_dump_chain(tdb, i);
+		tdb_dump_chain(tdb, i, TDB_HASH_TOP(i));
 	}
 	printf("freelist:\n");
-	tdb_dump_chain(tdb, -1);
+	for (i=0;i<tdb_freelist_count(tdb);i++) {
+		tdb_dump_chain(tdb, -1, tdb_freelist_top(tdb, i));
+	}
 }
 
 _PUBLIC_ int tdb_printfreelist(struct tdb_context *tdb)
@@ -109,38 +105,41 @@ _PUBLIC_ int tdb_printfreelist(struct tdb_context *tdb)
 	long total_free = 0;
 	tdb_off_t offset, rec_ptr;
 	struct tdb_record rec;
+	unsigned int c;
 
 	if ((ret = tdb_lock(tdb, -1, F_WRLCK)) != 0)
 		return ret;
 
-	offset = FREELIST_TOP;
-
-	/* read in the freelist top */
-	if (tdb_ofs_read(tdb, offset, &rec_ptr) == -1) {
-		tdb_unlock(tdb, -1, F_WRLCK);
-		return 0;
-	}
+	for (c = 0; c < tdb_freelist_count(tdb); c++) {
+		offset = tdb_freelist_top(tdb, c);
 
-	printf("freelist top=[0x%08x]\n", rec_ptr );
-	while (rec_ptr) {
-		if (tdb->methods->tdb_read(tdb, rec_ptr, (char *)&rec,
-					   sizeof(rec), DOCONV()) == -1) {
+		/* read in the freelist top */
+		if (tdb_ofs_read(tdb, offset, &rec_ptr) == -1) {
 			tdb_unlock(tdb, -1, F_WRLCK);
-			return -1;
+			return 0;
 		}
 
-		if (rec.magic != TDB_FREE_MAGIC) {
-			printf("bad magic 0x%08x in free list\n", rec.magic);
-			tdb_unlock(tdb, -1, F_WRLCK);
-			return -1;
+		printf("freelist top=[0x%08x]\n", rec_ptr );
+		while (rec_ptr) {
+			if (tdb->methods->tdb_read(tdb, rec_ptr, (char *)&rec,
+						   sizeof(rec), DOCONV()) == -1) {
+				tdb_unlock(tdb, -1, F_WRLCK);
+				return -1;
+			}
+
+			if (rec.magic != TDB_FREE_MAGIC) {
+				printf("bad magic 0x%08x in free list\n", rec.magic);
+				tdb_unlock(tdb, -1, F_WRLCK);
+				return -1;
+			}
+
+			printf("entry offset=[0x%08x], rec.rec_len = [0x%08x (%u)] (end = 0x%08x)\n",
+			       rec_ptr, rec.rec_len, rec.rec_len, rec_ptr + rec.rec_len);
+			total_free += rec.rec_len;
+
+			/* move to the next record */
+			rec_ptr = rec.next;
 		}
-
-		printf("entry offset=[0x%08x], rec.rec_len = [0x%08x (%u)] (end = 0x%08x)\n",
-		       rec_ptr, rec.rec_len, rec.rec_len, rec_ptr + rec.rec_len);
-		total_free += rec.rec_len;
-
-		/* move to the next record */
-		rec_ptr = rec.next;
 	}
 	printf("total rec_len = [0x%08lx (%lu)]\n", total_free, total_free);
 
@@ -27,6 +27,49 @@
 
 #include "tdb_private.h"
 
+/*
+ * Number of free lists, 1 unless the tdb was created with
+ * TDB_FREELIST_CLASSES.
+ */
+unsigned int tdb_freelist_count(struct tdb_context *tdb)
+{
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES) {
+		return TDB_FREELIST_NUM_CLASSES;
+	}
+	return 1;
+}
+
+/*
+ * Offset of the list head for size class c. The largest class
+ * uses the traditional FREELIST_TOP.
+ */
+tdb_off_t tdb_freelist_top(struct tdb_context *tdb, unsigned int c)
+{
+	if (c + 1 >= tdb_freelist_count(tdb)) {
+		return FREELIST_TOP;
+	}
+	return TDB_FREELIST_CLASS_TOP(c);
+}
+
+/*
+ * Size class of a free record: class 0 takes everything below 64
+ * bytes, each further class doubles the size, the last class takes
+ * everything that's left.
+ */
+static unsigned int tdb_freelist_class(struct tdb_context *tdb,
+				       tdb_len_t rec_len)
+{
+	unsigned int num = tdb_freelist_count(tdb);
+	unsigned int c = 0;
+
+	rec_len >>= 6;
+	while (rec_len != 0 && c + 1 < num) {
+		rec_len >>= 1;
+		c++;
+	}
+	return c;
+}
+
 /* read a freelist record and check for simple errors */
 int tdb_rec_free_read(struct tdb_context *tdb, tdb_off_t off, struct tdb_record *rec)
 {
@@ -263,6 +306,32 @@ static int check_merge_ptr_with_left_record(struct tdb_context *tdb,
 	return 1;
 }
 
+/**
+ * Move a free record that ended up in the wrong size class (because
+ * it grew by a merge or shrunk by an allocation) to the list it
+ * belongs to. last_ptr points to the link referencing rec_ptr.
+ * Afterwards rec->next points into the new list.
+ */
+static int tdb_freelist_relink(struct tdb_context *tdb, tdb_off_t last_ptr,
+			       tdb_off_t rec_ptr, struct tdb_record *rec)
+{
+	tdb_off_t top;
+
+	top = tdb_freelist_top(tdb, tdb_freelist_class(tdb, rec->rec_len));
+
+	if (tdb_ofs_write(tdb, last_ptr, &rec->next) == -1 ||
+	    tdb_ofs_read(tdb, top, &rec->next) == -1 ||
+	    tdb_rec_write(tdb, rec_ptr, rec) == -1 ||
+	    tdb_ofs_write(tdb, top, &rec_ptr) == -1) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL,
+			 "tdb_freelist_relink: failed at offset=%u\n",
+			 rec_ptr));
+		return -1;
+	}
+
+	return 0;
+}
+
 /**
  * Add an element into the freelist.
  *
@@ -273,9 +342,14 @@ static int check_merge_ptr_with_left_record(struct tdb_context *tdb,
  * record in the free list.
  *
  * This prevents db traverses from being O(n^2) after a lot of deletes.
+ *
+ * With size classes the record goes onto the list of its class. A
+ * left neighbour grown by the merge stays on its old list until the
+ * allocator walks past it.
  */
 int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec)
 {
+	tdb_off_t top;
 	int ret;
 
 	/* Allocation and tailer lock */
@@ -300,10 +374,11 @@ int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec)
 	/* Nothing to merge, prepend to free list */
 
 	rec->magic = TDB_FREE_MAGIC;
+	top = tdb_freelist_top(tdb, tdb_freelist_class(tdb, rec->rec_len));
 
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &rec->next) == -1 ||
+	if (tdb_ofs_read(tdb, top, &rec->next) == -1 ||
 	    tdb_rec_write(tdb, offset, rec) == -1 ||
-	    tdb_ofs_write(tdb, FREELIST_TOP, &offset) == -1) {
+	    tdb_ofs_write(tdb, top, &offset) == -1) {
 		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free record write failed at offset=%u\n", offset));
 		goto fail;
 	}
@@ -330,7 +405,8 @@ done:
  */
 static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 				  tdb_len_t length, tdb_off_t rec_ptr,
-				  struct tdb_record *rec, tdb_off_t last_ptr)
+				  struct tdb_record *rec, tdb_off_t last_ptr,
+				  unsigned int c)
 {
 #define MIN_REC_SIZE (sizeof(struct tdb_record) + sizeof(tdb_off_t) + 8)
 
@@ -359,6 +435,13 @@ static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 		return 0;
 	}
 
+	/* the rest might now belong to a smaller size class */
+	if (tdb_freelist_class(tdb, rec->rec_len) != c) {
+		if (tdb_freelist_relink(tdb, last_ptr, rec_ptr, rec) == -1) {
+			return 0;
+		}
+	}
+
 	/* and setup the new record */
 	rec_ptr += sizeof(*rec) + rec->rec_len;
 
@@ -377,72 +460,58 @@ static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 	return rec_ptr;
 }
 
-/* allocate some space from the free list. The offset returned points
-   to a unconnected tdb_record within the database with room for at
-   least length bytes of total data
+struct tdb_freelist_bestfit {
+	tdb_off_t rec_ptr, last_ptr;
+	tdb_len_t rec_len;
+	unsigned int c;
+};
 
-   0 is returned if the space could not be allocated
+/*
+ * Walk the free list of size class c, looking for a best fit for
+ * length bytes.
+ *
+ * Returns -1 on error, 1 if the fit found is good enough to stop
+ * searching and 0 otherwise.
  */
-static tdb_off_t tdb_allocate_from_freelist(
-	struct tdb_context *tdb, tdb_len_t length, struct tdb_record *rec)
+static int tdb_freelist_walk(struct tdb_context *tdb, unsigned int c,
+			     tdb_len_t length, struct tdb_record *rec,
+			     struct tdb_freelist_bestfit *bestfit,
+			     float *multiplier,
+			     bool *merge_created_candidate)
 {
-	tdb_off_t rec_ptr, last_ptr, newrec_ptr;
+	tdb_off_t rec_ptr, last_ptr;
 	struct tdb_chainwalk_ctx chainwalk;
 	bool modified;
-	struct {
-		tdb_off_t rec_ptr, last_ptr;
-		tdb_len_t rec_len;
-	} bestfit;
-	float multiplier = 1.0;
-	bool merge_created_candidate;
-
-	/* over-allocate to reduce fragmentation */
-	length *= 1.25;
-
-	/* Extra bytes required for tailer */
-	length += sizeof(tdb_off_t);
-	length = TDB_ALIGN(length, TDB_ALIGNMENT);
 
- again:
-	merge_created_candidate = false;
-	last_ptr = FREELIST_TOP;
+	last_ptr = tdb_freelist_top(tdb, c);
 
 	/* read in the freelist top */
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &rec_ptr) == -1)
-		return 0;
+	if (tdb_ofs_read(tdb, last_ptr, &rec_ptr) == -1)
+		return -1;
 
 	modified = false;
 	tdb_chainwalk_init(&chainwalk, rec_ptr);
 
-	bestfit.rec_ptr = 0;
-	bestfit.last_ptr = 0;
-	bestfit.rec_len = 0;
-
-	/*
-	   this is a best fit allocation strategy. Originally we used
-	   a first fit strategy, but it suffered from massive fragmentation
-	   issues when faced with a slowly increasing record size.
-	 */
 	while (rec_ptr) {
 		int ret;
 		tdb_off_t left_ptr;
 		struct tdb_record left_rec;
 
 		if (tdb_rec_free_read(tdb, rec_ptr, rec) == -1) {
-			return 0;
+			return -1;
 		}
 
 		ret = check_merge_with_left_record(tdb, rec_ptr, rec,
 						   &left_ptr, &left_rec);
 		if (ret == -1) {
-			return 0;
+			return -1;
 		}
 		if (ret == 1) {
 			/* merged */
 			rec_ptr = rec->next;
 			ret = tdb_ofs_write(tdb, last_ptr, &rec->next);
 			if (ret == -1) {
-				return 0;
+				return -1;
 			}
 
 			/*
@@ -466,25 +535,51 @@ static tdb_off_t tdb_allocate_from_freelist(
 			 * This way we can avoid expanding the database.
 			 */
 
-			if (bestfit.rec_ptr == left_ptr) {
-				bestfit.rec_len = left_rec.rec_len;
+			if (bestfit->rec_ptr == left_ptr) {
+				bestfit->rec_len = left_rec.rec_len;
 			}
 
 			if (left_rec.rec_len > length) {
-				merge_created_candidate = true;
+				*merge_created_candidate = true;
+			}
+
+			modified = true;
+
+			continue;
+		}
+
+		if (tdb_freelist_class(tdb, rec->rec_len) > c) {
+			tdb_off_t next = rec->next;
+
+			/*
+			 * A merge in tdb_free() grew this record beyond
+			 * its size class. Move it up to the list it
+			 * belongs to, which is walked after this one or,
+			 * if we are looking at the small classes, in
+			 * the next round.
+			 */
+			ret = tdb_freelist_relink(tdb, last_ptr, rec_ptr, rec);
+			if (ret == -1) {
+				return -1;
+			}
+
+			if (rec->rec_len >= length) {
+				*merge_created_candidate = true;
 			}
 
+			rec_ptr = next;
 			modified = true;
 
 			continue;
 		}
 
 		if (rec->rec_len >= length) {
-			if (bestfit.rec_ptr == 0 ||
-			    rec->rec_len < bestfit.rec_len) {
-				bestfit.rec_len = rec->rec_len;
-				bestfit.rec_ptr = rec_ptr;
-				bestfit.last_ptr = last_ptr;
+			if (bestfit->rec_ptr == 0 ||
+			    rec->rec_len < bestfit->rec_len) {
+				bestfit->rec_len = rec->rec_len;
+				bestfit->rec_ptr = rec_ptr;
+				bestfit->last_ptr = last_ptr;
+				bestfit->c = c;
 			}
 		}
 
@@ -496,7 +591,7 @@ static tdb_off_t tdb_allocate_from_freelist(
 			bool ok;
 			ok = tdb_chainwalk_check(tdb, &chainwalk, rec_ptr);
 			if (!ok) {
-				return 0;
+				return -1;
 			}
 		}
 
@@ -504,16 +599,80 @@ static tdb_off_t tdb_allocate_from_freelist(
 		   stop searching if its also not too big. The
 		   definition of 'too big' changes as we scan
 		   through */
-		if (bestfit.rec_len > 0 &&
-		    bestfit.rec_len < length * multiplier) {
-			break;
+		if (bestfit->rec_len > 0 &&
+		    bestfit->rec_len < length * (*multiplier)) {
+			return 1;
 		}
 
 		/* this multiplier means we only extremely rarely
 		   search more than 50 or so records. At 50 records we
 		   accept records up to 11 times larger than what we
 		   want */
-		multiplier *= 1.05;
+		*multiplier *= 1.05;
+	}
+
+	return 0;
+}
+
+/* allocate some space from the free list. The offset returned points
+   to a unconnected tdb_record within the database with room for at
+   least length bytes of total data
+
+   0 is returned if the space could not be allocated
+ */
+static tdb_off_t tdb_allocate_from_freelist(
+	struct tdb_context *tdb, tdb_len_t length, struct tdb_record *rec)
+{
+	tdb_off_t newrec_ptr;
+	struct tdb_freelist_bestfit bestfit;
+	float multiplier = 1.0;
+	bool merge_created_candidate;
+	unsigned int i, num, start;
+
+	/* over-allocate to reduce fragmentation */
+	length *= 1.25;
+
+	/* Extra bytes required for tailer */
+	length += sizeof(tdb_off_t);
+	length = TDB_ALIGN(length, TDB_ALIGNMENT);
+
+	num = tdb_freelist_count(tdb);
+	start = tdb_freelist_class(tdb, length);
+
+ again:
+	merge_created_candidate = false;
+
+	bestfit.rec_ptr = 0;
+	bestfit.last_ptr = 0;
+	bestfit.rec_len = 0;
+	bestfit.c = 0;
+
+	/*
+	   this is a best fit allocation strategy. Originally we used
+	   a first fit strategy, but it suffered from massive fragmentation
+	   issues when faced with a slowly increasing record size.
+
+	   With size classes we start with the class of the requested
+	   length and go up. The smaller classes only contain records
+	   grown by a merge, so we only look at them (and sort those
+	   records into their class) before expanding the database.
+	 */
+	for (i = 0; i < num; i++) {
+		unsigned int c = (start + i) % num;
+		int ret;
+
+		if (c < start && bestfit.rec_ptr != 0) {
+			break;
+		}
+
+		ret = tdb_freelist_walk(tdb, c, length, rec, &bestfit,
+					&multiplier, &merge_created_candidate);
+		if (ret == -1) {
+			return 0;
+		}
+		if (ret == 1) {
+			break;
+		}
 	}
 
 	if (bestfit.rec_ptr != 0) {
@@ -522,7 +681,8 @@ static tdb_off_t tdb_allocate_from_freelist(
 		}
 
 		newrec_ptr = tdb_allocate_ofs(tdb, length, bestfit.rec_ptr,
-					      rec, bestfit.last_ptr);
+					      rec, bestfit.last_ptr,
+					      bestfit.c);
 		return newrec_ptr;
 	}
 
@@ -650,6 +810,7 @@ static int tdb_freelist_merge_adjacent(struct tdb_context *tdb,
 	tdb_off_t cur, next;
 	int count = 0;
 	int merged = 0;
+	unsigned int c;
 	int ret;
 
 	ret = tdb_lock(tdb, -1, F_RDLCK);
@@ -657,32 +818,37 @@ static int tdb_freelist_merge_adjacent(struct tdb_context *tdb,
 		return -1;
 	}
 
-	cur = FREELIST_TOP;
-	while (tdb_ofs_read(tdb, cur, &next) == 0 && next != 0) {
-		tdb_off_t next2;
-
-		count++;
+	for (c = 0; c < tdb_freelist_count(tdb); c++) {
+		cur = tdb_freelist_top(tdb, c);
+		while (tdb_ofs_read(tdb, cur, &next) == 0 && next != 0) {
+			tdb_off_t next2;
 
-		ret = check_merge_ptr_with_left_record(tdb, next, &next2);
-		if (ret == -1) {
-			goto done;
-		}
-		if (ret == 1) {
-			/*
-			 * merged:
-			 * now let cur->next point to next2 instead of next
-			 */
+			count++;
 
-			ret = tdb_ofs_write(tdb, cur, &next2);
-			if (ret != 0) {
+			ret = check_merge_ptr_with_left_record(tdb, next,
+							       &next2);
+			if (ret == -1) {
 				goto done;
 			}
+			if (ret == 1) {
+				/*
+				 * merged:
+				 * now let cur->next point to next2 instead of
+				 * next and look at next2 in the next round,
+				 * it may be mergeable as well.
+				 */
+
+				ret = tdb_ofs_write(tdb, cur, &next2);
+				if (ret != 0) {
+					goto done;
+				}
+
+				merged++;
+				continue;
+			}
 
-			next = next2;
-			merged++;
+			cur = next;
 		}
-
-		cur = next;
 	}
 
 	if (count_records != NULL) {
@@ -707,14 +873,17 @@ static int tdb_freelist_size_no_merge(struct tdb_context *tdb)
 {
 	tdb_off_t ptr;
 	int count=0;
+	unsigned int c;
 
 	if (tdb_lock(tdb, -1, F_RDLCK) == -1) {
 		return -1;
 	}
 
-	ptr = FREELIST_TOP;
-	while (tdb_ofs_read(tdb, ptr, &ptr) == 0 && ptr != 0) {
-		count++;
+	for (c = 0; c < tdb_freelist_count(tdb); c++) {
+		ptr = tdb_freelist_top(tdb, c);
+		while (tdb_ofs_read(tdb, ptr, &ptr) == 0 && ptr != 0) {
+			count++;
+		}
 	}
 
 	tdb_unlock(tdb, -1, F_RDLCK);
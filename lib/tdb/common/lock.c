@@ -431,6 +431,8 @@ int tdb_nest_lock(struct tdb_context *tdb, uint32_t offset, int ltype,
 				if (ret != 0) {
 					return ret;
 				}
+			} else if (!(flags & TDB_LOCK_MARK_ONLY)) {
+				tdb_mutex_chain_upgrade(tdb, offset);
 			}
 			new_lck->ltype = F_WRLCK;
 		}
@@ -617,7 +619,11 @@ int tdb_nest_unlock(struct tdb_context *tdb, uint32_t offset, int ltype,
 	if (mark_lock) {
 		ret = 0;
 	} else {
-		ret = tdb_brunlock(tdb, ltype, offset, 1);
+		/*
+		 * Unlock with the type the lock has by now, it might have
+		 * been upgraded by a nested tdb_nest_lock()
+		 */
+		ret = tdb_brunlock(tdb, lck->ltype, offset, 1);
 	}
 
 	/*
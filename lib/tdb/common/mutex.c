@@ -78,11 +78,33 @@ struct tdb_mutexes {
 	pthread_mutex_t hashchains[1];
 };
 
+/*
+ * With TDB_FEATURE_FLAG_SEQCOUNT the mutex area is followed by an array of
+ * hash_size+1 sequence counters. Index 0 belongs to the allrecord lock,
+ * index n to the hash chain protected by hashchains[n]. The freelist does
+ * not need a counter, lockless readers never look at it.
+ *
+ * A counter is odd while someone holds the corresponding mutex and might
+ * modify the data behind it. Readers in tdb_parse_record() and tdb_fetch()
+ * sample the allrecord and the chain counter, walk the chain without taking
+ * a lock, copy the data out and check that neither counter has changed in
+ * the meantime. If it has, they retry and eventually fall back to the
+ * locked path.
+ */
+
 bool tdb_have_mutexes(struct tdb_context *tdb)
 {
 	return ((tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX) != 0);
 }
 
+bool tdb_have_seqcounts(struct tdb_context *tdb)
+{
+	if (!(tdb->feature_flags & TDB_FEATURE_FLAG_SEQCOUNT)) {
+		return false;
+	}
+	return (tdb->mutexes != NULL);
+}
+
 size_t tdb_mutex_size(struct tdb_context *tdb)
 {
 	size_t mutex_size;
@@ -94,9 +116,92 @@ size_t tdb_mutex_size(struct tdb_context *tdb)
 	mutex_size = sizeof(struct tdb_mutexes);
 	mutex_size += tdb->hash_size * sizeof(pthread_mutex_t);
 
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_SEQCOUNT) {
+		mutex_size += (tdb->hash_size + 1) * sizeof(uint32_t);
+	}
+
 	return TDB_ALIGN(mutex_size, tdb->page_size);
 }
 
+static volatile uint32_t *tdb_mutex_seqcounts(struct tdb_context *tdb)
+{
+	char *p = (char *)tdb->mutexes;
+
+	p += sizeof(struct tdb_mutexes);
+	p += tdb->hash_size * sizeof(pthread_mutex_t);
+
+	return (volatile uint32_t *)p;
+}
+
+static void tdb_mutex_seqcount_begin(struct tdb_context *tdb, unsigned idx)
+{
+	volatile uint32_t *seq;
+
+	if (!tdb_have_seqcounts(tdb)) {
+		return;
+	}
+	seq = &tdb_mutex_seqcounts(tdb)[idx];
+
+	/*
+	 * The counter might already be odd if the previous holder of
+	 * the mutex died, just keep it odd then.
+	 */
+	*seq |= 1;
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+static void tdb_mutex_seqcount_end(struct tdb_context *tdb, unsigned idx)
+{
+	volatile uint32_t *seq;
+
+	if (!tdb_have_seqcounts(tdb)) {
+		return;
+	}
+	seq = &tdb_mutex_seqcounts(tdb)[idx];
+
+	atomic_thread_fence(memory_order_seq_cst);
+	*seq = (*seq | 1) + 1;
+}
+
+/*
+ * Sample the counters for a lockless lookup in the chain of "hash". Returns
+ * false if a writer is active, the caller should not even try then.
+ */
+bool tdb_mutex_seqcount_read_begin(struct tdb_context *tdb, uint32_t hash,
+				   uint32_t seq[2])
+{
+	volatile uint32_t *seqcounts = tdb_mutex_seqcounts(tdb);
+
+	seq[0] = seqcounts[0];
+	seq[1] = seqcounts[BUCKET(hash)+1];
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if ((seq[0] & 1) || (seq[1] & 1)) {
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Check whether everything read since tdb_mutex_seqcount_read_begin() is
+ * consistent, i.e. no writer has touched the chain in between.
+ */
+bool tdb_mutex_seqcount_read_valid(struct tdb_context *tdb, uint32_t hash,
+				   const uint32_t seq[2])
+{
+	volatile uint32_t *seqcounts = tdb_mutex_seqcounts(tdb);
+
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (seqcounts[0] != seq[0]) {
+		return false;
+	}
+	if (seqcounts[BUCKET(hash)+1] != seq[1]) {
+		return false;
+	}
+	return true;
+}
+
 /*
  * Get the index for a chain mutex
  */
@@ -150,6 +255,24 @@ static bool tdb_mutex_index(struct tdb_context *tdb, off_t off, off_t len,
 	return true;
 }
 
+/*
+ * Mutexes don't do readlocks, so a chain lock that tdb_nest_lock()
+ * upgrades to F_WRLCK keeps the mutex and only needs to make the
+ * counter odd. tdb_nest_unlock() then unlocks it as F_WRLCK.
+ */
+void tdb_mutex_chain_upgrade(struct tdb_context *tdb, off_t off)
+{
+	unsigned idx;
+
+	if (!tdb_mutex_index(tdb, off, 1, &idx)) {
+		return;
+	}
+	if (idx == 0) {
+		return;
+	}
+	tdb_mutex_seqcount_begin(tdb, idx);
+}
+
 static bool tdb_have_mutex_chainlocks(struct tdb_context *tdb)
 {
 	size_t i;
@@ -196,8 +319,9 @@ static int chain_mutex_lock(pthread_mutex_t *m, bool waitflag)
 	return pthread_mutex_consistent(m);
 }
 
-static int allrecord_mutex_lock(struct tdb_mutexes *m, bool waitflag)
+static int allrecord_mutex_lock(struct tdb_context *tdb, bool waitflag)
 {
+	struct tdb_mutexes *m = tdb->mutexes;
 	int ret;
 
 	if (waitflag) {
@@ -215,6 +339,7 @@ static int allrecord_mutex_lock(struct tdb_mutexes *m, bool waitflag)
 	 * tdb_needs_recovery.
 	 */
 	m->allrecord_lock = F_UNLCK;
+	tdb_mutex_seqcount_end(tdb, 0);
 
 	return pthread_mutex_consistent(&m->allrecord_mutex);
 }
@@ -271,6 +396,9 @@ again:
 		 * chain lock.
 		 */
 
+		if (rw == F_WRLCK) {
+			tdb_mutex_seqcount_begin(tdb, idx);
+		}
 		*pret = 0;
 		return true;
 	}
@@ -296,6 +424,9 @@ again:
 	}
 
 	if (allrecord_ok) {
+		if (rw == F_WRLCK) {
+			tdb_mutex_seqcount_begin(tdb, idx);
+		}
 		*pret = 0;
 		return true;
 	}
@@ -307,7 +438,7 @@ again:
 		errno = ret;
 		goto fail;
 	}
-	ret = allrecord_mutex_lock(m, waitflag);
+	ret = allrecord_mutex_lock(tdb, waitflag);
 	if (ret == EBUSY) {
 		ret = EAGAIN;
 	}
@@ -347,6 +478,15 @@ bool tdb_mutex_unlock(struct tdb_context *tdb, int rw, off_t off, off_t len,
 	}
 	chain = &m->hashchains[idx];
 
+	if ((idx != 0) && (rw == F_WRLCK)) {
+		/*
+		 * Only writers make the counter odd, see
+		 * tdb_mutex_chain_upgrade(). A reader that dies holding
+		 * the mutex leaves it even.
+		 */
+		tdb_mutex_seqcount_end(tdb, idx);
+	}
+
 	ret = pthread_mutex_unlock(chain);
 	if (ret == 0) {
 		*pret = 0;
@@ -374,7 +514,7 @@ int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
 		return 0;
 	}
 
-	ret = allrecord_mutex_lock(m, waitflag);
+	ret = allrecord_mutex_lock(tdb, waitflag);
 	if (!waitflag && (ret == EBUSY)) {
 		errno = EAGAIN;
 		tdb->ecode = TDB_ERR_LOCK;
@@ -396,6 +536,9 @@ int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
 		goto fail_unlock_allrecord_mutex;
 	}
 	m->allrecord_lock = (ltype == F_RDLCK) ? F_RDLCK : F_WRLCK;
+	if (m->allrecord_lock == F_WRLCK) {
+		tdb_mutex_seqcount_begin(tdb, 0);
+	}
 
 	for (i=0; i<tdb->hash_size; i++) {
 
@@ -431,6 +574,9 @@ int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
 	return 0;
 
 fail_unroll_allrecord_lock:
+	if (m->allrecord_lock == F_WRLCK) {
+		tdb_mutex_seqcount_end(tdb, 0);
+	}
 	m->allrecord_lock = F_UNLCK;
 
 fail_unlock_allrecord_mutex:
@@ -470,6 +616,7 @@ int tdb_mutex_allrecord_upgrade(struct tdb_context *tdb)
 	}
 
 	m->allrecord_lock = F_WRLCK;
+	tdb_mutex_seqcount_begin(tdb, 0);
 
 	for (i=0; i<tdb->hash_size; i++) {
 
@@ -494,6 +641,7 @@ int tdb_mutex_allrecord_upgrade(struct tdb_context *tdb)
 	return 0;
 
 fail_unroll_allrecord_lock:
+	tdb_mutex_seqcount_end(tdb, 0);
 	m->allrecord_lock = F_RDLCK;
 	tdb->ecode = TDB_ERR_LOCK;
 	return -1;
@@ -516,6 +664,7 @@ void tdb_mutex_allrecord_downgrade(struct tdb_context *tdb)
 		return;
 	}
 
+	tdb_mutex_seqcount_end(tdb, 0);
 	m->allrecord_lock = F_RDLCK;
 	return;
 }
@@ -546,11 +695,17 @@ int tdb_mutex_allrecord_unlock(struct tdb_context *tdb)
 	}
 
 	old = m->allrecord_lock;
+	if (old == F_WRLCK) {
+		tdb_mutex_seqcount_end(tdb, 0);
+	}
 	m->allrecord_lock = F_UNLCK;
 
 	ret = pthread_mutex_unlock(&m->allrecord_mutex);
 	if (ret != 0) {
 		m->allrecord_lock = old;
+		if (old == F_WRLCK) {
+			tdb_mutex_seqcount_begin(tdb, 0);
+		}
 		TDB_LOG((tdb, TDB_DEBUG_FATAL, "pthread_mutex_unlock"
 			 "(allrecord_mutex) failed: %s\n", strerror(ret)));
 		return -1;
@@ -598,6 +753,11 @@ int tdb_mutex_init(struct tdb_context *tdb)
 
 	m->allrecord_lock = F_UNLCK;
 
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_SEQCOUNT) {
+		memset(discard_const_p(uint32_t, tdb_mutex_seqcounts(tdb)), 0,
+		       (tdb->hash_size + 1) * sizeof(uint32_t));
+	}
+
 	ret = pthread_mutex_init(&m->allrecord_mutex, &ma);
 	if (ret != 0) {
 		goto fail;
@@ -1031,6 +1191,23 @@ bool tdb_have_mutexes(struct tdb_context *tdb)
 	return false;
 }
 
+bool tdb_have_seqcounts(struct tdb_context *tdb)
+{
+	return false;
+}
+
+bool tdb_mutex_seqcount_read_begin(struct tdb_context *tdb, uint32_t hash,
+				   uint32_t seq[2])
+{
+	return false;
+}
+
+bool tdb_mutex_seqcount_read_valid(struct tdb_context *tdb, uint32_t hash,
+				   const uint32_t seq[2])
+{
+	return false;
+}
+
 int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
 			     enum tdb_lock_flags flags)
 {
@@ -84,6 +84,12 @@ static int tdb_new_database(struct tdb_context *tdb, struct tdb_header *header,
 	if (tdb->flags & TDB_MUTEX_LOCKING) {
 		newdb->feature_flags |= TDB_FEATURE_FLAG_MUTEX;
 	}
+	if (tdb->flags & TDB_LOCKLESS_READS) {
+		newdb->feature_flags |= TDB_FEATURE_FLAG_SEQCOUNT;
+	}
+	if (tdb->flags & TDB_FREELIST_CLASSES) {
+		newdb->feature_flags |= TDB_FEATURE_FLAG_FREELIST_CLASSES;
+	}
 
 	/*
 	 * If we have any features we add the FEATURE_FLAG_MAGIC, overwriting the
@@ -370,7 +376,8 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		tdb->read_only = 1;
 		/* read only databases don't do locking or clear if first */
 		tdb->flags |= TDB_NOLOCK;
-		tdb->flags &= ~(TDB_CLEAR_IF_FIRST|TDB_MUTEX_LOCKING);
+		tdb->flags &= ~(TDB_CLEAR_IF_FIRST|TDB_MUTEX_LOCKING|
+				TDB_LOCKLESS_READS);
 	}
 
 	if ((tdb->flags & TDB_ALLOW_NESTING) &&
@@ -432,6 +439,15 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		}
 	}
 
+	if ((tdb->flags & TDB_LOCKLESS_READS) &&
+	    !(tdb->flags & TDB_MUTEX_LOCKING)) {
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_open_ex: "
+			"invalid flags for %s - TDB_LOCKLESS_READS "
+			"requires TDB_MUTEX_LOCKING\n", name));
+		errno = EINVAL;
+		goto fail;
+	}
+
 	if (getenv("TDB_NO_FSYNC")) {
 		tdb->flags |= TDB_NOSYNC;
 	}
@@ -173,6 +173,36 @@ static void mark_free_area(struct found_table *found, tdb_off_t head,
 	}
 }
 
+/* Mark all entries of one free list, stopping at loops or garbage. */
+static void mark_free_list(struct tdb_context *tdb, struct found_table *found,
+			   tdb_off_t top)
+{
+	bool slow_chase = false;
+	tdb_off_t slow_off = top, off;
+	struct tdb_record rec;
+
+	if (tdb_ofs_read(tdb, top, &off) == -1)
+		return;
+
+	while (off && off != slow_off) {
+		if (tdb->methods->tdb_read(tdb, off, &rec, sizeof(rec),
+					   DOCONV()) != 0) {
+			break;
+		}
+		if (rec.magic != TDB_FREE_MAGIC) {
+			break;
+		}
+		mark_free_area(found, off, sizeof(rec) + rec.rec_len);
+
+		off = rec.next;
+
+		if (slow_chase) {
+			tdb_ofs_read(tdb, slow_off, &slow_off);
+		}
+		slow_chase = !slow_chase;
+	}
+}
+
 static int cmp_key(const void *a, const void *b)
 {
 	const struct found *fa = a, *fb = b;
@@ -286,6 +316,11 @@ _PUBLIC_ int tdb_rescue(struct tdb_context *tdb,
 		}
 	}
 
+	/* The other size classes of the free list live in the header. */
+	for (i = 0; i + 1 < tdb_freelist_count(tdb); i++) {
+		mark_free_list(tdb, &found, tdb_freelist_top(tdb, i));
+	}
+
 	/* Recovery area: must be marked as free, since it often has old
 	 * records in there! */
 	if (tdb_ofs_read(tdb, TDB_RECOVERY_HEAD, &off) == 0 && off != 0) {
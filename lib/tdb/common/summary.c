@@ -24,6 +24,8 @@
 	"Incompatible hash: %s\n" \
 	"Active/supported feature flags: 0x%08x/0x%08x\n" \
 	"Robust mutexes locking: %s\n" \
+	"Lockless reads: %s\n" \
+	"Freelist size classes: %s\n" \
 	"Smallest/average/largest keys: %zu/%zu/%zu\n" \
 	"Smallest/average/largest data: %zu/%zu/%zu\n" \
 	"Smallest/average/largest padding: %zu/%zu/%zu\n" \
@@ -33,6 +35,8 @@
 	"Smallest/average/largest free records: %zu/%zu/%zu\n" \
 	"Number of hash chains: %zu\n" \
 	"Smallest/average/largest hash chains: %zu/%zu/%zu\n" \
+	"Hash chains with 0/1/2/3-4/5-8/9-16/17+ records: " \
+	"%zu/%zu/%zu/%zu/%zu/%zu/%zu\n" \
 	"Number of uncoalesced records: %zu\n" \
 	"Smallest/average/largest uncoalesced runs: %zu/%zu/%zu\n" \
 	"Percentage keys/data/padding/free/dead/rechdrs&tailers/hashes: %.0f/%.0f/%.0f/%.0f/%.0f/%.0f/%.0f\n"
@@ -69,6 +73,28 @@ static size_t tally_mean(const struct tally *tally)
 	return tally->total / tally->num;
 }
 
+/*
+ * Chain length distribution, the buckets are 0, 1, 2, 3-4, 5-8, 9-16 and
+ * everything above. Long chains are the sign of a too small hash size.
+ */
+#define CHAIN_DIST_BUCKETS 7
+
+static void chain_dist_add(size_t *dist, size_t len)
+{
+	size_t i = 0;
+
+	if (len > 0) {
+		/* 1 -> 1, 2 -> 2, 3-4 -> 3, 5-8 -> 4, ... */
+		i = 1;
+		len -= 1;
+		while ((len != 0) && (i < CHAIN_DIST_BUCKETS - 1)) {
+			len >>= 1;
+			i++;
+		}
+	}
+	dist[i]++;
+}
+
 static size_t get_hash_length(struct tdb_context *tdb, unsigned int i)
 {
 	tdb_off_t rec_ptr;
@@ -101,6 +127,7 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 	off_t file_size;
 	tdb_off_t off, rec_off;
 	struct tally freet, keys, data, dead, extra, hashval, uncoal;
+	size_t chain_dist[CHAIN_DIST_BUCKETS] = { 0 };
 	struct tdb_record rec;
 	char *ret = NULL;
 	bool locked;
@@ -174,8 +201,11 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 	if (unc > 1)
 		tally_add(&uncoal, unc - 1);
 
-	for (off = 0; off < tdb->hash_size; off++)
-		tally_add(&hashval, get_hash_length(tdb, off));
+	for (off = 0; off < tdb->hash_size; off++) {
+		size_t hash_len = get_hash_length(tdb, off);
+		tally_add(&hashval, hash_len);
+		chain_dist_add(chain_dist, hash_len);
+	}
 
 	file_size = tdb->hdr_ofs + tdb->map_size;
 
@@ -186,6 +216,8 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 		 (tdb->hash_fn == tdb_jenkins_hash)?"yes":"no",
 		 (unsigned)tdb->feature_flags, TDB_SUPPORTED_FEATURE_FLAGS,
 		 (tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX)?"yes":"no",
+		 (tdb->feature_flags & TDB_FEATURE_FLAG_SEQCOUNT)?"yes":"no",
+		 (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES)?"yes":"no",
 		 keys.min, tally_mean(&keys), keys.max,
 		 data.min, tally_mean(&data), data.max,
 		 extra.min, tally_mean(&extra), extra.max,
@@ -195,6 +227,8 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 		 freet.min, tally_mean(&freet), freet.max,
 		 hashval.num,
 		 hashval.min, tally_mean(&hashval), hashval.max,
+		 chain_dist[0], chain_dist[1], chain_dist[2], chain_dist[3],
+		 chain_dist[4], chain_dist[5], chain_dist[6],
 		 uncoal.total,
 		 uncoal.min, tally_mean(&uncoal), uncoal.max,
 		 keys.total * 100.0 / file_size,
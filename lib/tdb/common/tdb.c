@@ -160,6 +160,183 @@ tdb_off_t tdb_find_lock_hash(struct tdb_context *tdb, TDB_DATA key, uint32_t has
 	return rec_ptr;
 }
 
+/*
+ * Lockless lookups for tdbs with TDB_FEATURE_FLAG_SEQCOUNT, see the
+ * description of the sequence counters in mutex.c.
+ */
+
+#define TDB_LOCKLESS_READ_RETRIES 10
+
+static bool tdb_lockless_read_ok(struct tdb_context *tdb)
+{
+	if (tdb->map_ptr == NULL) {
+		return false;
+	}
+	if (tdb->transaction != NULL) {
+		return false;
+	}
+	if (tdb->flags & TDB_CONVERT) {
+		return false;
+	}
+	if (tdb_have_extra_locks(tdb)) {
+		/*
+		 * We already hold locks, let the nesting logic in
+		 * lock.c deal with it.
+		 */
+		return false;
+	}
+	return tdb_have_seqcounts(tdb);
+}
+
+/*
+ * We might look at garbage while a writer is busy, so don't go through
+ * tdb_oob() which would remap and complain loudly. Everything outside the
+ * current mapping is left to the locked path.
+ */
+static bool tdb_lockless_map_ok(struct tdb_context *tdb, tdb_off_t off,
+				tdb_len_t len)
+{
+	tdb_off_t end;
+
+	if (!tdb_add_off_t(off, len, &end)) {
+		return false;
+	}
+	return (end <= tdb->map_size);
+}
+
+/*
+ * tdb_find() without locks and without any side effects. Returns 0 if the
+ * walk went through, *prec_ptr is 0 if the key was not found. Returns -1 if
+ * the chain looked inconsistent, the caller must retry.
+ */
+static int tdb_find_lockless(struct tdb_context *tdb, TDB_DATA key,
+			     uint32_t hash, struct tdb_record *r,
+			     tdb_off_t *prec_ptr)
+{
+	const char *map = (const char *)tdb->map_ptr;
+	tdb_off_t rec_ptr, slow_ptr;
+	bool slow_chase = false;
+
+	if (!tdb_lockless_map_ok(tdb, TDB_HASH_TOP(hash), sizeof(rec_ptr))) {
+		return -1;
+	}
+	memcpy(&rec_ptr, map + TDB_HASH_TOP(hash), sizeof(rec_ptr));
+
+	slow_ptr = rec_ptr;
+
+	while (rec_ptr != 0) {
+		if (!tdb_lockless_map_ok(tdb, rec_ptr, sizeof(*r))) {
+			return -1;
+		}
+		memcpy(r, map + rec_ptr, sizeof(*r));
+
+		if (TDB_BAD_MAGIC(r)) {
+			return -1;
+		}
+
+		if (!TDB_DEAD(r) && hash==r->full_hash
+		    && key.dsize==r->key_len) {
+			tdb_off_t key_ofs = rec_ptr + sizeof(*r);
+
+			if (!tdb_lockless_map_ok(tdb, key_ofs, r->key_len)) {
+				return -1;
+			}
+			if (memcmp(key.dptr, map + key_ofs, key.dsize) == 0) {
+				*prec_ptr = rec_ptr;
+				return 0;
+			}
+		}
+		rec_ptr = r->next;
+
+		/* Same circular chain detection as tdb_chainwalk_check() */
+		if (slow_chase) {
+			if (!tdb_lockless_map_ok(tdb, slow_ptr,
+						 sizeof(slow_ptr))) {
+				return -1;
+			}
+			memcpy(&slow_ptr, map + slow_ptr, sizeof(slow_ptr));
+		}
+		slow_chase = !slow_chase;
+
+		if (rec_ptr == slow_ptr) {
+			return -1;
+		}
+	}
+
+	*prec_ptr = 0;
+	return 0;
+}
+
+/*
+ * Copy the data for "key" without taking the chain lock. If the record fits
+ * into "buf" it is copied there, otherwise into a malloc'ed buffer. Returns
+ * false if the caller has to fall back to the locked path, in this case
+ * nothing is allocated. data->dptr is NULL if the record does not exist.
+ */
+static bool tdb_fetch_lockless(struct tdb_context *tdb, TDB_DATA key,
+			       uint32_t hash, uint8_t *buf, size_t buflen,
+			       TDB_DATA *data)
+{
+	int i;
+
+	for (i=0; i<TDB_LOCKLESS_READ_RETRIES; i++) {
+		struct tdb_record rec;
+		tdb_off_t rec_ptr, data_ofs;
+		uint32_t seq[2];
+		uint8_t *dptr = NULL;
+		bool ok;
+		int ret;
+
+		ok = tdb_mutex_seqcount_read_begin(tdb, hash, seq);
+		if (!ok) {
+			continue;
+		}
+
+		ret = tdb_find_lockless(tdb, key, hash, &rec, &rec_ptr);
+		if (ret == -1) {
+			continue;
+		}
+
+		if (rec_ptr != 0) {
+			data_ofs = rec_ptr + sizeof(rec) + rec.key_len;
+
+			if (!tdb_lockless_map_ok(tdb, data_ofs, rec.data_len)) {
+				continue;
+			}
+
+			if ((buf != NULL) && (rec.data_len <= buflen)) {
+				dptr = buf;
+			} else {
+				/* Same as tdb_alloc_read(), never malloc(0) */
+				dptr = malloc(rec.data_len ? rec.data_len : 1);
+				if (dptr == NULL) {
+					return false;
+				}
+			}
+			memcpy(dptr, (char *)tdb->map_ptr + data_ofs,
+			       rec.data_len);
+		}
+
+		ok = tdb_mutex_seqcount_read_valid(tdb, hash, seq);
+		if (!ok) {
+			if (dptr != buf) {
+				free(dptr);
+			}
+			continue;
+		}
+
+		if (rec_ptr == 0) {
+			*data = tdb_null;
+			return true;
+		}
+
+		*data = (TDB_DATA) { .dptr = dptr, .dsize = rec.data_len };
+		return true;
+	}
+
+	return false;
+}
+
 static TDB_DATA _tdb_fetch(struct tdb_context *tdb, TDB_DATA key);
 
 struct tdb_update_hash_state {
@@ -268,6 +445,15 @@ static TDB_DATA _tdb_fetch(struct tdb_context *tdb, TDB_DATA key)
 
 	/* find which hash bucket it is in */
 	hash = tdb->hash_fn(&key);
+
+	if (tdb_lockless_read_ok(tdb) &&
+	    tdb_fetch_lockless(tdb, key, hash, NULL, 0, &ret)) {
+		if (ret.dptr == NULL) {
+			tdb->ecode = TDB_ERR_NOEXIST;
+		}
+		return ret;
+	}
+
 	if (!(rec_ptr = tdb_find_lock_hash(tdb,key,hash,F_RDLCK,&rec)))
 		return tdb_null;
 
@@ -317,6 +503,28 @@ _PUBLIC_ int tdb_parse_record(struct tdb_context *tdb, TDB_DATA key,
 	/* find which hash bucket it is in */
 	hash = tdb->hash_fn(&key);
 
+	if (tdb_lockless_read_ok(tdb)) {
+		uint8_t buf[256];
+		TDB_DATA data;
+
+		if (tdb_fetch_lockless(tdb, key, hash, buf, sizeof(buf),
+				       &data)) {
+			if (data.dptr == NULL) {
+				tdb_trace_1rec_ret(tdb, "tdb_parse_record",
+						   key, -1);
+				tdb->ecode = TDB_ERR_NOEXIST;
+				return -1;
+			}
+			tdb_trace_1rec_ret(tdb, "tdb_parse_record", key, 0);
+
+			ret = parser(key, data, private_data);
+			if (data.dptr != buf) {
+				free(data.dptr);
+			}
+			return ret;
+		}
+	}
+
 	if (!(rec_ptr = tdb_find_lock_hash(tdb,key,hash,F_RDLCK,&rec))) {
 		/* record not found */
 		tdb_trace_1rec_ret(tdb, "tdb_parse_record", key, -1);
@@ -988,9 +1196,11 @@ _PUBLIC_ int tdb_wipe_all(struct tdb_context *tdb)
 	}
 
 	/* wipe the freelist */
-	if (tdb_ofs_write(tdb, FREELIST_TOP, &offset) == -1) {
-		TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_wipe_all: failed to write freelist\n"));
-		goto failed;
+	for (i=0;i<tdb_freelist_count(tdb);i++) {
+		if (tdb_ofs_write(tdb, tdb_freelist_top(tdb, i), &offset) == -1) {
+			TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_wipe_all: failed to write freelist\n"));
+			goto failed;
+		}
 	}
 
 	/* add all the rest of the file to the freelist, possibly leaving a gap
@@ -1126,6 +1336,204 @@ _PUBLIC_ int tdb_repack(struct tdb_context *tdb)
 	return 0;
 }
 
+/*
+  rehash a tdb: copy it to a new file with a different hash size and
+  replace the old file with it.
+
+  Writers are blocked by a transaction on the old file while the copy
+  runs, readers can go on. The rename is atomic, so after a crash we
+  find either the old or the new database. Other processes having the
+  database open keep working on the old file though, so this must only
+  be used for databases no other process has open, e.g. from tdbtool.
+ */
+_PUBLIC_ int tdb_rehash(struct tdb_context *tdb, uint32_t hash_size)
+{
+	struct tdb_context *new_db = NULL;
+	struct tdb_context *tmp_ctx_next;
+	struct tdb_context tmp_ctx;
+	struct traverse_state state;
+	struct stat st;
+	char *tmp_name = NULL;
+	uint32_t tdb_flags;
+	tdb_off_t seqnum;
+	size_t len;
+
+	tdb_trace(tdb, "tdb_rehash");
+
+	if (hash_size == 0) {
+		hash_size = DEFAULT_HASH_SIZE;
+	}
+	if (hash_size == tdb->hash_size) {
+		return 0;
+	}
+
+	if (tdb->read_only || tdb->traverse_read) {
+		tdb->ecode = TDB_ERR_RDONLY;
+		return -1;
+	}
+	if (tdb->flags & (TDB_INTERNAL|TDB_CLEAR_IF_FIRST)) {
+		/*
+		 * Those get recreated on every first open, just pass
+		 * the new hash size to tdb_open() instead.
+		 */
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_rehash: not supported "
+			 "for internal or CLEAR_IF_FIRST databases\n"));
+		tdb->ecode = TDB_ERR_EINVAL;
+		return -1;
+	}
+	if (tdb_have_mutexes(tdb)) {
+		/*
+		 * The other openers (e.g. of gencache.tdb) share the
+		 * mutex area of the old file, there is no way to move
+		 * them over.
+		 */
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_rehash: not supported "
+			 "for mutex databases\n"));
+		tdb->ecode = TDB_ERR_EINVAL;
+		return -1;
+	}
+	if (tdb->transaction != NULL || tdb_have_extra_locks(tdb)) {
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_rehash: not allowed "
+			 "with locks held or inside a transaction\n"));
+		tdb->ecode = TDB_ERR_LOCK;
+		return -1;
+	}
+
+	if (fstat(tdb->fd, &st) != 0) {
+		tdb->ecode = TDB_ERR_IO;
+		return -1;
+	}
+
+	len = strlen(tdb->name) + strlen(".rehash") + 1;
+	tmp_name = malloc(len);
+	if (tmp_name == NULL) {
+		tdb->ecode = TDB_ERR_OOM;
+		return -1;
+	}
+	snprintf(tmp_name, len, "%s.rehash", tdb->name);
+
+	if (tdb_transaction_start(tdb) != 0) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__
+			 " Failed to start transaction\n"));
+		goto fail;
+	}
+
+	/*
+	 * Pass our hash function explicitly, the new file has to be
+	 * created with the same one.
+	 */
+	tdb_flags = tdb->flags & ~(TDB_CONVERT|TDB_BIGENDIAN);
+	if (tdb->hash_fn == tdb_jenkins_hash) {
+		tdb_flags |= TDB_INCOMPATIBLE_HASH;
+	}
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES) {
+		tdb_flags |= TDB_FREELIST_CLASSES;
+	}
+
+	unlink(tmp_name);
+	new_db = tdb_open_ex(tmp_name, hash_size, tdb_flags,
+			     O_RDWR|O_CREAT|O_EXCL, st.st_mode & 0777,
+			     &tdb->log, tdb->hash_fn);
+	if (new_db == NULL) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__
+			 " Failed to create %s\n", tmp_name));
+		goto fail_cancel;
+	}
+
+	if (tdb_lockall(new_db) != 0) {
+		goto fail_cancel;
+	}
+
+	state.error = false;
+	state.dest_db = new_db;
+
+	if (tdb_traverse_read(tdb, repack_traverse, &state) == -1 ||
+	    state.error) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__
+			 " Failed to traverse copying out\n"));
+		goto fail_cancel;
+	}
+
+	/*
+	 * Make sure anyone watching the sequence number sees the
+	 * database has changed.
+	 */
+	if (tdb_ofs_read(tdb, TDB_SEQNUM_OFS, &seqnum) != 0) {
+		goto fail_cancel;
+	}
+	seqnum++;
+	if (tdb_ofs_write(new_db, TDB_SEQNUM_OFS, &seqnum) != 0) {
+		goto fail_cancel;
+	}
+
+	tdb_unlockall(new_db);
+
+	if (!(tdb->flags & TDB_NOSYNC) && fsync(new_db->fd) != 0) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__
+			 " fsync failed: %s\n", strerror(errno)));
+		goto fail_cancel;
+	}
+
+	tdb_close(new_db);
+	new_db = NULL;
+
+	if (rename(tmp_name, tdb->name) != 0) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__
+			 " Failed to rename %s: %s\n", tmp_name,
+			 strerror(errno)));
+		goto fail_cancel;
+	}
+
+	/*
+	 * Open the new file. If that fails, the caller's tdb still
+	 * works on the old, now unlinked, file with the same content.
+	 */
+	new_db = tdb_open_ex(tdb->name, 0, tdb->flags & ~TDB_CONVERT,
+			     tdb->open_flags & ~(O_CREAT|O_TRUNC|O_EXCL), 0,
+			     &tdb->log, tdb->hash_fn);
+	if (new_db == NULL) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__
+			 " Failed to reopen %s\n", tdb->name));
+		tdb_transaction_cancel(tdb);
+		SAFE_FREE(tmp_name);
+		tdb->ecode = TDB_ERR_IO;
+		return -1;
+	}
+
+	tdb_transaction_cancel(tdb);
+
+	/*
+	 * Swap the contexts so that the caller's tdb points to the new
+	 * file, then close the old one. Both are in the list of open
+	 * tdbs, keep the links as they are.
+	 */
+	tmp_ctx = *tdb;
+	*tdb = *new_db;
+	*new_db = tmp_ctx;
+
+	tmp_ctx_next = tdb->next;
+	tdb->next = new_db->next;
+	new_db->next = tmp_ctx_next;
+
+	tdb_close(new_db);
+	SAFE_FREE(tmp_name);
+
+	return 0;
+
+fail_cancel:
+	if (new_db != NULL) {
+		tdb_close(new_db);
+		unlink(tmp_name);
+	}
+	tdb_transaction_cancel(tdb);
+fail:
+	SAFE_FREE(tmp_name);
+	if (tdb->ecode == TDB_SUCCESS) {
+		tdb->ecode = TDB_ERR_IO;
+	}
+	return -1;
+}
+
 /* Even on files, we can get partial writes due to signals. */
 bool tdb_write_all(int fd, const void *buf, size_t count)
 {
@@ -75,11 +75,24 @@ typedef uint32_t tdb_off_t;
 #define TDB_PAD_U32  0x42424242
 
 #define TDB_FEATURE_FLAG_MUTEX 0x00000001
+#define TDB_FEATURE_FLAG_SEQCOUNT 0x00000002
+#define TDB_FEATURE_FLAG_FREELIST_CLASSES 0x00000004
 
 #define TDB_SUPPORTED_FEATURE_FLAGS ( \
 	TDB_FEATURE_FLAG_MUTEX | \
+	TDB_FEATURE_FLAG_SEQCOUNT | \
+	TDB_FEATURE_FLAG_FREELIST_CLASSES | \
 	0)
 
+/*
+ * With TDB_FEATURE_FLAG_FREELIST_CLASSES the freelist is split into
+ * TDB_FREELIST_NUM_CLASSES lists by record size. The list of the
+ * largest class stays at FREELIST_TOP, the others live in the header.
+ */
+#define TDB_FREELIST_NUM_CLASSES 8
+#define TDB_FREELIST_CLASS_TOP(c) \
+	(offsetof(struct tdb_header, freelist_classes) + (c)*sizeof(tdb_off_t))
+
 /* NB assumes there is a local variable called "tdb" that is the
  * current context, also takes doubly-parenthesized print-style
  * argument. */
@@ -187,7 +200,9 @@ struct tdb_header {
 	uint32_t magic2_hash; /* hash of TDB_MAGIC. */
 	uint32_t feature_flags;
 	tdb_len_t mutex_size; /* set if TDB_FEATURE_FLAG_MUTEX is set */
-	tdb_off_t reserved[25];
+	/* set if TDB_FEATURE_FLAG_FREELIST_CLASSES is set */
+	tdb_off_t freelist_classes[TDB_FREELIST_NUM_CLASSES - 1];
+	tdb_off_t reserved[25 - (TDB_FREELIST_NUM_CLASSES - 1)];
 };
 
 struct tdb_lock_type {
@@ -310,6 +325,8 @@ int tdb_ofs_read(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
 int tdb_ofs_write(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
 void *tdb_convert(void *buf, uint32_t size);
 int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec);
+unsigned int tdb_freelist_count(struct tdb_context *tdb);
+tdb_off_t tdb_freelist_top(struct tdb_context *tdb, unsigned int c);
 tdb_off_t tdb_allocate(struct tdb_context *tdb, int hash, tdb_len_t length,
 		       struct tdb_record *rec);
 
@@ -361,6 +378,11 @@ bool tdb_add_off_t(tdb_off_t a, tdb_off_t b, tdb_off_t *pret);
 #define tdb_add_len_t tdb_add_off_t
 
 size_t tdb_mutex_size(struct tdb_context *tdb);
+bool tdb_have_seqcounts(struct tdb_context *tdb);
+bool tdb_mutex_seqcount_read_begin(struct tdb_context *tdb, uint32_t hash,
+				   uint32_t seq[2]);
+bool tdb_mutex_seqcount_read_valid(struct tdb_context *tdb, uint32_t hash,
+				   const uint32_t seq[2]);
 bool tdb_have_mutexes(struct tdb_context *tdb);
 int tdb_mutex_init(struct tdb_context *tdb);
 int tdb_mutex_mmap(struct tdb_context *tdb);
@@ -369,6 +391,7 @@ bool tdb_mutex_lock(struct tdb_context *tdb, int rw, off_t off, off_t len,
 		    bool waitflag, int *pret);
 bool tdb_mutex_unlock(struct tdb_context *tdb, int rw, off_t off, off_t len,
 		      int *pret);
+void tdb_mutex_chain_upgrade(struct tdb_context *tdb, off_t off);
 int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
 			     enum tdb_lock_flags flags);
 int tdb_mutex_allrecord_unlock(struct tdb_context *tdb);
@@ -84,6 +84,11 @@ extern "C" {
 #define TDB_MUTEX_LOCKING 4096 /** optimized locking using robust mutexes if supported,
                                    only with tdb >= 1.3.0 and TDB_CLEAR_IF_FIRST
                                    after checking tdb_runtime_check_for_robust_mutexes() */
+#define TDB_LOCKLESS_READS 8192 /** lockless tdb_fetch()/tdb_parse_record() via per-chain
+                                    sequence counters, only with TDB_MUTEX_LOCKING (not for
+                                    fcntl locked tdbs), can't be opened by tdb < 1.4.3 */
+#define TDB_FREELIST_CLASSES 16384 /** size-class segregated freelists,
+                                       can't be opened by tdb < 1.4.3 */
 
 /** The tdb error codes */
 enum TDB_ERROR {TDB_SUCCESS=0, TDB_ERR_CORRUPT, TDB_ERR_IO, TDB_ERR_LOCK, 
@@ -152,6 +157,21 @@ struct tdb_logging_context {
  *                                             can't be opened by tdb < 1.3.0.
  *                                             Only valid in combination with TDB_CLEAR_IF_FIRST
  *                                             after checking tdb_runtime_check_for_robust_mutexes()\n
+ *                         TDB_LOCKLESS_READS - Let tdb_fetch() and tdb_parse_record() read
+ *                                              without taking the chain mutex,
+ *                                              can't be opened by tdb < 1.4.3.
+ *                                              Only valid in combination with TDB_MUTEX_LOCKING,
+ *                                              the sequence counters live in the mutex area.
+ *                                              Databases using fcntl locks, e.g. persistent
+ *                                              ones without TDB_MUTEX_LOCKING, always read
+ *                                              under the chain lock.
+ *                                              Whether the counters are used is decided when
+ *                                              the file is created, later opens follow the
+ *                                              header, so persistent files shared with older
+ *                                              binaries should not be created with it\n
+ *                         TDB_FREELIST_CLASSES - Keep free records in separate lists
+ *                                                by size to reduce fragmentation,
+ *                                                can't be opened by tdb < 1.4.3.\n
  *
  * @param[in]  open_flags Flags for the open(2) function.
  *
@@ -193,6 +213,21 @@ struct tdb_context *tdb_open(const char *name, int hash_size, int tdb_flags,
  *                                             can't be opened by tdb < 1.3.0.
  *                                             Only valid in combination with TDB_CLEAR_IF_FIRST
  *                                             after checking tdb_runtime_check_for_robust_mutexes()\n
+ *                         TDB_LOCKLESS_READS - Let tdb_fetch() and tdb_parse_record() read
+ *                                              without taking the chain mutex,
+ *                                              can't be opened by tdb < 1.4.3.
+ *                                              Only valid in combination with TDB_MUTEX_LOCKING,
+ *                                              the sequence counters live in the mutex area.
+ *                                              Databases using fcntl locks, e.g. persistent
+ *                                              ones without TDB_MUTEX_LOCKING, always read
+ *                                              under the chain lock.
+ *                                              Whether the counters are used is decided when
+ *                                              the file is created, later opens follow the
+ *                                              header, so persistent files shared with older
+ *                                              binaries should not be created with it\n
+ *                         TDB_FREELIST_CLASSES - Keep free records in separate lists
+ *                                                by size to reduce fragmentation,
+ *                                                can't be opened by tdb < 1.4.3.\n
  *
  * @param[in]  open_flags Flags for the open(2) function.
  *
@@ -307,6 +342,11 @@ TDB_DATA tdb_fetch(struct tdb_context *tdb, TDB_DATA key);
  * call other tdb routines from within the parser. Also, for good performance
  * you should make the parser fast to allow parallel operations.
  *
+ * For a tdb created with TDB_LOCKLESS_READS (which requires TDB_MUTEX_LOCKING)
+ * the record is looked up without taking the chain lock. The data is copied to a private buffer and only
+ * handed to the parser once it is known to be consistent, so the parser
+ * runs without any lock held in that case.
+ *
  * @param[in]  tdb      The tdb to parse the record.
  *
  * @param[in]  key      The key to parse.
@@ -1009,6 +1049,32 @@ void tdb_setalarm_sigptr(struct tdb_context *tdb, volatile sig_atomic_t *sigptr)
 int tdb_wipe_all(struct tdb_context *tdb);
 int tdb_repack(struct tdb_context *tdb);
 
+/**
+ * @brief Change the hash size of a database.
+ *
+ * The database is copied into a new file with the given hash size, which
+ * then replaces the old one. Writers are blocked during the copy, but this
+ * is not an online operation: only the calling tdb context is switched to
+ * the new file.
+ *
+ * @warning Other processes which have the database open are not notified.
+ * They continue to use the old, unlinked file and their changes are lost,
+ * so only use this on databases that are not in use elsewhere, e.g. from
+ * tdbtool with the service stopped.
+ *
+ * Not supported (fails with TDB_ERR_EINVAL) for TDB_INTERNAL,
+ * TDB_CLEAR_IF_FIRST and mutex databases. CLEAR_IF_FIRST databases are
+ * recreated on the first open, pass the new hash size to tdb_open() for
+ * those. Fails with TDB_ERR_LOCK inside a transaction or with locks held.
+ *
+ * @param[in]  tdb      The database to rehash.
+ *
+ * @param[in]  hash_size The new hash size, 0 for the default.
+ *
+ * @return              0 on success, -1 on error with error code set.
+ */
+int tdb_rehash(struct tdb_context *tdb, uint32_t hash_size);
+
 /* Debug functions. Not used in production. */
 void tdb_dump_all(struct tdb_context *tdb);
 int tdb_printfreelist(struct tdb_context *tdb);
@@ -0,0 +1,135 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/freelistcheck.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+#define NUM_KEYS 2000
+#define NUM_OPS 100000
+
+static uint8_t buf[8192];
+
+static double timeval_elapsed2(const struct timeval *tv1, const struct timeval *tv2)
+{
+	return (tv2->tv_sec - tv1->tv_sec) +
+	       (tv2->tv_usec - tv1->tv_usec)*1.0e-6;
+}
+
+static double timeval_elapsed(const struct timeval *tv)
+{
+	struct timeval tv2;
+	gettimeofday(&tv2, NULL);
+	return timeval_elapsed2(tv, &tv2);
+}
+
+/* Mostly small records with the occasional large one. */
+static size_t random_size(void)
+{
+	if (random() % 16 == 0) {
+		return random() % sizeof(buf);
+	}
+	return random() % 256;
+}
+
+static bool churn(struct tdb_context *tdb)
+{
+	unsigned int i;
+
+	srandom(1);
+
+	for (i = 0; i < NUM_OPS; i++) {
+		unsigned int k = random() % NUM_KEYS;
+		TDB_DATA key = { (unsigned char *)&k, sizeof(k) };
+		TDB_DATA data = { buf, random_size() };
+
+		if (random() % 3 == 0) {
+			if (tdb_delete(tdb, key) != 0 &&
+			    tdb_error(tdb) != TDB_ERR_NOEXIST) {
+				return false;
+			}
+		} else if (tdb_store(tdb, key, data, TDB_REPLACE) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool delete_all(struct tdb_context *tdb)
+{
+	unsigned int k;
+
+	for (k = 0; k < NUM_KEYS; k++) {
+		TDB_DATA key = { (unsigned char *)&k, sizeof(k) };
+
+		if (tdb_delete(tdb, key) != 0 &&
+		    tdb_error(tdb) != TDB_ERR_NOEXIST) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Random store/delete churn with and without size-class freelists. */
+int main(int argc, char *argv[])
+{
+	unsigned int i;
+	struct tdb_context *tdb;
+	int flags[] = { TDB_DEFAULT, TDB_FREELIST_CLASSES,
+			TDB_FREELIST_CLASSES|TDB_NOMMAP,
+			TDB_FREELIST_CLASSES|TDB_CONVERT };
+
+	plan_tests(sizeof(flags) / sizeof(flags[0]) * 9);
+	for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+		struct timeval start;
+		double elapsed;
+		int num_free;
+
+		tdb = tdb_open_ex("run-freelist-churn.tdb", 131, flags[i],
+				  O_RDWR|O_CREAT|O_TRUNC, 0600,
+				  &taplogctx, NULL);
+		ok1(tdb);
+		if (!tdb)
+			continue;
+		ok1(!!(tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES)
+		    == !!(flags[i] & TDB_FREELIST_CLASSES));
+
+		gettimeofday(&start, NULL);
+		ok1(churn(tdb));
+		elapsed = timeval_elapsed(&start);
+
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+		ok1(tdb_validate_freelist(tdb, &num_free) == 0);
+
+		diag("flags 0x%x: %d ops took %f seconds, "
+		     "file size %u, %d free records",
+		     flags[i], NUM_OPS, elapsed,
+		     (unsigned)tdb->map_size, num_free);
+
+		/* The size classes have to survive a reopen */
+		tdb_close(tdb);
+		tdb = tdb_open_ex("run-freelist-churn.tdb", 0,
+				  flags[i] & ~(TDB_FREELIST_CLASSES|TDB_CONVERT),
+				  O_RDWR, 0, &taplogctx, NULL);
+		ok1(!!(tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES)
+		    == !!(flags[i] & TDB_FREELIST_CLASSES));
+
+		/* Free records still get merged across the lists */
+		ok1(delete_all(tdb));
+		ok1(tdb_freelist_size(tdb) > 0);
+		ok1(tdb_freelist_size(tdb) == 1);
+		tdb_close(tdb);
+	}
+
+	return exit_status();
+}
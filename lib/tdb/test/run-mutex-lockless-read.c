@@ -0,0 +1,264 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdarg.h>
+#include <poll.h>
+
+#define NUM_STORES 20000
+
+static TDB_DATA key;
+static uint8_t value_a[16384], value_b[16384];
+
+static void log_fn(struct tdb_context *tdb, enum tdb_debug_level level,
+		   const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+static int check_parser(TDB_DATA k, TDB_DATA d, void *private_data)
+{
+	bool *torn = private_data;
+
+	if ((d.dsize != sizeof(value_a)) ||
+	    ((memcmp(d.dptr, value_a, d.dsize) != 0) &&
+	     (memcmp(d.dptr, value_b, d.dsize) != 0))) {
+		*torn = true;
+	}
+	return 0;
+}
+
+static int do_child(int tdb_flags, int to, int from)
+{
+	struct tdb_context *tdb;
+	unsigned int log_count;
+	struct tdb_logging_context log_ctx = { log_fn, &log_count };
+	TDB_DATA data;
+	int i, ret;
+	char c = 0;
+
+	tdb = tdb_open_ex("mutex-lockless-read.tdb", 0, tdb_flags,
+			  O_RDWR|O_CREAT, 0755, &log_ctx, NULL);
+	ok(tdb, "tdb_open_ex should succeed");
+
+	write(to, &c, sizeof(c));
+	read(from, &c, sizeof(c));
+
+	for (i=0; i<NUM_STORES; i++) {
+		data.dptr = (i % 2) ? value_b : value_a;
+		data.dsize = sizeof(value_a);
+
+		ret = tdb_store(tdb, key, data, 0);
+		if (ret != 0) {
+			break;
+		}
+	}
+	ok(ret == 0, "tdb_store should succeed");
+
+	tdb_close(tdb);
+
+	write(to, &c, sizeof(c));
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	unsigned int log_count;
+	struct tdb_logging_context log_ctx = { log_fn, &log_count };
+	volatile uint32_t *seqcounts;
+	uint32_t hash, seq;
+	TDB_DATA data;
+	int ret, status;
+	pid_t child, reader, wait_ret;
+	int fromchild[2];
+	int tochild[2];
+	char c;
+	int tdb_flags;
+	bool runtime_support;
+	bool torn = false;
+
+	runtime_support = tdb_runtime_check_for_robust_mutexes();
+
+	if (!runtime_support) {
+		skip(1, "No robust mutex support");
+		return exit_status();
+	}
+
+	key.dsize = strlen("hi");
+	key.dptr = discard_const_p(uint8_t, "hi");
+	memset(value_a, 'a', sizeof(value_a));
+	memset(value_b, 'b', sizeof(value_b));
+
+	tdb = tdb_open_ex("mutex-lockless-read.tdb", 0,
+			  TDB_CLEAR_IF_FIRST|TDB_LOCKLESS_READS,
+			  O_RDWR|O_CREAT, 0755, &log_ctx, NULL);
+	ok(tdb == NULL, "TDB_LOCKLESS_READS without mutexes should fail");
+	ok(errno == EINVAL, "errno should be EINVAL");
+
+	tdb_flags = TDB_INCOMPATIBLE_HASH|
+		TDB_MUTEX_LOCKING|
+		TDB_CLEAR_IF_FIRST|
+		TDB_LOCKLESS_READS;
+
+	pipe(fromchild);
+	pipe(tochild);
+
+	child = fork();
+	if (child == 0) {
+		close(fromchild[0]);
+		close(tochild[1]);
+		return do_child(tdb_flags, fromchild[1], tochild[0]);
+	}
+	close(fromchild[1]);
+	close(tochild[0]);
+
+	read(fromchild[0], &c, sizeof(c));
+
+	tdb = tdb_open_ex("mutex-lockless-read.tdb", 0, tdb_flags,
+			  O_RDWR|O_CREAT, 0755, &log_ctx, NULL);
+	ok(tdb, "tdb_open_ex should succeed");
+	ok(tdb_have_seqcounts(tdb), "tdb should have seqcounts");
+
+	data.dptr = value_a;
+	data.dsize = sizeof(value_a);
+
+	hash = tdb->hash_fn(&key);
+	seqcounts = tdb_mutex_seqcounts(tdb);
+	seq = seqcounts[BUCKET(hash)+1];
+	ok((seq % 2) == 0, "chain seqcount should be even");
+
+	ret = tdb_store(tdb, key, data, 0);
+	ok(ret == 0, "tdb_store should succeed");
+	ok(seqcounts[BUCKET(hash)+1] == seq + 2,
+	   "tdb_store should bump the chain seqcount");
+
+	seq = seqcounts[BUCKET(hash)+1];
+
+	ret = tdb_parse_record(tdb, key, check_parser, &torn);
+	ok(ret == 0, "tdb_parse_record should succeed");
+	ok(!torn, "tdb_parse_record should see the right data");
+
+	data = tdb_fetch(tdb, key);
+	ok(data.dsize == sizeof(value_a), "tdb_fetch should succeed");
+	ok(memcmp(data.dptr, value_a, data.dsize) == 0,
+	   "tdb_fetch should see the right data");
+	free(data.dptr);
+
+	ok(seqcounts[BUCKET(hash)+1] == seq,
+	   "lockless reads should not touch the chain seqcount");
+
+	ret = tdb_chainlock(tdb, key);
+	ok(ret == 0, "tdb_chainlock should succeed");
+	ok((seqcounts[BUCKET(hash)+1] % 2) == 1,
+	   "chain seqcount should be odd while locked");
+	ret = tdb_parse_record(tdb, key, check_parser, &torn);
+	ok(ret == 0, "nested tdb_parse_record should succeed");
+	ret = tdb_chainunlock(tdb, key);
+	ok(ret == 0, "tdb_chainunlock should succeed");
+
+	seq = seqcounts[BUCKET(hash)+1];
+	ret = tdb_chainlock_read(tdb, key);
+	ok(ret == 0, "tdb_chainlock_read should succeed");
+	ok(seqcounts[BUCKET(hash)+1] == seq,
+	   "a read chainlock should not touch the chain seqcount");
+	ret = tdb_chainlock(tdb, key);
+	ok(ret == 0, "nested tdb_chainlock should succeed");
+	ok((seqcounts[BUCKET(hash)+1] % 2) == 1,
+	   "chain seqcount should be odd once upgraded");
+	ret = tdb_chainunlock(tdb, key);
+	ok(ret == 0, "nested tdb_chainunlock should succeed");
+	ret = tdb_chainunlock_read(tdb, key);
+	ok(ret == 0, "tdb_chainunlock_read should succeed");
+	ok(seqcounts[BUCKET(hash)+1] == seq + 2,
+	   "chain seqcount should be even after an upgraded unlock");
+
+	/* A reader dying with the chain mutex held leaves it even */
+	seq = seqcounts[BUCKET(hash)+1];
+	reader = fork();
+	if (reader == 0) {
+		tdb_chainlock_read(tdb, key);
+		_exit(0);
+	}
+	wait_ret = waitpid(reader, &status, 0);
+	ok(wait_ret == reader, "reader child should have exited");
+	ok(seqcounts[BUCKET(hash)+1] == seq,
+	   "a dead reader should leave the chain seqcount alone");
+	ret = tdb_chainlock(tdb, key);
+	ok(ret == 0, "tdb_chainlock after a dead reader should succeed");
+	ret = tdb_chainunlock(tdb, key);
+	ok(ret == 0, "tdb_chainunlock should succeed");
+
+	ret = tdb_allrecord_lock(tdb, F_WRLCK, TDB_LOCK_WAIT, false);
+	ok(ret == 0, "tdb_allrecord_lock should succeed");
+	ok((seqcounts[0] % 2) == 1,
+	   "allrecord seqcount should be odd while locked");
+	ret = tdb_allrecord_unlock(tdb, F_WRLCK, false);
+	ok(ret == 0, "tdb_allrecord_unlock should succeed");
+	ok((seqcounts[0] % 2) == 0,
+	   "allrecord seqcount should be even after unlock");
+
+	write(tochild[1], &c, sizeof(c));
+
+	/*
+	 * Read while the child rewrites the record, we must never see a
+	 * mix of both values.
+	 */
+	do {
+		struct pollfd pfd = { .fd = fromchild[0], .events = POLLIN };
+
+		ret = tdb_parse_record(tdb, key, check_parser, &torn);
+		if ((ret != 0) || torn) {
+			break;
+		}
+
+		data = tdb_fetch(tdb, key);
+		ret = check_parser(key, data, &torn);
+		free(data.dptr);
+		if (torn) {
+			break;
+		}
+
+		ret = poll(&pfd, 1, 0);
+	} while (ret == 0);
+
+	ok(!torn, "concurrent lockless reads should never see torn data");
+
+	wait_ret = wait(&status);
+	ok(wait_ret == child, "child should have exited correctly");
+
+	ret = tdb_delete(tdb, key);
+	ok(ret == 0, "tdb_delete should succeed");
+
+	data = tdb_fetch(tdb, key);
+	ok(data.dptr == NULL, "tdb_fetch of deleted record should fail");
+	ok(tdb_error(tdb) == TDB_ERR_NOEXIST, "error should be NOEXIST");
+
+	tdb_close(tdb);
+
+	/* The header decides, not the flags of later opens */
+	tdb = tdb_open_ex("mutex-lockless-read.tdb", 0,
+			  TDB_INCOMPATIBLE_HASH|TDB_MUTEX_LOCKING,
+			  O_RDWR, 0755, &log_ctx, NULL);
+	ok(tdb, "tdb_open_ex without TDB_LOCKLESS_READS should succeed");
+	ok(tdb_have_seqcounts(tdb), "tdb should still have seqcounts");
+	tdb_close(tdb);
+
+	diag("done");
+	return exit_status();
+}
@@ -0,0 +1,100 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+#define NUM_RECORDS 1000
+
+static bool check_records(struct tdb_context *tdb)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		TDB_DATA key = { (unsigned char *)&i, sizeof(i) };
+		TDB_DATA data;
+		bool ok;
+
+		data = tdb_fetch(tdb, key);
+		ok = (data.dsize == sizeof(i)) &&
+			(memcmp(data.dptr, &i, sizeof(i)) == 0);
+		free(data.dptr);
+		if (!ok) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int i;
+	struct tdb_context *tdb;
+	int flags[] = { TDB_DEFAULT, TDB_NOMMAP,
+			TDB_CONVERT, TDB_INCOMPATIBLE_HASH };
+	uint32_t seqnum;
+
+	plan_tests(sizeof(flags) / sizeof(flags[0]) * 10 + 5);
+	for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+		unsigned int j;
+
+		tdb = tdb_open_ex("run-rehash.tdb", 7, flags[i]|TDB_SEQNUM,
+				  O_RDWR|O_CREAT|O_TRUNC, 0600,
+				  &taplogctx, NULL);
+		ok1(tdb);
+		if (!tdb)
+			continue;
+
+		for (j = 0; j < NUM_RECORDS; j++) {
+			TDB_DATA key = { (unsigned char *)&j, sizeof(j) };
+			if (tdb_store(tdb, key, key, TDB_INSERT) != 0)
+				fail("Storing in tdb");
+		}
+		seqnum = tdb_get_seqnum(tdb);
+
+		ok1(tdb_rehash(tdb, 1031) == 0);
+		ok1(tdb_hash_size(tdb) == 1031);
+		ok1(tdb_get_seqnum(tdb) != seqnum);
+		ok1(check_records(tdb));
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+
+		/* The new hash size has to be on disk */
+		tdb_close(tdb);
+		tdb = tdb_open_ex("run-rehash.tdb", 0, flags[i] & ~TDB_CONVERT,
+				  O_RDWR, 0, &taplogctx, NULL);
+		ok1(tdb);
+		ok1(tdb_hash_size(tdb) == 1031);
+		ok1(check_records(tdb));
+		ok1(access("run-rehash.tdb.rehash", F_OK) != 0);
+		tdb_close(tdb);
+	}
+
+	/* Not allowed with locks held */
+	tdb = tdb_open_ex("run-rehash.tdb", 0, TDB_DEFAULT,
+			  O_RDWR, 0, &taplogctx, NULL);
+	tdb_lockall(tdb);
+	ok1(tdb_rehash(tdb, 131) == -1);
+	ok1(tdb_error(tdb) == TDB_ERR_LOCK);
+	tdb_unlockall(tdb);
+	tdb_close(tdb);
+
+	/* CLEAR_IF_FIRST databases should be reopened with a new size */
+	tdb = tdb_open_ex("run-rehash-cif.tdb", 7, TDB_CLEAR_IF_FIRST,
+			  O_RDWR|O_CREAT|O_TRUNC, 0600, &taplogctx, NULL);
+	ok1(tdb);
+	ok1(tdb_rehash(tdb, 131) == -1);
+	ok1(tdb_error(tdb) == TDB_ERR_EINVAL);
+	tdb_close(tdb);
+
+	return exit_status();
+}
@@ -25,7 +25,7 @@ int main(int argc, char *argv[])
 	TDB_DATA data = { (unsigned char *)&j, sizeof(j) };
 	char *summary;
 
-	plan_tests(sizeof(flags) / sizeof(flags[0]) * 14);
+	plan_tests(sizeof(flags) / sizeof(flags[0]) * 16);
 	for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
 		tdb = tdb_open("run-summary.tdb", 131, flags[i],
 			       O_RDWR|O_CREAT|O_TRUNC, 0600);
@@ -45,6 +45,7 @@ int main(int argc, char *argv[])
 		diag("%s", summary);
 		ok1(strstr(summary, "Size of file/data: "));
 		ok1(strstr(summary, "Number of records: 500\n"));
+		ok1(strstr(summary, "Freelist size classes: no\n"));
 		ok1(strstr(summary, "Smallest/average/largest keys: 4/4/4\n"));
 		ok1(strstr(summary, "Smallest/average/largest data: 0/2/4\n"));
 		ok1(strstr(summary, "Smallest/average/largest padding: "));
@@ -53,6 +54,7 @@ int main(int argc, char *argv[])
 		ok1(strstr(summary, "Smallest/average/largest free records: "));
 		ok1(strstr(summary, "Number of hash chains: 131\n"));
 		ok1(strstr(summary, "Smallest/average/largest hash chains: "));
+		ok1(strstr(summary, "Hash chains with 0/1/2/3-4/5-8/9-16/17+ records: "));
 		ok1(strstr(summary, "Number of uncoalesced records: 0\n"));
 		ok1(strstr(summary, "Smallest/average/largest uncoalesced runs: 0/0/0\n"));
 		ok1(strstr(summary, "Percentage keys/data/padding/free/dead/rechdrs&tailers/hashes: "));
@@ -65,6 +65,7 @@ enum commands {
 	CMD_SYSTEM,
 	CMD_CHECK,
 	CMD_REPACK,
+	CMD_REHASH,
 	CMD_QUIT,
 	CMD_HELP
 };
@@ -105,6 +106,7 @@ COMMAND_TABLE cmd_table[] = {
 	{"q",		CMD_QUIT},
 	{"!",		CMD_SYSTEM},
 	{"repack",	CMD_REPACK},
+	{"rehash",	CMD_REHASH},
 	{NULL,		CMD_HELP}
 };
 
@@ -240,6 +242,7 @@ static void help(void)
 "  freelist_size        : print the number of records in the freelist\n"
 "  check                : check the integrity of an opened database\n"
 "  repack               : repack the database\n"
+"  rehash    hashsize   : change the hash size of the database\n"
 "  speed                : perform speed tests on the database\n"
 "  ! command            : execute system command\n"
 "  1 | first            : print the first record\n"
@@ -559,6 +562,23 @@ static void info_tdb(void)
 	}
 }
 
+static void rehash_tdb(const char *hashsize)
+{
+	unsigned long size = hashsize ? strtoul(hashsize, NULL, 0) : 0;
+
+	if (size == 0 || size > UINT32_MAX) {
+		terror("need a valid hash size");
+		return;
+	}
+
+	if (tdb_rehash(tdb, size) != 0) {
+		printf("Error = %s\n", tdb_errorstr(tdb));
+		return;
+	}
+
+	printf("hash size is now %d\n", tdb_hash_size(tdb));
+}
+
 static void speed_tdb(const char *tlimit)
 {
 	const char *str = "store test", *str2 = "transaction test";
@@ -748,6 +768,10 @@ static int do_command(void)
 			bIterate = 0;
 			tdb_repack(tdb);
 			return 0;
+		case CMD_REHASH:
+			bIterate = 0;
+			rehash_tdb(arg1);
+			return 0;
 		case CMD_TRANSACTION_CANCEL:
 			bIterate = 0;
 			tdb_transaction_cancel(tdb);
@@ -51,6 +51,82 @@ static bool test_tevent_req_create(struct torture_context *tctx,
 	return true;
 }
 
+struct post_state {
+	uint8_t dummy;
+};
+
+static void test_tevent_req_post_done(struct tevent_req *req)
+{
+	bool *done = tevent_req_callback_data(req, bool);
+	*done = true;
+}
+
+static void test_tevent_req_post_timer(struct tevent_context *ev,
+				       struct tevent_timer *te,
+				       struct timeval current_time,
+				       void *private_data)
+{
+	bool *fired = (bool *)private_data;
+	*fired = true;
+}
+
+static bool test_tevent_req_post(struct torture_context *tctx,
+				 const void *test_data)
+{
+	struct tevent_context *ev;
+	struct tevent_req *req;
+	struct post_state *state;
+	struct tevent_timer *te;
+	bool done = false;
+	bool fired = false;
+	bool ok;
+	int ret;
+
+	ev = samba_tevent_context_init(tctx);
+	torture_assert_not_null(tctx, ev, "samba_tevent_context_init failed\n");
+
+	/*
+	 * Without a callback tevent_req_post() must not schedule
+	 * anything, the result can be received right away. An
+	 * immediate event would run before the expired timer.
+	 */
+	req = tevent_req_create(tctx, &state, struct post_state);
+	torture_assert_not_null(tctx, req, "tevent_req_create failed\n");
+	tevent_req_done(req);
+	req = tevent_req_post(req, ev);
+
+	ok = tevent_req_is_in_progress(req);
+	torture_assert(tctx, !ok, "request still in progress\n");
+
+	te = tevent_add_timer(ev, ev, timeval_zero(),
+			      test_tevent_req_post_timer, &fired);
+	torture_assert_not_null(tctx, te, "tevent_add_timer failed\n");
+
+	ret = tevent_loop_once(ev);
+	torture_assert_int_equal(tctx, ret, 0, "tevent_loop_once failed\n");
+	torture_assert(tctx, fired, "immediate event was scheduled\n");
+	TALLOC_FREE(req);
+
+	/*
+	 * Setting the callback later still gets it called from the
+	 * event loop, but not before.
+	 */
+	req = tevent_req_create(tctx, &state, struct post_state);
+	torture_assert_not_null(tctx, req, "tevent_req_create failed\n");
+	tevent_req_done(req);
+	req = tevent_req_post(req, ev);
+	tevent_req_set_callback(req, test_tevent_req_post_done, &done);
+	torture_assert(tctx, !done, "callback called too early\n");
+
+	ret = tevent_loop_once(ev);
+	torture_assert_int_equal(tctx, ret, 0, "tevent_loop_once failed\n");
+	torture_assert(tctx, done, "callback not called\n");
+	TALLOC_FREE(req);
+
+	TALLOC_FREE(ev);
+	return true;
+}
+
 struct profile1_state {
 	uint8_t dummy;
 };
@@ -273,6 +349,11 @@ struct torture_suite *torture_local_tevent_req(TALLOC_CTX *mem_ctx)
 		"create",
 		test_tevent_req_create,
 		NULL);
+	torture_suite_add_simple_tcase_const(
+		suite,
+		"post",
+		test_tevent_req_post,
+		NULL);
 	torture_suite_add_simple_tcase_const(
 		suite,
 		"profile1",
@@ -1215,6 +1215,24 @@ void _tevent_req_oom(struct tevent_req *req,
  * }
  * @endcode
  *
+ * The immediate event is only scheduled once the caller sets a callback
+ * with tevent_req_set_callback(). A caller that finds the request already
+ * finished after the _send function returned can call the _recv function
+ * directly, this avoids the round trip through the event loop:
+ *
+ * @code
+ * subreq = computation_send(state, ev);
+ * if (tevent_req_nomem(subreq, req)) {
+ *     return tevent_req_post(req, ev);
+ * }
+ * if (!tevent_req_is_in_progress(subreq)) {
+ *     status = computation_recv(subreq);
+ *     TALLOC_FREE(subreq);
+ *     ...
+ * }
+ * tevent_req_set_callback(subreq, computation_done, req);
+ * @endcode
+ *
  * @param[in]  req      The finished request.
  *
  * @param[in]  ev       The tevent_context for the immediate event.
@@ -163,6 +163,17 @@ struct tevent_req {
 		 */
 		struct tevent_context *defer_callback_ev;
 
+		/**
+		 * @brief The event context given to tevent_req_post()
+		 *        before a callback was set.
+		 *
+		 * The immediate event is only scheduled once
+		 * tevent_req_set_callback() is called, callers
+		 * picking up a synchronous result with the _recv
+		 * function right away never need it.
+		 */
+		struct tevent_context *post_ev;
+
 		/**
 		 * @brief the timer event if tevent_req_set_endtime was used
 		 *
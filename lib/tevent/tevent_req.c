@@ -76,7 +76,7 @@ struct tevent_req *_tevent_req_create(TALLOC_CTX *mem_ctx,
 		return NULL;
 	}
 
-	req = talloc_pooled_object(
+	req = talloc_cached_pooled_object(
 		mem_ctx, struct tevent_req, 2,
 		sizeof(struct tevent_immediate) + data_size);
 	if (req == NULL) {
@@ -96,7 +96,7 @@ struct tevent_req *_tevent_req_create(TALLOC_CTX *mem_ctx,
 
 	/*
 	 * No need to check for req->internal.trigger!=NULL or
-	 * data!=NULL, this can't fail: talloc_pooled_object has
+	 * data!=NULL, this can't fail: talloc_cached_pooled_object has
 	 * already allocated sufficient memory.
 	 */
 
@@ -254,6 +254,17 @@ static void tevent_req_trigger(struct tevent_context *ev,
 struct tevent_req *tevent_req_post(struct tevent_req *req,
 				   struct tevent_context *ev)
 {
+	if (req->async.fn == NULL) {
+		/*
+		 * Nobody is waiting for a callback yet, the caller
+		 * might just want to pick up the result via the
+		 * _recv function. tevent_req_set_callback() will
+		 * schedule the trigger if needed.
+		 */
+		req->internal.post_ev = ev;
+		return req;
+	}
+
 	tevent_schedule_immediate(req->internal.trigger,
 				  ev, tevent_req_trigger, req);
 	return req;
@@ -356,8 +367,16 @@ void tevent_req_reset_endtime(struct tevent_req *req)
 
 void tevent_req_set_callback(struct tevent_req *req, tevent_req_fn fn, void *pvt)
 {
+	struct tevent_context *post_ev = req->internal.post_ev;
+
 	req->async.fn = fn;
 	req->async.private_data = pvt;
+
+	if ((post_ev != NULL) && (fn != NULL)) {
+		req->internal.post_ev = NULL;
+		tevent_schedule_immediate(req->internal.trigger,
+					  post_ev, tevent_req_trigger, req);
+	}
 }
 
 void *_tevent_req_callback_data(struct tevent_req *req)
@@ -47,6 +47,8 @@ enum memcache_number {
 	SHARE_MODE_LOCK_CACHE,	/* talloc */
 	VIRUSFILTER_SCAN_RESULTS_CACHE_TALLOC, /* talloc */
 	DFREE_CACHE,
+	DSDB_SEARCH_CACHE_TALLOC, /* talloc */
+	DSDB_ACLREAD_ACCESS_CACHE,
 };
 
 /*
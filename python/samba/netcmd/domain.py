@@ -98,6 +98,7 @@ from samba.provision.common import (
 
 from samba.netcmd.pso import cmd_domain_passwordsettings_pso
 from samba.netcmd.domain_backup import cmd_domain_backup
+from samba.netcmd.domain_backend import cmd_domain_convert_backend
 
 from samba.compat import binary_type
 from samba.compat import get_string
@@ -4397,3 +4398,4 @@ class cmd_domain(SuperCommand):
     subcommands["schemaupgrade"] = cmd_domain_schema_upgrade()
     subcommands["functionalprep"] = cmd_domain_functional_prep()
     subcommands["backup"] = cmd_domain_backup()
+    subcommands["convertbackend"] = cmd_domain_convert_backend()
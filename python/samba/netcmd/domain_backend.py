@@ -0,0 +1,283 @@
+# Unix SMB/CIFS implementation.
+#
+# Convert the sam.ldb partitions between backend stores
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+import os
+import tdb
+import ldb
+import samba.getopt as options
+from samba.netcmd import Command, Option, CommandError
+from samba.provision import DEFAULT_BACKEND_SIZE
+
+
+def store_url(store, path):
+    return "%s://%s" % (store, path)
+
+
+def remove_store_file(store, path):
+    """Remove a partition file and, for lmdb, its lock file"""
+    for name in [path, path + "-lock"]:
+        if (name == path or store == "mdb") and os.path.exists(name):
+            os.unlink(name)
+
+
+def converted_name(name, store):
+    """The file name of a partition converted to store.
+
+    The name must differ from that of the original, so that both files
+    exist while @PARTITION is switched over, and must end in .ldb.
+    """
+    stem = name
+    if stem.endswith(".ldb"):
+        stem = stem[:-len(".ldb")]
+    for suffix in [".tdb", ".mdb"]:
+        if stem.endswith(suffix):
+            stem = stem[:-len(suffix)]
+    return "%s.%s.ldb" % (stem, store)
+
+
+def copy_partition(src_store, src_path, dst_store, dst_path,
+                   replicate_entries, dst_options):
+    """Copy one partition into a new database using dst_store.
+
+    The GUID index settings of @INDEXLIST are written before the normal
+    records, so that they are stored under their GUID from the start
+    (lmdb limits keys to 511 bytes, which long DNs exceed).  The
+    attribute indexes are only added once all records are in, so that
+    they are built in a single re-index rather than one record at a
+    time.  Returns the number of records copied.
+    """
+    src = ldb.Ldb(url=store_url(src_store, src_path),
+                  flags=ldb.FLG_DONT_CREATE_DB,
+                  options=["modules:"])
+    dst = ldb.Ldb(url=store_url(dst_store, dst_path),
+                  options=["modules:"] + dst_options)
+
+    def copy_msg(msg):
+        new = ldb.Message(ldb.Dn(dst, str(msg.dn)))
+        for attr in msg:
+            if attr == "dn":
+                continue
+            new[attr] = ldb.MessageElement(list(msg[attr]),
+                                           ldb.FLAG_MOD_ADD,
+                                           attr)
+        dst.add(new)
+
+    def special(dn):
+        res = src.search(base=dn, scope=ldb.SCOPE_BASE, attrs=["*"])
+        if len(res) == 1:
+            return res[0]
+        return None
+
+    guid_index_attrs = ["@IDXGUID", "@IDX_DN_GUID"]
+
+    count = 0
+    dst.transaction_start()
+    try:
+        indexlist = special("@INDEXLIST")
+        if indexlist is not None and "@IDXGUID" in indexlist:
+            m = ldb.Message(ldb.Dn(dst, "@INDEXLIST"))
+            for attr in guid_index_attrs:
+                if attr in indexlist:
+                    m[attr] = ldb.MessageElement(list(indexlist[attr]),
+                                                 ldb.FLAG_MOD_ADD,
+                                                 attr)
+            dst.add(m)
+
+        for dn in replicate_entries:
+            if dn == "@INDEXLIST":
+                continue
+            msg = special(dn)
+            if msg is not None:
+                copy_msg(msg)
+
+        for msg in src.search_iterator(base="",
+                                       scope=ldb.SCOPE_SUBTREE,
+                                       expression="(distinguishedName=*)",
+                                       attrs=["*"]):
+            if not isinstance(msg, ldb.Message):
+                continue
+            copy_msg(msg)
+            count += 1
+
+        if indexlist is not None and "@IDXGUID" in indexlist:
+            m = ldb.Message(ldb.Dn(dst, "@INDEXLIST"))
+            for attr in indexlist:
+                if attr == "dn" or attr in guid_index_attrs:
+                    continue
+                m[attr] = ldb.MessageElement(list(indexlist[attr]),
+                                             ldb.FLAG_MOD_REPLACE,
+                                             attr)
+            if len(m) > 0:
+                dst.modify(m)
+        elif indexlist is not None:
+            copy_msg(indexlist)
+
+        # Keep the sequence number, as it is what the rest of the
+        # directory (and replication) uses to spot changes
+        msg = special("@BASEINFO")
+        if msg is not None and "sequenceNumber" in msg:
+            m = ldb.Message(ldb.Dn(dst, "@BASEINFO"))
+            for attr in ["sequenceNumber", "whenChanged"]:
+                if attr in msg:
+                    m[attr] = ldb.MessageElement(list(msg[attr]),
+                                                 ldb.FLAG_MOD_REPLACE,
+                                                 attr)
+            dst.modify(m)
+    except:
+        dst.transaction_cancel()
+        raise
+    dst.transaction_commit()
+
+    src_count = len(src.search(base="", scope=ldb.SCOPE_SUBTREE,
+                               expression="(distinguishedName=*)",
+                               attrs=["dn"]))
+    dst_count = len(dst.search(base="", scope=ldb.SCOPE_SUBTREE,
+                               expression="(distinguishedName=*)",
+                               attrs=["dn"]))
+    if src_count != dst_count:
+        raise CommandError("%s: copied %d records but found %d" %
+                           (src_path, src_count, dst_count))
+    return count
+
+
+class cmd_domain_convert_backend(Command):
+    """Convert the sam database partitions to another backend store.
+
+    This copies every partition of a local sam.ldb into a new file
+    using the requested backend store (tdb or mdb), named with a
+    ".<store>.ldb" suffix, and then switches the file names and the
+    backendStore in @PARTITION with a single modify.  The original files
+    are left in place.
+
+    Writers are blocked (via the metadata.tdb transaction lock) while
+    the copy runs.  As both sets of files exist when @PARTITION is
+    changed, every process either uses the old files with the old store
+    or the new files with the new one.  A running samba notices the
+    change on its next transaction or search and reopens the partitions,
+    so the DC does not need to be restarted.
+    """
+
+    synopsis = "%prog [options]"
+
+    takes_optiongroups = {
+        "sambaopts": options.SambaOptions,
+        "versionopts": options.VersionOptions,
+    }
+
+    takes_options = [
+        Option("-H", "--URL", help="LDB URL for the local sam.ldb",
+               type=str, metavar="URL", dest="H"),
+        Option("--backend-store", type="choice", metavar="BACKENDSTORE",
+               choices=["tdb", "mdb"], default="mdb",
+               help="The backend store to convert to, defaults to mdb"),
+        Option("--backend-store-size", type="bytes", metavar="SIZE",
+               help="Specify the size of the backend database, currently "
+                    "only supported by lmdb backends (default is 8 Gb)."),
+    ]
+
+    def run(self, H=None, backend_store="mdb", backend_store_size=None,
+            sambaopts=None, versionopts=None):
+        lp = sambaopts.get_loadparm()
+
+        if H is None:
+            url = lp.private_path("sam.ldb")
+        else:
+            url = H
+        if "://" in url:
+            (scheme, path) = url.split("://", 1)
+            if scheme not in ["tdb", "ldb"]:
+                raise CommandError("%s is not a local sam.ldb" % url)
+        else:
+            path = url
+        privatedir = os.path.dirname(path)
+
+        if backend_store_size is not None and backend_store != "mdb":
+            raise CommandError("--backend-store-size is only supported "
+                               "with --backend-store=mdb")
+        dst_options = []
+        if backend_store == "mdb":
+            size = backend_store_size or DEFAULT_BACKEND_SIZE
+            dst_options.append("lmdb_env_size:%d" % size)
+
+        samdb = ldb.Ldb(url=store_url("tdb", path),
+                        flags=ldb.FLG_DONT_CREATE_DB,
+                        options=["modules:"])
+        res = samdb.search(base="@PARTITION", scope=ldb.SCOPE_BASE,
+                           attrs=["partition", "backendStore",
+                                  "replicateEntries", "ldapBackend"])
+        if len(res) != 1:
+            raise CommandError("No @PARTITION record in %s" % path)
+        partitions = res[0]
+        if "ldapBackend" in partitions:
+            raise CommandError("Cannot convert a database with an "
+                               "LDAP backend")
+        old_store = str(partitions.get("backendStore", "tdb"))
+        if old_store == backend_store:
+            raise CommandError("The database already uses %s" %
+                               backend_store)
+        replicate_entries = [str(x) for x in
+                             partitions.get("replicateEntries", [])]
+
+        # Hold the metadata.tdb transaction lock, all writers (and
+        # partition reloads) take it first, so nothing changes under us
+        metadata = tdb.open(os.path.join(privatedir,
+                                         "sam.ldb.d", "metadata.tdb"))
+        metadata.transaction_start()
+        try:
+            files = []
+            for p in partitions["partition"]:
+                (dn, name) = str(p).rsplit(":", 1)
+                if not name.endswith(".ldb"):
+                    raise CommandError("No file name in partition "
+                                       "record %s" % p)
+                files.append((dn, name, converted_name(name,
+                                                       backend_store)))
+
+            try:
+                for (dn, name, new_name) in files:
+                    new = os.path.join(privatedir, new_name)
+                    remove_store_file(backend_store, new)
+                    count = copy_partition(old_store,
+                                           os.path.join(privatedir, name),
+                                           backend_store, new,
+                                           replicate_entries, dst_options)
+                    self.outf.write("Copied %d records of %s\n" %
+                                    (count, dn))
+
+                # Both sets of files exist, so @PARTITION is
+                # consistent before and after this single modify
+                m = ldb.Message(ldb.Dn(samdb, "@PARTITION"))
+                m["partition"] = ldb.MessageElement(
+                    ["%s:%s" % (dn, new_name)
+                     for (dn, name, new_name) in files],
+                    ldb.FLAG_MOD_REPLACE,
+                    "partition")
+                m["backendStore"] = ldb.MessageElement(backend_store,
+                                                       ldb.FLAG_MOD_REPLACE,
+                                                       "backendStore")
+                samdb.modify(m)
+            except:
+                for (dn, name, new_name) in files:
+                    remove_store_file(backend_store,
+                                      os.path.join(privatedir, new_name))
+                raise
+        finally:
+            metadata.transaction_cancel()
+
+        self.outf.write("Converted %d partitions from %s to %s, "
+                        "the original files are kept\n" %
+                        (len(files), old_store, backend_store))
@@ -952,9 +952,15 @@ class cmd_domain_backup_offline(samba.netcmd.Command):
         # 'backendStore' attribute on @PARTITION containing the text 'mdb'
         store_label = "backendStore"
         res = samdb.search(base="@PARTITION", scope=ldb.SCOPE_BASE,
-                           attrs=[store_label])
+                           attrs=[store_label, "partition"])
         mdb_backend = store_label in res[0] and str(res[0][store_label][0]) == 'mdb'
 
+        # Only the files @PARTITION points at are in the current store,
+        # "samba-tool domain convertbackend" leaves the originals behind
+        partition_files = set()
+        for p in res[0].get("partition", []):
+            partition_files.add(os.path.basename(str(p).rsplit(":", 1)[1]))
+
         sam_ldb_path = os.path.join(private_dir, 'sam.ldb')
         copy_function = None
         if mdb_backend:
@@ -970,8 +976,9 @@ class cmd_domain_backup_offline(samba.netcmd.Command):
         self.offline_tdb_copy(sam_ldb_path)
         sam_ldb_d = sam_ldb_path + '.d'
         for sam_file in os.listdir(sam_ldb_d):
+            in_store = sam_file in partition_files
             sam_file = os.path.join(sam_ldb_d, sam_file)
-            if sam_file.endswith('.ldb'):
+            if in_store or (sam_file.endswith('.ldb') and not partition_files):
                 logger.info('   backing up locked/related file ' + sam_file)
                 copy_function(sam_file)
             else:
@@ -1216,6 +1216,11 @@ schemaUpdateNow: 1
         '''return a new RID from the RID Pool on this DSA'''
         return dsdb._dsdb_allocate_rid(self)
 
+    def search_cache_stats(self):
+        '''return the counters of the search cache, or None if the
+        search_cache module is not loaded'''
+        return dsdb._dsdb_search_cache_stats(self)
+
     def normalize_dn_in_domain(self, dn):
         '''return a new DN expanded by adding the domain DN
 
@@ -679,6 +679,131 @@ class DsdbTests(TestCase):
 
         self.samdb.delete(kept_dn)
 
+    def search_description(self, samdb):
+        res = samdb.search(base=self.account_dn,
+                           scope=ldb.SCOPE_BASE,
+                           attrs=["description"])
+        self.assertEqual(len(res), 1)
+        return str(res[0]["description"][0])
+
+    def set_description(self, samdb, description):
+        m = ldb.Message()
+        m.dn = ldb.Dn(samdb, self.account_dn)
+        m["description"] = ldb.MessageElement(description,
+                                              ldb.FLAG_MOD_REPLACE,
+                                              "description")
+        samdb.modify(m)
+
+    def test_search_cache_sees_modify(self):
+        # The repeated search may be served by the search_cache
+        # module, which must notice writes from any connection
+        other = SamDB(session_info=self.session,
+                      credentials=self.creds,
+                      lp=self.lp)
+        self.assertEqual(self.search_description(self.samdb),
+                         "Test user for dsdb test")
+        self.assertEqual(self.search_description(self.samdb),
+                         "Test user for dsdb test")
+
+        self.set_description(other, "changed elsewhere")
+        self.assertEqual(self.search_description(self.samdb),
+                         "changed elsewhere")
+
+        self.set_description(self.samdb, "changed here")
+        self.assertEqual(self.search_description(self.samdb),
+                         "changed here")
+        self.assertEqual(self.search_description(other),
+                         "changed here")
+
+    def test_search_cache_transaction_cancel(self):
+        self.assertEqual(self.search_description(self.samdb),
+                         "Test user for dsdb test")
+        self.samdb.transaction_start()
+        self.set_description(self.samdb, "not committed")
+        self.assertEqual(self.search_description(self.samdb),
+                         "not committed")
+        self.samdb.transaction_cancel()
+        self.assertEqual(self.search_description(self.samdb),
+                         "Test user for dsdb test")
+
+    def search_last_logon(self, samdb):
+        res = samdb.search(base=self.account_dn,
+                           scope=ldb.SCOPE_BASE,
+                           attrs=["lastLogon"])
+        self.assertEqual(len(res), 1)
+        return int(res[0]["lastLogon"][0])
+
+    def set_last_logon(self, samdb, last_logon):
+        m = ldb.Message()
+        m.dn = ldb.Dn(samdb, self.account_dn)
+        m["lastLogon"] = ldb.MessageElement(str(last_logon),
+                                            ldb.FLAG_MOD_REPLACE,
+                                            "lastLogon")
+        samdb.modify(m)
+
+    def test_search_cache_sees_non_replicated_modify(self):
+        # lastLogon is not replicated, so changing it does not
+        # allocate a USN or move the sequence number
+        other = SamDB(session_info=self.session,
+                      credentials=self.creds,
+                      lp=self.lp)
+        self.set_last_logon(self.samdb, 1000)
+        res = self.samdb.search(base=self.account_dn,
+                                scope=ldb.SCOPE_BASE,
+                                attrs=["uSNChanged"])
+        usn = int(res[0]["uSNChanged"][0])
+
+        self.assertEqual(self.search_last_logon(self.samdb), 1000)
+        self.assertEqual(self.search_last_logon(self.samdb), 1000)
+
+        self.set_last_logon(other, 2000)
+        self.assertEqual(self.search_last_logon(self.samdb), 2000)
+
+        self.set_last_logon(self.samdb, 3000)
+        self.assertEqual(self.search_last_logon(self.samdb), 3000)
+        self.assertEqual(self.search_last_logon(other), 3000)
+
+        res = self.samdb.search(base=self.account_dn,
+                                scope=ldb.SCOPE_BASE,
+                                attrs=["uSNChanged"])
+        self.assertEqual(int(res[0]["uSNChanged"][0]), usn)
+
+    def test_search_cache_stats(self):
+        stats = self.samdb.search_cache_stats()
+        if stats is None or stats["max_size"] == 0:
+            self.skipTest("search cache is disabled")
+
+        self.search_description(self.samdb)
+        new_stats = self.samdb.search_cache_stats()
+        self.assertEqual(new_stats["misses"], stats["misses"] + 1)
+        self.assertEqual(new_stats["stores"], stats["stores"] + 1)
+        stats = new_stats
+
+        self.search_description(self.samdb)
+        new_stats = self.samdb.search_cache_stats()
+        self.assertEqual(new_stats["hits"], stats["hits"] + 1)
+        self.assertEqual(new_stats["misses"], stats["misses"])
+        stats = new_stats
+
+        # Any committed write invalidates the cache
+        self.set_last_logon(self.samdb, 4000)
+        self.search_description(self.samdb)
+        new_stats = self.samdb.search_cache_stats()
+        self.assertEqual(new_stats["invalidations"],
+                         stats["invalidations"] + 1)
+        self.assertEqual(new_stats["misses"], stats["misses"] + 1)
+        self.assertEqual(new_stats["hits"], stats["hits"])
+        stats = new_stats
+
+        # Constructed attributes may depend on the time
+        self.samdb.search(base=self.account_dn,
+                          scope=ldb.SCOPE_BASE,
+                          attrs=["msDS-User-Account-Control-Computed"])
+        new_stats = self.samdb.search_cache_stats()
+        self.assertEqual(new_stats["uncacheable"],
+                         stats["uncacheable"] + 1)
+        self.assertEqual(new_stats["stores"], stats["stores"])
+
     def test_normalize_dn_in_domain_full(self):
         domain_dn = self.samdb.domain_dn()
 
@@ -0,0 +1,155 @@
+# Unix SMB/CIFS implementation.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+from samba.tests.samba_tool.base import SambaToolCmdTest
+import ldb
+import os
+import shutil
+
+
+class ConvertBackendTestCase(SambaToolCmdTest):
+    """Test samba-tool domain convertbackend"""
+
+    def setUp(self):
+        super(ConvertBackendTestCase, self).setUp()
+        self.tempsambadir = os.path.join(self.tempdir, "samba")
+        os.mkdir(self.tempsambadir)
+        self.samdb_path = os.path.join(self.tempsambadir,
+                                       "private", "sam.ldb")
+
+    def provision(self, store):
+        command = (
+            "samba-tool " +
+            "domain provision " +
+            "--realm=foo.example.com " +
+            "--domain=FOO " +
+            ("--targetdir=%s " % self.tempsambadir) +
+            ("--backend-store=%s " % store) +
+            "--use-ntvfs"
+        )
+        (result, out, err) = self.run_command(command)
+        self.assertEqual(0, result, err)
+
+    def convert(self, store, extra=""):
+        return self.run_command(
+            "samba-tool domain convertbackend -H %s --backend-store=%s %s" %
+            (self.samdb_path, store, extra))
+
+    def backend_store(self):
+        samdb = ldb.Ldb(url=self.samdb_path,
+                        flags=ldb.FLG_DONT_CREATE_DB,
+                        options=["modules:"])
+        res = samdb.search(base="@PARTITION", scope=ldb.SCOPE_BASE,
+                           attrs=["backendStore"])
+        return str(res[0].get("backendStore", "tdb"))
+
+    def partition_files(self):
+        samdb = ldb.Ldb(url=self.samdb_path,
+                        flags=ldb.FLG_DONT_CREATE_DB,
+                        options=["modules:"])
+        res = samdb.search(base="@PARTITION", scope=ldb.SCOPE_BASE,
+                           attrs=["partition"])
+        files = {}
+        for p in res[0]["partition"]:
+            (dn, name) = str(p).rsplit(":", 1)
+            files[dn.lower()] = os.path.join(os.path.dirname(self.samdb_path),
+                                             name)
+        return files
+
+    def objects(self, samdb=None):
+        if samdb is None:
+            samdb = self.getSamDB("-H", self.samdb_path)
+        res = samdb.search(base=samdb.get_default_basedn(),
+                           scope=ldb.SCOPE_SUBTREE,
+                           expression="(objectClass=*)",
+                           attrs=["dn"])
+        return sorted(str(m.dn) for m in res)
+
+    def test_tdb_to_mdb_and_back(self):
+        self.provision("tdb")
+        before = self.objects()
+
+        (result, out, err) = self.convert("mdb", "--backend-store-size=64Mb")
+        self.assertEqual(0, result, err)
+        self.assertEqual(self.backend_store(), "mdb")
+        self.assertEqual(before, self.objects())
+
+        (result, out, err) = self.convert("mdb")
+        self.assertGreater(result, 0)
+        self.assertIn("already uses mdb", err)
+
+        (result, out, err) = self.convert("tdb")
+        self.assertEqual(0, result, err)
+        self.assertEqual(self.backend_store(), "tdb")
+        self.assertEqual(before, self.objects())
+
+    def test_convert_with_open_connection(self):
+        self.provision("tdb")
+        samdb = self.getSamDB("-H", self.samdb_path)
+        before = self.objects(samdb)
+        basedn = str(samdb.get_default_basedn())
+        old_files = self.partition_files()
+
+        (result, out, err) = self.convert("mdb", "--backend-store-size=64Mb")
+        self.assertEqual(0, result, err)
+        self.assertEqual(self.backend_store(), "mdb")
+
+        new_files = self.partition_files()
+        for dn in old_files:
+            self.assertNotEqual(old_files[dn], new_files[dn])
+            self.assertTrue(os.path.exists(old_files[dn]))
+            self.assertTrue(os.path.exists(new_files[dn]))
+
+        # The open connection switches to the converted partitions
+        self.assertEqual(before, self.objects(samdb))
+        ou = "OU=convert_test,%s" % basedn
+        samdb.add({"dn": ou, "objectclass": "organizationalUnit"})
+        self.assertIn(ou, self.objects())
+
+        # and no longer writes to the original files
+        old_domain = ldb.Ldb(url=old_files[basedn.lower()],
+                             flags=ldb.FLG_DONT_CREATE_DB,
+                             options=["modules:"])
+        res = old_domain.search(base=ou, scope=ldb.SCOPE_BASE,
+                                attrs=["dn"])
+        self.assertEqual(0, len(res))
+
+    def test_long_dn_to_mdb(self):
+        # lmdb keys are limited to 511 bytes, so the records have to
+        # be stored under their GUID from the start
+        self.provision("tdb")
+        samdb = self.getSamDB("-H", self.samdb_path)
+        dn = str(samdb.get_default_basedn())
+        for i in range(10):
+            dn = "OU=%s%d,%s" % ("x" * 60, i, dn)
+            samdb.add({"dn": dn, "objectclass": "organizationalUnit"})
+        self.assertGreater(len(dn), 511)
+        before = self.objects(samdb)
+
+        (result, out, err) = self.convert("mdb", "--backend-store-size=64Mb")
+        self.assertEqual(0, result, err)
+        self.assertEqual(self.backend_store(), "mdb")
+        self.assertEqual(before, self.objects())
+
+    def test_size_needs_mdb(self):
+        self.provision("mdb")
+        (result, out, err) = self.convert("tdb", "--backend-store-size=64Mb")
+        self.assertGreater(result, 0)
+        self.assertEqual(self.backend_store(), "mdb")
+
+    def tearDown(self):
+        super(ConvertBackendTestCase, self).tearDown()
+        shutil.rmtree(self.tempsambadir)
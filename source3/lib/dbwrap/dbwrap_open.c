@@ -124,6 +124,25 @@ struct db_context *db_open(TALLOC_CTX *mem_ctx,
 		if (require_mutex) {
 			tdb_flags |= TDB_MUTEX_LOCKING;
 		}
+
+		/*
+		 * Lockless reads need the mutex area, they are not
+		 * available for fcntl locked databases
+		 */
+		if (tdb_flags & TDB_MUTEX_LOCKING) {
+			bool try_lockless = true;
+
+			try_lockless = lp_parm_bool(-1,
+						    "dbwrap_tdb_lockless_reads",
+						    "*", try_lockless);
+			try_lockless = lp_parm_bool(-1,
+						    "dbwrap_tdb_lockless_reads",
+						    base, try_lockless);
+
+			if (try_lockless) {
+				tdb_flags |= TDB_LOCKLESS_READS;
+			}
+		}
 	}
 
 	if (lp_clustering()) {
@@ -828,6 +828,8 @@ struct dos_mode_at_state {
 };
 
 static void dos_mode_at_vfs_get_dosmode_done(struct tevent_req *subreq);
+static void dos_mode_at_vfs_get_dosmode_finish(struct tevent_req *req,
+					       struct tevent_req *subreq);
 
 struct tevent_req *dos_mode_at_send(TALLOC_CTX *mem_ctx,
 				    struct tevent_context *ev,
@@ -863,6 +865,15 @@ struct tevent_req *dos_mode_at_send(TALLOC_CTX *mem_ctx,
 	if (tevent_req_nomem(subreq, req)) {
 		return tevent_req_post(req, ev);
 	}
+	if (!tevent_req_is_in_progress(subreq)) {
+		/*
+		 * The VFS module answered right away (e.g. from a
+		 * cache), pick up the result without a round trip
+		 * through the event loop.
+		 */
+		dos_mode_at_vfs_get_dosmode_finish(req, subreq);
+		return tevent_req_post(req, ev);
+	}
 	tevent_req_set_callback(subreq, dos_mode_at_vfs_get_dosmode_done, req);
 
 	return req;
@@ -876,10 +887,6 @@ static void dos_mode_at_vfs_get_dosmode_done(struct tevent_req *subreq)
 	struct dos_mode_at_state *state =
 		tevent_req_data(req,
 		struct dos_mode_at_state);
-	char *path = NULL;
-	struct smb_filename *smb_path = NULL;
-	struct vfs_aio_state aio_state;
-	NTSTATUS status;
 	bool ok;
 
 	/*
@@ -888,6 +895,20 @@ static void dos_mode_at_vfs_get_dosmode_done(struct tevent_req *subreq)
 	ok = change_to_user_by_fsp(state->dir_fsp);
 	SMB_ASSERT(ok);
 
+	dos_mode_at_vfs_get_dosmode_finish(req, subreq);
+}
+
+static void dos_mode_at_vfs_get_dosmode_finish(struct tevent_req *req,
+					       struct tevent_req *subreq)
+{
+	struct dos_mode_at_state *state =
+		tevent_req_data(req,
+		struct dos_mode_at_state);
+	char *path = NULL;
+	struct smb_filename *smb_path = NULL;
+	struct vfs_aio_state aio_state;
+	NTSTATUS status;
+
 	status = SMB_VFS_GET_DOS_ATTRIBUTES_RECV(subreq,
 						 &aio_state,
 						 &state->dosmode);
@@ -293,28 +293,17 @@ void smb2_request_set_async_internal(struct smbd_smb2_request *req,
 
 static struct smbd_smb2_request *smbd_smb2_request_allocate(TALLOC_CTX *mem_ctx)
 {
-	TALLOC_CTX *mem_pool;
 	struct smbd_smb2_request *req;
 
-#if 0
-	/* Enable this to find subtle valgrind errors. */
-	mem_pool = talloc_init("smbd_smb2_request_allocate");
-#else
-	mem_pool = talloc_tos();
-#endif
-	if (mem_pool == NULL) {
-		return NULL;
-	}
-
-	req = talloc_zero(mem_pool, struct smbd_smb2_request);
+	/*
+	 * We allocate and free one of these for every request,
+	 * so let talloc recycle them via its object cache.
+	 */
+	req = talloc_cached_object(mem_ctx, struct smbd_smb2_request);
 	if (req == NULL) {
-		talloc_free(mem_pool);
 		return NULL;
 	}
-	talloc_reparent(mem_pool, mem_ctx, req);
-#if 0
-	TALLOC_FREE(mem_pool);
-#endif
+	ZERO_STRUCTP(req);
 
 	req->last_session_id = UINT64_MAX;
 	req->last_tid = UINT32_MAX;
@@ -1160,6 +1160,81 @@ static PyObject *py_dsdb_allocate_rid(PyObject *self, PyObject *args)
 	return PyInt_FromLong(rid);
 }
 
+/*
+  read the counters of the search_cache module
+ */
+static PyObject *py_dsdb_search_cache_stats(PyObject *self, PyObject *args)
+{
+	PyObject *py_ldb;
+	struct ldb_context *ldb;
+	TALLOC_CTX *tmp_ctx;
+	struct ldb_request *req = NULL;
+	struct ldb_result *res = NULL;
+	struct ldb_control *control = NULL;
+	struct dsdb_control_search_cache_stats *stats = NULL;
+	PyObject *py_stats;
+	int ret;
+
+	if (!PyArg_ParseTuple(args, "O", &py_ldb)) {
+		return NULL;
+	}
+
+	PyErr_LDB_OR_RAISE(py_ldb, ldb);
+
+	tmp_ctx = talloc_new(ldb);
+	if (tmp_ctx == NULL) {
+		return PyErr_NoMemory();
+	}
+
+	res = talloc_zero(tmp_ctx, struct ldb_result);
+	if (res == NULL) {
+		talloc_free(tmp_ctx);
+		return PyErr_NoMemory();
+	}
+
+	ret = ldb_build_search_req(&req, ldb, tmp_ctx,
+				   ldb_get_default_basedn(ldb),
+				   LDB_SCOPE_BASE, NULL, NULL, NULL,
+				   res, ldb_search_default_callback, NULL);
+	if (ret == LDB_SUCCESS) {
+		ret = ldb_request_add_control(req,
+					      DSDB_CONTROL_SEARCH_CACHE_STATS_OID,
+					      false, NULL);
+	}
+	if (ret == LDB_SUCCESS) {
+		ret = ldb_request(ldb, req);
+	}
+	if (ret == LDB_SUCCESS) {
+		ret = ldb_wait(req->handle, LDB_WAIT_ALL);
+	}
+	if (ret != LDB_SUCCESS) {
+		talloc_free(tmp_ctx);
+		PyErr_LDB_ERROR_IS_ERR_RAISE(py_ldb_get_exception(), ret, ldb);
+	}
+
+	control = ldb_controls_get_control(res->controls,
+					   DSDB_CONTROL_SEARCH_CACHE_STATS_OID);
+	if (control == NULL || control->data == NULL) {
+		talloc_free(tmp_ctx);
+		Py_RETURN_NONE;
+	}
+	stats = talloc_get_type_abort(control->data,
+				      struct dsdb_control_search_cache_stats);
+
+	py_stats = Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K}",
+				 "hits", (unsigned long long)stats->hits,
+				 "misses", (unsigned long long)stats->misses,
+				 "stores", (unsigned long long)stats->stores,
+				 "invalidations",
+				 (unsigned long long)stats->invalidations,
+				 "uncacheable",
+				 (unsigned long long)stats->uncacheable,
+				 "max_size",
+				 (unsigned long long)stats->max_size);
+	talloc_free(tmp_ctx);
+	return py_stats;
+}
+
 static PyObject *py_dns_delete_tombstones(PyObject *self, PyObject *args)
 {
 	PyObject *py_ldb;
@@ -1472,6 +1547,10 @@ static PyMethodDef py_dsdb_methods[] = {
 		"_dsdb_allocate_rid(samdb)"
 		" -> RID" },
 	{ "_dsdb_load_udv_v2", (PyCFunction)py_dsdb_load_udv_v2, METH_VARARGS, NULL },
+	{ "_dsdb_search_cache_stats", (PyCFunction)py_dsdb_search_cache_stats,
+		METH_VARARGS,
+		"_dsdb_search_cache_stats(samdb)"
+		" -> dict of the search_cache counters, or None" },
 	{ NULL }
 };
 
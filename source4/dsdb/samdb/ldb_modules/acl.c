@@ -2237,6 +2237,12 @@ static int acl_extended(struct ldb_module *module, struct ldb_request *req)
 		return ldb_next_request(module, req);
 	}
 
+	/* and the write generation, used by search_cache */
+	if (strcmp(req->op.extended.oid,
+		   DSDB_EXTENDED_WRITE_GENERATION_OID) == 0) {
+		return ldb_next_request(module, req);
+	}
+
 	if (dsdb_module_am_system(module) ||
 	    dsdb_module_am_administrator(module) || as_system) {
 		return ldb_next_request(module, req);
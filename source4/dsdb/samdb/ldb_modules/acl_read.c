@@ -37,6 +37,19 @@
 #include "librpc/gen_ndr/ndr_security.h"
 #include "param/param.h"
 #include "dsdb/samdb/ldb_modules/util.h"
+#include "lib/util/memcache.h"
+#include "lib/util/dlinklist.h"
+
+/*
+ * Most objects in a container share a handful of inherited
+ * descriptors, so keep the parsed form of the recent ones, and the
+ * result of each access check against them for the current token.
+ *
+ * A parsed SD is made of many small talloc chunks, so the SD cache
+ * is bounded by the number of entries rather than by size.
+ */
+#define ACLREAD_SD_CACHE_ENTRIES 64
+#define ACLREAD_ACCESS_CACHE_SIZE (1024 * 1024)
 
 struct aclread_context {
 	struct ldb_module *module;
@@ -53,14 +66,51 @@ struct aclread_context {
 	/* cache on the last parent we checked in this search */
 	struct ldb_dn *last_parent_dn;
 	int last_parent_check_ret;
+
+	/* the cached SD of the entry being checked */
+	uint64_t sd_id;
+	bool sd_has_self;
 };
 
 struct aclread_private {
 	bool enabled;
 
-	/* cache of the last SD we read during any search */
-	struct security_descriptor *sd_cached;
-	struct ldb_val sd_cached_blob;
+	/*
+	 * The recently parsed SDs and their binary nTSecurityDescriptor,
+	 * most recently used first
+	 */
+	struct aclread_sd_cache_entry *sd_cache;
+	unsigned int sd_cache_num;
+	uint64_t sd_id_next;
+
+	/*
+	 * Results of acl_check_access_on_attribute() keyed by
+	 * struct aclread_access_cache_key, valid for cache_sids only
+	 */
+	struct memcache *access_cache;
+	struct dom_sid *cache_sids;
+	uint32_t cache_num_sids;
+	uint64_t cache_privilege_mask;
+	uint32_t cache_rights_mask;
+};
+
+struct aclread_sd_cache_entry {
+	struct aclread_sd_cache_entry *prev, *next;
+	DATA_BLOB blob;
+	struct security_descriptor *sd;
+	uint64_t id;
+	bool has_self;
+};
+
+struct aclread_access_cache_key {
+	uint64_t sd_id;
+	struct GUID class_guid;
+	struct GUID attr_guid;
+	struct GUID security_guid;
+	uint32_t access_mask;
+	uint32_t have_sid;
+	/* Only num_auths sub_auths are set, the rest stay zero */
+	struct dom_sid sid;
 };
 
 static void aclread_mark_inaccesslible(struct ldb_message_element *el) {
@@ -152,6 +202,27 @@ static int aclread_check_parent(struct aclread_context *ac,
 	return ret;
 }
 
+/*
+ * Does the DACL mention PRINCIPAL_SELF?  Only then does the result of
+ * an access check depend on the objectSid of the object.
+ */
+static bool aclread_sd_has_self(const struct security_descriptor *sd)
+{
+	struct dom_sid self_sid;
+	uint32_t i;
+
+	if (sd->dacl == NULL) {
+		return false;
+	}
+	dom_sid_parse(SID_NT_SELF, &self_sid);
+	for (i = 0; i < sd->dacl->num_aces; i++) {
+		if (dom_sid_equal(&sd->dacl->aces[i].trustee, &self_sid)) {
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
  * The sd returned from this function is valid until the next call on
  * this module context
@@ -169,6 +240,8 @@ static int aclread_get_sd_from_ldb_message(struct aclread_context *ac,
 	struct aclread_private *private_data
 		= talloc_get_type(ldb_module_get_private(ac->module),
 				  struct aclread_private);
+	struct aclread_sd_cache_entry *entry = NULL;
+	DATA_BLOB sd_blob;
 	enum ndr_err_code ndr_err;
 
 	sd_element = ldb_msg_find_element(acl_res, "nTSecurityDescriptor");
@@ -180,49 +253,195 @@ static int aclread_get_sd_from_ldb_message(struct aclread_context *ac,
 	if (sd_element->num_values != 1) {
 		return ldb_operr(ldb);
 	}
+	sd_blob = data_blob_const(sd_element->values[0].data,
+				  sd_element->values[0].length);
 
 	/*
 	 * The time spent in ndr_pull_security_descriptor() is quite
-	 * expensive, so we check if this is the same binary blob as last
-	 * time, and if so return the memory tree from that previous parse.
+	 * expensive, so we check if we have seen the same binary blob
+	 * recently, and if so return the memory tree from that
+	 * previous parse.
 	 */
-
-	if (private_data->sd_cached != NULL &&
-	    private_data->sd_cached_blob.data != NULL &&
-	    ldb_val_equal_exact(&sd_element->values[0],
-				&private_data->sd_cached_blob)) {
-		*sd = private_data->sd_cached;
+	for (entry = private_data->sd_cache;
+	     entry != NULL;
+	     entry = entry->next) {
+		if (data_blob_cmp(&entry->blob, &sd_blob) == 0) {
+			break;
+		}
+	}
+	if (entry != NULL) {
+		DLIST_PROMOTE(private_data->sd_cache, entry);
+		*sd = entry->sd;
+		ac->sd_id = entry->id;
+		ac->sd_has_self = entry->has_self;
 		return LDB_SUCCESS;
 	}
 
-	*sd = talloc(private_data, struct security_descriptor);
-	if(!*sd) {
+	entry = talloc_zero(private_data, struct aclread_sd_cache_entry);
+	if (entry == NULL) {
 		return ldb_oom(ldb);
 	}
-	ndr_err = ndr_pull_struct_blob(&sd_element->values[0], *sd, *sd,
+	entry->blob = data_blob_talloc(entry, sd_blob.data, sd_blob.length);
+	if (entry->blob.data == NULL) {
+		TALLOC_FREE(entry);
+		return ldb_oom(ldb);
+	}
+	entry->sd = talloc(entry, struct security_descriptor);
+	if (entry->sd == NULL) {
+		TALLOC_FREE(entry);
+		return ldb_oom(ldb);
+	}
+	ndr_err = ndr_pull_struct_blob(&sd_blob, entry->sd, entry->sd,
 			     (ndr_pull_flags_fn_t)ndr_pull_security_descriptor);
 
 	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
-		TALLOC_FREE(*sd);
+		TALLOC_FREE(entry);
 		return ldb_operr(ldb);
 	}
+	entry->id = ++private_data->sd_id_next;
+	entry->has_self = aclread_sd_has_self(entry->sd);
 
-	talloc_unlink(private_data, private_data->sd_cached_blob.data);
-	if (ac->added_nTSecurityDescriptor) {
-		private_data->sd_cached_blob = sd_element->values[0];
-		talloc_steal(private_data, sd_element->values[0].data);
-	} else {
-		private_data->sd_cached_blob = ldb_val_dup(private_data,
-							   &sd_element->values[0]);
-		if (private_data->sd_cached_blob.data == NULL) {
-			TALLOC_FREE(*sd);
-			return ldb_operr(ldb);
+	*sd = entry->sd;
+	ac->sd_id = entry->id;
+	ac->sd_has_self = entry->has_self;
+
+	/*
+	 * The least recently used SD is dropped, the returned sd stays
+	 * valid until the next SD is added
+	 */
+	if (private_data->sd_cache_num == ACLREAD_SD_CACHE_ENTRIES) {
+		struct aclread_sd_cache_entry *last =
+			DLIST_TAIL(private_data->sd_cache);
+
+		DLIST_REMOVE(private_data->sd_cache, last);
+		TALLOC_FREE(last);
+		private_data->sd_cache_num -= 1;
+	}
+	DLIST_ADD(private_data->sd_cache, entry);
+	private_data->sd_cache_num += 1;
+
+	return LDB_SUCCESS;
+}
+
+/*
+ * acl_check_access_on_attribute() for the SD last returned by
+ * aclread_get_sd_from_ldb_message(), remembering the answer.
+ *
+ * The result only depends on the SD, the token, the access mask, the
+ * GUIDs of the class and attribute and (with PRINCIPAL_SELF ACEs) on
+ * the objectSid, so objects sharing an inherited SD share the
+ * results.
+ */
+static int aclread_check_access_on_attribute(struct aclread_context *ac,
+					     TALLOC_CTX *mem_ctx,
+					     struct security_descriptor *sd,
+					     struct dom_sid *sid,
+					     uint32_t access_mask,
+					     const struct dsdb_attribute *attr,
+					     const struct dsdb_class *objectclass)
+{
+	struct aclread_private *private_data
+		= talloc_get_type(ldb_module_get_private(ac->module),
+				  struct aclread_private);
+	struct aclread_access_cache_key key;
+	DATA_BLOB key_blob = data_blob_const(&key, sizeof(key));
+	DATA_BLOB value;
+	int ret;
+
+	if (private_data->access_cache == NULL || ac->sd_id == 0) {
+		return acl_check_access_on_attribute(ac->module, mem_ctx, sd,
+						     sid, access_mask, attr,
+						     objectclass);
+	}
+
+	ZERO_STRUCT(key);
+	key.sd_id = ac->sd_id;
+	key.class_guid = objectclass->schemaIDGUID;
+	key.attr_guid = attr->schemaIDGUID;
+	key.security_guid = attr->attributeSecurityGUID;
+	key.access_mask = access_mask;
+	if (ac->sd_has_self && sid != NULL) {
+		int i;
+
+		key.have_sid = 1;
+		key.sid.sid_rev_num = sid->sid_rev_num;
+		key.sid.num_auths = MIN(sid->num_auths,
+					ARRAY_SIZE(key.sid.sub_auths));
+		memcpy(key.sid.id_auth, sid->id_auth, sizeof(key.sid.id_auth));
+		for (i = 0; i < key.sid.num_auths; i++) {
+			key.sid.sub_auths[i] = sid->sub_auths[i];
+		}
+	}
+
+	if (memcache_lookup(private_data->access_cache,
+			    DSDB_ACLREAD_ACCESS_CACHE,
+			    key_blob, &value) &&
+	    value.length == sizeof(ret)) {
+		memcpy(&ret, value.data, sizeof(ret));
+		return ret;
+	}
+
+	ret = acl_check_access_on_attribute(ac->module, mem_ctx, sd, sid,
+					    access_mask, attr, objectclass);
+	if (ret == LDB_SUCCESS || ret == LDB_ERR_INSUFFICIENT_ACCESS_RIGHTS) {
+		memcache_add(private_data->access_cache,
+			     DSDB_ACLREAD_ACCESS_CACHE,
+			     key_blob,
+			     data_blob_const(&ret, sizeof(ret)));
+	}
+	return ret;
+}
+
+/*
+ * The access check results are only valid for the token they were
+ * made with, so drop them if the session has changed.
+ */
+static int aclread_check_cache_token(struct ldb_module *module,
+				     struct aclread_private *private_data)
+{
+	struct security_token *token = acl_user_token(module);
+
+	if (private_data->access_cache == NULL) {
+		return LDB_SUCCESS;
+	}
+
+	if (token != NULL &&
+	    private_data->cache_sids != NULL &&
+	    token->num_sids == private_data->cache_num_sids &&
+	    token->privilege_mask == private_data->cache_privilege_mask &&
+	    token->rights_mask == private_data->cache_rights_mask) {
+		uint32_t i;
+
+		/* Unused sub_auths are not compared */
+		for (i = 0; i < token->num_sids; i++) {
+			if (!dom_sid_equal(&token->sids[i],
+					   &private_data->cache_sids[i])) {
+				break;
+			}
+		}
+		if (i == token->num_sids) {
+			return LDB_SUCCESS;
 		}
 	}
 
-	talloc_unlink(private_data, private_data->sd_cached);
-	private_data->sd_cached = *sd;
+	memcache_flush(private_data->access_cache, DSDB_ACLREAD_ACCESS_CACHE);
+	TALLOC_FREE(private_data->cache_sids);
+	private_data->cache_num_sids = 0;
+	private_data->cache_privilege_mask = 0;
+	private_data->cache_rights_mask = 0;
 
+	if (token == NULL) {
+		return LDB_SUCCESS;
+	}
+
+	private_data->cache_sids = talloc_memdup(private_data, token->sids,
+				sizeof(struct dom_sid) * token->num_sids);
+	if (private_data->cache_sids == NULL && token->num_sids != 0) {
+		return ldb_module_oom(module);
+	}
+	private_data->cache_num_sids = token->num_sids;
+	private_data->cache_privilege_mask = token->privilege_mask;
+	private_data->cache_rights_mask = token->rights_mask;
 	return LDB_SUCCESS;
 }
 
@@ -576,13 +795,13 @@ static int aclread_callback(struct ldb_request *req, struct ldb_reply *ares)
 				continue;
 			}
 
-			ret = acl_check_access_on_attribute(ac->module,
-							    tmp_ctx,
-							    sd,
-							    sid,
-							    access_mask,
-							    attr,
-							    objectclass);
+			ret = aclread_check_access_on_attribute(ac,
+								tmp_ctx,
+								sd,
+								sid,
+								access_mask,
+								attr,
+								objectclass);
 
 			/*
 			 * Dirsync control needs the replpropertymetadata attribute
@@ -747,6 +966,11 @@ static int aclread_search(struct ldb_module *module, struct ldb_request *req)
 		return ldb_next_request(module, req);
 	}
 
+	ret = aclread_check_cache_token(module, p);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
 	/* check accessibility of base */
 	if (!ldb_dn_is_null(req->op.search.base)) {
 		ret = dsdb_module_search_dn(module, req, &res, req->op.search.base,
@@ -874,6 +1098,10 @@ static int aclread_init(struct ldb_module *module)
 		return ldb_module_oom(module);
 	}
 	p->enabled = lpcfg_parm_bool(ldb_get_opaque(ldb, "loadparm"), NULL, "acl", "search", true);
+	p->access_cache = memcache_init(p, ACLREAD_ACCESS_CACHE_SIZE);
+	if (p->access_cache == NULL) {
+		return ldb_module_oom(module);
+	}
 	ldb_module_set_private(module, p);
 	return ldb_next_init(module);
 }
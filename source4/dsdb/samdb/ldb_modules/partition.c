@@ -697,6 +697,10 @@ static int partition_replicate(struct ldb_module *module, struct ldb_request *re
 	struct partition_private_data *data = talloc_get_type(ldb_module_get_private(module),
 							      struct partition_private_data);
 
+	if (data && data->metadata) {
+		data->metadata->modified = true;
+	}
+
 	/* if we aren't initialised yet go further */
 	if (!data || !data->partitions) {
 		return ldb_next_request(module, req);
@@ -1125,6 +1129,13 @@ int partition_prepare_commit(struct ldb_module *module)
 							      struct partition_private_data);
 	int ret;
 
+	if (data && data->metadata && data->metadata->modified) {
+		ret = partition_metadata_inc_write_generation(module);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	}
+
 	/*
 	 * Order of prepare_commit calls must match that in
 	 * partition_start_trans. See comment in that function for detail.
@@ -1435,6 +1446,40 @@ static int partition_sequence_number(struct ldb_module *module, struct ldb_reque
 	return ldb_module_done(req, NULL, ext, LDB_SUCCESS);
 }
 
+/*
+ * The count of committed write transactions, see
+ * partition_metadata_inc_write_generation()
+ */
+static int partition_write_generation(struct ldb_module *module, struct ldb_request *req)
+{
+	struct ldb_extended *ext;
+	struct dsdb_extended_write_generation *gen;
+	uint64_t generation;
+	int ret;
+
+	ret = partition_metadata_write_generation(module, &generation);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	ext = talloc_zero(req, struct ldb_extended);
+	if (!ext) {
+		return ldb_module_oom(module);
+	}
+	gen = talloc_zero(ext, struct dsdb_extended_write_generation);
+	if (gen == NULL) {
+		talloc_free(ext);
+		return ldb_module_oom(module);
+	}
+	ext->oid = DSDB_EXTENDED_WRITE_GENERATION_OID;
+	ext->data = gen;
+
+	gen->generation = generation;
+
+	/* send request done */
+	return ldb_module_done(req, NULL, ext, LDB_SUCCESS);
+}
+
 /* lock all the backends */
 int partition_read_lock(struct ldb_module *module)
 {
@@ -1677,6 +1722,10 @@ static int partition_extended(struct ldb_module *module, struct ldb_request *req
 		return partition_sequence_number(module, req);
 	}
 
+	if (strcmp(req->op.extended.oid, DSDB_EXTENDED_WRITE_GENERATION_OID) == 0) {
+		return partition_write_generation(module, req);
+	}
+
 	if (strcmp(req->op.extended.oid, DSDB_EXTENDED_CREATE_PARTITION_OID) == 0) {
 		return partition_create(module, req);
 	}
@@ -44,6 +44,8 @@ struct partition_metadata {
 	struct tdb_wrap *db;
 	int in_transaction;
 	int read_lock_count;
+	/* a write was sent to a backend in this transaction */
+	bool modified;
 };
 
 struct partition_private_data {
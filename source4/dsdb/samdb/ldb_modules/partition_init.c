@@ -198,16 +198,77 @@ static const char **find_modules_for_dn(struct partition_private_data *data, str
 	}
 }
 
+/*
+ * Connect to the backend database of a partition and load the module
+ * chain for it, returning the 'partition_next' module that
+ * ldb_next_request() in partition.c is called on
+ */
+static int partition_connect_backend(struct ldb_context *ldb,
+				     struct partition_private_data *data,
+				     TALLOC_CTX *mem_ctx,
+				     struct ldb_dn *dn,
+				     const char *backend_url,
+				     struct ldb_module **_module)
+{
+	struct ldb_module *backend_module;
+	struct ldb_module *module_chain;
+	struct ldb_module *module;
+	const char **modules;
+	const char **options = NULL;
+	int ret;
+
+	options = ldb_options_get(ldb);
+	ret = ldb_module_connect_backend(
+	    ldb, backend_url, options, &backend_module);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	modules = find_modules_for_dn(data, dn);
+
+	if (!modules) {
+		DEBUG(0, ("Unable to load partition modules for new DN %s, perhaps you need to reprovision?  See partition-upgrade.txt for instructions\n", ldb_dn_get_linearized(dn)));
+		talloc_free(backend_module);
+		return LDB_ERR_CONSTRAINT_VIOLATION;
+	}
+	ret = ldb_module_load_list(ldb, modules, backend_module, &module_chain);
+	if (ret != LDB_SUCCESS) {
+		ldb_asprintf_errstring(ldb, 
+				       "partition_init: "
+				       "loading backend for %s failed: %s", 
+				       ldb_dn_get_linearized(dn), ldb_errstring(ldb));
+		talloc_free(backend_module);
+		return ret;
+	}
+	ret = ldb_module_init_chain(ldb, module_chain);
+	if (ret != LDB_SUCCESS) {
+		ldb_asprintf_errstring(ldb,
+				       "partition_init: "
+				       "initialising backend for %s failed: %s", 
+				       ldb_dn_get_linearized(dn), ldb_errstring(ldb));
+		talloc_free(backend_module);
+		return ret;
+	}
+
+	/* This weirdness allows us to use ldb_next_request() in partition.c */
+	module = ldb_module_new(mem_ctx, ldb, "partition_next", NULL);
+	if (!module) {
+		talloc_free(backend_module);
+		return ldb_oom(ldb);
+	}
+	talloc_steal(module, backend_module);
+	ldb_module_set_next(module, talloc_steal(module, module_chain));
+
+	*_module = module;
+	return LDB_SUCCESS;
+}
+
 static int new_partition_from_dn(struct ldb_context *ldb, struct partition_private_data *data, 
 				 TALLOC_CTX *mem_ctx, 
 				 struct ldb_dn *dn, const char *filename,
 				 const char *backend_db_store,
 				 struct dsdb_partition **partition) {
 	struct dsdb_control_current_partition *ctrl;
-	struct ldb_module *backend_module;
-	struct ldb_module *module_chain;
-	const char **modules;
-	const char **options = NULL;
 	int ret;
 
 	(*partition) = talloc_zero(mem_ctx, struct dsdb_partition);
@@ -257,49 +318,15 @@ static int new_partition_from_dn(struct ldb_context *ldb, struct partition_priva
 
 	ctrl->version = DSDB_CONTROL_CURRENT_PARTITION_VERSION;
 	ctrl->dn = talloc_steal(ctrl, dn);
-	
-	options = ldb_options_get(ldb);
-	ret = ldb_module_connect_backend(
-	    ldb, (*partition)->backend_url, options, &backend_module);
-	if (ret != LDB_SUCCESS) {
-		return ret;
-	}
-	talloc_steal((*partition), backend_module);
-
-	modules = find_modules_for_dn(data, dn);
 
-	if (!modules) {
-		DEBUG(0, ("Unable to load partition modules for new DN %s, perhaps you need to reprovision?  See partition-upgrade.txt for instructions\n", ldb_dn_get_linearized(dn)));
-		talloc_free(*partition);
-		return LDB_ERR_CONSTRAINT_VIOLATION;
-	}
-	ret = ldb_module_load_list(ldb, modules, backend_module, &module_chain);
+	ret = partition_connect_backend(ldb, data, *partition, dn,
+					(*partition)->backend_url,
+					&(*partition)->module);
 	if (ret != LDB_SUCCESS) {
-		ldb_asprintf_errstring(ldb, 
-				       "partition_init: "
-				       "loading backend for %s failed: %s", 
-				       ldb_dn_get_linearized(dn), ldb_errstring(ldb));
-		talloc_free(*partition);
-		return ret;
-	}
-	ret = ldb_module_init_chain(ldb, module_chain);
-	if (ret != LDB_SUCCESS) {
-		ldb_asprintf_errstring(ldb,
-				       "partition_init: "
-				       "initialising backend for %s failed: %s", 
-				       ldb_dn_get_linearized(dn), ldb_errstring(ldb));
 		talloc_free(*partition);
 		return ret;
 	}
 
-	/* This weirdness allows us to use ldb_next_request() in partition.c */
-	(*partition)->module = ldb_module_new(*partition, ldb, "partition_next", NULL);
-	if (!(*partition)->module) {
-		talloc_free(*partition);
-		return ldb_oom(ldb);
-	}
-	ldb_module_set_next((*partition)->module, talloc_steal((*partition)->module, module_chain));
-
 	/* if we were in a transaction then we need to start a
 	   transaction on this new partition, otherwise we'll get a
 	   transaction mismatch when we end the transaction */
@@ -379,6 +406,204 @@ static int add_partition_to_data(struct ldb_context *ldb, struct partition_priva
 	return LDB_SUCCESS;
 }
 
+/*
+ * The backend URL a partition should use after @PARTITION has changed
+ * to give it the record 'record' and the store 'backend_db_store'.
+ * Sets *url to NULL if 'record' is not for this partition.
+ */
+static int partition_new_backend_url(struct ldb_context *ldb,
+				     TALLOC_CTX *mem_ctx,
+				     struct dsdb_partition *partition,
+				     const DATA_BLOB *record,
+				     const char *backend_db_store,
+				     const char **url)
+{
+	DATA_BLOB dn_blob = *record;
+	const char *filename = NULL;
+	const char *path = NULL;
+	struct ldb_dn *dn = NULL;
+
+	*url = NULL;
+
+	if (dn_blob.length > 4 &&
+	    (strncmp((const char *)&dn_blob.data[dn_blob.length-4], ".ldb", 4) == 0)) {
+		/* Look for DN:filename.ldb */
+		char *p = strrchr((const char *)dn_blob.data, ':');
+		if (p == NULL) {
+			return LDB_SUCCESS;
+		}
+		filename = p+1;
+		dn_blob.length = ((uint8_t *)p - dn_blob.data);
+	}
+
+	dn = ldb_dn_from_ldb_val(mem_ctx, ldb, &dn_blob);
+	if (dn == NULL || ldb_dn_compare(dn, partition->ctrl->dn) != 0) {
+		return LDB_SUCCESS;
+	}
+
+	if (filename != NULL) {
+		path = ldb_relative_path(ldb, mem_ctx, filename);
+		if (path == NULL) {
+			return ldb_oom(ldb);
+		}
+	} else {
+		/* The file name comes from the DN, so has not changed */
+		path = strstr(partition->backend_url, "://");
+		if (path == NULL) {
+			return LDB_SUCCESS;
+		}
+		path += 3;
+	}
+
+	*url = talloc_asprintf(mem_ctx, "%s://%s", backend_db_store, path);
+	if (*url == NULL) {
+		return ldb_oom(ldb);
+	}
+	return LDB_SUCCESS;
+}
+
+/*
+ * Have the file or backend store (tdb or mdb) of any open partition
+ * changed in @PARTITION?
+ */
+static bool partition_backends_changed(struct partition_private_data *data,
+				       struct ldb_message_element *partition_attributes,
+				       const char *backend_db_store)
+{
+	size_t len = strlen(backend_db_store);
+	unsigned int i, j;
+
+	if (data->ldapBackend != NULL || partition_attributes == NULL) {
+		return false;
+	}
+
+	for (i=0; data->partitions && data->partitions[i]; i++) {
+		struct dsdb_partition *partition = data->partitions[i];
+		bool found = false;
+
+		if (strncmp(partition->backend_url, backend_db_store, len) != 0 ||
+		    strncmp(partition->backend_url + len, "://", 3) != 0) {
+			return true;
+		}
+
+		for (j=0; j < partition_attributes->num_values; j++) {
+			if (data_blob_cmp(&partition->orig_record,
+					  &partition_attributes->values[j]) == 0) {
+				found = true;
+				break;
+			}
+		}
+		if (!found) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * The partitions were converted to another backend store (with
+ * 'samba-tool domain convertbackend') while we had them open.  The
+ * converted copies have new file names, so @PARTITION was switched to
+ * them in a single modify, and the old files are left in place.
+ * Connect to the new files.
+ *
+ * All the new backends are connected before any partition is
+ * switched over, so a failure leaves the old ones in use.  This is
+ * only called when no transaction or read lock is held, so there is
+ * no request in progress on the old module chains and they are freed,
+ * closing the old files.
+ */
+static int partition_reopen_backends(struct ldb_context *ldb,
+				     struct partition_private_data *data,
+				     struct ldb_message_element *partition_attributes,
+				     const char *backend_db_store)
+{
+	TALLOC_CTX *mem_ctx = NULL;
+	struct ldb_module **modules = NULL;
+	const char **urls = NULL;
+	DATA_BLOB *records = NULL;
+	unsigned int i, j, count;
+	int ret;
+
+	for (count=0; data->partitions && data->partitions[count]; count++) {
+		/* noop */
+	}
+
+	mem_ctx = talloc_new(data);
+	if (mem_ctx == NULL) {
+		return ldb_oom(ldb);
+	}
+	modules = talloc_zero_array(mem_ctx, struct ldb_module *, count);
+	urls = talloc_zero_array(mem_ctx, const char *, count);
+	records = talloc_zero_array(mem_ctx, DATA_BLOB, count);
+	if (modules == NULL || urls == NULL || records == NULL) {
+		talloc_free(mem_ctx);
+		return ldb_oom(ldb);
+	}
+
+	for (i=0; i < count; i++) {
+		struct dsdb_partition *partition = data->partitions[i];
+
+		for (j=0; j < partition_attributes->num_values; j++) {
+			ret = partition_new_backend_url(
+				ldb, mem_ctx, partition,
+				&partition_attributes->values[j],
+				backend_db_store, &urls[i]);
+			if (ret != LDB_SUCCESS) {
+				talloc_free(mem_ctx);
+				return ret;
+			}
+			if (urls[i] != NULL) {
+				records[i] = data_blob_talloc(
+					mem_ctx,
+					partition_attributes->values[j].data,
+					partition_attributes->values[j].length);
+				break;
+			}
+		}
+		if (urls[i] == NULL ||
+		    strcmp(urls[i], partition->backend_url) == 0) {
+			continue;
+		}
+
+		ret = partition_connect_backend(ldb, data, mem_ctx,
+						partition->ctrl->dn, urls[i],
+						&modules[i]);
+		if (ret != LDB_SUCCESS) {
+			ldb_asprintf_errstring(ldb,
+					       "partition: unable to reopen "
+					       "%s as %s: %s",
+					       ldb_dn_get_linearized(
+						       partition->ctrl->dn),
+					       urls[i],
+					       ldb_errstring(ldb));
+			talloc_free(mem_ctx);
+			return ret;
+		}
+	}
+
+	for (i=0; i < count; i++) {
+		struct dsdb_partition *partition = data->partitions[i];
+
+		if (records[i].data != NULL) {
+			partition->orig_record = records[i];
+			talloc_steal(partition, records[i].data);
+		}
+		if (modules[i] == NULL) {
+			continue;
+		}
+		DEBUG(1, ("partition: switching %s from %s to %s\n",
+			  ldb_dn_get_linearized(partition->ctrl->dn),
+			  partition->backend_url, urls[i]));
+		talloc_free(partition->module);
+		partition->module = talloc_steal(partition, modules[i]);
+		partition->backend_url = talloc_steal(partition, urls[i]);
+	}
+
+	talloc_free(mem_ctx);
+	return LDB_SUCCESS;
+}
+
 int partition_reload_if_required(struct ldb_module *module, 
 				 struct partition_private_data *data,
 				 struct ldb_request *parent)
@@ -428,6 +653,7 @@ int partition_reload_if_required(struct ldb_module *module,
 
 	partition_attributes = ldb_msg_find_element(msg, "partition");
 	partial_replicas     = ldb_msg_find_element(msg, "partialReplica");
+	TALLOC_FREE(data->backend_db_store);
 	data->backend_db_store
 		= talloc_strdup(data, ldb_msg_find_attr_as_string(msg, "backendStore", "tdb"));
 
@@ -436,6 +662,29 @@ int partition_reload_if_required(struct ldb_module *module,
 		return ldb_module_oom(module);
 	}
 
+	/*
+	 * Switch any open partitions over to their new files and
+	 * backend store.  This can't be done while they are locked or
+	 * in a transaction, so in that case force another reload next
+	 * time.
+	 */
+	if (partition_backends_changed(data, partition_attributes,
+				       data->backend_db_store)) {
+		if (data->in_transaction > 0 ||
+		    (data->metadata != NULL &&
+		     data->metadata->read_lock_count > 0)) {
+			data->metadata_seq = 0;
+		} else {
+			ret = partition_reopen_backends(ldb, data,
+							partition_attributes,
+							data->backend_db_store);
+			if (ret != LDB_SUCCESS) {
+				talloc_free(mem_ctx);
+				return ret;
+			}
+		}
+	}
+
 	for (i=0; partition_attributes && i < partition_attributes->num_values; i++) {
 		unsigned int j;
 		bool new_partition = true;
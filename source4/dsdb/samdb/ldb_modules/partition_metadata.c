@@ -181,6 +181,71 @@ int partition_metadata_inc_schema_sequence(struct ldb_module *module)
 }
 
 
+/*
+ * Count a committed write transaction.
+ *
+ * The sequence number only moves when a USN is allocated, so it misses
+ * writes to non-replicated attributes (lastLogon, badPwdCount, ...).
+ * This counter moves on every transaction that changed anything.
+ */
+int partition_metadata_inc_write_generation(struct ldb_module *module)
+{
+	struct partition_private_data *data;
+	int ret;
+	uint64_t value = 0;
+
+	data = talloc_get_type_abort(ldb_module_get_private(module),
+				    struct partition_private_data);
+	if (!data || !data->metadata) {
+		return ldb_module_error(module, LDB_ERR_OPERATIONS_ERROR,
+					"partition_metadata: metadata not initialized");
+	}
+
+	if (data->metadata->in_transaction == 0) {
+		return ldb_module_error(module, LDB_ERR_OPERATIONS_ERROR,
+					"partition_metadata: increment write generation without transaction");
+	}
+	ret = partition_metadata_get_uint64(module, DSDB_METADATA_WRITE_GENERATION, &value, 0);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	value++;
+	ret = partition_metadata_set_uint64(module, DSDB_METADATA_WRITE_GENERATION, value, false);
+	if (ret == LDB_ERR_OPERATIONS_ERROR) {
+		/* Modify failed, let's try the add */
+		ret = partition_metadata_set_uint64(module, DSDB_METADATA_WRITE_GENERATION, value, true);
+	}
+	return ret;
+}
+
+/*
+ * Read the write generation, default to 0 if the key is missing
+ */
+int partition_metadata_write_generation(struct ldb_module *module, uint64_t *value)
+{
+	/*
+	 * As for the sequence number, lock all the databases so the
+	 * value is not ahead of the records we can see
+	 */
+	int ret = partition_read_lock(module);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	ret = partition_metadata_get_uint64(module,
+					    DSDB_METADATA_WRITE_GENERATION,
+					    value,
+					    0);
+	if (ret == LDB_SUCCESS) {
+		ret = partition_read_unlock(module);
+	} else {
+		/* Don't overwrite the error code */
+		partition_read_unlock(module);
+	}
+	return ret;
+}
+
 
 /*
  * Open sam.ldb.d/metadata.tdb.
@@ -565,6 +630,9 @@ int partition_metadata_end_trans(struct ldb_module *module)
 	}
 
 	data->metadata->in_transaction--;
+	if (data->metadata->in_transaction == 0) {
+		data->metadata->modified = false;
+	}
 
 	if (tdb_transaction_commit(tdb) != 0) {
 		return ldb_module_error(module, LDB_ERR_OPERATIONS_ERROR,
@@ -597,6 +665,9 @@ int partition_metadata_del_trans(struct ldb_module *module)
 	}
 
 	data->metadata->in_transaction--;
+	if (data->metadata->in_transaction == 0) {
+		data->metadata->modified = false;
+	}
 
 	tdb_transaction_cancel(tdb);
 
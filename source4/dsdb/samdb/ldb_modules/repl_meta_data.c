@@ -3287,11 +3287,13 @@ static int replmd_modify_handle_linked_attribs(struct ldb_module *module,
 					       time_t t,
 					       struct ldb_request *parent)
 {
-	struct ldb_result *res;
+	struct ldb_result *res = NULL;
 	unsigned int i;
-	int ret;
+	unsigned int num_attrs = 0;
+	int ret = LDB_SUCCESS;
 	struct ldb_context *ldb = ldb_module_get_ctx(module);
-	struct ldb_message *old_msg;
+	struct ldb_message *old_msg = NULL;
+	const char **attrs = NULL;
 
 	if (dsdb_functional_level(ldb) == DS_DOMAIN_FUNCTION_2000) {
 		/*
@@ -3308,26 +3310,47 @@ static int replmd_modify_handle_linked_attribs(struct ldb_module *module,
 	}
 
 	/*
-	 * TODO:
-	 *
-	 * We should restrict this to the intersection of the list of
-	 * linked attributes in the schema and the list of attributes
-	 * being modified.
-	 *
-	 * This will help performance a little, as otherwise we have
-	 * to allocate the entire object value-by-value.
+	 * Only fetch the forward links being modified, rather than
+	 * allocating the entire object value-by-value.  A large group
+	 * would otherwise have every attribute unpacked here on each
+	 * modify, and if no forward links are being modified we do not
+	 * need the old object at all.
 	 */
-	ret = dsdb_module_search_dn(module, msg, &res, msg->dn, NULL,
-	                            DSDB_FLAG_NEXT_MODULE |
-	                            DSDB_SEARCH_SHOW_RECYCLED |
-				    DSDB_SEARCH_REVEAL_INTERNALS |
-				    DSDB_SEARCH_SHOW_DN_IN_STORAGE_FORMAT,
-				    parent);
-	if (ret != LDB_SUCCESS) {
-		return ret;
+	attrs = talloc_array(msg, const char *, msg->num_elements + 1);
+	if (attrs == NULL) {
+		return ldb_module_oom(module);
+	}
+	for (i = 0; i < msg->num_elements; i++) {
+		const struct dsdb_attribute *schema_attr
+			= dsdb_attribute_by_lDAPDisplayName(ac->schema,
+							    msg->elements[i].name);
+		if (schema_attr == NULL ||
+		    schema_attr->linkID == 0 ||
+		    (schema_attr->linkID & 1) == 1) {
+			continue;
+		}
+		attrs[num_attrs] = NULL;
+		if (ldb_attr_in_list(attrs, schema_attr->lDAPDisplayName)) {
+			continue;
+		}
+		attrs[num_attrs++] = schema_attr->lDAPDisplayName;
 	}
+	attrs[num_attrs] = NULL;
 
-	old_msg = res->msgs[0];
+	if (num_attrs != 0) {
+		ret = dsdb_module_search_dn(module, msg, &res, msg->dn, attrs,
+					    DSDB_FLAG_NEXT_MODULE |
+					    DSDB_SEARCH_SHOW_RECYCLED |
+					    DSDB_SEARCH_REVEAL_INTERNALS |
+					    DSDB_SEARCH_SHOW_DN_IN_STORAGE_FORMAT,
+					    parent);
+		if (ret != LDB_SUCCESS) {
+			talloc_free(attrs);
+			return ret;
+		}
+
+		old_msg = res->msgs[0];
+	}
 
 	for (i=0; i<msg->num_elements; i++) {
 		struct ldb_message_element *el = &msg->elements[i];
@@ -3431,6 +3454,7 @@ static int replmd_modify_handle_linked_attribs(struct ldb_module *module,
 	}
 
 	talloc_free(res);
+	talloc_free(attrs);
 	return ret;
 }
 
@@ -286,6 +286,7 @@ static int samba_dsdb_init(struct ldb_module *module)
 					     "dsdb_notification",
 					     "schema_load",
 					     "lazy_commit",
+					     "search_cache",
 					     "dirsync",
 					     "dsdb_paged_results",
 					     "vlv",
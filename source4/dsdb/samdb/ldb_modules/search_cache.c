@@ -0,0 +1,564 @@
+/*
+   ldb database library
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ *  Name: ldb
+ *
+ *  Component: ldb search_cache module
+ *
+ *  Description: cache the results of repeated identical searches
+ *
+ *  Clients like sssd and printers send the same searches over and
+ *  over again, and each of them goes through acl_read, operational,
+ *  extended_dn_out and an index lookup.  This module keeps the final
+ *  results, keyed on the base, scope, filter, attributes and the
+ *  security token of the caller.
+ *
+ *  A cached result is only valid while the write generation (kept by
+ *  the partition module in metadata.tdb) is unchanged.  It counts every
+ *  committed write transaction, so any write, from this or any other
+ *  process and whether or not it allocated a USN, invalidates the
+ *  cache.
+ *
+ *  Searches with controls, inside a transaction or asking for
+ *  constructed attributes (which may depend on the time rather than
+ *  on the database) are never cached.
+ *
+ *  The cache size is set with 'dsdb:search cache size' (in bytes,
+ *  0 disables the cache).
+ */
+
+#include "includes.h"
+#include "ldb_module.h"
+#include "dsdb/samdb/samdb.h"
+#include "dsdb/samdb/ldb_modules/util.h"
+#include "libcli/security/security.h"
+#include "param/param.h"
+#include "lib/util/memcache.h"
+
+#define SEARCH_CACHE_DEFAULT_SIZE (8 * 1024 * 1024)
+
+/* Don't let a single result push out most of the cache */
+#define SEARCH_CACHE_MAX_ENTRIES 1000
+
+struct search_cache_private {
+	struct memcache *cache;
+	size_t max_size;
+	bool in_transaction;
+	uint64_t generation;
+	struct dsdb_control_search_cache_stats stats;
+};
+
+struct search_cache_result {
+	uint64_t generation;
+	unsigned int count;
+	struct ldb_message **msgs;
+	unsigned int num_refs;
+	const char **refs;
+};
+
+struct search_cache_context {
+	struct ldb_module *module;
+	struct ldb_request *req;
+	DATA_BLOB key;
+	struct search_cache_result *result;
+};
+
+/*
+ * Constructed attributes like msDS-User-Account-Control-Computed are
+ * calculated from the current time, so can't be cached on the
+ * write generation alone
+ */
+static bool search_cache_attr_ok(const struct dsdb_schema *schema,
+				 const char *name)
+{
+	const struct dsdb_attribute *attr = NULL;
+
+	if (name == NULL) {
+		return true;
+	}
+	attr = dsdb_attribute_by_lDAPDisplayName(schema, name);
+	if (attr == NULL) {
+		return true;
+	}
+	return !(attr->systemFlags & DS_FLAG_ATTR_IS_CONSTRUCTED);
+}
+
+static bool search_cache_tree_ok(const struct dsdb_schema *schema,
+				 const struct ldb_parse_tree *tree)
+{
+	unsigned int i;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			if (!search_cache_tree_ok(schema,
+						  tree->u.list.elements[i])) {
+				return false;
+			}
+		}
+		return true;
+	case LDB_OP_NOT:
+		return search_cache_tree_ok(schema, tree->u.isnot.child);
+	case LDB_OP_EQUALITY:
+	case LDB_OP_GREATER:
+	case LDB_OP_LESS:
+	case LDB_OP_APPROX:
+		return search_cache_attr_ok(schema, tree->u.equality.attr);
+	case LDB_OP_SUBSTRING:
+		return search_cache_attr_ok(schema, tree->u.substring.attr);
+	case LDB_OP_PRESENT:
+		return search_cache_attr_ok(schema, tree->u.present.attr);
+	case LDB_OP_EXTENDED:
+		return search_cache_attr_ok(schema, tree->u.extended.attr);
+	}
+	return false;
+}
+
+static bool search_cache_is_cacheable(struct ldb_module *module,
+				      struct ldb_request *req)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	const struct dsdb_schema *schema = NULL;
+	unsigned int i;
+
+	if (req->controls != NULL) {
+		return false;
+	}
+	if (req->op.search.base != NULL &&
+	    ldb_dn_is_special(req->op.search.base)) {
+		return false;
+	}
+
+	schema = dsdb_get_schema(ldb, req);
+	if (schema == NULL) {
+		return false;
+	}
+	for (i = 0;
+	     req->op.search.attrs != NULL && req->op.search.attrs[i] != NULL;
+	     i++) {
+		if (!search_cache_attr_ok(schema, req->op.search.attrs[i])) {
+			return false;
+		}
+	}
+	return search_cache_tree_ok(schema, req->op.search.tree);
+}
+
+/*
+ * Build the cache key from everything that changes the result of a
+ * search without controls.
+ *
+ * acl_read only filters untrusted requests, and then only on the
+ * SIDs and privileges in the token.
+ */
+static int search_cache_key(TALLOC_CTX *mem_ctx,
+			    struct ldb_module *module,
+			    struct ldb_request *req,
+			    DATA_BLOB *key)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct security_token *token = NULL;
+	const char *filter = NULL;
+	char *k = NULL;
+	unsigned int i;
+
+	filter = ldb_filter_from_tree(mem_ctx, req->op.search.tree);
+	if (filter == NULL) {
+		return ldb_module_oom(module);
+	}
+
+	k = talloc_asprintf(mem_ctx, "%d:%s:%s",
+			    req->op.search.scope,
+			    req->op.search.base == NULL ? "" :
+			    ldb_dn_get_extended_linearized(mem_ctx,
+						req->op.search.base, 1),
+			    filter);
+	if (k == NULL) {
+		return ldb_module_oom(module);
+	}
+
+	if (req->op.search.attrs == NULL) {
+		k = talloc_asprintf_append_buffer(k, ":(null)");
+	} else {
+		for (i = 0; k != NULL && req->op.search.attrs[i] != NULL; i++) {
+			k = talloc_asprintf_append_buffer(k, ":%s",
+						req->op.search.attrs[i]);
+		}
+	}
+	if (k == NULL) {
+		return ldb_module_oom(module);
+	}
+
+	if (!ldb_req_is_untrusted(req)) {
+		k = talloc_asprintf_append_buffer(k, "|trusted");
+	} else if (dsdb_module_am_system(module)) {
+		k = talloc_asprintf_append_buffer(k, "|system");
+	} else {
+		token = acl_user_token(module);
+		if (token == NULL) {
+			k = talloc_asprintf_append_buffer(k, "|anonymous");
+		} else {
+			k = talloc_asprintf_append_buffer(
+				k, "|%"PRIx64":%"PRIx32,
+				(uint64_t)token->privilege_mask,
+				(uint32_t)token->rights_mask);
+			for (i = 0; k != NULL && i < token->num_sids; i++) {
+				struct dom_sid_buf buf;
+				k = talloc_asprintf_append_buffer(
+					k, ":%s",
+					dom_sid_str_buf(&token->sids[i],
+							&buf));
+			}
+		}
+	}
+	if (k == NULL) {
+		return ldb_oom(ldb);
+	}
+
+	*key = data_blob_const(k, talloc_get_size(k));
+	return LDB_SUCCESS;
+}
+
+static int search_cache_callback(struct ldb_request *req,
+				 struct ldb_reply *ares)
+{
+	struct search_cache_context *ac = NULL;
+	struct search_cache_private *private_data = NULL;
+	struct search_cache_result *result = NULL;
+
+	ac = talloc_get_type(req->context, struct search_cache_context);
+	private_data = talloc_get_type(ldb_module_get_private(ac->module),
+				       struct search_cache_private);
+	result = ac->result;
+
+	if (!ares) {
+		return ldb_module_done(ac->req, NULL, NULL,
+					LDB_ERR_OPERATIONS_ERROR);
+	}
+	if (ares->error != LDB_SUCCESS) {
+		return ldb_module_done(ac->req, ares->controls,
+					ares->response, ares->error);
+	}
+
+	switch (ares->type) {
+	case LDB_REPLY_ENTRY:
+		if (result != NULL && ares->controls == NULL &&
+		    result->count < SEARCH_CACHE_MAX_ENTRIES) {
+			struct ldb_message **msgs = NULL;
+
+			msgs = talloc_realloc(result, result->msgs,
+					      struct ldb_message *,
+					      result->count + 1);
+			if (msgs != NULL) {
+				result->msgs = msgs;
+				msgs[result->count] = ldb_msg_copy(
+					msgs, ares->message);
+			}
+			if (msgs == NULL || msgs[result->count] == NULL) {
+				TALLOC_FREE(ac->result);
+			} else {
+				result->count++;
+			}
+		} else {
+			TALLOC_FREE(ac->result);
+		}
+		return ldb_module_send_entry(ac->req, ares->message,
+					     ares->controls);
+
+	case LDB_REPLY_REFERRAL:
+		if (result != NULL) {
+			const char **refs = NULL;
+
+			refs = talloc_realloc(result, result->refs,
+					      const char *,
+					      result->num_refs + 1);
+			if (refs != NULL) {
+				result->refs = refs;
+				refs[result->num_refs] = talloc_strdup(
+					refs, ares->referral);
+			}
+			if (refs == NULL || refs[result->num_refs] == NULL) {
+				TALLOC_FREE(ac->result);
+			} else {
+				result->num_refs++;
+			}
+		}
+		return ldb_module_send_referral(ac->req, ares->referral);
+
+	case LDB_REPLY_DONE:
+		if (result != NULL && ares->controls == NULL &&
+		    result->generation == private_data->generation &&
+		    !private_data->in_transaction &&
+		    talloc_total_size(result) < private_data->max_size / 8) {
+			memcache_add_talloc(private_data->cache,
+					    DSDB_SEARCH_CACHE_TALLOC,
+					    ac->key, &ac->result);
+			private_data->stats.stores++;
+		}
+		return ldb_module_done(ac->req, ares->controls,
+				       ares->response, LDB_SUCCESS);
+	}
+
+	return LDB_SUCCESS;
+}
+
+static int search_cache_send_stats(struct ldb_module *module,
+				   struct ldb_request *req)
+{
+	struct search_cache_private *private_data =
+		talloc_get_type(ldb_module_get_private(module),
+				struct search_cache_private);
+	struct dsdb_control_search_cache_stats *stats = NULL;
+	struct ldb_control **controls = NULL;
+
+	controls = talloc_zero_array(req, struct ldb_control *, 2);
+	if (controls == NULL) {
+		return ldb_module_oom(module);
+	}
+	controls[0] = talloc_zero(controls, struct ldb_control);
+	if (controls[0] == NULL) {
+		return ldb_module_oom(module);
+	}
+	stats = talloc(controls[0], struct dsdb_control_search_cache_stats);
+	if (stats == NULL) {
+		return ldb_module_oom(module);
+	}
+	*stats = private_data->stats;
+	stats->max_size = private_data->max_size;
+
+	controls[0]->oid = DSDB_CONTROL_SEARCH_CACHE_STATS_OID;
+	controls[0]->critical = 0;
+	controls[0]->data = stats;
+
+	return ldb_module_done(req, controls, NULL, LDB_SUCCESS);
+}
+
+static int search_cache_write_generation(struct ldb_module *module,
+					 struct ldb_request *req,
+					 uint64_t *generation)
+{
+	struct dsdb_extended_write_generation *gen = NULL;
+	struct ldb_result *res = NULL;
+	int ret;
+
+	ret = dsdb_module_extended(module, req, &res,
+				   DSDB_EXTENDED_WRITE_GENERATION_OID, NULL,
+				   DSDB_FLAG_NEXT_MODULE, req);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+	if (res->extended == NULL || res->extended->data == NULL) {
+		talloc_free(res);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	gen = talloc_get_type_abort(res->extended->data,
+				    struct dsdb_extended_write_generation);
+	*generation = gen->generation;
+	talloc_free(res);
+	return LDB_SUCCESS;
+}
+
+static int search_cache_search(struct ldb_module *module,
+			       struct ldb_request *req)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct search_cache_private *private_data =
+		talloc_get_type(ldb_module_get_private(module),
+				struct search_cache_private);
+	struct search_cache_context *ac = NULL;
+	struct search_cache_result *result = NULL;
+	struct ldb_request *down_req = NULL;
+	uint64_t generation;
+	unsigned int i;
+	int ret;
+
+	if (ldb_request_get_control(req,
+			DSDB_CONTROL_SEARCH_CACHE_STATS_OID) != NULL) {
+		return search_cache_send_stats(module, req);
+	}
+
+	if (private_data == NULL || private_data->cache == NULL ||
+	    private_data->in_transaction) {
+		return ldb_next_request(module, req);
+	}
+
+	if (!search_cache_is_cacheable(module, req)) {
+		private_data->stats.uncacheable++;
+		return ldb_next_request(module, req);
+	}
+
+	ret = search_cache_write_generation(module, req, &generation);
+	if (ret != LDB_SUCCESS) {
+		return ldb_next_request(module, req);
+	}
+	if (generation != private_data->generation) {
+		memcache_flush(private_data->cache, DSDB_SEARCH_CACHE_TALLOC);
+		private_data->generation = generation;
+		private_data->stats.invalidations++;
+	}
+
+	ac = talloc_zero(req, struct search_cache_context);
+	if (ac == NULL) {
+		return ldb_module_oom(module);
+	}
+	ac->module = module;
+	ac->req = req;
+
+	ret = search_cache_key(ac, module, req, &ac->key);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	result = memcache_lookup_talloc(private_data->cache,
+					DSDB_SEARCH_CACHE_TALLOC,
+					ac->key);
+	if (result != NULL && result->generation == generation) {
+		private_data->stats.hits++;
+
+		/*
+		 * The caller owns (and may steal) what we send, so
+		 * only ever hand out copies
+		 */
+		for (i = 0; i < result->count; i++) {
+			struct ldb_message *msg = NULL;
+
+			msg = ldb_msg_copy(req, result->msgs[i]);
+			if (msg == NULL) {
+				return ldb_module_oom(module);
+			}
+			ret = ldb_module_send_entry(req, msg, NULL);
+			if (ret != LDB_SUCCESS) {
+				return ret;
+			}
+		}
+		for (i = 0; i < result->num_refs; i++) {
+			char *ref = talloc_strdup(req, result->refs[i]);
+			if (ref == NULL) {
+				return ldb_module_oom(module);
+			}
+			ret = ldb_module_send_referral(req, ref);
+			if (ret != LDB_SUCCESS) {
+				return ret;
+			}
+		}
+		talloc_free(ac);
+		return ldb_module_done(req, NULL, NULL, LDB_SUCCESS);
+	}
+	private_data->stats.misses++;
+
+	ac->result = talloc_zero(ac, struct search_cache_result);
+	if (ac->result == NULL) {
+		return ldb_module_oom(module);
+	}
+	ac->result->generation = generation;
+
+	ret = ldb_build_search_req_ex(&down_req, ldb, ac,
+				      req->op.search.base,
+				      req->op.search.scope,
+				      req->op.search.tree,
+				      req->op.search.attrs,
+				      req->controls,
+				      ac, search_cache_callback,
+				      req);
+	LDB_REQ_SET_LOCATION(down_req);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	return ldb_next_request(module, down_req);
+}
+
+static int search_cache_start_transaction(struct ldb_module *module)
+{
+	struct search_cache_private *private_data =
+		talloc_get_type(ldb_module_get_private(module),
+				struct search_cache_private);
+
+	if (private_data != NULL) {
+		private_data->in_transaction = true;
+	}
+	return ldb_next_start_trans(module);
+}
+
+static int search_cache_end_transaction(struct ldb_module *module)
+{
+	struct search_cache_private *private_data =
+		talloc_get_type(ldb_module_get_private(module),
+				struct search_cache_private);
+
+	if (private_data != NULL) {
+		private_data->in_transaction = false;
+	}
+	return ldb_next_end_trans(module);
+}
+
+static int search_cache_del_transaction(struct ldb_module *module)
+{
+	struct search_cache_private *private_data =
+		talloc_get_type(ldb_module_get_private(module),
+				struct search_cache_private);
+
+	if (private_data != NULL) {
+		private_data->in_transaction = false;
+	}
+	return ldb_next_del_trans(module);
+}
+
+static int search_cache_init(struct ldb_module *module)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct loadparm_context *lp_ctx = NULL;
+	struct search_cache_private *private_data = NULL;
+
+	private_data = talloc_zero(module, struct search_cache_private);
+	if (private_data == NULL) {
+		return ldb_module_oom(module);
+	}
+
+	lp_ctx = talloc_get_type(ldb_get_opaque(ldb, "loadparm"),
+				 struct loadparm_context);
+	private_data->max_size = lpcfg_parm_ulong(lp_ctx, NULL, "dsdb",
+						  "search cache size",
+						  SEARCH_CACHE_DEFAULT_SIZE);
+	if (private_data->max_size != 0) {
+		private_data->cache = memcache_init(private_data,
+						    private_data->max_size);
+		if (private_data->cache == NULL) {
+			return ldb_module_oom(module);
+		}
+	}
+
+	ldb_module_set_private(module, private_data);
+	return ldb_next_init(module);
+}
+
+static const struct ldb_module_ops ldb_search_cache_module_ops = {
+	.name		   = "search_cache",
+	.search            = search_cache_search,
+	.start_transaction = search_cache_start_transaction,
+	.end_transaction   = search_cache_end_transaction,
+	.del_transaction   = search_cache_del_transaction,
+	.init_context	   = search_cache_init,
+};
+
+int ldb_search_cache_module_init(const char *version)
+{
+	LDB_MODULE_CHECK_VERSION(version);
+	return ldb_register_module(&ldb_search_cache_module_ops);
+}
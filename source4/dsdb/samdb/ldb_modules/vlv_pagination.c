@@ -59,6 +59,12 @@ struct results_store {
 	time_t timestamp;
 
 	struct GUID *results;
+	/*
+	 * The first value of the sort attribute for each result, in the
+	 * same order, so "greater than or equal" seeks are a binary search
+	 * in memory.  A missing value has data == NULL and sorts last.
+	 */
+	struct ldb_val *sort_values;
 	size_t num_entries;
 	size_t result_array_size;
 
@@ -119,9 +125,7 @@ static struct results_store *new_store(struct private_data *priv)
 struct vlv_sort_context {
 	struct ldb_context *ldb;
 	ldb_attr_comparison_t comparison_fn;
-	const char *attr;
 	struct vlv_context *ac;
-	int status;
 	struct ldb_val value;
 };
 
@@ -232,36 +236,24 @@ static int send_referrals(struct results_store *store,
 /* vlv_value_compare() is used in a binary search */
 
 static int vlv_value_compare(struct vlv_sort_context *target,
-			     struct GUID *guid)
+			     struct ldb_val *value)
 {
-	struct ldb_result *result = NULL;
-	struct ldb_message_element *el = NULL;
-	struct vlv_context *ac = target->ac;
-	int ret;
-	const char *attrs[2] = {
-		target->attr,
-		NULL
-	};
-
-	ret = vlv_search_by_dn_guid(ac->module, ac, &result, guid, attrs);
-
-	if (ret != LDB_SUCCESS) {
-		target->status = ret;
-		/* returning 0 ends the search. */
-		return 0;
+	if (value->data == NULL) {
+		/* entries without the sort attribute are always last */
+		return -1;
 	}
-
-	el = ldb_msg_find_element(result->msgs[0], target->attr);
-	return target->comparison_fn(target->ldb, ac,
-				     &target->value, &el->values[0]);
-
+	return target->comparison_fn(target->ldb, target->ac,
+				     &target->value, value);
 }
 
 /* The same as vlv_value_compare() but sorting in the opposite direction. */
 static int vlv_value_compare_rev(struct vlv_sort_context *target,
-			     struct GUID *guid)
+				 struct ldb_val *value)
 {
-	return -vlv_value_compare(target, guid);
+	if (value->data == NULL) {
+		return -1;
+	}
+	return -vlv_value_compare(target, value);
 }
 
 
@@ -271,16 +263,12 @@ static int vlv_value_compare_rev(struct vlv_sort_context *target,
 
    If the query value is greater than (or less than in the reverse case) all
    the items, An index just beyond the last position is used.
-
-   If an error occurs during the search for the index, we stash it in the
-   status argument.
  */
 
 static int vlv_gt_eq_to_index(struct vlv_context *ac,
-			      struct GUID *guid_array,
+			      struct ldb_val *value_array,
 			      struct ldb_vlv_req_control *vlv_details,
-			      struct ldb_server_sort_control *sort_details,
-			      int *status)
+			      struct ldb_server_sort_control *sort_details)
 {
 	/* this has a >= comparison string, which needs to be
 	 * converted into indices.
@@ -288,7 +276,7 @@ static int vlv_gt_eq_to_index(struct vlv_context *ac,
 	size_t len = ac->store->num_entries;
 	struct ldb_context *ldb;
 	const struct ldb_schema_attribute *a;
-	struct GUID *result = NULL;
+	struct ldb_val *result = NULL;
 	struct vlv_sort_context context;
 	struct ldb_val value = {
 		.data = (uint8_t *)vlv_details->match.gtOrEq.value,
@@ -300,34 +288,27 @@ static int vlv_gt_eq_to_index(struct vlv_context *ac,
 	context = (struct vlv_sort_context){
 		.ldb = ldb,
 		.comparison_fn = a->syntax->comparison_fn,
-		.attr = sort_details->attributeName,
 		.ac = ac,
-		.status = LDB_SUCCESS,
 		.value = value
 	};
 
 	if (sort_details->reverse) {
 		/* when the sort is reversed, "gtOrEq" means
 		   "less than or equal" */
-		BINARY_ARRAY_SEARCH_GTE(guid_array, len, &context,
+		BINARY_ARRAY_SEARCH_GTE(value_array, len, &context,
 					vlv_value_compare_rev,
 					result, result);
 	} else {
-		BINARY_ARRAY_SEARCH_GTE(guid_array, len, &context,
+		BINARY_ARRAY_SEARCH_GTE(value_array, len, &context,
 					vlv_value_compare,
 					result, result);
 	}
-	if (context.status != LDB_SUCCESS) {
-		*status = context.status;
-		return len;
-	}
-	*status = LDB_SUCCESS;
 
 	if (result == NULL) {
 		/* the target is beyond the end of the array */
 		return len;
 	}
-	return result - guid_array;
+	return result - value_array;
 
 }
 
@@ -421,16 +402,9 @@ static int vlv_results(struct vlv_context *ac, struct ldb_reply *ares)
 
 	if (ac->store->num_entries != 0) {
 		if (vlv_details->type == 1) {
-			target = vlv_gt_eq_to_index(ac, ac->store->results,
+			target = vlv_gt_eq_to_index(ac, ac->store->sort_values,
 						    vlv_details,
-						    sort_details, &ret);
-			if (ret != LDB_SUCCESS) {
-				return ldb_module_done(
-					ac->req,
-					ac->controls,
-					ares->response,
-					ret);
-			}
+						    sort_details);
 		} else {
 			target = vlv_calc_real_offset(vlv_details->match.byOffset.offset,
 						      vlv_details->match.byOffset.contentCount,
@@ -571,6 +545,7 @@ static int vlv_search_callback(struct ldb_request *req, struct ldb_reply *ares)
 {
 	struct vlv_context *ac;
 	struct results_store *store;
+	struct ldb_message_element *el = NULL;
 	int ret;
 
 	ac = talloc_get_type(req->context, struct vlv_context);
@@ -592,7 +567,10 @@ static int vlv_search_callback(struct ldb_request *req, struct ldb_reply *ares)
 			store->result_array_size = 16;
 			store->results = talloc_array(store, struct GUID,
 						      store->result_array_size);
-			if (store->results == NULL) {
+			store->sort_values = talloc_array(store, struct ldb_val,
+							  store->result_array_size);
+			if (store->results == NULL ||
+			    store->sort_values == NULL) {
 				return ldb_module_done(ac->req, NULL, NULL,
 						       LDB_ERR_OPERATIONS_ERROR);
 			}
@@ -601,14 +579,36 @@ static int vlv_search_callback(struct ldb_request *req, struct ldb_reply *ares)
 			store->results = talloc_realloc(store, store->results,
 							struct GUID,
 							store->result_array_size);
-			if (store->results == NULL) {
+			store->sort_values = talloc_realloc(store,
+							    store->sort_values,
+							    struct ldb_val,
+							    store->result_array_size);
+			if (store->results == NULL ||
+			    store->sort_values == NULL) {
 				return ldb_module_done(ac->req, NULL, NULL,
 						       LDB_ERR_OPERATIONS_ERROR);
 			}
 		}
 		store->results[store->num_entries] = \
 			samdb_result_guid(ares->message, "objectGUID");
+
+		el = ldb_msg_find_element(ares->message,
+					  store->sort_details->attributeName);
+		if (el != NULL && el->num_values != 0) {
+			store->sort_values[store->num_entries] =
+				ldb_val_dup(store->sort_values,
+					    &el->values[0]);
+			if (store->sort_values[store->num_entries].data
+			    == NULL) {
+				return ldb_module_done(ac->req, NULL, NULL,
+						       LDB_ERR_OPERATIONS_ERROR);
+			}
+		} else {
+			store->sort_values[store->num_entries] =
+				(struct ldb_val) { .data = NULL };
+		}
 		store->num_entries++;
+		talloc_free(ares);
 		break;
 
 	case LDB_REPLY_REFERRAL:
@@ -623,7 +623,12 @@ static int vlv_search_callback(struct ldb_request *req, struct ldb_reply *ares)
 			store->results = talloc_realloc(store, store->results,
 							struct GUID,
 							store->num_entries);
-			if (store->results == NULL) {
+			store->sort_values = talloc_realloc(store,
+							    store->sort_values,
+							    struct ldb_val,
+							    store->num_entries);
+			if (store->results == NULL ||
+			    store->sort_values == NULL) {
 				return ldb_module_done(ac->req, NULL, NULL,
 						       LDB_ERR_OPERATIONS_ERROR);
 			}
@@ -814,9 +819,18 @@ static int vlv_search(struct ldb_module *module, struct ldb_request *req)
 	 * saved search.
 	 */
 	if (vlv_ctrl->ctxid_len == 0) {
-		static const char * const attrs[2] = {
-			"objectGUID", NULL
-		};
+		/*
+		 * We ask for the sort attribute as well as the GUID, so
+		 * that server_sort leaves it on the entries and we can
+		 * keep it for "greater than or equal" seeks.
+		 */
+		const char **attrs = talloc_array(ac, const char *, 3);
+		if (attrs == NULL) {
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		attrs[0] = "objectGUID";
+		attrs[1] = sort_ctrl[0]->attributeName;
+		attrs[2] = NULL;
 
 		ac->store = new_store(priv);
 		if (ac->store == NULL) {
@@ -221,6 +221,21 @@ struct dsdb_control_transaction_identifier {
 	struct GUID transaction_guid;
 };
 
+/*
+ * Sent on a search to ask the search_cache module for its statistics,
+ * which come back as a response control with this OID.  The search
+ * itself is not performed.
+ */
+#define DSDB_CONTROL_SEARCH_CACHE_STATS_OID "1.3.6.1.4.1.7165.4.3.35"
+struct dsdb_control_search_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t stores;
+	uint64_t invalidations;
+	uint64_t uncacheable;
+	size_t max_size;
+};
+
 #define DSDB_EXTENDED_REPLICATED_OBJECTS_OID "1.3.6.1.4.1.7165.4.4.1"
 struct dsdb_extended_replicated_object {
 	struct ldb_message *msg;
@@ -308,6 +323,16 @@ struct dsdb_extended_allocate_rid {
 
 #define DSDB_EXTENDED_SCHEMA_LOAD "1.3.6.1.4.1.7165.4.4.10"
 
+/*
+ * Returns a struct dsdb_extended_write_generation: a counter of the
+ * committed write transactions, including those that did not allocate
+ * a USN
+ */
+#define DSDB_EXTENDED_WRITE_GENERATION_OID "1.3.6.1.4.1.7165.4.4.11"
+struct dsdb_extended_write_generation {
+	uint64_t generation;
+};
+
 #define DSDB_OPENLDAP_DEREFERENCE_CONTROL "1.3.6.1.4.1.4203.666.5.16"
 
 struct dsdb_openldap_dereference {
@@ -350,6 +375,7 @@ struct dsdb_extended_dn_store_format {
 #define DSDB_SAMDB_MINIMUM_ALLOWED_RID   1000
 
 #define DSDB_METADATA_SCHEMA_SEQ_NUM	"SCHEMA_SEQ_NUM"
+#define DSDB_METADATA_WRITE_GENERATION	"WRITE_GENERATION"
 
 /*
  * must be in LDB_FLAG_INTERNAL_MASK
@@ -1085,6 +1085,66 @@ class AclSearchTests(AclTests):
             self.assert_search_on_attr(str(ou1_dn), self.ldb_admin, attr,
                                        expected_list=self.full_list)
 
+    def test_search8(self):
+        """Objects sharing a security descriptor show each user only the attributes they are allowed to see"""
+        self.create_clean_ou("OU=ou1," + self.base_dn)
+        mod = "(A;CI;LC;;;%s)(A;CI;LC;;;%s)" % (str(self.user_sid),
+                                                str(self.group_sid))
+        self.sd_utils.dacl_add_ace("OU=ou1," + self.base_dn, mod)
+        # user1 may read ou, members of group1 may read everything
+        mod = "(A;;LC;;;%s)(A;;LC;;;%s)" % (str(self.user_sid),
+                                            str(self.group_sid))
+        mod += "(OA;;RP;bf9679f0-0de6-11d0-a285-00aa003049e2;;%s)" % (str(self.user_sid))
+        mod += "(A;;RP;;;%s)" % (str(self.group_sid))
+        tmp_desc = security.descriptor.from_sddl("D:(A;;RPWPCRCCDCLCLORCWOWDSDDTSW;;;DA)" + mod,
+                                                 self.domain_sid)
+        self.ldb_admin.create_ou("OU=ou2,OU=ou1," + self.base_dn, sd=tmp_desc)
+        self.ldb_admin.create_ou("OU=ou3,OU=ou2,OU=ou1," + self.base_dn,
+                                 sd=tmp_desc)
+        self.ldb_admin.create_ou("OU=ou4,OU=ou2,OU=ou1," + self.base_dn,
+                                 sd=tmp_desc)
+        ou_list = ["OU=ou2,OU=ou1," + self.base_dn,
+                   "OU=ou3,OU=ou2,OU=ou1," + self.base_dn,
+                   "OU=ou4,OU=ou2,OU=ou1," + self.base_dn]
+        group_list = ['dn', 'objectClass', 'ou', 'distinguishedName', 'name',
+                      'objectGUID', 'objectCategory', 'instanceType',
+                      'whenCreated', 'uSNCreated']
+
+        # repeat the searches, alternating between the users, so that
+        # the later ones see the access checks made by the earlier ones
+        for i in range(2):
+            res = self.ldb_user.search("OU=ou2,OU=ou1," + self.base_dn,
+                                       expression="(objectClass=*)",
+                                       scope=SCOPE_SUBTREE)
+            self.assertEquals(sorted([str(x.dn) for x in res]),
+                              sorted(ou_list))
+            for x in res:
+                self.assertEquals(sorted(x.keys()), sorted(['dn', 'ou']))
+
+            res = self.ldb_user2.search("OU=ou2,OU=ou1," + self.base_dn,
+                                        expression="(objectClass=*)",
+                                        scope=SCOPE_SUBTREE)
+            self.assertEquals(sorted([str(x.dn) for x in res]),
+                              sorted(ou_list))
+            for x in res:
+                for attr in group_list:
+                    self.assertTrue(attr in x)
+
+        # give read property on Public Information on one of the objects
+        mod = "(OA;;RP;e48d0154-bcf8-11d1-8702-00c04fb96050;;%s)" % (str(self.user_sid))
+        self.sd_utils.dacl_add_ace("OU=ou4,OU=ou2,OU=ou1," + self.base_dn, mod)
+        res = self.ldb_user.search("OU=ou2,OU=ou1," + self.base_dn,
+                                   expression="(objectClass=*)",
+                                   scope=SCOPE_SUBTREE)
+        self.assertEquals(len(res), 3)
+        for x in res:
+            if str(x.dn) == "OU=ou4,OU=ou2,OU=ou1," + self.base_dn:
+                ok_list = ['dn', 'objectClass', 'ou', 'distinguishedName',
+                           'name', 'objectGUID', 'objectCategory']
+            else:
+                ok_list = ['dn', 'ou']
+            self.assertEquals(sorted(x.keys()), sorted(ok_list))
+
 
 # tests on ldap delete operations
 
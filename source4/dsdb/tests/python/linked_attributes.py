@@ -651,6 +651,69 @@ class LATests(samba.tests.TestCase):
         self.assert_forward_links(g2, [])
         self.assert_forward_links(g3, [])
 
+    def revealed_links(self, obj, attr):
+        res = self.samdb.search(obj,
+                                scope=ldb.SCOPE_BASE,
+                                attrs=[attr],
+                                controls=["extended_dn:1:1",
+                                          "reveal_internals:0"])
+        if attr not in res[0]:
+            return []
+        return sorted(str(x) for x in res[0][attr])
+
+    def test_la_modify_untouched_links(self):
+        """A modify only loads and rewrites the forward links it names,
+        the link metadata of all the others stays as it was.
+        """
+        if opts.no_reveal_internals:
+            print('skipping because --no-reveal-internals')
+            return
+
+        u1, u2, u3, u4 = self.add_objects(4, 'user', 'u_untouched')
+        (g1,) = self.add_objects(1, 'group', 'g_untouched')
+
+        self.add_linked_attribute(g1, [u1, u2])
+        self.add_linked_attribute(g1, u3, attr='managedBy')
+        members = self.revealed_links(g1, 'member')
+        managers = self.revealed_links(g1, 'managedBy')
+        self.assertEqual(len(members), 2)
+        self.assertEqual(len(managers), 1)
+
+        # no linked attribute in the modify
+        m = ldb.Message()
+        m.dn = ldb.Dn(self.samdb, g1)
+        m['description'] = ldb.MessageElement('untouched',
+                                              ldb.FLAG_MOD_REPLACE,
+                                              'description')
+        self.samdb.modify(m)
+
+        self.assertEqual(members, self.revealed_links(g1, 'member'))
+        self.assertEqual(managers, self.revealed_links(g1, 'managedBy'))
+
+        # only member is modified
+        self.add_linked_attribute(g1, u4)
+
+        new_members = self.revealed_links(g1, 'member')
+        self.assertEqual(len(new_members), 3)
+        for x in members:
+            self.assertIn(x, new_members)
+        self.assertEqual(managers, self.revealed_links(g1, 'managedBy'))
+
+        # only managedBy is modified
+        self.replace_linked_attribute(g1, u1, attr='managedBy')
+
+        self.assertEqual(new_members, self.revealed_links(g1, 'member'))
+
+        # and the results are the same as ever
+        self.assert_forward_links(g1, [u1, u2, u4])
+        self.assert_forward_links(g1, [u1], attr='managedBy')
+        self.assert_back_links(u1, [g1])
+        self.assert_back_links(u2, [g1])
+        self.assert_back_links(u3, [])
+        self.assert_back_links(u4, [g1])
+        self.assert_back_links(u1, [g1], attr='managedObjects')
+        self.assert_back_links(u3, [], attr='managedObjects')
+
     def test_one_way_attributes(self):
         e1, e2 = self.add_objects(2, 'msExchConfigurationContainer',
                                   'e_one_way')
@@ -343,6 +343,39 @@ class BaseSortTests(samba.tests.TestCase):
                         self.fail('the search for %s should not return %s' %
                                   (result_attr, sort_attr))
 
+    def _test_server_sort_integer(self):
+        # The sort keys of integers have to order negative numbers
+        # and numbers of different lengths numerically
+        values = {
+            'flags': [-2147483648, -1000000, -10, -9, -1, 0, 1, 9, 10,
+                      11, 100, 1000000, 2147483647],
+            'accountExpires': [-5, 0, 9, 10, 100, 2 ** 32, 2 ** 32 + 1,
+                               10 ** 12, 2 ** 63 - 1],
+        }
+
+        for attr, attr_values in values.items():
+            expected = []
+            for i, user in enumerate(self.users):
+                value = attr_values[i % len(attr_values)]
+                m = ldb.Message()
+                m.dn = ldb.Dn(self.ldb, user['dn'])
+                m[attr] = ldb.MessageElement(str(value),
+                                             ldb.FLAG_MOD_REPLACE, attr)
+                self.ldb.modify(m)
+                expected.append(value)
+            expected.sort()
+
+            for rev in (0, 1):
+                res = self.ldb.search(self.ou,
+                                      scope=ldb.SCOPE_ONELEVEL, attrs=[attr],
+                                      controls=["server_sort:1:%d:%s" %
+                                                (rev, attr)])
+                self.assertEqual(len(res), len(self.users))
+
+                expected_order = expected if rev == 0 else expected[::-1]
+                received_order = [int(x[attr][0]) for x in res]
+                self.assertEqual(expected_order, received_order)
+
 
 class SimpleSortTests(BaseSortTests):
     avoid_tricky_sort = True
@@ -359,6 +392,9 @@ class SimpleSortTests(BaseSortTests):
     def test_server_sort_us_english(self):
         self._test_server_sort_us_english()
 
+    def test_server_sort_integer(self):
+        self._test_server_sort_integer()
+
 
 class UnicodeSortTests(BaseSortTests):
     avoid_tricky_sort = False
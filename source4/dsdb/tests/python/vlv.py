@@ -1218,6 +1218,90 @@ class VLVTests(VLVTestsBase):
         expected_results = [r for r in full_results if r != del_user[attr]]
         self.assertEqual(results, expected_results)
 
+    # A ">=" seek on a view uses the sort values of the initial search,
+    # like the offsets do
+    def test_vlv_gte_modify_during_view(self):
+        attr = 'roomNumber'
+        expr = "(objectclass=user)"
+        sort_control = "server_sort:1:0:%s" % attr
+
+        # Start new search
+        full_results, cookie = self.vlv_search(attr, expr,
+                                               after_count=len(self.users))
+
+        edit_index = len(self.users)//2
+        edit_attr = full_results[edit_index]
+        users_with_attr = [u for u in self.users if u[attr] == edit_attr]
+        self.assertEqual(len(users_with_attr), 1)
+        edit_user = users_with_attr[0]
+
+        # Put z at the front of the val so it would come last in ordering
+        edit_val = "z_" + edit_user[attr]
+
+        m = ldb.Message()
+        m.dn = ldb.Dn(self.ldb, edit_user['dn'])
+        m[attr] = ldb.MessageElement(edit_val, ldb.FLAG_MOD_REPLACE, attr)
+        self.ldb.modify(m)
+
+        vlv_search = encode_vlv_control(before=1,
+                                        after=1,
+                                        gte=get_bytes(edit_attr),
+                                        cookie=cookie)
+        res = self.ldb.search(self.ou,
+                              expression=expr,
+                              scope=ldb.SCOPE_ONELEVEL,
+                              attrs=[attr],
+                              controls=[sort_control, vlv_search])
+        results = [str(x[attr][0]) for x in res]
+
+        expected_results = full_results[edit_index - 1: edit_index + 2]
+        expected_results[1] = edit_val
+        self.assertEqual(results, expected_results)
+
+    # Entries without the sort attribute come after all the others,
+    # so a ">=" seek beyond every value lands on the first of them
+    def test_vlv_gte_missing_sort_attr(self):
+        attr = 'roomNumber'
+        sort_control = "server_sort:1:0:%s" % attr
+
+        missing = []
+        for i in range(3):
+            name = "vlvmissing%d" % i
+            self.ldb.add({"dn": "cn=%s,%s" % (name, self.ou),
+                          "cn": name,
+                          "objectclass": "user"})
+            missing.append(name)
+
+        res = self.ldb.search(self.ou,
+                              scope=ldb.SCOPE_ONELEVEL,
+                              attrs=[attr, 'cn'],
+                              controls=[sort_control])
+        present = [str(x['cn'][0]) for x in res if attr in x]
+        self.assertEqual(len(present), len(self.users))
+        self.assertEqual(sorted(str(x['cn'][0]) for x in res
+                                if attr not in x),
+                         missing)
+
+        cookie = None
+        for i in range(2):
+            vlv_search = encode_vlv_control(before=1,
+                                            after=len(missing),
+                                            gte=b"zzzz",
+                                            cookie=cookie)
+            res = self.ldb.search(self.ou,
+                                  scope=ldb.SCOPE_ONELEVEL,
+                                  attrs=[attr, 'cn'],
+                                  controls=[sort_control, vlv_search])
+            results = [str(x['cn'][0]) for x in res]
+
+            self.assertEqual(results[0], present[-1])
+            self.assertEqual(sorted(results[1:]), missing)
+            for x in list(res)[1:]:
+                self.assertNotIn(attr, x)
+
+            cookie = get_cookie(res.controls,
+                                len(self.users) + len(missing))
+
 
 class PagedResultsTests(TestsWithUserOU):
 
@@ -1273,6 +1273,8 @@ static const struct ldap_control_handler ldap_known_controls[] = {
 	{ DSDB_CONTROL_NO_GLOBAL_CATALOG, NULL, NULL },
 	{ DSDB_EXTENDED_SCHEMA_UPGRADE_IN_PROGRESS_OID, NULL, NULL },
 	{ DSDB_CONTROL_TRANSACTION_IDENTIFIER_OID, NULL, NULL},
+	{ DSDB_CONTROL_SEARCH_CACHE_STATS_OID, NULL, NULL },
+	{ DSDB_EXTENDED_WRITE_GENERATION_OID, NULL, NULL },
 	{ NULL, NULL, NULL }
 };
 